@@ -24,6 +24,7 @@
 #include "common.h"
 #include "utils.h"
 #include "gearman_utils.h"
+#include "gm_payload.h"
 
 int mod_gm_con_errors = 0;
 struct timeval mod_gm_error_time;
@@ -37,6 +38,7 @@ unsigned long total_submit_errors_delta = 0;
 float current_submit_rate = 0;
 float current_avg_submit_duration = 0;
 struct timeval total_submit_time;
+static pthread_mutex_t submit_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
 extern mod_gm_opt_t *mod_gm_opt;
 
 /* create the gearman worker */
@@ -120,6 +122,67 @@ gearman_client_st * create_client_blocking( gm_server_t * server_list[GM_LISTSIZ
 }
 
 
+/* update submission statistics and log them every log_stats_interval seconds,
+ * a submission without errors resets the error counter */
+static void update_submit_stats(struct timeval t1, struct timeval t2, int jobs, int errors, int log_stats_interval) {
+    double elapsed;
+
+    pthread_mutex_lock(&submit_stats_mutex);
+    if(errors == 0)
+        mod_gm_con_errors = 0;
+    if(log_stats_interval <= 0 || jobs <= 0) {
+        pthread_mutex_unlock(&submit_stats_mutex);
+        return;
+    }
+
+    elapsed = elapsed_time(t1, t2);
+    total_submit_sum += elapsed;
+    total_submit_jobs_delta += jobs;
+    total_submit_jobs += jobs;
+    /* batches share one round trip, so count the duration per job */
+    if(elapsed / jobs > total_submit_max)
+        total_submit_max = elapsed / jobs;
+    total_submit_errors += errors;
+    total_submit_errors_delta += errors;
+    if(t2.tv_sec >= total_submit_time.tv_sec + log_stats_interval) {
+        if(total_submit_time.tv_sec > 0) {
+            current_submit_rate = (total_submit_jobs_delta-total_submit_errors_delta) / elapsed_time(total_submit_time, t2);
+            current_avg_submit_duration = total_submit_sum/total_submit_jobs_delta;
+            current_submit_max = total_submit_max;
+            gm_log(GM_LOG_INFO, "gearmand submission statistics: jobs:%7lu   errors: %7lu   submit_rate: %6.1f/s   avg_submit_duration: %.6fs   max_submit_duration: %.6fs\n",
+                total_submit_jobs_delta,
+                total_submit_errors_delta,
+                current_submit_rate,
+                current_avg_submit_duration,
+                total_submit_max
+            );
+            total_submit_sum          = 0;
+            total_submit_jobs_delta   = 0;
+            total_submit_errors_delta = 0;
+            total_submit_max          = 0;
+        }
+        gettimeofday(&total_submit_time,NULL);
+    }
+    pthread_mutex_unlock(&submit_stats_mutex);
+}
+
+/* log lost jobs */
+static void log_submit_error(gearman_client_st *client, struct timeval t2, int lost) {
+    pthread_mutex_lock(&submit_stats_mutex);
+    /* only log the first error, otherwise we would fill the log very quickly */
+    if( mod_gm_con_errors == 0 ) {
+        gettimeofday(&mod_gm_error_time,NULL);
+        gm_log( GM_LOG_ERROR, "sending job to gearmand failed: %s\n", gearman_client_error(client) );
+    }
+    /* or every minute to give an update */
+    else if( t2.tv_sec >= mod_gm_error_time.tv_sec + 60) {
+        gettimeofday(&mod_gm_error_time,NULL);
+        gm_log( GM_LOG_ERROR, "sending job to gearmand failed: %s (%i lost jobs so far)\n", gearman_client_error(client), mod_gm_con_errors );
+    }
+    mod_gm_con_errors += lost;
+    pthread_mutex_unlock(&submit_stats_mutex);
+}
+
 /* create a task and send it */
 int add_job_to_queue(gearman_client_st **client, gm_server_t * server_list[GM_LISTSIZE], char * queue, char * uniq, char * data, int priority, int retries, int transport_mode, EVP_CIPHER_CTX * ctx, int async, int log_stats_interval) {
     gearman_job_handle_t job_handle;
@@ -128,7 +191,6 @@ int add_job_to_queue(gearman_client_st **client, gm_server_t * server_list[GM_LI
     int size;
     int ret = GM_OK;
     struct timeval t1, t2;
-    double elapsed;
 
     /* check too long queue names */
     if(strlen(queue) > GEARMAN_FUNCTION_MAX_SIZE - 1) {
@@ -143,7 +205,7 @@ int add_job_to_queue(gearman_client_st **client, gm_server_t * server_list[GM_LI
     }
 
     gm_log( GM_LOG_TRACE, "add_job_to_queue(%s, %s, %d, %d, %d, %d, %d)\n", queue, uniq, priority, retries, transport_mode, async, log_stats_interval);
-    gm_log( GM_LOG_TRACE, "%zu --->%s<---\n", strlen(data), data );
+    gm_log( GM_LOG_TRACE, "%zu --->%s<---\n", gm_payload_size(data), data );
 
     gettimeofday(&t1,NULL);
     size = mod_gm_encrypt(ctx, &crypted_data, data, transport_mode);
@@ -170,52 +232,12 @@ int add_job_to_queue(gearman_client_st **client, gm_server_t * server_list[GM_LI
     gettimeofday(&t2,NULL);
 
     // log some statistics
-    if(log_stats_interval > 0) {
-        elapsed = elapsed_time(t1, t2);
-        total_submit_sum += elapsed;
-        total_submit_jobs_delta++;
-        total_submit_jobs++;
-        if(elapsed > total_submit_max)
-            total_submit_max = elapsed;
-        if(rc != GEARMAN_SUCCESS && rc != GEARMAN_IO_WAIT) {
-            total_submit_errors++;
-            total_submit_errors_delta++;
-        }
-        if(t2.tv_sec >= total_submit_time.tv_sec + log_stats_interval) {
-            if(total_submit_time.tv_sec > 0) {
-                current_submit_rate = (total_submit_jobs_delta-total_submit_errors_delta) / elapsed_time(total_submit_time, t2);
-                current_avg_submit_duration = total_submit_sum/total_submit_jobs_delta;
-                current_submit_max = total_submit_max;
-                gm_log(GM_LOG_INFO, "gearmand submission statistics: jobs:%7lu   errors: %7lu   submit_rate: %6.1f/s   avg_submit_duration: %.6fs   max_submit_duration: %.6fs\n",
-                    total_submit_jobs_delta,
-                    total_submit_errors_delta,
-                    current_submit_rate,
-                    current_avg_submit_duration,
-                    total_submit_max
-                );
-                total_submit_sum          = 0;
-                total_submit_jobs_delta   = 0;
-                total_submit_errors_delta = 0;
-                total_submit_max          = 0;
-            }
-            gettimeofday(&total_submit_time,NULL);
-        }
-    }
+    update_submit_stats(t1, t2, 1, (rc != GEARMAN_SUCCESS && rc != GEARMAN_IO_WAIT) ? 1 : 0, log_stats_interval);
 
     if(rc != GEARMAN_SUCCESS && rc != GEARMAN_IO_WAIT) {
         /* log the error */
         if(retries == 0) {
-            /* only log the first error, otherwise we would fill the log very quickly */
-            if( mod_gm_con_errors == 0 ) {
-                gettimeofday(&mod_gm_error_time,NULL);
-                gm_log( GM_LOG_ERROR, "sending job to gearmand failed: %s\n", gearman_client_error(*client) );
-            }
-            /* or every minute to give an update */
-            else if( t2.tv_sec >= mod_gm_error_time.tv_sec + 60) {
-                gettimeofday(&mod_gm_error_time,NULL);
-                gm_log( GM_LOG_ERROR, "sending job to gearmand failed: %s (%i lost jobs so far)\n", gearman_client_error(*client), mod_gm_con_errors );
-            }
-            mod_gm_con_errors++;
+            log_submit_error(*client, t2, 1);
         }
 
         /* recreate client, otherwise gearman sigsegvs */
@@ -245,13 +267,157 @@ int add_job_to_queue(gearman_client_st **client, gm_server_t * server_list[GM_LI
         }
     }
 
-    /* reset error counter */
-    mod_gm_con_errors = 0;
-
     gm_log( GM_LOG_TRACE, "add_job_to_queue() finished successfully\n");
     return GM_OK;
 }
 
+/* mark pipelined job as sent once gearmand created it */
+static gearman_return_t job_created_callback(gearman_task_st *task) {
+    gm_submit_job_t * job = (gm_submit_job_t *)gearman_task_context(task);
+    if(job != NULL)
+        job->status = GM_OK;
+    return GEARMAN_SUCCESS;
+}
+
+/* send many jobs at once and collect the acknowledgements afterwards */
+int add_jobs_to_queue(gearman_client_st **client, gm_server_t * server_list[GM_LISTSIZE], gm_submit_job_t ** jobs, int num, int transport_mode, EVP_CIPHER_CTX * ctx, int async, int log_stats_interval) {
+    gearman_task_st * task;
+    gearman_return_t rc;
+    char ** crypted_data;
+    int * size;
+    int x, sent, failed, retry;
+    int lost = 0;
+    struct timeval t1, t2;
+
+    if(num <= 0)
+        return GM_OK;
+
+    /* nothing to pipeline */
+    if(num == 1) {
+        jobs[0]->status = add_job_to_queue(client, server_list, jobs[0]->queue, jobs[0]->uniq, jobs[0]->data, jobs[0]->priority, jobs[0]->retries, transport_mode, ctx, async, log_stats_interval);
+        return(jobs[0]->status);
+    }
+
+    gm_log( GM_LOG_TRACE, "add_jobs_to_queue(%d, %d, %d, %d)\n", num, transport_mode, async, log_stats_interval);
+
+    /* encrypt everything once, failed jobs are resent from these buffers */
+    crypted_data = gm_malloc(num * sizeof(char *));
+    size         = gm_malloc(num * sizeof(int));
+    for(x = 0; x < num; x++) {
+        jobs[x]->status = GM_ERROR;
+        crypted_data[x] = NULL;
+        if(strlen(jobs[x]->queue) > GEARMAN_FUNCTION_MAX_SIZE - 1) {
+            gm_log( GM_LOG_ERROR, "queue name too long: '%s'\n", jobs[x]->queue );
+            continue;
+        }
+        if(jobs[x]->uniq != NULL && strlen(jobs[x]->uniq) > GEARMAN_MAX_UNIQUE_SIZE) {
+            gm_log( GM_LOG_ERROR, "unique name too long (%zu > %d): '%s'\n", strlen(jobs[x]->uniq), GEARMAN_MAX_UNIQUE_SIZE, jobs[x]->uniq );
+            continue;
+        }
+        if(jobs[x]->priority != GM_JOB_PRIO_LOW && jobs[x]->priority != GM_JOB_PRIO_NORMAL && jobs[x]->priority != GM_JOB_PRIO_HIGH) {
+            gm_log( GM_LOG_ERROR, "add_jobs_to_queue() wrong priority: %d\n", jobs[x]->priority );
+            continue;
+        }
+        gm_log( GM_LOG_TRACE, "%zu --->%s<---\n", gm_payload_size(jobs[x]->data), jobs[x]->data );
+        size[x] = mod_gm_encrypt(ctx, &crypted_data[x], jobs[x]->data, transport_mode);
+        if(size[x] <= 0) {
+            gm_log( GM_LOG_ERROR, "encrypting job failed\n" );
+            gm_free(crypted_data[x]);
+        }
+    }
+
+    while(*client != NULL) {
+        gettimeofday(&t1,NULL);
+
+        /* write all jobs back to back */
+        gearman_client_set_created_fn(*client, job_created_callback);
+        sent = 0;
+        for(x = 0; x < num; x++) {
+            if(crypted_data[x] == NULL || jobs[x]->status == GM_OK)
+                continue;
+            if( jobs[x]->priority == GM_JOB_PRIO_LOW ) {
+                task = gearman_client_add_task_low_background(*client, NULL, jobs[x], jobs[x]->queue, jobs[x]->uniq, ( void * )crypted_data[x], ( size_t )size[x], &rc);
+            }
+            else if( jobs[x]->priority == GM_JOB_PRIO_HIGH ) {
+                task = gearman_client_add_task_high_background(*client, NULL, jobs[x], jobs[x]->queue, jobs[x]->uniq, ( void * )crypted_data[x], ( size_t )size[x], &rc);
+            }
+            else {
+                task = gearman_client_add_task_background(*client, NULL, jobs[x], jobs[x]->queue, jobs[x]->uniq, ( void * )crypted_data[x], ( size_t )size[x], &rc);
+            }
+            if(task == NULL) {
+                gm_log( GM_LOG_TRACE, "add_jobs_to_queue() adding task failed: %s\n", gearman_strerror(rc) );
+                continue;
+            }
+            sent++;
+        }
+
+        /* and collect the job created packets */
+        rc = gearman_client_run_tasks(*client);
+        while(rc == GEARMAN_IO_WAIT) {
+            if(gearman_client_wait(*client) != GEARMAN_SUCCESS)
+                break;
+            rc = gearman_client_run_tasks(*client);
+        }
+        gearman_client_task_free_all(*client);
+        gearman_client_clear_fn(*client);
+        gettimeofday(&t2,NULL);
+
+        failed = 0;
+        for(x = 0; x < num; x++) {
+            if(crypted_data[x] != NULL && jobs[x]->status != GM_OK)
+                failed++;
+        }
+
+        // log some statistics
+        update_submit_stats(t1, t2, sent, failed, log_stats_interval);
+
+        if(failed == 0)
+            break;
+
+        /* give up on jobs without retries */
+        retry = 0;
+        for(x = 0; x < num; x++) {
+            if(crypted_data[x] == NULL || jobs[x]->status == GM_OK)
+                continue;
+            if(jobs[x]->retries > 0) {
+                jobs[x]->retries--;
+                retry++;
+            } else {
+                gm_free(crypted_data[x]);
+            }
+        }
+        if(retry < failed)
+            log_submit_error(*client, t2, failed - retry);
+
+        /* recreate client, otherwise gearman sigsegvs */
+        gm_free_client(client);
+        if(async) {
+            *client = create_client(server_list);
+        } else {
+            *client = create_client_blocking(server_list);
+        }
+
+        if(retry == 0)
+            break;
+        gm_log( GM_LOG_TRACE, "add_jobs_to_queue() retrying %d jobs\n", retry );
+    }
+
+    for(x = 0; x < num; x++) {
+        if(jobs[x]->status != GM_OK)
+            lost++;
+        gm_free(crypted_data[x]);
+    }
+    gm_free(crypted_data);
+    gm_free(size);
+
+    if(lost > 0) {
+        gm_log(GM_LOG_TRACE, "add_jobs_to_queue() finished with errors\n");
+        return GM_ERROR;
+    }
+    gm_log( GM_LOG_TRACE, "add_jobs_to_queue() finished successfully\n");
+    return GM_OK;
+}
+
 /* free client structure */
 void gm_free_client(gearman_client_st **client) {
     if(client == NULL)
@@ -0,0 +1,150 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/* include header */
+#include "gm_buffer.h"
+#include "gm_alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* make room for len more bytes plus the terminating zero */
+static void gm_buffer_reserve(gm_buffer_t * buf, size_t len) {
+    size_t size = buf->size;
+    if(buf->len + len + 1 <= size)
+        return;
+    if(size == 0)
+        size = GM_BUFFER_INITIAL_SIZE;
+    while(buf->len + len + 1 > size)
+        size *= 2;
+    buf->data = gm_realloc(buf->data, size);
+    buf->size = size;
+}
+
+/* create new buffer */
+gm_buffer_t * gm_buffer_new(void) {
+    gm_buffer_t * buf = gm_malloc(sizeof(gm_buffer_t));
+    buf->data = NULL;
+    buf->len  = 0;
+    buf->size = 0;
+    gm_buffer_reserve(buf, 0);
+    buf->data[0] = '\x0';
+    return(buf);
+}
+
+/* free buffer */
+void gm_buffer_free(gm_buffer_t ** buf) {
+    if(*buf == NULL)
+        return;
+    gm_free((*buf)->data);
+    gm_free(*buf);
+}
+
+/* empty buffer, give back memory of large jobs */
+void gm_buffer_reset(gm_buffer_t * buf) {
+    if(buf->size > GM_BUFFER_SHRINK_SIZE) {
+        gm_free(buf->data);
+        buf->size = 0;
+        buf->len  = 0;
+        gm_buffer_reserve(buf, 0);
+    }
+    buf->len     = 0;
+    buf->data[0] = '\x0';
+}
+
+/* append raw data */
+void gm_buffer_append(gm_buffer_t * buf, const char * data, size_t len) {
+    gm_buffer_reserve(buf, len);
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    buf->data[buf->len] = '\x0';
+}
+
+/* append string */
+void gm_buffer_append_str(gm_buffer_t * buf, const char * str) {
+    if(str == NULL)
+        str = "(null)";
+    gm_buffer_append(buf, str, strlen(str));
+}
+
+/* append number without going through printf */
+void gm_buffer_append_int(gm_buffer_t * buf, long long value) {
+    char tmp[24];
+    char * p = tmp + sizeof(tmp);
+    unsigned long long v = value < 0 ? -(unsigned long long)value : (unsigned long long)value;
+    do {
+        *--p = '0' + (v % 10);
+        v /= 10;
+    } while(v > 0);
+    if(value < 0)
+        *--p = '-';
+    gm_buffer_append(buf, p, tmp + sizeof(tmp) - p);
+}
+
+/* append timestamp as seconds.microseconds */
+void gm_buffer_append_time(gm_buffer_t * buf, long long usec) {
+    char frac[7];
+    long long rest;
+    int x;
+
+    if(usec < 0) {
+        gm_buffer_append(buf, "-", 1);
+        usec = -usec;
+    }
+    gm_buffer_append_int(buf, usec / 1000000);
+    rest = usec % 1000000;
+    frac[0] = '.';
+    for(x = 6; x > 0; x--) {
+        frac[x] = '0' + (rest % 10);
+        rest /= 10;
+    }
+    gm_buffer_append(buf, frac, 7);
+}
+
+/* append formated string */
+void gm_buffer_printf(gm_buffer_t * buf, const char * fmt, ...) {
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(buf->data + buf->len, buf->size - buf->len, fmt, ap);
+    va_end(ap);
+    if(len < 0) {
+        buf->data[buf->len] = '\x0';
+        return;
+    }
+
+    if((size_t)len >= buf->size - buf->len) {
+        gm_buffer_reserve(buf, len);
+        va_start(ap, fmt);
+        vsnprintf(buf->data + buf->len, buf->size - buf->len, fmt, ap);
+        va_end(ap);
+    }
+    buf->len += len;
+}
+
+/* convert timeval to microseconds */
+long long timeval2usec(struct timeval * t) {
+    return((long long)t->tv_sec * 1000000 + t->tv_usec);
+}
@@ -25,6 +25,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <stdint.h>
 
 #include <gm_crypt.h>
 #include "common.h"
@@ -184,6 +185,77 @@ void mod_gm_hexsum(char *dest, char *text) {
     return;
 }
 
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return((x << r) | (x >> (64 - r)));
+}
+
+static inline uint64_t fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return(k);
+}
+
+/* create MurmurHash3 x64_128 hex sum for char[] */
+void mod_gm_fasthexsum(char *dest, const char *text, size_t len) {
+    const unsigned char * data = (const unsigned char *)text;
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+    size_t nblocks = len / 16;
+    uint64_t h1 = 0, h2 = 0;
+    uint64_t k1, k2;
+    unsigned char result[16];
+    size_t i;
+    int x;
+
+    for(i = 0; i < nblocks; i++) {
+        memcpy(&k1, data + i * 16, 8);
+        memcpy(&k2, data + i * 16 + 8, 8);
+
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    /* tail */
+    k1 = 0;
+    k2 = 0;
+    data += nblocks * 16;
+    for(x = (int)(len & 15) - 1; x >= 8; x--)
+        k2 = (k2 << 8) | data[x];
+    for(; x >= 0; x--)
+        k1 = (k1 << 8) | data[x];
+    if(len & 15) {
+        if((len & 15) > 8) {
+            k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        }
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    /* finalization */
+    h1 ^= (uint64_t)len;
+    h2 ^= (uint64_t)len;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+
+    for(x = 0; x < 8; x++) {
+        result[x]     = (unsigned char)(h1 >> (x * 8));
+        result[x + 8] = (unsigned char)(h2 >> (x * 8));
+    }
+    for(x = 0; x < 16; x++) {
+        dest[x*2]     = hex[(result[x] >> 4) & 0xF];
+        dest[x*2 + 1] = hex[result[x] & 0xF];
+    }
+    dest[32] = '\0';
+}
+
 int base64_decode(const char *source, int sourcelen, unsigned char * target) {
     int n = EVP_DecodeBlock(target, (const unsigned char*)source, sourcelen);
     if(n == -1) {
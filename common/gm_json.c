@@ -0,0 +1,119 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+#include "gm_json.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* escape sequence for each character, 0 if it can be copied as is */
+static const char json_escapes[256] = {
+    ['\b'] = 'b', ['\t'] = 't', ['\n'] = 'n', ['\f'] = 'f', ['\r'] = 'r',
+    [0x01] = 'u', [0x02] = 'u', [0x03] = 'u', [0x04] = 'u', [0x05] = 'u', [0x06] = 'u', [0x07] = 'u',
+    [0x0b] = 'u', [0x0e] = 'u', [0x0f] = 'u', [0x10] = 'u', [0x11] = 'u', [0x12] = 'u', [0x13] = 'u',
+    [0x14] = 'u', [0x15] = 'u', [0x16] = 'u', [0x17] = 'u', [0x18] = 'u', [0x19] = 'u', [0x1a] = 'u',
+    [0x1b] = 'u', [0x1c] = 'u', [0x1d] = 'u', [0x1e] = 'u', [0x1f] = 'u', [0x7f] = 'u',
+    ['"']  = '"', ['\\'] = '\\',
+};
+
+/* start object */
+void gm_json_open(gm_buffer_t * buf) {
+    gm_buffer_append(buf, "{", 1);
+}
+
+/* finish object */
+void gm_json_close(gm_buffer_t * buf) {
+    gm_buffer_append(buf, "}", 1);
+}
+
+/* append key with separator */
+void gm_json_key(gm_buffer_t * buf, const char * key) {
+    if(buf->len > 0 && buf->data[buf->len-1] != '{')
+        gm_buffer_append(buf, ",\"", 2);
+    else
+        gm_buffer_append(buf, "\"", 1);
+    gm_buffer_append_str(buf, key);
+    gm_buffer_append(buf, "\":", 2);
+}
+
+/* append escaped string */
+void gm_json_escape(gm_buffer_t * buf, const char * str) {
+    const unsigned char * start = (const unsigned char *)str;
+    const unsigned char * p     = start;
+    char esc[7];
+
+    for(;;) {
+        /* fast path, find next character which needs escaping */
+        while(*p != '\x0' && json_escapes[*p] == 0)
+            p++;
+        if(p > start)
+            gm_buffer_append(buf, (const char *)start, p - start);
+        if(*p == '\x0')
+            return;
+        if(json_escapes[*p] == 'u') {
+            snprintf(esc, sizeof(esc), "\\u%04x", *p);
+            gm_buffer_append(buf, esc, 6);
+        } else {
+            esc[0] = '\\';
+            esc[1] = json_escapes[*p];
+            gm_buffer_append(buf, esc, 2);
+        }
+        start = ++p;
+    }
+}
+
+/* append string member */
+void gm_json_str(gm_buffer_t * buf, const char * key, const char * value) {
+    gm_json_key(buf, key);
+    if(value == NULL) {
+        gm_buffer_append(buf, "null", 4);
+        return;
+    }
+    gm_buffer_append(buf, "\"", 1);
+    gm_json_escape(buf, value);
+    gm_buffer_append(buf, "\"", 1);
+}
+
+/* append integer member */
+void gm_json_int(gm_buffer_t * buf, const char * key, long long value) {
+    gm_json_key(buf, key);
+    gm_buffer_append_int(buf, value);
+}
+
+/* append floating point member */
+void gm_json_double(gm_buffer_t * buf, const char * key, double value) {
+    gm_json_key(buf, key);
+    if(!isfinite(value)) {
+        gm_buffer_append(buf, "null", 4);
+        return;
+    }
+    gm_buffer_printf(buf, "%f", value);
+}
+
+/* append timestamp member */
+void gm_json_timeval(gm_buffer_t * buf, const char * key, struct timeval * value) {
+    gm_json_key(buf, key);
+    gm_buffer_append_time(buf, timeval2usec(value));
+}
@@ -0,0 +1,387 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/* include header */
+#include "gm_payload.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* key names */
+#define GM_PAYLOAD_NAME(id, key) #key,
+const char * const gm_payload_keys[GM_PAYLOAD_KEY_NUM] = {
+    GM_PAYLOAD_KEYS(GM_PAYLOAD_NAME)
+};
+#undef GM_PAYLOAD_NAME
+
+/* key lengths */
+#define GM_PAYLOAD_LEN(id, key) sizeof(#key) - 1,
+static const size_t gm_payload_key_len[GM_PAYLOAD_KEY_NUM] = {
+    GM_PAYLOAD_KEYS(GM_PAYLOAD_LEN)
+};
+#undef GM_PAYLOAD_LEN
+
+/* hash table of key index + 1, 0 marks free slots */
+static unsigned char key_table[GM_PAYLOAD_HASH_SIZE];
+static pthread_once_t key_table_once = PTHREAD_ONCE_INIT;
+
+/* chosen to map all keys to different slots, check with t/01-utils when adding keys */
+static unsigned int key_hash(const char * key, size_t len) {
+    return((len + (unsigned char)key[0] * 7 + (unsigned char)key[len/2] * 2 + (unsigned char)key[len-1]) & (GM_PAYLOAD_HASH_SIZE - 1));
+}
+
+static void key_table_init(void) {
+    unsigned int slot;
+    int x;
+    for(x = 0; x < GM_PAYLOAD_KEY_NUM; x++) {
+        slot = key_hash(gm_payload_keys[x], gm_payload_key_len[x]);
+        while(key_table[slot] != 0)
+            slot = (slot + 1) & (GM_PAYLOAD_HASH_SIZE - 1);
+        key_table[slot] = x + 1;
+    }
+}
+
+/* look up a key */
+int gm_payload_key(const char * key, size_t len) {
+    unsigned int slot;
+    int x;
+
+    if(len == 0)
+        return(-1);
+    pthread_once(&key_table_once, key_table_init);
+    slot = key_hash(key, len);
+    while((x = key_table[slot]) != 0) {
+        x--;
+        if(gm_payload_key_len[x] == len && memcmp(gm_payload_keys[x], key, len) == 0)
+            return(x);
+        slot = (slot + 1) & (GM_PAYLOAD_HASH_SIZE - 1);
+    }
+    return(-1);
+}
+
+/* number of probes for a key */
+int gm_payload_probes(int key) {
+    unsigned int slot;
+    int probes = 1;
+
+    pthread_once(&key_table_once, key_table_init);
+    slot = key_hash(gm_payload_keys[key], gm_payload_key_len[key]);
+    while(key_table[slot] != key + 1) {
+        slot = (slot + 1) & (GM_PAYLOAD_HASH_SIZE - 1);
+        probes++;
+    }
+    return(probes);
+}
+
+/* split payload into values */
+int gm_payload_parse(gm_payload_t * payload, char * data, size_t size) {
+    char * end = data + size;
+    char * line;
+    char * eol;
+    char * sep;
+    size_t len;
+    int key;
+
+    memset(payload, 0, sizeof(*payload));
+    for(line = data; line < end; line = eol + 1) {
+        eol = memchr(line, '\n', end - line);
+        if(eol == NULL)
+            eol = end;
+        *eol = '\x0';
+
+        sep = memchr(line, '=', eol - line);
+        if(sep == NULL) {
+            /* a key without value still counts as empty value */
+            sep = eol;
+        } else {
+            *sep = '\x0';
+        }
+
+        key = gm_payload_key(line, sep - line);
+        len = sep == eol ? 0 : eol - sep - 1;
+        if(key >= 0) {
+            payload->value[key] = sep == eol ? eol : sep + 1;
+            payload->len[key]   = len;
+        }
+
+        /* an empty value ends the payload */
+        if(len == 0)
+            break;
+        if(key >= 0)
+            payload->found++;
+    }
+    return(payload->found);
+}
+
+/* little endian integers of the binary format */
+static void put_u32(unsigned char * p, unsigned long value) {
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+    p[2] = (value >> 16) & 0xff;
+    p[3] = (value >> 24) & 0xff;
+}
+
+static unsigned long get_u32(const unsigned char * p) {
+    return((unsigned long)p[0] | (unsigned long)p[1] << 8 | (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24);
+}
+
+static void put_i64(unsigned char * p, long long value) {
+    unsigned long long v = (unsigned long long)value;
+    int x;
+    for(x = 0; x < 8; x++) {
+        p[x] = v & 0xff;
+        v >>= 8;
+    }
+}
+
+static long long get_i64(const unsigned char * p) {
+    unsigned long long v = 0;
+    int x;
+    for(x = 7; x >= 0; x--)
+        v = v << 8 | p[x];
+    return((long long)v);
+}
+
+/* true if data starts with a binary header */
+int gm_payload_is_binary(const char * data, size_t size) {
+    if(size < GM_PAYLOAD_HEADER_SIZE || memcmp(data, GM_PAYLOAD_MAGIC, GM_PAYLOAD_MAGIC_SIZE) != 0)
+        return(0);
+    return(get_u32((const unsigned char *)data + GM_PAYLOAD_MAGIC_SIZE + 1) <= size - GM_PAYLOAD_HEADER_SIZE);
+}
+
+/* size of a text or binary payload */
+size_t gm_payload_size(const char * data) {
+    if(strncmp(data, GM_PAYLOAD_MAGIC, GM_PAYLOAD_MAGIC_SIZE) != 0)
+        return(strlen(data));
+    return(GM_PAYLOAD_HEADER_SIZE + get_u32((const unsigned char *)data + GM_PAYLOAD_MAGIC_SIZE + 1));
+}
+
+/* split binary payload into values */
+static int parse_binary(gm_payload_t * payload, char * data) {
+    unsigned char * p   = (unsigned char *)data + GM_PAYLOAD_HEADER_SIZE;
+    unsigned char * end = p + get_u32((unsigned char *)data + GM_PAYLOAD_MAGIC_SIZE + 1);
+    unsigned long len;
+    int key;
+
+    if((unsigned char)data[GM_PAYLOAD_MAGIC_SIZE] != GM_PAYLOAD_VERSION)
+        return(0);
+
+    while(p < end) {
+        key = *p & ~GM_PAYLOAD_TAG_NUM;
+        if(*p++ & GM_PAYLOAD_TAG_NUM) {
+            if(end - p < 8)
+                break;
+            if(key < GM_PAYLOAD_KEY_NUM) {
+                payload->num[key]  = get_i64(p);
+                payload->numeric  |= 1U << key;
+                payload->found++;
+            }
+            p += 8;
+            continue;
+        }
+        if(end - p < 4)
+            break;
+        len = get_u32(p);
+        p += 4;
+        /* strings are followed by a zero byte */
+        if((unsigned long)(end - p) <= len || p[len] != '\x0')
+            break;
+        if(key < GM_PAYLOAD_KEY_NUM) {
+            payload->value[key] = (char *)p;
+            payload->len[key]   = len;
+            if(len > 0)
+                payload->found++;
+        }
+        p += len + 1;
+    }
+
+    /* broken records, do not use any of it */
+    if(p != end) {
+        memset(payload, 0, sizeof(*payload));
+        payload->format = GM_PAYLOAD_FORMAT_BINARY;
+    }
+    return(payload->found);
+}
+
+/* split text or binary payload into values */
+int gm_payload_decode(gm_payload_t * payload, char * data, size_t size) {
+    if(!gm_payload_is_binary(data, size))
+        return(gm_payload_parse(payload, data, strnlen(data, size)));
+    memset(payload, 0, sizeof(*payload));
+    payload->format = GM_PAYLOAD_FORMAT_BINARY;
+    return(parse_binary(payload, data));
+}
+
+/* value of a key, NULL if missing or empty */
+char * gm_payload_value(gm_payload_t * payload, int key) {
+    if(payload->len[key] == 0)
+        return(NULL);
+    return(payload->value[key]);
+}
+
+/* integer value of a key */
+int gm_payload_int(gm_payload_t * payload, int key, long long * value) {
+    if(payload->numeric & (1U << key)) {
+        *value = payload->num[key];
+        return(1);
+    }
+    if(payload->len[key] == 0)
+        return(0);
+    *value = atoll(payload->value[key]);
+    return(1);
+}
+
+/* timestamp value of a key */
+int gm_payload_time(gm_payload_t * payload, int key, struct timeval * t) {
+    if(payload->numeric & (1U << key)) {
+        t->tv_sec  = payload->num[key] / 1000000;
+        t->tv_usec = payload->num[key] % 1000000;
+        return(1);
+    }
+    if(payload->len[key] == 0)
+        return(0);
+    string2timeval(payload->value[key], t);
+    return(1);
+}
+
+/* replace escaped newlines in place */
+size_t gm_payload_unescape(char * value, size_t len) {
+    char * src = memchr(value, '\\', len);
+    char * end = value + len;
+    char * dst;
+
+    if(src == NULL)
+        return(len);
+    for(dst = src; src < end; src++) {
+        if(src[0] == '\\' && src + 1 < end && src[1] == 'n') {
+            *dst++ = '\n';
+            src++;
+        } else {
+            *dst++ = *src;
+        }
+    }
+    *dst = '\x0';
+    return(dst - value);
+}
+
+/* the format is given by the header written in gm_payload_begin */
+static int is_binary(gm_buffer_t * buf) {
+    return(buf->len >= GM_PAYLOAD_HEADER_SIZE && memcmp(buf->data, GM_PAYLOAD_MAGIC, GM_PAYLOAD_MAGIC_SIZE) == 0);
+}
+
+/* start a new payload */
+void gm_payload_begin(gm_buffer_t * buf, int format) {
+    unsigned char header[GM_PAYLOAD_HEADER_SIZE];
+    gm_buffer_reset(buf);
+    if(format != GM_PAYLOAD_FORMAT_BINARY)
+        return;
+    memcpy(header, GM_PAYLOAD_MAGIC, GM_PAYLOAD_MAGIC_SIZE);
+    header[GM_PAYLOAD_MAGIC_SIZE] = GM_PAYLOAD_VERSION;
+    put_u32(header + GM_PAYLOAD_MAGIC_SIZE + 1, 0);
+    gm_buffer_append(buf, (char *)header, GM_PAYLOAD_HEADER_SIZE);
+}
+
+/* append key= or the tag and a placeholder for the length */
+static void append_key(gm_buffer_t * buf, int key) {
+    unsigned char tag[5];
+    if(is_binary(buf)) {
+        tag[0] = key;
+        put_u32(tag + 1, 0);
+        gm_buffer_append(buf, (char *)tag, 5);
+        return;
+    }
+    gm_buffer_append(buf, gm_payload_keys[key], gm_payload_key_len[key]);
+    gm_buffer_append(buf, "=", 1);
+}
+
+/* append a binary number record */
+static void append_num(gm_buffer_t * buf, int key, long long value) {
+    unsigned char record[9];
+    record[0] = key | GM_PAYLOAD_TAG_NUM;
+    put_i64(record + 1, value);
+    gm_buffer_append(buf, (char *)record, 9);
+}
+
+/* append key=value line */
+void gm_payload_append(gm_buffer_t * buf, int key, const char * value) {
+    size_t offset = gm_payload_open(buf, key);
+    gm_buffer_append_str(buf, value);
+    if(is_binary(buf)) {
+        put_u32((unsigned char *)buf->data + offset - 4, buf->len - offset);
+        gm_buffer_append(buf, "", 1);
+        return;
+    }
+    gm_buffer_append(buf, "\n", 1);
+}
+
+/* append key=value line with integer */
+void gm_payload_append_int(gm_buffer_t * buf, int key, long long value) {
+    if(is_binary(buf)) {
+        append_num(buf, key, value);
+        return;
+    }
+    append_key(buf, key);
+    gm_buffer_append_int(buf, value);
+    gm_buffer_append(buf, "\n", 1);
+}
+
+/* append key=value line with timestamp */
+void gm_payload_append_time(gm_buffer_t * buf, int key, long long usec) {
+    if(is_binary(buf)) {
+        append_num(buf, key, usec);
+        return;
+    }
+    append_key(buf, key);
+    gm_buffer_append_time(buf, usec);
+    gm_buffer_append(buf, "\n", 1);
+}
+
+/* start a value which is written piecewise */
+size_t gm_payload_open(gm_buffer_t * buf, int key) {
+    append_key(buf, key);
+    return(buf->len);
+}
+
+/* finish a piecewise value */
+void gm_payload_close(gm_buffer_t * buf, size_t offset) {
+    if(!is_binary(buf)) {
+        gm_buffer_append(buf, "\n", 1);
+        return;
+    }
+    /* binary values are sent raw */
+    buf->len = offset + gm_payload_unescape(buf->data + offset, buf->len - offset);
+    put_u32((unsigned char *)buf->data + offset - 4, buf->len - offset);
+    gm_buffer_append(buf, "", 1);
+}
+
+/* append end marker */
+void gm_payload_end(gm_buffer_t * buf) {
+    if(is_binary(buf)) {
+        put_u32((unsigned char *)buf->data + GM_PAYLOAD_MAGIC_SIZE + 1, buf->len - GM_PAYLOAD_HEADER_SIZE);
+        return;
+    }
+    gm_buffer_append(buf, "\n\n", 2);
+}
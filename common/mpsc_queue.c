@@ -0,0 +1,61 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/* include header */
+#include "mpsc_queue.h"
+#include "common.h"
+
+/* initialize an empty queue */
+void mpsc_queue_init(mpsc_queue_t * queue) {
+    __atomic_store_n(&queue->head, NULL, __ATOMIC_RELEASE);
+}
+
+/* push a node, lock free */
+int mpsc_queue_push(mpsc_queue_t * queue, mpsc_queue_node_t * node) {
+    mpsc_queue_node_t * head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    do {
+        node->next = head;
+    } while(!__atomic_compare_exchange_n(&queue->head, &head, node, TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return(head == NULL ? TRUE : FALSE);
+}
+
+/* swap out the whole queue and return it in FIFO order */
+mpsc_queue_node_t * mpsc_queue_take_all(mpsc_queue_t * queue) {
+    mpsc_queue_node_t * list = __atomic_exchange_n(&queue->head, NULL, __ATOMIC_ACQUIRE);
+    mpsc_queue_node_t * fifo = NULL;
+    mpsc_queue_node_t * next;
+
+    /* nodes have been pushed to the front, so reverse them */
+    while(list != NULL) {
+        next       = list->next;
+        list->next = fifo;
+        fifo       = list;
+        list       = next;
+    }
+    return(fifo);
+}
+
+/* check if there is anything queued */
+int mpsc_queue_is_empty(mpsc_queue_t * queue) {
+    return(__atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == NULL ? TRUE : FALSE);
+}
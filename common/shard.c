@@ -0,0 +1,131 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/* include header */
+#include "shard.h"
+#include "gm_alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* fnv-1a, continues with the given hash */
+static unsigned int shard_fnv1a(unsigned int hash, const char * str) {
+    while(*str != '\0') {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619U;
+    }
+    return(hash);
+}
+
+/* murmur3 finalizer, spreads similar names over the whole ring */
+static unsigned int shard_mix(unsigned int hash) {
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bU;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35U;
+    hash ^= hash >> 16;
+    return(hash);
+}
+
+/* calculate shard key from host and optional service */
+unsigned int gm_shard_hash(const char * host, const char * service) {
+    unsigned int hash = 2166136261U;
+    hash = shard_fnv1a(hash, host);
+    if(service != NULL) {
+        hash = shard_fnv1a(hash, ";");
+        hash = shard_fnv1a(hash, service);
+    }
+    hash = shard_mix(hash);
+    /* 0 is used for jobs without shard key */
+    return(hash == 0 ? 1 : hash);
+}
+
+/* sort points by hash, server index breaks ties */
+static int shard_point_cmp(const void * a, const void * b) {
+    const gm_shard_point_t * p1 = a;
+    const gm_shard_point_t * p2 = b;
+    if(p1->hash != p2->hash)
+        return(p1->hash < p2->hash ? -1 : 1);
+    return(p1->server - p2->server);
+}
+
+/* create hash ring */
+gm_shard_ring_t * gm_shard_ring_create(gm_server_t * server_list[GM_LISTSIZE], int server_num, int replicas) {
+    gm_shard_ring_t * ring;
+    char name[GM_SMALLBUFSIZE];
+    int x, y, n = 0;
+
+    if(replicas <= 0)
+        replicas = GM_SHARD_REPLICAS;
+
+    ring             = gm_malloc(sizeof(gm_shard_ring_t));
+    ring->server_num = server_num;
+    ring->points_num = server_num * replicas;
+    ring->points     = gm_malloc(ring->points_num * sizeof(gm_shard_point_t));
+    for(x = 0; x < server_num; x++) {
+        for(y = 0; y < replicas; y++) {
+            snprintf(name, sizeof(name), "%s:%d-%d", server_list[x]->host, server_list[x]->port, y);
+            ring->points[n].hash   = shard_mix(shard_fnv1a(2166136261U, name));
+            ring->points[n].server = x;
+            n++;
+        }
+    }
+    qsort(ring->points, ring->points_num, sizeof(gm_shard_point_t), shard_point_cmp);
+
+    return(ring);
+}
+
+/* return server for this shard key, skipping servers which are down */
+int gm_shard_ring_lookup(gm_shard_ring_t * ring, unsigned int hash, int * down) {
+    int low  = 0;
+    int high = ring->points_num;
+    int mid, x, server;
+
+    if(ring->points_num == 0)
+        return(-1);
+
+    /* first point with a hash >= key */
+    while(low < high) {
+        mid = low + (high - low) / 2;
+        if(ring->points[mid].hash < hash)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    for(x = 0; x < ring->points_num; x++) {
+        server = ring->points[(low + x) % ring->points_num].server;
+        if(down == NULL || !down[server])
+            return(server);
+    }
+    return(-1);
+}
+
+/* free hash ring */
+void gm_shard_ring_free(gm_shard_ring_t ** ring) {
+    if(*ring == NULL)
+        return;
+    gm_free((*ring)->points);
+    gm_free(*ring);
+}
@@ -25,6 +25,7 @@
 #include "utils.h"
 #include "gm_crypt.h"
 #include "gearman_utils.h"
+#include "gm_payload.h"
 
 #include <dirent.h>
 #include "popenRWE.h"
@@ -140,23 +141,29 @@ int mod_gm_encrypt(EVP_CIPHER_CTX * ctx, char ** ciphertext, const char * plaint
     unsigned char * crypted;
     unsigned char * base64;
 
+    /* already encrypted, ex.: replayed from the spool */
+    if(mode == GM_ENCODE_NONE) {
+        *ciphertext = gm_strdup(plaintext);
+        return strlen(*ciphertext);
+    }
+
+    /* binary payloads may contain zero bytes */
+    size = gm_payload_size(plaintext);
+
     if(mode == GM_ENCODE_AND_ENCRYPT) {
-        size = strlen(plaintext)+1;
+        size++;
         crypted = gm_malloc(sizeof(char) * (size + (2*BLOCKSIZE)));
         size = mod_gm_aes_encrypt(ctx, crypted, (const unsigned char*)plaintext, size);
         if(size <= 0) {
             gm_free(crypted);
             return -1;
         }
+        base64 = base64_encode(crypted, size);
+        gm_free(crypted);
     }
     else {
-        crypted = (unsigned char*)gm_strdup(plaintext);
-        size    = strlen(plaintext);
+        base64 = base64_encode((const unsigned char*)plaintext, size);
     }
-
-    /* now encode in base64 */
-    base64 = base64_encode(crypted, size);
-    gm_free(crypted);
     *ciphertext = (char*)base64;
     return strlen(*ciphertext);
 }
@@ -175,7 +182,7 @@ int mod_gm_decrypt(EVP_CIPHER_CTX * ctx, char ** plaintext, const char * ciphert
         gm_log( GM_LOG_ERROR, "failed to decode base64 string.\n" );
         return -1;
     }
-    if(mode == GM_ENCODE_AND_ENCRYPT || (mode == GM_ENCODE_ACCEPT_ALL && strncmp((char*)buffer, "type=", 5))) {
+    if(mode == GM_ENCODE_AND_ENCRYPT || (mode == GM_ENCODE_ACCEPT_ALL && strncmp((char*)buffer, "type=", 5) && !gm_payload_is_binary((char*)buffer, bsize))) {
         /* decrypt if it is no plaintext already. */
         /* And if this is base64 encoded encrypted data, it is a multiple of blocksize, strip off
            trailing artefacts.
@@ -187,13 +194,14 @@ int mod_gm_decrypt(EVP_CIPHER_CTX * ctx, char ** plaintext, const char * ciphert
             return -1;
         }
         (*plaintext)[max_size-1] = '\x0';
+        gm_free(buffer);
+        return bsize;
     }
-    else  {
-        buffer[bsize] = '\x0';
-        *plaintext = gm_strndup((char*)buffer, bsize);
-    }
-    gm_free(buffer);
-    return 1;
+
+    /* plain base64, binary payloads may contain zero bytes */
+    buffer[bsize] = '\x0';
+    *plaintext = (char*)buffer;
+    return bsize;
 }
 
 
@@ -258,6 +266,16 @@ int set_default_options(mod_gm_opt_t *opt) {
 
     opt->set_queues_by_hand = 0;
     opt->result_workers     = 1;
+    opt->result_workers_max = 0;
+    opt->result_injection_budget = GM_DEFAULT_RESULT_INJECTION_BUDGET;
+    opt->submit_workers     = 1;
+    opt->submit_queue_size  = GM_DEFAULT_SUBMIT_QUEUE_SIZE;
+    opt->submit_queue_overflow = GM_SUBMIT_OVERFLOW_BLOCK;
+    opt->sharding           = GM_SHARD_NONE;
+    opt->spool_dir          = NULL;
+    opt->metrics_socket     = NULL;
+    opt->spool_max_size     = GM_DEFAULT_SPOOL_MAX_SIZE;
+    opt->spool_max_age      = GM_DEFAULT_SPOOL_MAX_AGE;
     opt->lock               = NULL;
     opt->crypt_key          = NULL;
     opt->result_queue       = NULL;
@@ -273,8 +291,13 @@ int set_default_options(mod_gm_opt_t *opt) {
     opt->perfdata           = GM_DISABLED;
     opt->perfdata_mode      = GM_PERFDATA_OVERWRITE;
     opt->perfdata_send_all  = GM_DISABLED;
+    opt->perfdata_batch_size  = GM_DEFAULT_PERFDATA_BATCH_SIZE;
+    opt->perfdata_batch_bytes = GM_DEFAULT_PERFDATA_BATCH_BYTES;
+    opt->perfdata_batch_delay = GM_DEFAULT_PERFDATA_BATCH_DELAY;
+    opt->export_coalesce_window = 0;
     opt->use_uniq_jobs      = GM_ENABLED;
     opt->log_stats_interval = 60;
+    opt->submit_batch_size  = GM_DEFAULT_SUBMIT_BATCH_SIZE;
     opt->do_hostchecks      = GM_ENABLED;
     opt->route_eventhandler_like_checks = GM_DISABLED;
     opt->hosts              = GM_DISABLED;
@@ -297,12 +320,21 @@ int set_default_options(mod_gm_opt_t *opt) {
     opt->timeout_return     = 2;
     opt->identifier         = NULL;
     opt->queue_cust_var     = NULL;
+    opt->priority_cust_var  = NULL;
     opt->show_error_output  = GM_ENABLED;
     opt->dup_results_are_passive = GM_ENABLED;
     opt->orphan_host_checks      = GM_ENABLED;
     opt->orphan_service_checks   = GM_ENABLED;
     opt->orphan_return           = 2;
+    opt->orphan_grace            = 0;
+    opt->admission_max_queue_depth = 0;
+    opt->admission_max_queue_age   = 0;
+    opt->admission_policy          = GM_ADMISSION_LOCAL;
+    opt->admission_postpone_delay  = GM_DEFAULT_ADMISSION_POSTPONE;
+    opt->result_coalesce         = GM_DISABLED;
+    opt->result_coalesce_keep_state_changes = GM_ENABLED;
     opt->accept_clear_results    = GM_DISABLED;
+    opt->wire_format             = GM_PAYLOAD_FORMAT_TEXT;
     opt->has_starttime      = FALSE;
     opt->has_finishtime     = FALSE;
     opt->has_latency        = FALSE;
@@ -313,7 +345,7 @@ int set_default_options(mod_gm_opt_t *opt) {
 
     opt->restrict_command_characters = gm_strdup("$&();<>`\"'|");
     opt->workaround_rc_25            = GM_DISABLED;
-    opt->internal_check_dummy        = TRUE;
+    opt->internal_checks             = GM_INTERNAL_CHECK_DUMMY;
 
     opt->host               = NULL;
     opt->service            = NULL;
@@ -346,6 +378,9 @@ int set_default_options(mod_gm_opt_t *opt) {
     opt->local_servicegroups_num  = 0;
     for(i=0;i<GM_LISTSIZE;i++)
         opt->local_servicegroups_list[i] = NULL;
+    opt->priority_hostgroups_num  = 0;
+    for(i=0;i<GM_LISTSIZE;i++)
+        opt->priority_hostgroups_list[i] = NULL;
     for(i=0;i<GM_NEBTYPESSIZE;i++) {
         mod_gm_exp_t *mod_gm_exp;
         mod_gm_exp              = gm_malloc(sizeof(mod_gm_exp_t));
@@ -362,6 +397,20 @@ int set_default_options(mod_gm_opt_t *opt) {
 }
 
 
+/* parse a priority class name */
+int parse_priority(const char * value) {
+    if(value == NULL)
+        return(0);
+    if(!strcasecmp(value, "high"))
+        return(GM_JOB_PRIO_HIGH);
+    if(!strcasecmp(value, "normal"))
+        return(GM_JOB_PRIO_NORMAL);
+    if(!strcasecmp(value, "low"))
+        return(GM_JOB_PRIO_LOW);
+    return(0);
+}
+
+
 /* parse an option value to yes/no */
 int parse_yes_or_no(char*value, int dfl) {
     if(value == NULL)
@@ -561,12 +610,82 @@ int parse_args_line(mod_gm_opt_t *opt, char * arg, int recursion_level) {
         return(GM_OK);
     }
 
+    /* orphan_grace */
+    else if ( !strcmp( key, "orphan_grace" ) ) {
+        opt->orphan_grace = atoi( value );
+        if(opt->orphan_grace < 0) { opt->orphan_grace = 0; }
+        return(GM_OK);
+    }
+
+    /* admission_max_queue_depth */
+    else if ( !strcmp( key, "admission_max_queue_depth" ) ) {
+        opt->admission_max_queue_depth = atoi( value );
+        if(opt->admission_max_queue_depth < 0) { opt->admission_max_queue_depth = 0; }
+        return(GM_OK);
+    }
+
+    /* admission_max_queue_age */
+    else if ( !strcmp( key, "admission_max_queue_age" ) ) {
+        opt->admission_max_queue_age = atoi( value );
+        if(opt->admission_max_queue_age < 0) { opt->admission_max_queue_age = 0; }
+        return(GM_OK);
+    }
+
+    /* admission_policy */
+    else if ( !strcmp( key, "admission_policy" ) ) {
+        lc(value);
+        if(!strcmp( value, "local" ))
+            opt->admission_policy = GM_ADMISSION_LOCAL;
+        else if(!strcmp( value, "postpone" ))
+            opt->admission_policy = GM_ADMISSION_POSTPONE;
+        else if(!strcmp( value, "enqueue" ))
+            opt->admission_policy = GM_ADMISSION_ENQUEUE;
+        else {
+            gm_log( GM_LOG_ERROR, "unknown admission_policy: %s, use local, postpone or enqueue\n", value );
+            return(GM_ERROR);
+        }
+        return(GM_OK);
+    }
+
+    /* admission_postpone_delay */
+    else if ( !strcmp( key, "admission_postpone_delay" ) ) {
+        opt->admission_postpone_delay = atoi( value );
+        if(opt->admission_postpone_delay < 1) { opt->admission_postpone_delay = 1; }
+        return(GM_OK);
+    }
+
+    /* result_coalesce */
+    else if ( !strcmp( key, "result_coalesce" ) ) {
+        opt->result_coalesce = parse_yes_or_no(value, GM_ENABLED);
+        return(GM_OK);
+    }
+
+    /* result_coalesce_keep_state_changes */
+    else if ( !strcmp( key, "result_coalesce_keep_state_changes" ) ) {
+        opt->result_coalesce_keep_state_changes = parse_yes_or_no(value, GM_ENABLED);
+        return(GM_OK);
+    }
+
     /* accept_clear_results */
     else if ( !strcmp( key, "accept_clear_results" ) ) {
         opt->accept_clear_results = parse_yes_or_no(value, GM_ENABLED);
         return(GM_OK);
     }
 
+    /* wire_format */
+    else if ( !strcmp( key, "wire_format" ) ) {
+        lc(value);
+        if(!strcmp( value, "text" ))
+            opt->wire_format = GM_PAYLOAD_FORMAT_TEXT;
+        else if(!strcmp( value, "binary" ))
+            opt->wire_format = GM_PAYLOAD_FORMAT_BINARY;
+        else {
+            gm_log( GM_LOG_ERROR, "unknown wire_format: %s, use text or binary\n", value );
+            return(GM_ERROR);
+        }
+        return(GM_OK);
+    }
+
     /* latency_flatten_window */
     else if ( !strcmp( key, "latency_flatten_window" ) ) {
         opt->latency_flatten_window = atoi(value);
@@ -644,12 +763,107 @@ int parse_args_line(mod_gm_opt_t *opt, char * arg, int recursion_level) {
         if(opt->log_stats_interval < 0) { opt->log_stats_interval = 0; }
     }
 
+    /* submit_batch_size */
+    else if ( !strcmp( key, "submit_batch_size" ) ) {
+        opt->submit_batch_size = atoi( value );
+        if(opt->submit_batch_size < 1) { opt->submit_batch_size = 1; }
+    }
+
     /* result worker */
     else if ( !strcmp( key, "result_workers" ) ) {
         opt->result_workers = atoi( value );
         if(opt->result_workers < 0) { opt->result_workers = 0; }
     }
 
+    /* upper limit of result worker */
+    else if ( !strcmp( key, "result_workers_max" ) ) {
+        opt->result_workers_max = atoi( value );
+        if(opt->result_workers_max < 0) { opt->result_workers_max = 0; }
+    }
+
+    /* result injection budget */
+    else if ( !strcmp( key, "result_injection_budget" ) ) {
+        opt->result_injection_budget = atoi( value );
+        if(opt->result_injection_budget < 0) { opt->result_injection_budget = 0; }
+    }
+
+    /* submit worker */
+    else if ( !strcmp( key, "submit_workers" ) ) {
+        opt->submit_workers = atoi( value );
+        if(opt->submit_workers < 0) { opt->submit_workers = 0; }
+    }
+
+    /* submit queue size */
+    else if ( !strcmp( key, "submit_queue_size" ) ) {
+        opt->submit_queue_size = atoi( value );
+        if(opt->submit_queue_size <= 0) { opt->submit_queue_size = GM_DEFAULT_SUBMIT_QUEUE_SIZE; }
+    }
+
+    /* submit queue overflow */
+    else if ( !strcmp( key, "submit_queue_overflow" ) ) {
+        if ( !strcmp( value, "block" ) ) {
+            opt->submit_queue_overflow = GM_SUBMIT_OVERFLOW_BLOCK;
+        }
+        else if ( !strcmp( value, "local" ) ) {
+            opt->submit_queue_overflow = GM_SUBMIT_OVERFLOW_LOCAL;
+        }
+        else if ( !strcmp( value, "drop" ) ) {
+            opt->submit_queue_overflow = GM_SUBMIT_OVERFLOW_DROP;
+        }
+        else {
+            gm_log( GM_LOG_ERROR, "unknown submit queue overflow mode '%s', use one of 'block', 'local' and 'drop'\n", value );
+            return(GM_ERROR);
+        }
+    }
+
+    /* sharding */
+    else if ( !strcmp( key, "sharding" ) ) {
+        if ( !strcmp( value, "host" ) ) {
+            opt->sharding = GM_SHARD_HOST;
+        }
+        else if ( !strcmp( value, "service" ) ) {
+            opt->sharding = GM_SHARD_SERVICE;
+        }
+        else if ( !strcmp( value, "no" ) || !strcmp( value, "off" ) ) {
+            opt->sharding = GM_SHARD_NONE;
+        }
+        else {
+            gm_log( GM_LOG_ERROR, "unknown sharding mode '%s', use one of 'no', 'host' and 'service'\n", value );
+            return(GM_ERROR);
+        }
+    }
+
+    /* spool_dir */
+    else if ( !strcmp( key, "spool_dir" ) ) {
+        gm_free(opt->spool_dir);
+        if(strlen(value) > 0)
+            opt->spool_dir = gm_strdup( value );
+    }
+
+    /* metrics_socket */
+    else if ( !strcmp( key, "metrics_socket" ) ) {
+        gm_free(opt->metrics_socket);
+        if(strlen(value) > 0)
+            opt->metrics_socket = gm_strdup( value );
+    }
+
+    /* spool_max_size */
+    else if ( !strcmp( key, "spool_max_size" ) ) {
+        opt->spool_max_size = atoi( value );
+        if(opt->spool_max_size <= 0) { opt->spool_max_size = GM_DEFAULT_SPOOL_MAX_SIZE; }
+        /* the spool grows in whole segments, a smaller limit would never allow one */
+        if(opt->spool_max_size < GM_SPOOL_SEGMENT_SIZE / 1048576) {
+            gm_log( GM_LOG_INFO, "Warning: spool_max_size=%dMB is smaller than one spool segment, rounding up to %dMB\n", opt->spool_max_size, GM_SPOOL_SEGMENT_SIZE / 1048576 );
+            opt->spool_max_size = GM_SPOOL_SEGMENT_SIZE / 1048576;
+        }
+    }
+
+    /* spool_max_age */
+    else if ( !strcmp( key, "spool_max_age" ) ) {
+        opt->spool_max_age = atoi( value );
+        if(opt->spool_max_age < 0) { opt->spool_max_age = 0; }
+    }
+
     /* return code */
     else if (   !strcmp( key, "returncode" )
              || !strcmp( key, "r" )
@@ -840,6 +1054,24 @@ int parse_args_line(mod_gm_opt_t *opt, char * arg, int recursion_level) {
         }
     }
 
+    /* perfdata_batch_size */
+    else if ( !strcmp( key, "perfdata_batch_size" ) ) {
+        opt->perfdata_batch_size = atoi( value );
+        if(opt->perfdata_batch_size <= 0) { opt->perfdata_batch_size = GM_DEFAULT_PERFDATA_BATCH_SIZE; }
+    }
+
+    /* perfdata_batch_bytes */
+    else if ( !strcmp( key, "perfdata_batch_bytes" ) ) {
+        opt->perfdata_batch_bytes = atoi( value );
+        if(opt->perfdata_batch_bytes <= 0) { opt->perfdata_batch_bytes = GM_DEFAULT_PERFDATA_BATCH_BYTES; }
+    }
+
+    /* perfdata_batch_delay */
+    else if ( !strcmp( key, "perfdata_batch_delay" ) ) {
+        opt->perfdata_batch_delay = atoi( value );
+        if(opt->perfdata_batch_delay <= 0) { opt->perfdata_batch_delay = GM_DEFAULT_PERFDATA_BATCH_DELAY; }
+    }
+
     /* perfdata_mode */
     else if ( !strcmp( key, "perfdata_mode" ) ) {
         opt->perfdata_mode = atoi( value );
@@ -938,6 +1170,37 @@ int parse_args_line(mod_gm_opt_t *opt, char * arg, int recursion_level) {
         opt->queue_cust_var = gm_strdup( value );
     }
 
+    /* priority_custom_variable */
+    else if ( !strcmp( key, "priority_custom_variable" ) ) {
+        /* uppercase custom variable name */
+        for(x = 0; value[x] != '\x0'; x++) {
+            value[x] = toupper(value[x]);
+        }
+        gm_free(opt->priority_cust_var);
+        opt->priority_cust_var = gm_strdup( value );
+    }
+
+    /* priority hostgroups */
+    else if (   !strcmp( key, "priority_hostgroups" )
+             || !strcmp( key, "priority_hostgroup" ) ) {
+        char *groupname;
+        int priority;
+        groupname = strsep( &value, ":" );
+        priority  = parse_priority(trim(groupname));
+        if(priority == 0 || value == NULL) {
+            gm_log( GM_LOG_ERROR, "priority_hostgroups must be <high|normal|low>:<hostgroup>[,<hostgroup>...]\n" );
+            return(GM_ERROR);
+        }
+        while ( (groupname = strsep( &value, "," )) != NULL ) {
+            groupname = trim(groupname);
+            if ( strcmp( groupname, "" ) && opt->priority_hostgroups_num < GM_LISTSIZE ) {
+                opt->priority_hostgroups_list[opt->priority_hostgroups_num] = gm_strdup(groupname);
+                opt->priority_hostgroups_prio[opt->priority_hostgroups_num] = priority;
+                opt->priority_hostgroups_num++;
+            }
+        }
+    }
+
     /* export queues */
     else if ( !strcmp( key, "export" ) ) {
         export_queue        = strsep( &value, ":" );
@@ -975,6 +1238,12 @@ int parse_args_line(mod_gm_opt_t *opt, char * arg, int recursion_level) {
         }
     }
 
+    /* export_coalesce_window */
+    else if ( !strcmp( key, "export_coalesce_window" ) ) {
+        opt->export_coalesce_window = atoi( value );
+        if(opt->export_coalesce_window < 0) { opt->export_coalesce_window = 0; }
+    }
+
     /* p1_file */
     else if ( !strcmp( key, "p1_file" ) ) {
 #ifdef EMBEDDEDPERL
@@ -1003,7 +1272,30 @@ int parse_args_line(mod_gm_opt_t *opt, char * arg, int recursion_level) {
 
     /* internal_check_dummy */
     else if ( !strcmp( key, "internal_check_dummy" ) ) {
-        opt->internal_check_dummy = parse_yes_or_no(value, GM_ENABLED);
+        if(parse_yes_or_no(value, GM_ENABLED) == GM_ENABLED)
+            opt->internal_checks |= GM_INTERNAL_CHECK_DUMMY;
+        else
+            opt->internal_checks &= ~GM_INTERNAL_CHECK_DUMMY;
+        return(GM_OK);
+    }
+
+    /* internal_checks */
+    else if ( !strcmp( key, "internal_checks" ) ) {
+        char *handler;
+        opt->internal_checks = 0;
+        while ( (handler = strsep( &value, "," )) != NULL ) {
+            handler = trim(handler);
+            if ( !strcmp( handler, "check_dummy" ) )
+                opt->internal_checks |= GM_INTERNAL_CHECK_DUMMY;
+            else if ( !strcmp( handler, "constant" ) )
+                opt->internal_checks |= GM_INTERNAL_CHECK_CONSTANT;
+            else if ( !strcmp( handler, "check_copy_state" ) )
+                opt->internal_checks |= GM_INTERNAL_CHECK_COPY_STATE;
+            else if ( !strcmp( handler, "all" ) )
+                opt->internal_checks |= GM_INTERNAL_CHECK_ALL;
+            else if ( strcmp( handler, "none" ) && strlen( handler ) > 0 )
+                gm_log( GM_LOG_ERROR, "unknown internal check: %s\n", handler );
+        }
         return(GM_OK);
     }
 
@@ -1160,8 +1452,47 @@ void dumpconfig(mod_gm_opt_t *opt, int mode) {
         gm_log( GM_LOG_DEBUG, "debug result:                    %s\n", opt->debug_result == GM_ENABLED ? "yes" : "no");
         if(opt->result_workers != 1)
             gm_log( GM_LOG_DEBUG, "result_worker:                   %d\n", opt->result_workers);
+        if(opt->result_workers_max > opt->result_workers)
+            gm_log( GM_LOG_DEBUG, "result_workers_max:              %d\n", opt->result_workers_max);
+        if(opt->result_injection_budget > 0) {
+            gm_log( GM_LOG_DEBUG, "result_injection_budget:         %dms\n", opt->result_injection_budget);
+        } else {
+            gm_log( GM_LOG_DEBUG, "result_injection_budget:         unlimited\n");
+        }
+        gm_log( GM_LOG_DEBUG, "submit_workers:                  %d\n", opt->submit_workers);
+        if(opt->submit_workers > 0) {
+            gm_log( GM_LOG_DEBUG, "submit_queue_size:               %d\n", opt->submit_queue_size);
+            gm_log( GM_LOG_DEBUG, "submit_queue_overflow:           %s\n", opt->submit_queue_overflow == GM_SUBMIT_OVERFLOW_LOCAL ? "local" : (opt->submit_queue_overflow == GM_SUBMIT_OVERFLOW_DROP ? "drop" : "block"));
+        }
+        gm_log( GM_LOG_DEBUG, "sharding:                        %s\n", opt->sharding == GM_SHARD_HOST ? "host" : (opt->sharding == GM_SHARD_SERVICE ? "service" : "no"));
+        gm_log( GM_LOG_DEBUG, "spool_dir:                       %s\n", opt->spool_dir == NULL ? "disabled" : opt->spool_dir);
+        if(opt->spool_dir != NULL) {
+            gm_log( GM_LOG_DEBUG, "spool_max_size:                  %dMB\n", opt->spool_max_size);
+            gm_log( GM_LOG_DEBUG, "spool_max_age:                   %ds\n", opt->spool_max_age);
+        }
+        gm_log( GM_LOG_DEBUG, "metrics_socket:                  %s\n", opt->metrics_socket == NULL ? "disabled" : opt->metrics_socket);
         gm_log( GM_LOG_DEBUG, "do_hostchecks:                   %s\n", opt->do_hostchecks == GM_ENABLED ? "yes" : "no");
         gm_log( GM_LOG_DEBUG, "route_eventhandler_like_checks:  %s\n", opt->route_eventhandler_like_checks == GM_ENABLED ? "yes" : "no");
+        if(opt->orphan_grace > 0) {
+            gm_log( GM_LOG_DEBUG, "orphan_grace:                    %ds\n", opt->orphan_grace);
+        } else {
+            gm_log( GM_LOG_DEBUG, "orphan_grace:                    disabled\n");
+        }
+        if(opt->admission_max_queue_depth > 0 || opt->admission_max_queue_age > 0) {
+            gm_log( GM_LOG_DEBUG, "admission_max_queue_depth:       %d\n", opt->admission_max_queue_depth);
+            gm_log( GM_LOG_DEBUG, "admission_max_queue_age:         %ds\n", opt->admission_max_queue_age);
+            gm_log( GM_LOG_DEBUG, "admission_policy:                %s\n", opt->admission_policy == GM_ADMISSION_LOCAL ? "local" : (opt->admission_policy == GM_ADMISSION_POSTPONE ? "postpone" : "enqueue"));
+            if(opt->admission_policy == GM_ADMISSION_POSTPONE)
+                gm_log( GM_LOG_DEBUG, "admission_postpone_delay:        %ds\n", opt->admission_postpone_delay);
+        } else {
+            gm_log( GM_LOG_DEBUG, "admission control:               disabled\n");
+        }
+        gm_log( GM_LOG_DEBUG, "result_coalesce:                 %s\n", opt->result_coalesce == GM_ENABLED ? (opt->result_coalesce_keep_state_changes == GM_ENABLED ? "yes, keep state changes" : "yes") : "no");
+        gm_log( GM_LOG_DEBUG, "internal_checks:                 %s%s%s%s\n",
+                opt->internal_checks == 0 ? "none" : "",
+                opt->internal_checks & GM_INTERNAL_CHECK_DUMMY ? "check_dummy " : "",
+                opt->internal_checks & GM_INTERNAL_CHECK_CONSTANT ? "constant " : "",
+                opt->internal_checks & GM_INTERNAL_CHECK_COPY_STATE ? "check_copy_state" : "");
         if(opt->latency_flatten_window > 0) {
             gm_log( GM_LOG_DEBUG, "latency_flatten_window:          %d\n", opt->latency_flatten_window);
         } else {
@@ -1183,6 +1514,11 @@ void dumpconfig(mod_gm_opt_t *opt, int mode) {
     if(mode == GM_NEB_MODE) {
         gm_log( GM_LOG_DEBUG, "perfdata:                        %s\n", opt->perfdata      == GM_ENABLED ? "yes" : "no");
         gm_log( GM_LOG_DEBUG, "perfdata mode:                   %s\n", opt->perfdata_mode == GM_PERFDATA_OVERWRITE ? "overwrite" : "append");
+        if(opt->perfdata_batch_size > 1) {
+            gm_log( GM_LOG_DEBUG, "perfdata_batch_size:             %d\n", opt->perfdata_batch_size);
+            gm_log( GM_LOG_DEBUG, "perfdata_batch_bytes:            %d\n", opt->perfdata_batch_bytes);
+            gm_log( GM_LOG_DEBUG, "perfdata_batch_delay:            %ds\n", opt->perfdata_batch_delay);
+        }
     }
     if(mode == GM_NEB_MODE || mode == GM_WORKER_MODE) {
         gm_log( GM_LOG_DEBUG, "hosts:                           %s\n", opt->hosts         == GM_ENABLED ? "yes" : "no");
@@ -1200,6 +1536,9 @@ void dumpconfig(mod_gm_opt_t *opt, int mode) {
             gm_log( GM_LOG_DEBUG, "local_hostgroups:                %s\n", opt->local_hostgroups_list[i]);
         for(i=0;i<opt->local_servicegroups_num;i++)
             gm_log( GM_LOG_DEBUG, "local_servicegroups:             %s\n", opt->local_servicegroups_list[i]);
+        gm_log( GM_LOG_DEBUG, "priority by cust var:            %s\n", opt->priority_cust_var == NULL ? "no" : opt->priority_cust_var);
+        for(i=0;i<opt->priority_hostgroups_num;i++)
+            gm_log( GM_LOG_DEBUG, "priority_hostgroups:             %s:%s\n", opt->priority_hostgroups_prio[i] == GM_JOB_PRIO_HIGH ? "high" : (opt->priority_hostgroups_prio[i] == GM_JOB_PRIO_NORMAL ? "normal" : "low"), opt->priority_hostgroups_list[i]);
         /* export queues*/
         for(i=0;i<GM_NEBTYPESSIZE;i++) {
             char * type = nebcallback2str(i);
@@ -1207,6 +1546,8 @@ void dumpconfig(mod_gm_opt_t *opt, int mode) {
                 gm_log( GM_LOG_DEBUG, "export:                          %-45s -> %s\n", type, opt->exports[i]->name[j]);
             gm_free(type);
         }
+        if(opt->export_coalesce_window > 0)
+            gm_log( GM_LOG_DEBUG, "export_coalesce_window:          %ds\n", opt->export_coalesce_window);
     }
 
     /* encryption */
@@ -1222,9 +1563,13 @@ void dumpconfig(mod_gm_opt_t *opt, int mode) {
     }
     if(mode == GM_NEB_MODE) {
         gm_log( GM_LOG_DEBUG, "accept clear result:             %s\n", opt->accept_clear_results == GM_ENABLED ? "yes" : "no");
+        gm_log( GM_LOG_DEBUG, "wire_format:                     %s\n", opt->wire_format == GM_PAYLOAD_FORMAT_BINARY ? "binary" : "text");
     }
     gm_log( GM_LOG_DEBUG, "transport mode:                  %s\n", opt->encryption == GM_ENABLED ? "aes-256+base64" : "base64 only");
     gm_log( GM_LOG_DEBUG, "use uniq jobs:                   %s\n", opt->use_uniq_jobs == GM_ENABLED ? "yes" : "no");
+    if(mode == GM_NEB_MODE || mode == GM_SEND_GEARMAN_MODE) {
+        gm_log( GM_LOG_DEBUG, "submit_batch_size:               %d\n", opt->submit_batch_size);
+    }
 
     gm_log( GM_LOG_DEBUG, "--------------------------------\n" );
     return;
@@ -1252,6 +1597,10 @@ void mod_gm_free_opt(mod_gm_opt_t *opt) {
         gm_free(opt->local_hostgroups_list[i]);
     for(i=0;i<opt->local_servicegroups_num;i++)
         gm_free(opt->local_servicegroups_list[i]);
+    for(i=0;i<opt->priority_hostgroups_num;i++)
+        gm_free(opt->priority_hostgroups_list[i]);
+    for(i=0;i<opt->perfdata_queues_num;i++)
+        gm_free(opt->perfdata_queues_list[i]);
     for(i=0;i<GM_NEBTYPESSIZE;i++) {
         for(j=0;j<opt->exports[i]->elem_number;j++) {
           gm_free(opt->exports[i]->name[j]);
@@ -1272,6 +1621,9 @@ void mod_gm_free_opt(mod_gm_opt_t *opt) {
     gm_free(opt->service);
     gm_free(opt->identifier);
     gm_free(opt->queue_cust_var);
+    gm_free(opt->priority_cust_var);
+    gm_free(opt->spool_dir);
+    gm_free(opt->metrics_socket);
     gm_free(opt->host_perfdata_template);
     gm_free(opt->service_perfdata_template);
 #ifdef EMBEDDEDPERL
@@ -1357,6 +1709,7 @@ int set_default_job(gm_job_t *job, mod_gm_opt_t *opt) {
     job->start_time.tv_sec   = 0L;
     job->start_time.tv_usec  = 0L;
     job->has_been_sent       = FALSE;
+    job->wire_format         = GM_PAYLOAD_FORMAT_TEXT;
 
     return(GM_OK);
 }
@@ -1635,11 +1988,48 @@ int check_param_server(gm_server_t * new_server, gm_server_t * server_list[GM_LI
 }
 
 
+/* assemble a result */
+static void build_result(gm_buffer_t * result, gm_job_t * exec_job, int format, int passive) {
+    size_t offset;
+
+    gm_payload_begin(result, format);
+    if(passive)
+        gm_payload_append(result, GM_PAYLOAD_TYPE, "passive");
+    gm_payload_append(result, GM_PAYLOAD_HOST_NAME, exec_job->host_name);
+    gm_payload_append_time(result, GM_PAYLOAD_CORE_START_TIME, timeval2usec(&exec_job->next_check));
+    gm_payload_append_time(result, GM_PAYLOAD_START_TIME, timeval2usec(&exec_job->start_time));
+    gm_payload_append_time(result, GM_PAYLOAD_FINISH_TIME, timeval2usec(&exec_job->finish_time));
+    gm_payload_append_int(result, GM_PAYLOAD_RETURN_CODE, exec_job->return_code);
+    gm_payload_append_int(result, GM_PAYLOAD_EXITED_OK, exec_job->exited_ok);
+    gm_payload_append(result, GM_PAYLOAD_SOURCE, exec_job->source);
+    if(exec_job->service_description != NULL)
+        gm_payload_append(result, GM_PAYLOAD_SERVICE_DESCRIPTION, exec_job->service_description);
+
+    /* output is the last line, it is written piecewise */
+    offset = gm_payload_open(result, GM_PAYLOAD_OUTPUT);
+    if(mod_gm_opt->debug_result) {
+        gm_buffer_append(result, "(", 1);
+        gm_buffer_append_str(result, hostname);
+        gm_buffer_append(result, ") - ", 4);
+    }
+    gm_buffer_append_str(result, exec_job->output);
+    if(mod_gm_opt->show_error_output && exec_job->error != NULL && strlen(exec_job->error) > 0) {
+        if(strlen(exec_job->output) > 0)
+            gm_buffer_append(result, "\\n", 2);
+        gm_buffer_append(result, "[", 1);
+        gm_buffer_append_str(result, exec_job->error);
+        gm_buffer_append(result, "] ", 2);
+    }
+    gm_payload_close(result, offset);
+    gm_payload_end(result);
+    if(format == GM_PAYLOAD_FORMAT_TEXT)
+        gm_buffer_append(result, "\n", 1);
+}
+
+
 /* send results back */
 void send_result_back(gm_job_t * exec_job, EVP_CIPHER_CTX * ctx) {
-    char * temp_buffer1;
-    char * temp_buffer2;
-    int result_size;
+    gm_buffer_t * result;
     gm_log( GM_LOG_TRACE, "send_result_back()\n" );
 
     /* avoid duplicate returned results */
@@ -1666,62 +2056,21 @@ void send_result_back(gm_job_t * exec_job, EVP_CIPHER_CTX * ctx) {
         return;
     }
 
-    result_size  = strlen(exec_job->output)+GM_BUFFERSIZE;
-    temp_buffer1 = gm_malloc(sizeof(char*)*result_size);
-    temp_buffer2 = gm_malloc(sizeof(char*)*result_size);
-
+    result = gm_buffer_new();
     gm_log( GM_LOG_TRACE, "queue: %s\n", exec_job->result_queue );
-    temp_buffer1[0]='\x0';
-    snprintf( temp_buffer1, result_size-1, "host_name=%s\ncore_start_time=%Lf\nstart_time=%Lf\nfinish_time=%Lf\nreturn_code=%i\nexited_ok=%i\nsource=%s\n",
-              exec_job->host_name,
-              timeval2double(&exec_job->next_check),
-              timeval2double(&exec_job->start_time),
-              timeval2double(&exec_job->finish_time),
-              exec_job->return_code,
-              exec_job->exited_ok,
-              exec_job->source
-            );
-    temp_buffer1[result_size-1]='\x0';
-
-    if(exec_job->service_description != NULL) {
-        temp_buffer2[0]='\x0';
-        strcat(temp_buffer2, "service_description=");
-        strcat(temp_buffer2, exec_job->service_description);
-        strcat(temp_buffer2, "\n");
-
-        strcat(temp_buffer1, temp_buffer2);
-    }
-    temp_buffer1[result_size]='\x0';
-
-    if(exec_job->output != NULL) {
-        temp_buffer2[0]='\x0';
-        strcat(temp_buffer2, "output=");
-        if(mod_gm_opt->debug_result) {
-            strcat(temp_buffer2, "(");
-            strcat(temp_buffer2, hostname);
-            strcat(temp_buffer2, ") - ");
-        }
-        strcat(temp_buffer2, exec_job->output);
-        if(mod_gm_opt->show_error_output && exec_job->error != NULL && strlen(exec_job->error) > 0) {
-            if(strlen(exec_job->output) > 0)
-                strcat(temp_buffer2, "\\n");
-            strcat(temp_buffer2, "[");
-            strcat(temp_buffer2, exec_job->error);
-            strcat(temp_buffer2, "] ");
-        }
-        strcat(temp_buffer2, "\n\n\n");
-        strcat(temp_buffer1, temp_buffer2);
-    }
-    strcat(temp_buffer1, "\n");
-    temp_buffer1[result_size]='\x0';
-
-    gm_log( GM_LOG_TRACE, "data:\n%s\n", temp_buffer1);
 
+    /* answer in the format of the job, the module which sent it understands it */
+    build_result(result, exec_job, exec_job->wire_format, FALSE);
+
+    gm_log( GM_LOG_TRACE, "data:\n%s\n", result->data);
+
+    /* a worker executes one job at a time, holding results back to batch
+     * them with add_jobs_to_queue() would only delay them */
     if(add_job_to_queue(&current_client,
                          mod_gm_opt->server_list,
                          exec_job->result_queue,
                          NULL,
-                         temp_buffer1,
+                         result->data,
                          GM_JOB_PRIO_NORMAL,
                          GM_DEFAULT_JOB_RETRIES,
                          mod_gm_opt->transportmode,
@@ -1736,17 +2085,13 @@ void send_result_back(gm_job_t * exec_job, EVP_CIPHER_CTX * ctx) {
     }
 
     if( mod_gm_opt->dupserver_num ) {
-        temp_buffer2[0]='\x0';
-        if(mod_gm_opt->dup_results_are_passive) {
-            strcat(temp_buffer2, "type=passive\n");
-        }
-        strcat(temp_buffer2, temp_buffer1);
-        temp_buffer2[result_size]='\x0';
+        /* duplicate results may be sent as passive results, always as text for any module version */
+        build_result(result, exec_job, GM_PAYLOAD_FORMAT_TEXT, mod_gm_opt->dup_results_are_passive);
         if( add_job_to_queue(&current_client_dup,
                               mod_gm_opt->dupserver_list,
                               exec_job->result_queue,
                               NULL,
-                              temp_buffer2,
+                              result->data,
                               GM_JOB_PRIO_NORMAL,
                               GM_DEFAULT_JOB_RETRIES,
                               mod_gm_opt->transportmode,
@@ -1763,8 +2108,7 @@ void send_result_back(gm_job_t * exec_job, EVP_CIPHER_CTX * ctx) {
     else {
         gm_log( GM_LOG_TRACE, "send_result_back() has no duplicate servers to send to.\n" );
     }
-    gm_free(temp_buffer1);
-    gm_free(temp_buffer2);
+    gm_buffer_free(&result);
     return;
 }
 
@@ -0,0 +1,117 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/** @file
+ *  @brief header for the admission control
+ *
+ *  A background thread polls the status of all gearmand servers and
+ *  estimates for each target queue how long a new job would wait. Checks for
+ *  queues exceeding admission_max_queue_depth or admission_max_queue_age are
+ *  handled by the admission_policy instead of adding to the backlog.
+ *
+ *  @{
+ */
+
+#include "mod_gearman.h"
+
+/**
+ * start_admission
+ *
+ * start the thread polling the gearmand servers, does nothing unless a limit
+ * is configured
+ *
+ * @return GM_OK on success
+ */
+int start_admission(void);
+
+/**
+ * stop_admission
+ *
+ * stop the polling thread
+ *
+ * @return nothing
+ */
+void stop_admission(void);
+
+/**
+ * admission_check
+ *
+ * decide what to do with a new check, must only be called from the core
+ * thread
+ *
+ * @param[in] queue - target queue
+ *
+ * @return GM_ADMISSION_ENQUEUE, GM_ADMISSION_LOCAL or GM_ADMISSION_POSTPONE
+ */
+int admission_check(const char * queue);
+
+/**
+ * admission_update
+ *
+ * update a queue with the numbers of a new poll, used by the polling thread
+ *
+ * @param[in] queue   - target queue
+ * @param[in] waiting - jobs waiting in gearmand, summed over all servers
+ * @param[in] workers - workers registered for this queue
+ * @param[in] elapsed - seconds since the last update
+ *
+ * @return nothing
+ */
+void admission_update(const char * queue, int waiting, int workers, int elapsed);
+
+/**
+ * admission_estimate_wait
+ *
+ * estimate how long a new job would wait in the queue
+ *
+ * @param[in] waiting      - jobs waiting now
+ * @param[in] last_waiting - jobs waiting at the last poll
+ * @param[in] submitted    - jobs sent since the last poll
+ * @param[in] last_wait    - estimate of the last poll
+ * @param[in] elapsed      - seconds since the last poll
+ *
+ * @return estimated wait time in seconds
+ */
+int admission_estimate_wait(int waiting, int last_waiting, unsigned long submitted, int last_wait, int elapsed);
+
+/**
+ * admission_overloaded
+ *
+ * decide if a queue is overloaded, a queue has to drop below half of the
+ * limits before it is accepted again
+ *
+ * @param[in] overloaded - current state
+ * @param[in] waiting    - jobs waiting
+ * @param[in] workers    - registered workers
+ * @param[in] wait       - estimated wait time in seconds
+ * @param[in] max_depth  - maximum waiting jobs, 0 for no limit
+ * @param[in] max_age    - maximum wait time, 0 for no limit
+ *
+ * @return TRUE if new checks should not be added
+ */
+int admission_overloaded(int overloaded, int waiting, int workers, int wait, int max_depth, int max_age);
+
+/**
+ * @}
+ */
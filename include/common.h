@@ -72,6 +72,7 @@
 #define GM_OK                           0
 #define GM_ERROR                        1
 #define GM_NO_EPN                      -1
+#define GM_QUEUE_FULL                   2
 
 #define GM_EXIT_UNKNOWN               768   /* results in exit code 3 after processed by WEXITSTATUS() */
 
@@ -117,6 +118,7 @@
 #define GM_ENCODE_AND_ENCRYPT           1
 #define GM_ENCODE_ONLY                  2
 #define GM_ENCODE_ACCEPT_ALL            3
+#define GM_ENCODE_NONE                  4      /**< data is already encrypted and encoded */
 
 /* dump config modes */
 #define GM_WORKER_MODE                  1
@@ -131,6 +133,59 @@
 #define GM_PERFDATA_OVERWRITE           1
 #define GM_PERFDATA_APPEND              2
 
+/* perfdata batching */
+#define GM_DEFAULT_PERFDATA_BATCH_SIZE  1       /**< records per perfdata job, 1 disables batching */
+#define GM_DEFAULT_PERFDATA_BATCH_BYTES 65536   /**< maximum size of a perfdata batch job */
+#define GM_DEFAULT_PERFDATA_BATCH_DELAY 1       /**< seconds a record may wait in a batch */
+
+/* submit queue overflow modes */
+#define GM_SUBMIT_OVERFLOW_BLOCK        1
+#define GM_SUBMIT_OVERFLOW_LOCAL        2
+#define GM_SUBMIT_OVERFLOW_DROP         3
+#define GM_DEFAULT_SUBMIT_QUEUE_SIZE 10000
+#define GM_DEFAULT_SUBMIT_BATCH_SIZE 100
+
+/* internal check handlers */
+#define GM_INTERNAL_CHECK_DUMMY         1       /**< check_dummy */
+#define GM_INTERNAL_CHECK_CONSTANT      2       /**< true / false */
+#define GM_INTERNAL_CHECK_COPY_STATE    4       /**< check_copy_state */
+#define GM_INTERNAL_CHECK_ALL           (GM_INTERNAL_CHECK_DUMMY|GM_INTERNAL_CHECK_CONSTANT|GM_INTERNAL_CHECK_COPY_STATE)
+
+/* sharding modes */
+#define GM_SHARD_NONE                   0
+#define GM_SHARD_HOST                   1
+#define GM_SHARD_SERVICE                2
+
+/* spool for jobs which could not be sent */
+#define GM_SPOOL_SEGMENT_SIZE           4194304 /**< size of a single spool file */
+#define GM_DEFAULT_SPOOL_MAX_SIZE       100     /**< maximum spool size in megabytes */
+#define GM_DEFAULT_SPOOL_MAX_AGE        3600    /**< discard spooled jobs older than that */
+#define GM_SPOOL_RETRY_INTERVAL         5       /**< seconds between replay attempts */
+
+/* admission control for overloaded queues */
+#define GM_ADMISSION_ENQUEUE            0       /**< send the check to gearmand anyway */
+#define GM_ADMISSION_LOCAL              1       /**< let the core execute the check */
+#define GM_ADMISSION_POSTPONE           2       /**< reschedule the check */
+#define GM_ADMISSION_POLL_INTERVAL      2       /**< seconds between polling the queue status */
+#define GM_DEFAULT_ADMISSION_POSTPONE   30      /**< seconds to postpone checks */
+
+/* negotiation of the wire format */
+#define GM_WIRE_NEGOTIATION_INTERVAL    10      /**< seconds between polling which workers accept binary jobs */
+
+/* scaling of the result worker threads */
+#define GM_RESULT_SCALE_INTERVAL        5       /**< seconds between result thread scaling decisions */
+#define GM_RESULT_SCALE_BACKLOG         100     /**< waiting results per thread which trigger a new thread */
+#define GM_RESULT_SCALE_BUSY_HIGH       0.75    /**< busy ratio which triggers a new result thread */
+#define GM_RESULT_SCALE_BUSY_LOW        0.25    /**< busy ratio below which idle result threads are stopped */
+
+/* recycling of check results */
+#define GM_RESULT_POOL_SIZE             1024    /**< unused check results kept per result thread */
+#define GM_RESULT_POOL_STRINGS_MIN      512     /**< initial string storage of a pooled check result */
+#define GM_RESULT_POOL_STRINGS_MAX      65536   /**< check results with larger string storage are not kept */
+
+/* default time in milliseconds spent per run moving results into the core */
+#define GM_DEFAULT_RESULT_INJECTION_BUDGET 20
+
 
 #ifndef TRUE
 #define TRUE                            1
@@ -207,14 +262,28 @@ typedef struct mod_gm_opt_struct {
     FILE         * logfile_fp;                              /**< filedescriptor for the logfile */
     int            log_stats_interval;                      /**< interval in seconds to log gearman submission statistics  */
     int            use_uniq_jobs;                           /**< flag whether normal jobs will be sent with/without uniq set */
+    int            submit_batch_size;                       /**< maximum number of jobs sent to gearmand at once */
 /* neb module */
     char         * result_queue;                            /**< name of the result queue used by the neb module */
     int            result_workers;                          /**< number of result worker threads started */
+    int            result_workers_max;                      /**< upper limit when scaling result worker threads */
+    int            result_injection_budget;                 /**< max. milliseconds spent per run to put results into the core */
+    int            submit_workers;                          /**< number of submit threads started */
+    int            submit_queue_size;                       /**< maximum number of jobs waiting in the submit queue */
+    int            submit_queue_overflow;                   /**< what to do with new jobs if the submit queue is full */
+    int            sharding;                                /**< send checks to a single server picked by host or service */
+    char         * spool_dir;                               /**< folder to spool jobs to when gearmand is unreachable */
+    int            spool_max_size;                          /**< maximum size of the spool in megabytes */
+    int            spool_max_age;                           /**< discard spooled jobs older than this amount of seconds */
+    char         * metrics_socket;                          /**< unix socket serving submission and result statistics */
     int            perfdata;                                /**< flag whether perfdata will be distributed or not */
     int            perfdata_mode;                           /**< flag whether perfdata will be sent with/without uniq set */
     int            perfdata_send_all;                       /**< flag whether perfdata will be sent to all queues */
     char         * perfdata_queues_list[GM_LISTSIZE];       /**< list of perfdata queue names */
     int            perfdata_queues_num;                     /**< number of perfdata queues */
+    int            perfdata_batch_size;                     /**< maximum number of perfdata records per job */
+    int            perfdata_batch_bytes;                    /**< maximum size of a perfdata batch in bytes */
+    int            perfdata_batch_delay;                    /**< maximum seconds a perfdata record is held back */
     char         * local_hostgroups_list[GM_LISTSIZE];      /**< list of hostgroups which will not be distributed */
     int            local_hostgroups_num;                    /**< number of elements in local_hostgroups_list */
     char         * local_servicegroups_list[GM_LISTSIZE];   /**< list of group  which will not be distributed */
@@ -222,13 +291,26 @@ typedef struct mod_gm_opt_struct {
     int            do_hostchecks;                           /**< flag whether mod-gearman will process hostchecks at all */
     int            route_eventhandler_like_checks;          /**< flag whether mod-gearman will route like normal checks */
     char         * queue_cust_var;                          /**< custom variable name which contains the target queue */
+    char         * priority_cust_var;                       /**< custom variable name which contains the priority class */
+    char         * priority_hostgroups_list[GM_LISTSIZE];   /**< list of hostgroups with a priority class */
+    int            priority_hostgroups_prio[GM_LISTSIZE];   /**< priority class for each element in priority_hostgroups_list */
+    int            priority_hostgroups_num;                 /**< number of elements in priority_hostgroups_list */
     mod_gm_exp_t * exports[GM_NEBTYPESSIZE];                /**< list of exporter queues */
     int            exports_count;                           /**< number of export queues */
+    int            export_coalesce_window;                  /**< send only the latest status per object within this amount of seconds */
     int            orphan_host_checks;                      /**< generate fake result for orphaned host checks */
     int            orphan_service_checks;                   /**< generate fake result for orphaned service checks */
+    int            orphan_grace;                            /**< seconds after the check timeout until a job without result is orphaned, 0 disables tracking */
     int            accept_clear_results;                    /**< accept unencrypted results */
     int            latency_flatten_window;                  /**< postpone high latency checks */
-    int            internal_check_dummy;                    /**< handle check_dummy checks internally */
+    int            internal_checks;                         /**< internal check handlers, GM_INTERNAL_CHECK_* flags */
+    int            admission_max_queue_depth;               /**< waiting jobs after which a queue is overloaded, 0 for no limit */
+    int            admission_max_queue_age;                 /**< estimated wait in seconds after which a queue is overloaded, 0 for no limit */
+    int            admission_policy;                        /**< GM_ADMISSION_* for checks to overloaded queues */
+    int            admission_postpone_delay;                /**< seconds to postpone checks to overloaded queues */
+    int            result_coalesce;                         /**< keep only the newest result per object in a batch */
+    int            result_coalesce_keep_state_changes;      /**< do not drop older results which change the state */
+    int            wire_format;                             /**< GM_PAYLOAD_FORMAT_* of jobs sent to the workers */
     char         * host_perfdata_template;                  /**< template used for host performance data */
     char         * service_perfdata_template;               /**< template used for service performance data */
 /* worker */
@@ -301,6 +383,7 @@ typedef struct gm_job_struct {
     struct timeval start_time;          /**< time when the job really started */
     struct timeval finish_time;         /**< time when the job was finished */
     int            has_been_sent;       /**< flag if job has been sent back */
+    int            wire_format;         /**< format of the job, the result is sent back in the same format */
 } gm_job_t;
 
 /*
@@ -0,0 +1,117 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/** @file
+ *  @brief header for the neb export engine
+ *
+ *  Serializes the data of all neb callbacks as json and sends it to the
+ *  configured export queues. Host and service status updates fire on every
+ *  check, so they can be coalesced: within the export_coalesce_window only
+ *  the latest status of each object is sent.
+ *
+ *  @{
+ */
+
+#include "mod_gearman.h"
+#include "gm_buffer.h"
+
+/**
+ * export_serialize
+ *
+ * append the json representation of a neb callback
+ *
+ * @param[in] buf           - buffer
+ * @param[in] callback_type - neb callback type
+ * @param[in] data          - neb callback data
+ *
+ * @return GM_OK on success, GM_ERROR for unknown callback types
+ */
+int export_serialize(gm_buffer_t * buf, int callback_type, void * data);
+
+/**
+ * export_send
+ *
+ * send serialized data to all export queues of this callback type
+ *
+ * @param[in] callback_type - neb callback type
+ * @param[in] buf           - serialized data
+ *
+ * @return nothing
+ */
+void export_send(int callback_type, gm_buffer_t * buf);
+
+/**
+ * export_coalesce_init
+ *
+ * allocate the pending status tables, must be called after the objects
+ * have been created
+ *
+ * @return nothing
+ */
+void export_coalesce_init(void);
+
+/**
+ * export_coalesce_add
+ *
+ * remember a status update to be sent later
+ *
+ * @param[in] callback_type - neb callback type
+ * @param[in] data          - neb callback data
+ *
+ * @return TRUE if the update has been held back, FALSE if it should be sent now
+ */
+int export_coalesce_add(int callback_type, void * data);
+
+/**
+ * export_coalesce_flush
+ *
+ * send the latest status of all updated objects
+ *
+ * @return nothing
+ */
+void export_coalesce_flush(void);
+
+/**
+ * export_coalesce_tick
+ *
+ * flush pending updates once the window has passed
+ *
+ * @param[in] now - current time
+ *
+ * @return nothing
+ */
+void export_coalesce_tick(time_t now);
+
+/**
+ * export_coalesce_free
+ *
+ * send pending updates and free the tables
+ *
+ * @return nothing
+ */
+void export_coalesce_free(void);
+
+/**
+ * @}
+ */
@@ -37,15 +37,47 @@
 #include <unistd.h>
 #include <assert.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include "libgearman-1.0/gearman.h"
 #include "openssl/evp.h"
 
+/** job to be sent to gearmand */
+typedef struct gm_submit_job_struct {
+    char * queue;                   /**< target queue name */
+    char * uniq;                    /**< optional uniq key or NULL */
+    char * data;                    /**< plain text job data */
+    int    priority;                /**< job priority */
+    int    retries;                 /**< number of retries on errors */
+    unsigned int shard;             /**< shard key or 0 if the job may go to any server */
+    int    status;                  /**< GM_OK once gearmand has accepted the job */
+} gm_submit_job_t;
+
 typedef void*( mod_gm_worker_fn)(gearman_job_st *job, void *context, size_t *result_size, gearman_return_t *ret_ptr);
 
 gearman_client_st * create_client( gm_server_t * server_list[GM_LISTSIZE]);
 gearman_client_st * create_client_blocking( gm_server_t * server_list[GM_LISTSIZE]);
 gearman_worker_st * create_worker(gm_server_t * server_list[GM_LISTSIZE]);
 int add_job_to_queue(gearman_client_st **client, gm_server_t * server_list[GM_LISTSIZE], char * queue, char * uniq, char * data, int priority, int retries, int transport_mode, EVP_CIPHER_CTX * ctx, int async, int stats_log_interval);
+
+/**
+ * add_jobs_to_queue
+ *
+ * send a batch of jobs to gearmand. All jobs are written back to back and the
+ * acknowledgements are collected afterwards, so the whole batch only costs a
+ * single round trip. Failed jobs are resent as long as they have retries left.
+ *
+ * @param[in] client - gearman client, will be recreated on errors
+ * @param[in] server_list - list of gearmand servers
+ * @param[in,out] jobs - list of jobs, status will be set for each job
+ * @param[in] num - number of jobs
+ * @param[in] transport_mode - encryption mode
+ * @param[in] ctx - openssl context
+ * @param[in] async - recreate client with non-blocking io
+ * @param[in] log_stats_interval - interval to log submission statistics
+ *
+ * @return GM_OK if all jobs have been sent, GM_ERROR otherwise
+ */
+int add_jobs_to_queue(gearman_client_st **client, gm_server_t * server_list[GM_LISTSIZE], gm_submit_job_t ** jobs, int num, int transport_mode, EVP_CIPHER_CTX * ctx, int async, int log_stats_interval);
 int worker_add_function( gearman_worker_st * worker, char * queue, gearman_worker_fn *function);
 void gm_free_client(gearman_client_st **client);
 void gm_free_worker(gearman_worker_st **worker);
@@ -0,0 +1,149 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/** @file
+ *  @brief growable string buffer
+ *
+ *  Used to assemble jobs without a fixed size static buffer. Buffers grow as
+ *  needed and give memory back on reset after an unusually large job.
+ *
+ *  @{
+ */
+
+#ifndef _GM_BUFFER_H
+#define _GM_BUFFER_H
+
+#include <stddef.h>
+#include <sys/time.h>
+
+/** initial size of a new buffer */
+#define GM_BUFFER_INITIAL_SIZE  4096
+
+/** buffers larger than this are shrunk on reset */
+#define GM_BUFFER_SHRINK_SIZE   65536
+
+/** growable string buffer */
+typedef struct gm_buffer_struct {
+    char   * data;              /**< zero terminated content */
+    size_t   len;               /**< length of the content */
+    size_t   size;              /**< allocated size */
+} gm_buffer_t;
+
+/**
+ * gm_buffer_new
+ *
+ * @return new empty buffer
+ */
+gm_buffer_t * gm_buffer_new(void);
+
+/**
+ * gm_buffer_free
+ *
+ * @param[in,out] buf - buffer to free, will be set to NULL
+ *
+ * @return nothing
+ */
+void gm_buffer_free(gm_buffer_t ** buf);
+
+/**
+ * gm_buffer_reset
+ *
+ * empty the buffer, releases memory if it has grown too large
+ *
+ * @param[in] buf - buffer
+ *
+ * @return nothing
+ */
+void gm_buffer_reset(gm_buffer_t * buf);
+
+/**
+ * gm_buffer_append
+ *
+ * @param[in] buf  - buffer
+ * @param[in] data - data to append
+ * @param[in] len  - length of data
+ *
+ * @return nothing
+ */
+void gm_buffer_append(gm_buffer_t * buf, const char * data, size_t len);
+
+/**
+ * gm_buffer_append_str
+ *
+ * @param[in] buf - buffer
+ * @param[in] str - string to append, NULL is appended as "(null)"
+ *
+ * @return nothing
+ */
+void gm_buffer_append_str(gm_buffer_t * buf, const char * str);
+
+/**
+ * gm_buffer_append_int
+ *
+ * @param[in] buf   - buffer
+ * @param[in] value - number to append
+ *
+ * @return nothing
+ */
+void gm_buffer_append_int(gm_buffer_t * buf, long long value);
+
+/**
+ * gm_buffer_append_time
+ *
+ * append a timestamp as seconds with 6 decimals, same as "%Lf" would print
+ * it for timeval2double()
+ *
+ * @param[in] buf  - buffer
+ * @param[in] usec - timestamp in microseconds
+ *
+ * @return nothing
+ */
+void gm_buffer_append_time(gm_buffer_t * buf, long long usec);
+
+/**
+ * gm_buffer_printf
+ *
+ * append formated string
+ *
+ * @param[in] buf - buffer
+ * @param[in] fmt - format
+ *
+ * @return nothing
+ */
+void gm_buffer_printf(gm_buffer_t * buf, const char * fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * timeval2usec
+ *
+ * @param[in] t - timeval
+ *
+ * @return timestamp in microseconds
+ */
+long long timeval2usec(struct timeval * t);
+
+#endif
+
+/**
+ * @}
+ */
@@ -88,6 +88,20 @@ int mod_gm_aes_decrypt(EVP_CIPHER_CTX * ctx, unsigned char * plaintext, unsigned
  */
 void mod_gm_hexsum(char *dest, char *text);
 
+/**
+ * create non cryptographic 128 bit hex sum of text (MurmurHash3 x64_128)
+ *
+ * much faster than mod_gm_hexsum, use it for identifiers which do not need
+ * to be compatible with other tools
+ *
+ * @param[out] dest - pointer to hex sum, must hold 33 bytes
+ * @param[in] text  - source text
+ * @param[in] len   - length of text
+ *
+ * @return nothing
+ */
+void mod_gm_fasthexsum(char *dest, const char *text, size_t len);
+
 /**
  * decode base64 encoded data
  *
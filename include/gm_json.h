@@ -0,0 +1,142 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/** @file
+ *  @brief streaming json writer
+ *
+ *  Appends json objects to a growable buffer without intermediate copies.
+ *  Strings without special characters are copied in one go, only strings
+ *  which need escaping are written piecewise.
+ *
+ *  @{
+ */
+
+#ifndef _GM_JSON_H
+#define _GM_JSON_H
+
+#include "gm_buffer.h"
+
+/**
+ * gm_json_open
+ *
+ * start a new object, either top level or as value of the last key
+ *
+ * @param[in] buf - buffer
+ *
+ * @return nothing
+ */
+void gm_json_open(gm_buffer_t * buf);
+
+/**
+ * gm_json_close
+ *
+ * finish the current object
+ *
+ * @param[in] buf - buffer
+ *
+ * @return nothing
+ */
+void gm_json_close(gm_buffer_t * buf);
+
+/**
+ * gm_json_key
+ *
+ * append a key, separated from the previous member if necessary
+ *
+ * @param[in] buf - buffer
+ * @param[in] key - key, must not need escaping
+ *
+ * @return nothing
+ */
+void gm_json_key(gm_buffer_t * buf, const char * key);
+
+/**
+ * gm_json_escape
+ *
+ * append escaped string without quotes
+ *
+ * @param[in] buf - buffer
+ * @param[in] str - string
+ *
+ * @return nothing
+ */
+void gm_json_escape(gm_buffer_t * buf, const char * str);
+
+/**
+ * gm_json_str
+ *
+ * append string member, NULL is written as null
+ *
+ * @param[in] buf   - buffer
+ * @param[in] key   - key
+ * @param[in] value - value
+ *
+ * @return nothing
+ */
+void gm_json_str(gm_buffer_t * buf, const char * key, const char * value);
+
+/**
+ * gm_json_int
+ *
+ * append integer member
+ *
+ * @param[in] buf   - buffer
+ * @param[in] key   - key
+ * @param[in] value - value
+ *
+ * @return nothing
+ */
+void gm_json_int(gm_buffer_t * buf, const char * key, long long value);
+
+/**
+ * gm_json_double
+ *
+ * append floating point member
+ *
+ * @param[in] buf   - buffer
+ * @param[in] key   - key
+ * @param[in] value - value
+ *
+ * @return nothing
+ */
+void gm_json_double(gm_buffer_t * buf, const char * key, double value);
+
+/**
+ * gm_json_timeval
+ *
+ * append timestamp member as seconds with 6 decimals
+ *
+ * @param[in] buf   - buffer
+ * @param[in] key   - key
+ * @param[in] value - timestamp
+ *
+ * @return nothing
+ */
+void gm_json_timeval(gm_buffer_t * buf, const char * key, struct timeval * value);
+
+#endif
+
+/**
+ * @}
+ */
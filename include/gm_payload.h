@@ -0,0 +1,329 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/** @file
+ *  @brief key/value payload of jobs and results
+ *
+ *  Jobs and results are sent as newline separated key=value lines. All keys
+ *  are listed once in GM_PAYLOAD_KEYS, the encoders and the decoders of the
+ *  neb module, the worker and the tools use the generated names so both
+ *  sides always agree.
+ *
+ *  The parser works in place: lines are split with memchr, keys are looked
+ *  up in a collision free hash table and values stay slices of the parsed
+ *  buffer.
+ *
+ *  Payloads can also be written in a compact binary format. It starts with
+ *  a header of the magic "\x7fGMB", a version byte and the length of the
+ *  records as 32 bit little endian. Each record is the key id as tag byte.
+ *  Strings follow as 32 bit length, the raw bytes and a zero byte, so they
+ *  can be used in place. Numbers have the GM_PAYLOAD_TAG_NUM bit set in the
+ *  tag and follow as 64 bit little endian integer, timestamps are sent in
+ *  microseconds. Output is never escaped in the binary format.
+ *
+ *  The decoder accepts both formats. The neb module sends binary jobs only
+ *  when enabled with wire_format=binary and only to queues whose workers
+ *  all registered the queue with GM_PAYLOAD_BINARY_SUFFIX. Workers answer in
+ *  the format of the job, so old workers and modules keep talking the text
+ *  format.
+ *
+ *  @{
+ */
+
+#ifndef _GM_PAYLOAD_H
+#define _GM_PAYLOAD_H
+
+#include <stddef.h>
+
+#include "gm_buffer.h"
+
+/** all known keys, X(ID, key) */
+#define GM_PAYLOAD_KEYS(X) \
+    X(TYPE,                 type) \
+    X(RESULT_QUEUE,         result_queue) \
+    X(TARGET_QUEUE,         target_queue) \
+    X(HOST_NAME,            host_name) \
+    X(SERVICE_DESCRIPTION,  service_description) \
+    X(CONTACT,              contact) \
+    X(CHECK_OPTIONS,        check_options) \
+    X(SCHEDULED_CHECK,      scheduled_check) \
+    X(LATENCY,              latency) \
+    X(NEXT_CHECK,           next_check) \
+    X(START_TIME,           start_time) \
+    X(CORE_TIME,            core_time) \
+    X(CORE_START_TIME,      core_start_time) \
+    X(FINISH_TIME,          finish_time) \
+    X(TIMEOUT,              timeout) \
+    X(COMMAND_LINE,         command_line) \
+    X(PLUGIN_OUTPUT,        plugin_output) \
+    X(LONG_PLUGIN_OUTPUT,   long_plugin_output) \
+    X(RETURN_CODE,          return_code) \
+    X(EXITED_OK,            exited_ok) \
+    X(EARLY_TIMEOUT,        early_timeout) \
+    X(SOURCE,               source) \
+    X(OUTPUT,               output)
+
+/** payload keys, GM_PAYLOAD_HOST_NAME etc. */
+#define GM_PAYLOAD_ENUM(id, key) GM_PAYLOAD_##id,
+enum gm_payload_key {
+    GM_PAYLOAD_KEYS(GM_PAYLOAD_ENUM)
+    GM_PAYLOAD_KEY_NUM
+};
+#undef GM_PAYLOAD_ENUM
+
+/** wire formats */
+#define GM_PAYLOAD_FORMAT_TEXT      0       /**< key=value lines */
+#define GM_PAYLOAD_FORMAT_BINARY    1       /**< tagged binary records */
+
+#define GM_PAYLOAD_MAGIC            "\x7fGMB"  /**< start of binary payloads */
+#define GM_PAYLOAD_MAGIC_SIZE       4
+#define GM_PAYLOAD_VERSION          1       /**< version of the binary format */
+#define GM_PAYLOAD_HEADER_SIZE      9       /**< magic, version and length of the records */
+#define GM_PAYLOAD_BINARY_SUFFIX    "@binary"  /**< workers accepting binary jobs of a queue also register queue@binary */
+#define GM_PAYLOAD_TAG_NUM          0x80    /**< tag bit of records with a 64 bit number */
+
+/** size of the key hash table, must be a power of 2 */
+#define GM_PAYLOAD_HASH_SIZE    64
+
+/** parsed payload */
+typedef struct gm_payload_struct {
+    char       * value[GM_PAYLOAD_KEY_NUM]; /**< zero terminated value inside the parsed buffer, NULL if missing */
+    size_t       len[GM_PAYLOAD_KEY_NUM];   /**< length of the value */
+    long long    num[GM_PAYLOAD_KEY_NUM];   /**< numbers of binary payloads */
+    unsigned int numeric;                   /**< bit per key with a value in num */
+    int          found;                     /**< number of known keys with a value */
+    int          format;                    /**< GM_PAYLOAD_FORMAT_* of the parsed payload */
+} gm_payload_t;
+
+/** key names indexed by enum gm_payload_key */
+extern const char * const gm_payload_keys[GM_PAYLOAD_KEY_NUM];
+
+/**
+ * gm_payload_key
+ *
+ * look up a key
+ *
+ * @param[in] key - key, does not need to be zero terminated
+ * @param[in] len - length of the key
+ *
+ * @return enum gm_payload_key or -1 for unknown keys
+ */
+int gm_payload_key(const char * key, size_t len);
+
+/**
+ * gm_payload_probes
+ *
+ * @param[in] key - enum gm_payload_key
+ *
+ * @return number of probes needed to find this key in the hash table
+ */
+int gm_payload_probes(int key);
+
+/**
+ * gm_payload_parse
+ *
+ * split a payload into its values. The buffer is modified, newlines and
+ * separators are replaced by zero bytes. Parsing stops at the first line
+ * without value, which is the end marker of all jobs and results.
+ * Unknown keys are ignored.
+ *
+ * @param[out] payload - parsed values
+ * @param[in]  data    - payload, will be modified
+ * @param[in]  size    - length of the payload
+ *
+ * @return number of known keys with a value
+ */
+int gm_payload_parse(gm_payload_t * payload, char * data, size_t size);
+
+/**
+ * gm_payload_decode
+ *
+ * split a text or binary payload into its values, the buffer is modified.
+ * Binary payloads with an unknown version or broken records are rejected.
+ *
+ * @param[out] payload - parsed values
+ * @param[in]  data    - payload, will be modified
+ * @param[in]  size    - size of the buffer, binary payloads may be shorter
+ *
+ * @return number of known keys with a value
+ */
+int gm_payload_decode(gm_payload_t * payload, char * data, size_t size);
+
+/**
+ * gm_payload_is_binary
+ *
+ * @param[in] data - payload
+ * @param[in] size - size of the buffer
+ *
+ * @return true if data starts with a binary header which fits into size
+ */
+int gm_payload_is_binary(const char * data, size_t size);
+
+/**
+ * gm_payload_size
+ *
+ * @param[in] data - zero terminated text payload or binary payload
+ *
+ * @return size of the payload without trailing zero byte
+ */
+size_t gm_payload_size(const char * data);
+
+/**
+ * gm_payload_value
+ *
+ * @param[in] payload - parsed payload
+ * @param[in] key     - enum gm_payload_key
+ *
+ * @return value or NULL if the key is missing or empty
+ */
+char * gm_payload_value(gm_payload_t * payload, int key);
+
+/**
+ * gm_payload_int
+ *
+ * @param[in]  payload - parsed payload
+ * @param[in]  key     - enum gm_payload_key
+ * @param[out] value   - number
+ *
+ * @return true if the key has a value
+ */
+int gm_payload_int(gm_payload_t * payload, int key, long long * value);
+
+/**
+ * gm_payload_time
+ *
+ * @param[in]  payload - parsed payload
+ * @param[in]  key     - enum gm_payload_key
+ * @param[out] t       - timestamp
+ *
+ * @return true if the key has a value
+ */
+int gm_payload_time(gm_payload_t * payload, int key, struct timeval * t);
+
+/**
+ * gm_payload_unescape
+ *
+ * replace escaped newlines in place
+ *
+ * @param[in] value - zero terminated value
+ * @param[in] len   - length of the value
+ *
+ * @return new length of the value
+ */
+size_t gm_payload_unescape(char * value, size_t len);
+
+/**
+ * gm_payload_begin
+ *
+ * empty the buffer and start a new payload, all following appends use the
+ * format given here
+ *
+ * @param[in] buf    - buffer
+ * @param[in] format - GM_PAYLOAD_FORMAT_*
+ *
+ * @return nothing
+ */
+void gm_payload_begin(gm_buffer_t * buf, int format);
+
+/**
+ * gm_payload_append
+ *
+ * append a key=value line or string record, NULL values are written as (null)
+ *
+ * @param[in] buf   - buffer
+ * @param[in] key   - enum gm_payload_key
+ * @param[in] value - value
+ *
+ * @return nothing
+ */
+void gm_payload_append(gm_buffer_t * buf, int key, const char * value);
+
+/**
+ * gm_payload_append_int
+ *
+ * append a key=value line or number record with an integer value
+ *
+ * @param[in] buf   - buffer
+ * @param[in] key   - enum gm_payload_key
+ * @param[in] value - value
+ *
+ * @return nothing
+ */
+void gm_payload_append_int(gm_buffer_t * buf, int key, long long value);
+
+/**
+ * gm_payload_append_time
+ *
+ * append a key=value line with a timestamp as seconds.microseconds or a
+ * number record with the timestamp in microseconds
+ *
+ * @param[in] buf  - buffer
+ * @param[in] key  - enum gm_payload_key
+ * @param[in] usec - timestamp in microseconds
+ *
+ * @return nothing
+ */
+void gm_payload_append_time(gm_buffer_t * buf, int key, long long usec);
+
+/**
+ * gm_payload_open
+ *
+ * start a value which is appended piecewise to the buffer
+ *
+ * @param[in] buf - buffer
+ * @param[in] key - enum gm_payload_key
+ *
+ * @return offset of the value in the buffer
+ */
+size_t gm_payload_open(gm_buffer_t * buf, int key);
+
+/**
+ * gm_payload_close
+ *
+ * finish a value started with gm_payload_open. Escaped newlines of binary
+ * payloads are replaced, binary values are sent raw.
+ *
+ * @param[in] buf    - buffer
+ * @param[in] offset - offset returned by gm_payload_open
+ *
+ * @return nothing
+ */
+void gm_payload_close(gm_buffer_t * buf, size_t offset);
+
+/**
+ * gm_payload_end
+ *
+ * append the end marker, binary payloads get the final length in their header
+ *
+ * @param[in] buf - buffer
+ *
+ * @return nothing
+ */
+void gm_payload_end(gm_buffer_t * buf);
+
+#endif
+
+/**
+ * @}
+ */
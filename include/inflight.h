@@ -0,0 +1,117 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief header for the in-flight job table
+ *
+ *  Every check sent to gearmand is remembered until its result arrives.
+ *  Jobs are sorted into a timing wheel by their deadline (check timeout plus
+ *  orphan_grace), so overdue jobs can be turned into orphaned results right
+ *  away instead of waiting for the core to notice. The table also knows the
+ *  number of outstanding jobs per queue.
+ *
+ *  All functions are thread safe, results are removed from the result
+ *  threads while the core thread adds new jobs.
+ *
+ *  @{
+ */
+
+#include "mod_gearman.h"
+
+/** number of seconds covered by one round of the timing wheel, must be a power of 2 */
+#define INFLIGHT_WHEEL_SIZE 1024
+
+/** callback for overdue jobs */
+typedef void (*inflight_orphan_cb)(host * hst, service * svc, const char * queue);
+
+/**
+ * inflight_init
+ *
+ * allocate the job table, must be called after the objects have been created
+ *
+ * @param[in] now - current time
+ *
+ * @return nothing
+ */
+void inflight_init(time_t now);
+
+/**
+ * inflight_free
+ *
+ * forget all jobs and free the table
+ *
+ * @return nothing
+ */
+void inflight_free(void);
+
+/**
+ * inflight_add
+ *
+ * remember a submitted check, replaces an older job of the same object
+ *
+ * @param[in] hst      - host
+ * @param[in] svc      - service or NULL for host checks
+ * @param[in] queue    - target queue
+ * @param[in] deadline - time when the job is considered orphaned
+ *
+ * @return nothing
+ */
+void inflight_add(host * hst, service * svc, const char * queue, time_t deadline);
+
+/**
+ * inflight_remove
+ *
+ * forget a job once its result arrived
+ *
+ * @param[in] host_name           - host name
+ * @param[in] service_description - service description or NULL for host checks
+ *
+ * @return TRUE if the job was known, FALSE otherwise
+ */
+int inflight_remove(const char * host_name, const char * service_description);
+
+/**
+ * inflight_expire
+ *
+ * remove all jobs with a deadline up to now and pass them to the callback.
+ * The callback runs while the table is locked and must not use it.
+ *
+ * @param[in] now      - current time
+ * @param[in] callback - called for each overdue job
+ *
+ * @return number of overdue jobs
+ */
+int inflight_expire(time_t now, inflight_orphan_cb callback);
+
+/**
+ * inflight_count
+ *
+ * @param[in] queue - queue name or NULL for all queues
+ *
+ * @return number of outstanding jobs
+ */
+int inflight_count(const char * queue);
+
+/**
+ * @}
+ */
@@ -0,0 +1,76 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/** @file
+ *  @brief header for the host and service name table
+ *
+ *  Maps host names and service descriptions of incoming results to the
+ *  objects of the core. The table is built once from the object
+ *  configuration and only read afterwards, so the result threads can use
+ *  it without locking. Results can then point to the names of the objects
+ *  instead of copies, and results for unknown objects are dropped before
+ *  they cost any time in the core.
+ *
+ *  @{
+ */
+
+#include "mod_gearman.h"
+
+/**
+ * intern_init
+ *
+ * build the table, must be called after the objects have been created and
+ * only once
+ *
+ * @return nothing
+ */
+void intern_init(void);
+
+/**
+ * intern_free
+ *
+ * free the table, no result thread must be running anymore
+ *
+ * @return nothing
+ */
+void intern_free(void);
+
+/**
+ * intern_lookup
+ *
+ * find the object of a result, safe to call from any thread
+ *
+ * @param[in]  host_name           - host name
+ * @param[in]  service_description - service description or NULL for hosts
+ * @param[out] hst                 - host, NULL if the table has not been built yet
+ * @param[out] svc                 - service, NULL for hosts or if the table has not been built yet
+ *
+ * @return GM_OK if the object exists or the table has not been built yet,
+ *         GM_ERROR for unknown objects
+ */
+int intern_lookup(const char * host_name, const char * service_description, host ** hst, service ** svc);
+
+/**
+ * @}
+ */
@@ -0,0 +1,89 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief header for internal checks
+ *
+ *  Some checks are trivial enough to be answered by the neb module itself,
+ *  which saves the gearmand round trip and the fork on the worker. The
+ *  command line of each object is parsed once and the result is cached per
+ *  host and service until the command line changes.
+ *
+ *  Supported checks:
+ *   - check_dummy <state> [<output>]
+ *   - true and false without arguments
+ *   - check_copy_state <host> [<service>], returns the current state and
+ *     output of another host or service
+ *
+ *  @{
+ */
+
+#include "mod_gearman.h"
+
+/**
+ * internal_checks_init
+ *
+ * allocate the per object cache, must be called after the objects have been
+ * created
+ *
+ * @return nothing
+ */
+void internal_checks_init(void);
+
+/**
+ * internal_checks_free
+ *
+ * free the cache and log the final statistics
+ *
+ * @return nothing
+ */
+void internal_checks_free(void);
+
+/**
+ * internal_check_execute
+ *
+ * answer a check internally if possible
+ *
+ * @param[in]  command_line - processed command line
+ * @param[in]  hst          - host
+ * @param[in]  svc          - service or NULL for host checks
+ * @param[out] return_code  - plugin return code
+ * @param[out] output       - plugin output, must be freed by the caller
+ *
+ * @return GM_OK if the check has been answered, GM_ERROR if it has to be
+ *         executed by a worker
+ */
+int internal_check_execute(const char * command_line, host * hst, service * svc, int * return_code, char ** output);
+
+/**
+ * internal_checks_served
+ *
+ * @param[in] handler - GM_INTERNAL_CHECK_* flag of a single handler
+ *
+ * @return number of checks answered by this handler
+ */
+unsigned long internal_checks_served(int handler);
+
+/**
+ * @}
+ */
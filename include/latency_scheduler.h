@@ -0,0 +1,108 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief header for the latency flattening scheduler
+ *
+ *  Checks with a high latency are postponed to spread the load after
+ *  restarts and outages. A timing wheel counts the upcoming submissions per
+ *  second and target queue, so postponed checks can be placed into the least
+ *  loaded second of the flatten window instead of a random one.
+ *
+ *  @{
+ */
+
+#include "mod_gearman.h"
+
+/** number of seconds covered by the timing wheel, must be a power of 2 */
+#define LATENCY_WHEEL_SIZE 4096
+
+/**
+ * latency_scheduler_init
+ *
+ * reset the timing wheel
+ *
+ * @param[in] now - current time
+ *
+ * @return nothing
+ */
+void latency_scheduler_init(time_t now);
+
+/**
+ * latency_scheduler_free
+ *
+ * free all timing wheels
+ *
+ * @return nothing
+ */
+void latency_scheduler_free(void);
+
+/**
+ * latency_scheduler_advance
+ *
+ * move the wheel forward and forget elapsed seconds
+ *
+ * @param[in] now - current time
+ *
+ * @return nothing
+ */
+void latency_scheduler_advance(time_t now);
+
+/**
+ * latency_scheduler_add
+ *
+ * count a scheduled submission
+ *
+ * @param[in] queue - target queue
+ * @param[in] when  - time of the submission
+ *
+ * @return nothing
+ */
+void latency_scheduler_add(const char * queue, time_t when);
+
+/**
+ * latency_scheduler_place
+ *
+ * count a postponed submission in the least loaded second after it
+ *
+ * @param[in] queue     - target queue
+ * @param[in] when      - currently scheduled time
+ * @param[in] delay_max - maximum delay in seconds
+ *
+ * @return new time of the submission, always later than when
+ */
+time_t latency_scheduler_place(const char * queue, time_t when, int delay_max);
+
+/**
+ * latency_scheduler_load
+ *
+ * @param[in] queue - target queue
+ * @param[in] when  - time
+ *
+ * @return number of submissions scheduled for this second
+ */
+unsigned int latency_scheduler_load(const char * queue, time_t when);
+
+/**
+ * @}
+ */
@@ -0,0 +1,157 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief header for the neb module metrics socket
+ *
+ *  Submission and result statistics are collected in atomic counters, so
+ *  neither the core nor the result and submit threads ever wait for a
+ *  reader. A separate thread serves them in the Prometheus text format on
+ *  the unix socket set by metrics_socket. Plain GET requests are answered
+ *  with a http header, so the socket can be scraped directly.
+ *
+ *  @{
+ */
+
+#include "mod_gearman.h"
+#include "gm_buffer.h"
+
+/** maximum number of queues with separate statistics, further queues are summed up as "other" */
+#define METRICS_MAX_QUEUES 256
+
+/**
+ * start_metrics
+ *
+ * create the metrics socket and start the thread serving it
+ *
+ * @return GM_OK on success, GM_ERROR otherwise
+ */
+int start_metrics(void);
+
+/**
+ * stop_metrics
+ *
+ * stop the metrics thread and remove the socket
+ *
+ * @return nothing
+ */
+void stop_metrics(void);
+
+/**
+ * metrics_free
+ *
+ * free the statistics, must only be called once all threads are stopped
+ *
+ * @return nothing
+ */
+void metrics_free(void);
+
+/**
+ * metrics_submit
+ *
+ * count a job sent to gearmand
+ *
+ * @param[in] queue    - target queue
+ * @param[in] success  - TRUE if the job has been accepted by gearmand
+ * @param[in] duration - submit duration in microseconds
+ *
+ * @return nothing
+ */
+void metrics_submit(const char * queue, int success, long long duration);
+
+/**
+ * metrics_admission
+ *
+ * count a decision for a check to an overloaded queue
+ *
+ * @param[in] queue    - target queue
+ * @param[in] decision - GM_ADMISSION_*
+ *
+ * @return nothing
+ */
+void metrics_admission(const char * queue, int decision);
+
+/**
+ * metrics_result_received
+ *
+ * count a result received from a worker
+ *
+ * @return nothing
+ */
+void metrics_result_received(void);
+
+/**
+ * metrics_result_unknown
+ *
+ * count a result for an unknown host or service
+ *
+ * @return nothing
+ */
+void metrics_result_unknown(void);
+
+/**
+ * metrics_result_added
+ *
+ * count a result added to the result list
+ *
+ * @return nothing
+ */
+void metrics_result_added(void);
+
+/**
+ * metrics_results_injected
+ *
+ * count results moved into the core during one run
+ *
+ * @param[in] count    - number of results
+ * @param[in] duration - duration of the run in microseconds
+ *
+ * @return nothing
+ */
+void metrics_results_injected(int count, long long duration);
+
+/**
+ * metrics_results_coalesced
+ *
+ * count stale results dropped before reaching the core
+ *
+ * @param[in] count - number of results
+ *
+ * @return nothing
+ */
+void metrics_results_coalesced(int count);
+
+/**
+ * metrics_render
+ *
+ * write all metrics in the Prometheus text format
+ *
+ * @param[out] buf - target buffer
+ *
+ * @return nothing
+ */
+void metrics_render(gm_buffer_t * buf);
+
+/**
+ * @}
+ */
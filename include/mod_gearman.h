@@ -33,6 +33,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <pthread.h>
 
 /** @file
@@ -79,7 +80,16 @@ int nebmodule_init( int flags, char * args, nebmodule * handle);
  */
 int nebmodule_deinit( int flags, int reason );
 
+/** allocate a new check result which can be added to the result list
+ *
+ * @return new initialized check result
+ */
+check_result * mod_gm_new_check_result(void);
+
 /** adds check result to result list
+ *
+ * the check result must have been allocated by mod_gm_new_check_result()
+ * or result_pool_get()
  *
  * @param[in] newcheckresult - new checkresult structure to add to list
  *
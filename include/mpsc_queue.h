@@ -0,0 +1,103 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief intrusive multi-producer/single-consumer queue
+ *
+ *  Producers push nodes embedded in their own structures without taking a
+ *  lock or allocating memory. The single consumer takes the whole queue at
+ *  once and gets the nodes back in FIFO order.
+ *
+ *  @{
+ */
+
+#ifndef _MPSC_QUEUE_H
+#define _MPSC_QUEUE_H
+
+#include <stddef.h>
+
+/** queue node, embed this into the queued structure */
+typedef struct mpsc_queue_node_struct {
+    struct mpsc_queue_node_struct * next;   /**< next node */
+} mpsc_queue_node_t;
+
+/** queue head */
+typedef struct mpsc_queue_struct {
+    mpsc_queue_node_t * head;               /**< last pushed node */
+} mpsc_queue_t;
+
+/** static initializer for a mpsc queue */
+#define MPSC_QUEUE_INITIALIZER { NULL }
+
+/** get the containing structure from a queue node */
+#define mpsc_queue_entry(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+
+/**
+ * mpsc_queue_init
+ *
+ * initialize an empty queue
+ *
+ * @param[in] queue - queue to initialize
+ *
+ * @return nothing
+ */
+void mpsc_queue_init(mpsc_queue_t * queue);
+
+/**
+ * mpsc_queue_push
+ *
+ * add a node to the queue, safe to call from any number of threads
+ *
+ * @param[in] queue - queue to add to
+ * @param[in] node  - node to add
+ *
+ * @return TRUE if the queue was empty before
+ */
+int mpsc_queue_push(mpsc_queue_t * queue, mpsc_queue_node_t * node);
+
+/**
+ * mpsc_queue_take_all
+ *
+ * remove all nodes from the queue at once, must only be called
+ * from a single consumer thread
+ *
+ * @param[in] queue - queue to empty
+ *
+ * @return list of nodes in FIFO order or NULL if the queue was empty
+ */
+mpsc_queue_node_t * mpsc_queue_take_all(mpsc_queue_t * queue);
+
+/**
+ * mpsc_queue_is_empty
+ *
+ * @param[in] queue - queue to check
+ *
+ * @return TRUE if there are no nodes in the queue
+ */
+int mpsc_queue_is_empty(mpsc_queue_t * queue);
+
+#endif
+
+/**
+ * @}
+ */
@@ -0,0 +1,92 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/** @file
+ *  @brief header for batched perfdata submission
+ *
+ *  Sending one job per check result makes the gearmand round trip the limit
+ *  for perfdata throughput. With batching enabled, the processed template
+ *  lines are collected and sent as a single job to every perfdata queue once
+ *  the batch is full, too large or too old. In overwrite mode a newer record
+ *  replaces an older one of the same host or service within the batch.
+ *
+ *  @{
+ */
+
+#include "mod_gearman.h"
+
+/**
+ * perfdata_batch_init
+ *
+ * allocate the batch according to the perfdata_batch_* options
+ *
+ * @return nothing
+ */
+void perfdata_batch_init(void);
+
+/**
+ * perfdata_batch_add
+ *
+ * add a processed perfdata record to the batch, sends the batch when it is full
+ *
+ * @param[in] host_name           - host name
+ * @param[in] service_description - service description or NULL for hosts
+ * @param[in] data                - processed template
+ *
+ * @return nothing
+ */
+void perfdata_batch_add(const char * host_name, const char * service_description, const char * data);
+
+/**
+ * perfdata_batch_flush
+ *
+ * send all collected records to the perfdata queues
+ *
+ * @return nothing
+ */
+void perfdata_batch_flush(void);
+
+/**
+ * perfdata_batch_tick
+ *
+ * send the batch if its oldest record has been waiting long enough
+ *
+ * @param[in] now - current time
+ *
+ * @return nothing
+ */
+void perfdata_batch_tick(time_t now);
+
+/**
+ * perfdata_batch_free
+ *
+ * send remaining records and free the batch
+ *
+ * @return nothing
+ */
+void perfdata_batch_free(void);
+
+/**
+ * @}
+ */
@@ -0,0 +1,94 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/** @file
+ *  @brief header for precompiled perfdata templates
+ *
+ *  Expanding the perfdata templates with the core macro functions computes
+ *  every host and service macro for each check result. The templates are
+ *  split into literal text and macro references once instead, so only the
+ *  referenced fields have to be read from the host and service objects.
+ *  Templates using macros which are not supported here are not compiled and
+ *  still go through the core macro processing.
+ *
+ *  @{
+ */
+
+#include "mod_gearman.h"
+#include "gm_buffer.h"
+
+/** single part of a compiled template */
+typedef struct perfdata_token_struct {
+    int           macro;            /**< macro id or -1 for literal text */
+    const char  * text;             /**< literal text, points into the template */
+    size_t        len;              /**< length of the literal text */
+} perfdata_token_t;
+
+/** compiled template */
+typedef struct perfdata_template_struct {
+    char              * source;     /**< copy of the template, holds the literal text */
+    perfdata_token_t  * tokens;     /**< list of tokens */
+    int                 tokens_num; /**< number of tokens */
+} perfdata_template_t;
+
+/**
+ * perfdata_template_compile
+ *
+ * split a template into literal text and macros
+ *
+ * @param[in] tmpl    - template
+ * @param[in] service - TRUE if the template is used for services
+ *
+ * @return compiled template or NULL if the template uses unsupported macros
+ */
+perfdata_template_t * perfdata_template_compile(const char * tmpl, int service);
+
+/**
+ * perfdata_template_render
+ *
+ * expand a compiled template and append it followed by a newline
+ *
+ * @param[in] tpl - compiled template
+ * @param[in] buf - buffer to append to
+ * @param[in] hst - host
+ * @param[in] svc - service or NULL for host templates
+ *
+ * @return nothing
+ */
+void perfdata_template_render(perfdata_template_t * tpl, gm_buffer_t * buf, host * hst, service * svc);
+
+/**
+ * perfdata_template_free
+ *
+ * free a compiled template
+ *
+ * @param[in] tpl - compiled template, will be set to NULL
+ *
+ * @return nothing
+ */
+void perfdata_template_free(perfdata_template_t ** tpl);
+
+/**
+ * @}
+ */
@@ -0,0 +1,58 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/** @file
+ *  @brief header for result coalescing
+ *
+ *  After a gearmand outage or a spool replay, a batch of results can contain
+ *  several results for the same host or service. Only the newest one by
+ *  finish time is interesting for the core, older ones would just update the
+ *  state and notify for stale data.
+ *
+ *  @{
+ */
+
+#include "mod_gearman.h"
+
+/**
+ * result_coalesce
+ *
+ * keep only the newest result per object, results which change the state of
+ * the object may be kept as well
+ *
+ * @param[in,out] results            - results, kept ones are moved to the
+ *                                     front in arrival order with the results
+ *                                     of one object ordered by finish time,
+ *                                     dropped ones are moved behind them
+ * @param[in]     num                - number of results
+ * @param[in]     keep_state_changes - keep older results if they change the
+ *                                     state of the object
+ *
+ * @return number of kept results
+ */
+int result_coalesce(check_result ** results, int num, int keep_state_changes);
+
+/**
+ * @}
+ */
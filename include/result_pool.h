@@ -0,0 +1,132 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/** @file
+ *  @brief pool of check results
+ *
+ *  Each result thread keeps its own pool of check results. The core gives
+ *  the results back as soon as they have been processed, so in the steady
+ *  state no memory is allocated per result. Host name, service description
+ *  and output are stored in a buffer which belongs to the check result and
+ *  is reused together with it, unless the names point to the core objects.
+ *
+ *  @{
+ */
+
+#include "mod_gearman.h"
+#include "mpsc_queue.h"
+
+/** check result as queued by the result threads, must start with the check
+ *  result itself so the core can treat it like any other check result */
+typedef struct mod_gm_result_struct {
+    check_result                 result;        /**< the check result */
+    mpsc_queue_node_t            node;          /**< result list and free list */
+    struct result_pool_struct  * pool;          /**< owning pool, NULL if not pooled */
+    int                          interned;      /**< host name and service description belong to the core objects */
+    int                          lane;          /**< result lane, -1 if the core has to resolve it */
+    char                       * strings;       /**< storage for the strings of the result */
+    size_t                       strings_size;  /**< allocated size of the storage */
+    size_t                       strings_len;   /**< used part of the storage */
+} mod_gm_result_t;
+
+/** pool of check results of one thread */
+typedef struct result_pool_struct {
+    mpsc_queue_node_t * free;                   /**< unused results, only used by the owner */
+    int                 free_num;               /**< number of unused results */
+    mpsc_queue_t        returned;               /**< results given back by the core */
+    int                 refs;                   /**< owner and results in use */
+    unsigned long       allocs;                 /**< number of allocations */
+    unsigned long       reused;                 /**< number of reused results */
+} result_pool_t;
+
+/**
+ * result_pool_new
+ *
+ * @return new empty pool
+ */
+result_pool_t * result_pool_new(void);
+
+/**
+ * result_pool_close
+ *
+ * called by the owner when it does not need the pool anymore. The pool is
+ * freed once all results have been given back.
+ *
+ * @param[in] pool - pool
+ *
+ * @return nothing
+ */
+void result_pool_close(result_pool_t * pool);
+
+/**
+ * result_pool_get
+ *
+ * get an initialized check result, must only be called by the owner
+ *
+ * @param[in] pool - pool or NULL to allocate a result without pool
+ *
+ * @return check result
+ */
+mod_gm_result_t * result_pool_get(result_pool_t * pool);
+
+/**
+ * result_pool_reserve
+ *
+ * make room for the strings of a fresh result
+ *
+ * @param[in] res  - result
+ * @param[in] size - total size of all strings including the terminating zeros
+ *
+ * @return nothing
+ */
+void result_pool_reserve(mod_gm_result_t * res, size_t size);
+
+/**
+ * result_pool_strdup
+ *
+ * copy a string into the storage of a result, falls back to the heap if it
+ * does not fit
+ *
+ * @param[in] res - result
+ * @param[in] str - string
+ * @param[in] len - length of the string
+ *
+ * @return copy of the string
+ */
+char * result_pool_strdup(mod_gm_result_t * res, const char * str, size_t len);
+
+/**
+ * result_pool_put
+ *
+ * give a result back to its pool, safe to call from any thread
+ *
+ * @param[in] res - result
+ *
+ * @return nothing
+ */
+void result_pool_put(mod_gm_result_t * res);
+
+/**
+ * @}
+ */
@@ -0,0 +1,62 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief header for the result thread scaling decisions
+ *
+ *  @{
+ */
+
+#include "mod_gearman.h"
+
+/**
+ * result_threads_target
+ *
+ * calculate the number of result threads for the current load
+ *
+ * @param[in] current - number of running threads
+ * @param[in] min     - lower limit
+ * @param[in] max     - upper limit
+ * @param[in] waiting - results waiting in the result queue, -1 if unknown
+ * @param[in] busy    - ratio of time spent processing results (0-1)
+ *
+ * @return number of threads
+ */
+int result_threads_target(int current, int min, int max, int waiting, double busy);
+
+/**
+ * result_threads_busy_ratio
+ *
+ * calculate the share of time the result threads spent processing results
+ *
+ * @param[in] busy     - microseconds all threads spent processing results
+ * @param[in] threads  - number of running threads
+ * @param[in] interval - length of the measured interval in seconds
+ *
+ * @return busy ratio (0-1), 0 if no thread is running
+ */
+double result_threads_busy_ratio(unsigned long long busy, int threads, int interval);
+
+/**
+ * @}
+ */
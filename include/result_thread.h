@@ -35,6 +35,26 @@ void *result_worker(void *);
 int set_worker( gearman_worker_st **worker );
 void *get_results( gearman_job_st *, void *, size_t *, gearman_return_t * );
 
+/**
+ * start_result_threads
+ *
+ * start result_workers threads and, if result_workers_max is larger, a
+ * controller which grows and shrinks the pool depending on the result queue
+ * backlog and the busy ratio of the threads
+ *
+ * @return GM_OK on success
+ */
+int start_result_threads(void);
+
+/**
+ * shutdown_result_threads
+ *
+ * stop the controller and all result threads
+ *
+ * @return nothing
+ */
+void shutdown_result_threads(void);
+
 /**
  * @}
  */
@@ -0,0 +1,161 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/** @file
+ *  @brief header for the target queue cache
+ *
+ *  Resolving the target queue walks custom variables and checks the group
+ *  membership for every configured hostgroup and servicegroup. The result
+ *  only changes when the object configuration or a custom variable changes,
+ *  so it is resolved once per host and service and kept in a table indexed
+ *  by the object id. The table also holds the static part of the check job,
+ *  the priority class and the unique job keys for each object.
+ *
+ *  @{
+ */
+
+#include "mod_gearman.h"
+
+/**
+ * route_cache_init
+ *
+ * resolve the configured groups and the target queue of all hosts and services
+ *
+ * @return nothing
+ */
+void route_cache_init(void);
+
+/**
+ * route_cache_free
+ *
+ * free the cache
+ *
+ * @return nothing
+ */
+void route_cache_free(void);
+
+/**
+ * route_cache_invalidate
+ *
+ * forget all resolved queues, they will be resolved again on next use
+ *
+ * @return nothing
+ */
+void route_cache_invalidate(void);
+
+/**
+ * route_cache_uses_custom_variables
+ *
+ * cached queues and priorities have to be invalidated when a custom variable
+ * changes if either of them is read from custom variables
+ *
+ * @return TRUE if the cache depends on custom variables
+ */
+int route_cache_uses_custom_variables(void);
+
+/**
+ * route_cache_resolve
+ *
+ * resolve the target queue without using the cache
+ *
+ * @param[in] hst - host
+ * @param[in] svc - service or NULL for host jobs
+ *
+ * @return queue name or an empty string if the job should run locally
+ */
+const char * route_cache_resolve(host * hst, service * svc);
+
+/**
+ * route_cache_lookup
+ *
+ * return the cached target queue, resolves it on first use
+ *
+ * @param[in] hst - host
+ * @param[in] svc - service or NULL for host jobs
+ *
+ * @return queue name or an empty string if the job should run locally
+ */
+const char * route_cache_lookup(host * hst, service * svc);
+
+/**
+ * route_cache_priority
+ *
+ * return the cached priority class from the priority custom variable or the
+ * priority hostgroups, resolves it on first use
+ *
+ * @param[in] hst - host
+ * @param[in] svc - service or NULL for host jobs
+ *
+ * @return GM_JOB_PRIO_* or 0 if no priority is configured for this object
+ */
+int route_cache_priority(host * hst, service * svc);
+
+/**
+ * route_cache_result_lane
+ *
+ * return the result lane from the cached priority class without resolving
+ * it, may be called by the result threads once the cache has been built
+ *
+ * @param[in] hst - host
+ * @param[in] svc - service or NULL for host results
+ *
+ * @return lane index or -1 if the priority has not been resolved yet
+ */
+int route_cache_result_lane(host * hst, service * svc);
+
+/**
+ * route_cache_uniq
+ *
+ * return the unique key of a job, hashed on first use
+ *
+ * @param[in] hst            - host
+ * @param[in] svc            - service or NULL for host jobs
+ * @param[in] perfdata_queue - index into the perfdata queue list or -1 for
+ *                             check jobs
+ *
+ * @return 32 character hex key, valid until the cache is freed or the next
+ *         call for an object created after startup
+ */
+const char * route_cache_uniq(host * hst, service * svc, int perfdata_queue);
+
+/**
+ * route_cache_job_prefix
+ *
+ * return the static fields of a check job (type, result_queue, target_queue,
+ * host_name and service_description), rendered on first use
+ *
+ * @param[in] hst    - host
+ * @param[in] svc    - service or NULL for host checks
+ * @param[in] format - GM_PAYLOAD_FORMAT_* of the job, the prefix is rebuilt
+ *                     when it changes
+ * @param[out] len   - length of the prefix
+ *
+ * @return prefix, valid until the cache is invalidated or the next call for
+ *         this object or an object created after startup
+ */
+const char * route_cache_job_prefix(host * hst, service * svc, int format, size_t * len);
+
+/**
+ * @}
+ */
@@ -41,6 +41,7 @@
 #include <sys/wait.h>
 #include <libgearman/gearman.h>
 #include "common.h"
+#include "gearman_utils.h"
 #include "openssl/evp.h"
 
 /** send_gearman
@@ -100,6 +101,28 @@ int verify_options(mod_gm_opt_t *opt);
  */
 int send_result(EVP_CIPHER_CTX * ctx);
 
+/**
+ * create_result
+ *
+ * create result data from the current options
+ *
+ * @return result data, must be freed
+ */
+char * create_result(void);
+
+/**
+ * submit_results
+ *
+ * send a batch of results as gearman jobs
+ *
+ * @param[in] ctx - openssl context
+ * @param[in] jobs - list of jobs, will be freed
+ * @param[in] num - number of jobs
+ *
+ * @return STATE_OK on success or STATE_UNKNOWN if something went wrong
+ */
+int submit_results(EVP_CIPHER_CTX * ctx, gm_submit_job_t ** jobs, int num);
+
 /**
  * submit_result
  *
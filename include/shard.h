@@ -0,0 +1,113 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/** @file
+ *  @brief consistent hash ring to shard jobs over multiple gearmand servers
+ *
+ *  Every server is placed on the ring a number of times. A job is sent to the
+ *  first server found clockwise from the hash of its shard key. If a server
+ *  goes down, only its own keys move to the next servers on the ring, all
+ *  other keys stay where they are.
+ *
+ *  @{
+ */
+
+#ifndef _SHARD_H
+#define _SHARD_H
+
+#include "common.h"
+
+/** number of points per server on the ring */
+#define GM_SHARD_REPLICAS       160
+
+/** seconds a failed server is skipped before it is tried again */
+#define GM_SHARD_RETRY_INTERVAL 30
+
+/** single point on the ring */
+typedef struct gm_shard_point_struct {
+    unsigned int hash;                  /**< position on the ring */
+    int          server;                /**< index into the server list */
+} gm_shard_point_t;
+
+/** consistent hash ring */
+typedef struct gm_shard_ring_struct {
+    gm_shard_point_t * points;          /**< points sorted by hash */
+    int                points_num;      /**< number of points */
+    int                server_num;      /**< number of servers */
+} gm_shard_ring_t;
+
+/**
+ * gm_shard_hash
+ *
+ * calculate the shard key for a host or service
+ *
+ * @param[in] host    - host name
+ * @param[in] service - service description or NULL
+ *
+ * @return shard key, never 0
+ */
+unsigned int gm_shard_hash(const char * host, const char * service);
+
+/**
+ * gm_shard_ring_create
+ *
+ * create the ring for a list of servers
+ *
+ * @param[in] server_list - list of gearmand servers
+ * @param[in] server_num  - number of servers
+ * @param[in] replicas    - number of points per server
+ *
+ * @return new ring
+ */
+gm_shard_ring_t * gm_shard_ring_create(gm_server_t * server_list[GM_LISTSIZE], int server_num, int replicas);
+
+/**
+ * gm_shard_ring_lookup
+ *
+ * find the server responsible for a shard key
+ *
+ * @param[in] ring - hash ring
+ * @param[in] hash - shard key
+ * @param[in] down - list of flags for servers which should be skipped or NULL
+ *
+ * @return index of the server or -1 if all servers are down
+ */
+int gm_shard_ring_lookup(gm_shard_ring_t * ring, unsigned int hash, int * down);
+
+/**
+ * gm_shard_ring_free
+ *
+ * free the ring
+ *
+ * @param[in,out] ring - ring to free, will be set to NULL
+ *
+ * @return nothing
+ */
+void gm_shard_ring_free(gm_shard_ring_t ** ring);
+
+#endif
+
+/**
+ * @}
+ */
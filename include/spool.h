@@ -0,0 +1,128 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief header for the neb job spool
+ *
+ *  Jobs which could not be sent to gearmand are appended to a spool of
+ *  fixed size, memory mapped files in the spool_dir. A replay thread sends
+ *  them in order once gearmand is reachable again. Spooled jobs survive
+ *  a restart of the core.
+ *
+ *  @{
+ */
+
+#include "mod_gearman.h"
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#define GM_SPOOL_MAGIC          0x4d475350      /**< marks a completely written record */
+#define GM_SPOOL_FILE_PREFIX    "spool."        /**< file name prefix of spool segments */
+
+/** header of a spooled job, followed by queue, uniq and data */
+typedef struct gm_spool_record_struct {
+    uint32_t magic;                 /**< GM_SPOOL_MAGIC once the record is complete */
+    uint32_t size;                  /**< total size of the record including padding */
+    uint32_t consumed;              /**< set once the job has been replayed or expired */
+    int32_t  priority;              /**< job priority */
+    int64_t  timestamp;             /**< time when the job has been spooled */
+    uint32_t queue_len;             /**< length of the queue name including the trailing zero */
+    uint32_t uniq_len;              /**< length of the uniq key including the trailing zero or 0 */
+    uint32_t data_len;              /**< length of the encrypted data including the trailing zero */
+    uint32_t reserved;              /**< unused, keeps the header 8 byte aligned */
+} gm_spool_record_t;
+
+/** a mapped spool file */
+typedef struct gm_spool_segment_struct {
+    unsigned long seq;              /**< sequence number of this segment */
+    int           fd;               /**< file descriptor or -1 */
+    char        * map;              /**< mapped file or NULL */
+    size_t        size;             /**< size of the mapped file */
+    size_t        offset;           /**< current read or write position */
+} gm_spool_segment_t;
+
+/**
+ * start_spool
+ *
+ * open the spool and start the replay thread, does nothing
+ * unless spool_dir is set
+ *
+ * @return GM_OK on success, GM_ERROR otherwise
+ */
+int start_spool(void);
+
+/**
+ * stop_spool
+ *
+ * stop the replay thread and close the spool. Remaining jobs
+ * stay on disk and will be replayed after the next start.
+ *
+ * @return nothing
+ */
+void stop_spool(void);
+
+/**
+ * mod_gm_spool_enabled
+ *
+ * @return TRUE if the spool is available
+ */
+int mod_gm_spool_enabled(void);
+
+/**
+ * mod_gm_spool_is_empty
+ *
+ * @return TRUE if there are no jobs waiting for replay
+ */
+int mod_gm_spool_is_empty(void);
+
+/**
+ * mod_gm_spool_job
+ *
+ * append a job to the spool
+ *
+ * @param[in] queue    - queue name
+ * @param[in] uniq     - uniq key or NULL
+ * @param[in] data     - already encrypted job data
+ * @param[in] priority - job priority
+ *
+ * @return GM_OK if the job has been spooled, GM_ERROR if it has been dropped
+ */
+int mod_gm_spool_job(char * queue, char * uniq, char * data, int priority);
+
+/**
+ * spool_replay_worker
+ *
+ * main loop of the replay thread
+ *
+ * @param[in] data - unused
+ *
+ * @return NULL
+ */
+void *spool_replay_worker(void * data);
+
+/**
+ * @}
+ */
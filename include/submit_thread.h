@@ -0,0 +1,87 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief header for the neb submit threads
+ *
+ *  The NEB callbacks put new jobs into a bounded submit queue. One or more
+ *  submit threads take them from there, encrypt them and send them to
+ *  gearmand, so a slow gearmand does not block the core.
+ *
+ *  @{
+ */
+
+#include "mod_gearman.h"
+
+#include <libgearman/gearman.h>
+
+/**
+ * start_submit_threads
+ *
+ * initialize the submit queue and start the submit threads
+ *
+ * @return GM_OK on success, GM_ERROR otherwise
+ */
+int start_submit_threads(void);
+
+/**
+ * shutdown_submit_threads
+ *
+ * stop all submit threads and free the remaining queue
+ *
+ * @return nothing
+ */
+void shutdown_submit_threads(void);
+
+/**
+ * mod_gm_submit_job
+ *
+ * put a new job into the submit queue. Sends the job directly if
+ * no submit threads are configured.
+ *
+ * @param[in] queue    - queue name
+ * @param[in] uniq     - uniq key or NULL
+ * @param[in] data     - plain text job data
+ * @param[in] priority - job priority
+ * @param[in] retries  - number of retries
+ * @param[in] shard    - shard key or 0 to send the job to any server
+ *
+ * @return GM_OK when the job has been queued, GM_QUEUE_FULL when the job should be
+ *         executed locally and GM_ERROR when the job has been dropped
+ */
+int mod_gm_submit_job(char * queue, char * uniq, char * data, int priority, int retries, unsigned int shard);
+
+/**
+ * submit_worker
+ *
+ * main loop of a submit thread
+ *
+ * @param[in] data - unused
+ *
+ * @return NULL
+ */
+void *submit_worker(void * data);
+
+/**
+ * @}
+ */
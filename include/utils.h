@@ -96,7 +96,7 @@ void mod_gm_crypt_deinit(EVP_CIPHER_CTX *);
  *
  * @param[in] ctx - openssl context
  * @param[out] ciphertext - pointer to target encrypted text
- * @param[in] plaintext - source text to encrypt
+ * @param[in] plaintext - source text or binary payload to encrypt
  * @param[in] mode - encryption mode (base64 or aes64 with base64)
  *
  * @return base64 encoded text or aes encrypted text based on mode
@@ -112,7 +112,7 @@ int mod_gm_encrypt(EVP_CIPHER_CTX * ctx, char ** ciphertext, const char * plaint
  * @param[in] ciphertext_size - size of ciphertext
  * @param[in] mode - do only base64 decoding or decryption too
  *
- * @return 1 on success
+ * @return size of the plaintext buffer, binary payloads may be shorter, -1 on errors
  */
 int mod_gm_decrypt(EVP_CIPHER_CTX * ctx, char ** plaintext, const char * ciphertext, size_t ciphertext_size, int mode);
 
@@ -205,6 +205,17 @@ int parse_args_line(mod_gm_opt_t *opt, char * arg, int recursion_level);
  */
 int parse_yes_or_no(char*value, int dfl);
 
+/**
+ * parse_priority
+ *
+ * parse a priority class name (high, normal or low)
+ *
+ * @param[in] value - string to parse
+ *
+ * @return GM_JOB_PRIO_* or 0 if the value is not a priority
+ */
+int parse_priority(const char * value);
+
 /**
  * read_config_file
  *
@@ -0,0 +1,99 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/** @file
+ *  @brief header for the wire format negotiation
+ *
+ *  Workers accepting binary jobs register an additional function named
+ *  after each of their queues with GM_PAYLOAD_BINARY_SUFFIX appended. With
+ *  wire_format=binary a background thread polls the status of all gearmand
+ *  servers and a queue gets binary jobs only while every worker registered
+ *  for it also registered the binary function. All other queues keep
+ *  getting text jobs.
+ *
+ *  @{
+ */
+
+#include "mod_gearman.h"
+
+/**
+ * start_wire_negotiation
+ *
+ * start the thread polling the gearmand servers, does nothing unless
+ * wire_format=binary is set
+ *
+ * @return GM_OK on success
+ */
+int start_wire_negotiation(void);
+
+/**
+ * stop_wire_negotiation
+ *
+ * stop the polling thread
+ *
+ * @return nothing
+ */
+void stop_wire_negotiation(void);
+
+/**
+ * wire_format_for_queue
+ *
+ * return the format of new jobs for a queue, must only be called from the
+ * core thread
+ *
+ * @param[in] queue - target queue
+ *
+ * @return GM_PAYLOAD_FORMAT_BINARY if enabled and all workers of the queue
+ *         accept it, GM_PAYLOAD_FORMAT_TEXT otherwise
+ */
+int wire_format_for_queue(const char * queue);
+
+/**
+ * wire_format_capable
+ *
+ * decide if a queue may get binary jobs
+ *
+ * @param[in] workers        - workers registered for the queue
+ * @param[in] binary_workers - workers registered for the binary function of the queue
+ *
+ * @return TRUE if there are workers and all of them accept binary jobs
+ */
+int wire_format_capable(int workers, int binary_workers);
+
+/**
+ * wire_format_update
+ *
+ * update a queue with the numbers of a new poll, used by the polling thread
+ *
+ * @param[in] queue          - target queue
+ * @param[in] workers        - workers registered for the queue
+ * @param[in] binary_workers - workers registered for the binary function of the queue
+ *
+ * @return nothing
+ */
+void wire_format_update(const char * queue, int workers, int binary_workers);
+
+/**
+ * @}
+ */
@@ -54,11 +54,13 @@ void worker_loop(void);
 void *get_job( gearman_job_st *, void *, size_t *, gearman_return_t * );
 void do_exec_job(void);
 int set_worker( gearman_worker_st **worker );
+void add_job_function( gearman_worker_st *worker, char * queue );
 void exit_sighandler(int sig);
 void idle_sighandler(int sig);
 void set_state(int status);
 void clean_worker_exit(int sig);
 void *return_status( gearman_job_st *, void *, size_t *, gearman_return_t *);
+void *accept_binary( gearman_job_st *, void *, size_t *, gearman_return_t *);
 #ifdef GM_DEBUG
 void write_debug_file(char ** text);
 #endif
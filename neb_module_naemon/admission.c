@@ -0,0 +1,286 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+
+/* include header */
+#include "admission.h"
+#include "gearman_utils.h"
+#include "metrics.h"
+#include "shard.h"
+#include "utils.h"
+
+#include <limits.h>
+
+#define ADMISSION_MAX_QUEUES 256
+
+extern mod_gm_opt_t *mod_gm_opt;
+
+/* state of a single target queue */
+typedef struct admission_queue_struct {
+    char          * name;               /* queue name, set once by the core thread */
+    unsigned long   submitted;          /* admitted checks, updated by the core thread */
+    int             overloaded;         /* TRUE while new checks are not admitted */
+    unsigned long   last_submitted;     /* submitted at the last poll, only used by the polling thread */
+    int             waiting;            /* jobs waiting at the last poll */
+    int             workers;            /* workers at the last poll */
+    int             wait;               /* estimated wait time in seconds */
+} admission_queue_t;
+
+static admission_queue_t queues[ADMISSION_MAX_QUEUES];
+
+/* polling thread */
+static pthread_t admission_thr;
+static int admission_running          = FALSE;
+static int admission_should_terminate = FALSE;
+static pthread_mutex_t admission_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t admission_cond   = PTHREAD_COND_INITIALIZER;
+
+/* return the state of a queue, creates it if requested */
+static admission_queue_t * get_queue(const char * name, int create) {
+    unsigned int slot = gm_shard_hash(name, NULL) % ADMISSION_MAX_QUEUES;
+    char * current;
+    int x;
+
+    for(x = 0; x < ADMISSION_MAX_QUEUES; x++) {
+        current = __atomic_load_n(&queues[slot].name, __ATOMIC_ACQUIRE);
+        if(current == NULL) {
+            if(create == FALSE)
+                return(NULL);
+            /* only the core thread adds queues, so no need for a compare and swap */
+            __atomic_store_n(&queues[slot].name, gm_strdup(name), __ATOMIC_RELEASE);
+            return(&queues[slot]);
+        }
+        if(!strcmp(current, name))
+            return(&queues[slot]);
+        slot = (slot + 1) % ADMISSION_MAX_QUEUES;
+    }
+    return(NULL);
+}
+
+/* estimate the wait time from the jobs drained since the last poll */
+int admission_estimate_wait(int waiting, int last_waiting, unsigned long submitted, int last_wait, int elapsed) {
+    long drained = (long)submitted + last_waiting - waiting;
+
+    if(waiting <= 0)
+        return(0);
+    if(elapsed <= 0)
+        return(last_wait);
+
+    /* nothing left the queue, so the oldest job is at least one interval older */
+    if(drained <= 0) {
+        if(last_wait > INT_MAX - elapsed)
+            return(INT_MAX);
+        return(last_wait + elapsed);
+    }
+
+    if((long long)waiting * elapsed / drained > INT_MAX)
+        return(INT_MAX);
+    return((int)((long long)waiting * elapsed / drained));
+}
+
+/* decide if a queue is overloaded */
+int admission_overloaded(int overloaded, int waiting, int workers, int wait, int max_depth, int max_age) {
+    if(max_depth <= 0 && max_age <= 0)
+        return(FALSE);
+
+    /* nobody will ever pick up these jobs */
+    if(waiting > 0 && workers == 0)
+        return(TRUE);
+
+    if(max_depth > 0 && waiting > max_depth)
+        return(TRUE);
+    if(max_age > 0 && wait > max_age)
+        return(TRUE);
+
+    /* recover only after the queue drained to half of the limits */
+    if(overloaded == TRUE) {
+        if(max_depth > 0 && waiting > max_depth / 2)
+            return(TRUE);
+        if(max_age > 0 && wait > max_age / 2)
+            return(TRUE);
+    }
+    return(FALSE);
+}
+
+/* update a queue with new poll data */
+static void update_queue(admission_queue_t * q, int waiting, int workers, int elapsed) {
+    unsigned long submitted = __atomic_load_n(&q->submitted, __ATOMIC_RELAXED);
+    int overloaded          = __atomic_load_n(&q->overloaded, __ATOMIC_RELAXED);
+    int new_overloaded;
+
+    q->wait           = admission_estimate_wait(waiting, q->waiting, submitted - q->last_submitted, q->wait, elapsed);
+    q->waiting        = waiting;
+    q->workers        = workers;
+    q->last_submitted = submitted;
+
+    new_overloaded = admission_overloaded(overloaded, waiting, workers, q->wait, mod_gm_opt->admission_max_queue_depth, mod_gm_opt->admission_max_queue_age);
+    if(new_overloaded == overloaded)
+        return;
+    __atomic_store_n(&q->overloaded, new_overloaded, __ATOMIC_RELAXED);
+    if(new_overloaded == TRUE)
+        gm_log( GM_LOG_INFO, "queue %s is overloaded: %d jobs waiting, %d workers, estimated wait %ds\n", q->name, waiting, workers, q->wait );
+    else
+        gm_log( GM_LOG_INFO, "queue %s recovered: %d jobs waiting, %d workers, estimated wait %ds\n", q->name, waiting, workers, q->wait );
+}
+
+/* update a queue by name */
+void admission_update(const char * queue, int waiting, int workers, int elapsed) {
+    admission_queue_t * q = get_queue(queue, FALSE);
+    if(q != NULL)
+        update_queue(q, waiting, workers, elapsed);
+}
+
+/* decide what to do with a new check */
+int admission_check(const char * queue) {
+    admission_queue_t * q;
+    int decision;
+
+    if(mod_gm_opt->admission_max_queue_depth <= 0 && mod_gm_opt->admission_max_queue_age <= 0)
+        return(GM_ADMISSION_ENQUEUE);
+
+    q = get_queue(queue, TRUE);
+    if(q == NULL)
+        return(GM_ADMISSION_ENQUEUE);
+
+    decision = GM_ADMISSION_ENQUEUE;
+    if(__atomic_load_n(&q->overloaded, __ATOMIC_RELAXED) == TRUE) {
+        decision = mod_gm_opt->admission_policy;
+        metrics_admission(queue, decision);
+    }
+    if(decision == GM_ADMISSION_ENQUEUE)
+        __atomic_add_fetch(&q->submitted, 1, __ATOMIC_RELAXED);
+    return(decision);
+}
+
+/* poll all servers and update all known queues */
+static void poll_servers(int elapsed) {
+    mod_gm_server_status_t * stats[GM_LISTSIZE];
+    char * message = NULL;
+    char * version = NULL;
+    char * name;
+    int x, y, z, answered, waiting, workers;
+
+    answered = 0;
+    for(x = 0; x < mod_gm_opt->server_num; x++) {
+        stats[answered] = gm_malloc(sizeof(mod_gm_server_status_t));
+        stats[answered]->function_num = 0;
+        stats[answered]->worker_num   = 0;
+        if(get_gearman_server_data(stats[answered], &message, &version, mod_gm_opt->server_list[x]->host, mod_gm_opt->server_list[x]->port) == STATE_OK)
+            answered++;
+        else
+            free_mod_gm_status_server(stats[answered]);
+        gm_free(message);
+        gm_free(version);
+    }
+
+    /* keep the last state if no server answered */
+    if(answered > 0) {
+        for(x = 0; x < ADMISSION_MAX_QUEUES; x++) {
+            name = __atomic_load_n(&queues[x].name, __ATOMIC_ACQUIRE);
+            if(name == NULL)
+                continue;
+            waiting = 0;
+            workers = 0;
+            for(y = 0; y < answered; y++) {
+                for(z = 0; z < stats[y]->function_num; z++) {
+                    if(!strcmp(stats[y]->function[z].queue, name)) {
+                        waiting += stats[y]->function[z].waiting;
+                        workers += stats[y]->function[z].worker;
+                    }
+                }
+            }
+            update_queue(&queues[x], waiting, workers, elapsed);
+        }
+    }
+
+    for(y = 0; y < answered; y++)
+        free_mod_gm_status_server(stats[y]);
+}
+
+/* main loop of the polling thread */
+static void *admission_worker( __attribute__((__unused__)) void * data ) {
+    struct timeval now;
+    struct timespec deadline;
+    time_t last_poll;
+
+    gm_log( GM_LOG_DEBUG, "admission thr-%ld started\n", pthread_self() );
+
+    last_poll = time(NULL);
+    while(TRUE) {
+        pthread_mutex_lock(&admission_mutex);
+        gettimeofday(&now, NULL);
+        deadline.tv_sec  = now.tv_sec + GM_ADMISSION_POLL_INTERVAL;
+        deadline.tv_nsec = now.tv_usec * 1000;
+        while(admission_should_terminate == FALSE && pthread_cond_timedwait(&admission_cond, &admission_mutex, &deadline) != ETIMEDOUT)
+            ;
+        if(admission_should_terminate == TRUE) {
+            pthread_mutex_unlock(&admission_mutex);
+            break;
+        }
+        pthread_mutex_unlock(&admission_mutex);
+
+        poll_servers((int)(time(NULL) - last_poll));
+        last_poll = time(NULL);
+    }
+
+    gm_log( GM_LOG_DEBUG, "admission thr-%ld finished\n", pthread_self() );
+    return(NULL);
+}
+
+/* start the polling thread */
+int start_admission(void) {
+    int ret;
+
+    admission_should_terminate = FALSE;
+    if(mod_gm_opt->admission_max_queue_depth <= 0 && mod_gm_opt->admission_max_queue_age <= 0)
+        return(GM_OK);
+
+    if((ret = pthread_create(&admission_thr, NULL, &admission_worker, NULL)) != 0) {
+        gm_log( GM_LOG_ERROR, "failed to create admission thread: %s\n", strerror(ret));
+        return(GM_ERROR);
+    }
+    admission_running = TRUE;
+    return(GM_OK);
+}
+
+/* stop the polling thread */
+void stop_admission(void) {
+    int x;
+
+    if(admission_running == TRUE) {
+        pthread_mutex_lock(&admission_mutex);
+        admission_should_terminate = TRUE;
+        pthread_cond_signal(&admission_cond);
+        pthread_mutex_unlock(&admission_mutex);
+        if(pthread_join(admission_thr, NULL) != 0) {
+            gm_log( GM_LOG_ERROR, "failed to join admission thread: %s\n", strerror(errno) );
+        }
+        admission_running = FALSE;
+    }
+
+    for(x = 0; x < ADMISSION_MAX_QUEUES; x++) {
+        gm_free(queues[x].name);
+        memset(&queues[x], 0, sizeof(admission_queue_t));
+    }
+}
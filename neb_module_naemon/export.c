@@ -0,0 +1,668 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+
+/* include header */
+#include "export.h"
+#include "submit_thread.h"
+#include "gm_json.h"
+#include "utils.h"
+
+extern mod_gm_opt_t *mod_gm_opt;
+
+/* callback names, indexed by callback type */
+static const char * callback_names[GM_NEBTYPESSIZE] = {
+    [NEBCALLBACK_PROCESS_DATA]                     = "NEBCALLBACK_PROCESS_DATA",
+    [NEBCALLBACK_TIMED_EVENT_DATA]                 = "NEBCALLBACK_TIMED_EVENT_DATA",
+    [NEBCALLBACK_LOG_DATA]                         = "NEBCALLBACK_LOG_DATA",
+    [NEBCALLBACK_SYSTEM_COMMAND_DATA]              = "NEBCALLBACK_SYSTEM_COMMAND_DATA",
+    [NEBCALLBACK_EVENT_HANDLER_DATA]               = "NEBCALLBACK_EVENT_HANDLER_DATA",
+    [NEBCALLBACK_NOTIFICATION_DATA]                = "NEBCALLBACK_NOTIFICATION_DATA",
+    [NEBCALLBACK_SERVICE_CHECK_DATA]               = "NEBCALLBACK_SERVICE_CHECK_DATA",
+    [NEBCALLBACK_HOST_CHECK_DATA]                  = "NEBCALLBACK_HOST_CHECK_DATA",
+    [NEBCALLBACK_COMMENT_DATA]                     = "NEBCALLBACK_COMMENT_DATA",
+    [NEBCALLBACK_DOWNTIME_DATA]                    = "NEBCALLBACK_DOWNTIME_DATA",
+    [NEBCALLBACK_FLAPPING_DATA]                    = "NEBCALLBACK_FLAPPING_DATA",
+    [NEBCALLBACK_PROGRAM_STATUS_DATA]              = "NEBCALLBACK_PROGRAM_STATUS_DATA",
+    [NEBCALLBACK_HOST_STATUS_DATA]                 = "NEBCALLBACK_HOST_STATUS_DATA",
+    [NEBCALLBACK_SERVICE_STATUS_DATA]              = "NEBCALLBACK_SERVICE_STATUS_DATA",
+    [NEBCALLBACK_ADAPTIVE_PROGRAM_DATA]            = "NEBCALLBACK_ADAPTIVE_PROGRAM_DATA",
+    [NEBCALLBACK_ADAPTIVE_HOST_DATA]               = "NEBCALLBACK_ADAPTIVE_HOST_DATA",
+    [NEBCALLBACK_ADAPTIVE_SERVICE_DATA]            = "NEBCALLBACK_ADAPTIVE_SERVICE_DATA",
+    [NEBCALLBACK_EXTERNAL_COMMAND_DATA]            = "NEBCALLBACK_EXTERNAL_COMMAND_DATA",
+    [NEBCALLBACK_AGGREGATED_STATUS_DATA]           = "NEBCALLBACK_AGGREGATED_STATUS_DATA",
+    [NEBCALLBACK_RETENTION_DATA]                   = "NEBCALLBACK_RETENTION_DATA",
+    [NEBCALLBACK_CONTACT_NOTIFICATION_DATA]        = "NEBCALLBACK_CONTACT_NOTIFICATION_DATA",
+    [NEBCALLBACK_CONTACT_NOTIFICATION_METHOD_DATA] = "NEBCALLBACK_CONTACT_NOTIFICATION_METHOD_DATA",
+    [NEBCALLBACK_ACKNOWLEDGEMENT_DATA]             = "NEBCALLBACK_ACKNOWLEDGEMENT_DATA",
+    [NEBCALLBACK_STATE_CHANGE_DATA]                = "NEBCALLBACK_STATE_CHANGE_DATA",
+    [NEBCALLBACK_CONTACT_STATUS_DATA]              = "NEBCALLBACK_CONTACT_STATUS_DATA",
+    [NEBCALLBACK_ADAPTIVE_CONTACT_DATA]            = "NEBCALLBACK_ADAPTIVE_CONTACT_DATA",
+};
+
+/* latest status update of a single object */
+typedef struct export_pending_struct {
+    int             pending;        /* TRUE if an update is waiting */
+    int             type;
+    int             flags;
+    int             attr;
+    struct timeval  timestamp;
+} export_pending_t;
+
+static export_pending_t * pending_hosts    = NULL;
+static export_pending_t * pending_services = NULL;
+static unsigned int pending_hosts_num      = 0;
+static unsigned int pending_services_num   = 0;
+
+/* ids of objects with pending updates, in order of their first update */
+static unsigned int * dirty_hosts    = NULL;
+static unsigned int * dirty_services = NULL;
+static unsigned int dirty_hosts_num    = 0;
+static unsigned int dirty_services_num = 0;
+
+static time_t last_flush = 0;
+static gm_buffer_t * coalesce_buffer = NULL;
+
+
+/* common members of all neb structs */
+static void json_header(gm_buffer_t * buf, int callback_type, int type, int flags, int attr, struct timeval * timestamp) {
+    char * type_name = nebtype2str(type);
+    gm_json_open(buf);
+    gm_json_str(buf, "callback_type", callback_names[callback_type]);
+    gm_json_str(buf, "type", type_name);
+    gm_json_int(buf, "flags", flags);
+    gm_json_int(buf, "attr", attr);
+    gm_json_timeval(buf, "timestamp", timestamp);
+    free(type_name);
+}
+
+/* current status of a host object */
+static void json_host(gm_buffer_t * buf, host * hst) {
+    if(hst == NULL)
+        return;
+    gm_json_str(buf, "host_name", hst->name);
+    gm_json_int(buf, "current_state", hst->current_state);
+    gm_json_int(buf, "last_state", hst->last_state);
+    gm_json_int(buf, "state_type", hst->state_type);
+    gm_json_int(buf, "current_attempt", hst->current_attempt);
+    gm_json_int(buf, "max_attempts", hst->max_attempts);
+    gm_json_int(buf, "has_been_checked", hst->has_been_checked);
+    gm_json_int(buf, "last_check", (long long)hst->last_check);
+    gm_json_int(buf, "next_check", (long long)hst->next_check);
+    gm_json_int(buf, "last_state_change", (long long)hst->last_state_change);
+    gm_json_double(buf, "latency", hst->latency);
+    gm_json_double(buf, "execution_time", hst->execution_time);
+    gm_json_double(buf, "percent_state_change", hst->percent_state_change);
+    gm_json_int(buf, "is_flapping", hst->is_flapping);
+    gm_json_int(buf, "problem_has_been_acknowledged", hst->problem_has_been_acknowledged);
+    gm_json_int(buf, "scheduled_downtime_depth", hst->scheduled_downtime_depth);
+    gm_json_int(buf, "checks_enabled", hst->checks_enabled);
+    gm_json_int(buf, "notifications_enabled", hst->notifications_enabled);
+    gm_json_int(buf, "modified_attributes", hst->modified_attributes);
+    gm_json_str(buf, "plugin_output", hst->plugin_output);
+    gm_json_str(buf, "long_plugin_output", hst->long_plugin_output);
+    gm_json_str(buf, "perf_data", hst->perf_data);
+}
+
+/* current status of a service object */
+static void json_service(gm_buffer_t * buf, service * svc) {
+    if(svc == NULL)
+        return;
+    gm_json_str(buf, "host_name", svc->host_name);
+    gm_json_str(buf, "service_description", svc->description);
+    gm_json_int(buf, "current_state", svc->current_state);
+    gm_json_int(buf, "last_state", svc->last_state);
+    gm_json_int(buf, "state_type", svc->state_type);
+    gm_json_int(buf, "current_attempt", svc->current_attempt);
+    gm_json_int(buf, "max_attempts", svc->max_attempts);
+    gm_json_int(buf, "has_been_checked", svc->has_been_checked);
+    gm_json_int(buf, "last_check", (long long)svc->last_check);
+    gm_json_int(buf, "next_check", (long long)svc->next_check);
+    gm_json_int(buf, "last_state_change", (long long)svc->last_state_change);
+    gm_json_double(buf, "latency", svc->latency);
+    gm_json_double(buf, "execution_time", svc->execution_time);
+    gm_json_double(buf, "percent_state_change", svc->percent_state_change);
+    gm_json_int(buf, "is_flapping", svc->is_flapping);
+    gm_json_int(buf, "problem_has_been_acknowledged", svc->problem_has_been_acknowledged);
+    gm_json_int(buf, "scheduled_downtime_depth", svc->scheduled_downtime_depth);
+    gm_json_int(buf, "checks_enabled", svc->checks_enabled);
+    gm_json_int(buf, "notifications_enabled", svc->notifications_enabled);
+    gm_json_int(buf, "modified_attributes", svc->modified_attributes);
+    gm_json_str(buf, "plugin_output", svc->plugin_output);
+    gm_json_str(buf, "long_plugin_output", svc->long_plugin_output);
+    gm_json_str(buf, "perf_data", svc->perf_data);
+}
+
+/* serialize neb callback data */
+int export_serialize(gm_buffer_t * buf, int callback_type, void * data) {
+    char * event_type;
+    char * type;
+    nebstruct_process_data                      * npd;
+    nebstruct_timed_event_data                  * nted;
+    nebstruct_log_data                          * nld;
+    nebstruct_system_command_data               * nscd;
+    nebstruct_event_handler_data                * nehd;
+    nebstruct_notification_data                 * nnd;
+    nebstruct_service_check_data                * nscd2;
+    nebstruct_host_check_data                   * nhcd;
+    nebstruct_comment_data                      * ncd;
+    nebstruct_downtime_data                     * ndd;
+    nebstruct_flapping_data                     * nfd;
+    nebstruct_program_status_data               * npsd;
+    nebstruct_host_status_data                  * nhsd;
+    nebstruct_service_status_data               * nssd;
+    nebstruct_adaptive_program_data             * napd;
+    nebstruct_adaptive_host_data                * nahd;
+    nebstruct_adaptive_service_data             * nasd;
+    nebstruct_external_command_data             * necd;
+    nebstruct_aggregated_status_data            * nagsd;
+    nebstruct_retention_data                    * nrd;
+    nebstruct_contact_notification_data         * ncnd;
+    nebstruct_contact_notification_method_data  * ncnmd;
+    nebstruct_acknowledgement_data              * nackd;
+    nebstruct_statechange_data                  * nstd;
+    nebstruct_contact_status_data               * ncsd;
+    nebstruct_adaptive_contact_data             * nacd;
+    contact * cntct;
+
+    switch (callback_type) {
+        case NEBCALLBACK_PROCESS_DATA:                      /*  7 */
+            npd = (nebstruct_process_data *)data;
+            json_header(buf, callback_type, npd->type, npd->flags, npd->attr, &npd->timestamp);
+            break;
+        case NEBCALLBACK_TIMED_EVENT_DATA:                  /*  8 */
+            nted       = (nebstruct_timed_event_data *)data;
+            event_type = eventtype2str(nted->event_type);
+            type       = nebtype2str(nted->type);
+            gm_json_open(buf);
+            gm_json_str(buf, "callback_type", callback_names[callback_type]);
+            gm_json_str(buf, "event_type", event_type);
+            gm_json_str(buf, "type", type);
+            gm_json_int(buf, "flags", nted->flags);
+            gm_json_int(buf, "attr", nted->attr);
+            gm_json_timeval(buf, "timestamp", &nted->timestamp);
+            gm_json_int(buf, "recurring", nted->recurring);
+            gm_json_int(buf, "run_time", (int)nted->run_time);
+            free(event_type);
+            free(type);
+            break;
+        case NEBCALLBACK_LOG_DATA:                          /*  9 */
+            nld = (nebstruct_log_data *)data;
+            json_header(buf, callback_type, nld->type, nld->flags, nld->attr, &nld->timestamp);
+            gm_json_int(buf, "entry_time", (int)nld->entry_time);
+            gm_json_int(buf, "data_type", nld->data_type);
+            gm_json_str(buf, "data", nld->data);
+            break;
+        case NEBCALLBACK_SYSTEM_COMMAND_DATA:               /* 10 */
+            nscd = (nebstruct_system_command_data *)data;
+            json_header(buf, callback_type, nscd->type, nscd->flags, nscd->attr, &nscd->timestamp);
+            gm_json_timeval(buf, "start_time", &nscd->start_time);
+            gm_json_timeval(buf, "end_time", &nscd->end_time);
+            gm_json_int(buf, "timeout", nscd->timeout);
+            gm_json_str(buf, "command_line", nscd->command_line);
+            gm_json_int(buf, "early_timeout", nscd->early_timeout);
+            gm_json_double(buf, "execution_time", nscd->execution_time);
+            gm_json_int(buf, "return_code", nscd->return_code);
+            gm_json_str(buf, "output", nscd->output);
+            break;
+        case NEBCALLBACK_EVENT_HANDLER_DATA:                /* 11 */
+            nehd = (nebstruct_event_handler_data *)data;
+            json_header(buf, callback_type, nehd->type, nehd->flags, nehd->attr, &nehd->timestamp);
+            gm_json_int(buf, "eventhandler_type", nehd->eventhandler_type);
+            gm_json_str(buf, "host_name", nehd->host_name);
+            gm_json_str(buf, "service_description", nehd->service_description);
+            gm_json_int(buf, "state_type", nehd->state_type);
+            gm_json_int(buf, "state", nehd->state);
+            gm_json_int(buf, "timeout", nehd->timeout);
+            gm_json_str(buf, "command_name", nehd->command_name);
+            gm_json_str(buf, "command_args", nehd->command_args);
+            gm_json_str(buf, "command_line", nehd->command_line);
+            gm_json_timeval(buf, "start_time", &nehd->start_time);
+            gm_json_timeval(buf, "end_time", &nehd->end_time);
+            gm_json_int(buf, "early_timeout", nehd->early_timeout);
+            gm_json_double(buf, "execution_time", nehd->execution_time);
+            gm_json_int(buf, "return_code", nehd->return_code);
+            gm_json_str(buf, "output", nehd->output);
+            break;
+        case NEBCALLBACK_NOTIFICATION_DATA:                 /* 12 */
+            nnd = (nebstruct_notification_data *)data;
+            json_header(buf, callback_type, nnd->type, nnd->flags, nnd->attr, &nnd->timestamp);
+            gm_json_int(buf, "notification_type", nnd->notification_type);
+            gm_json_timeval(buf, "start_time", &nnd->start_time);
+            gm_json_timeval(buf, "end_time", &nnd->end_time);
+            gm_json_str(buf, "host_name", nnd->host_name);
+            gm_json_str(buf, "service_description", nnd->service_description);
+            gm_json_int(buf, "reason_type", nnd->reason_type);
+            gm_json_int(buf, "state", nnd->state);
+            gm_json_str(buf, "output", nnd->output);
+            gm_json_str(buf, "ack_author", nnd->ack_author);
+            gm_json_str(buf, "ack_data", nnd->ack_data);
+            gm_json_int(buf, "escalated", nnd->escalated);
+            gm_json_int(buf, "contacts_notified", nnd->contacts_notified);
+            break;
+        case NEBCALLBACK_SERVICE_CHECK_DATA:                /* 13 */
+            nscd2 = (nebstruct_service_check_data *)data;
+            json_header(buf, callback_type, nscd2->type, nscd2->flags, nscd2->attr, &nscd2->timestamp);
+            gm_json_str(buf, "host_name", nscd2->host_name);
+            gm_json_str(buf, "service_description", nscd2->service_description);
+            gm_json_int(buf, "check_type", nscd2->check_type);
+            gm_json_int(buf, "current_attempt", nscd2->current_attempt);
+            gm_json_int(buf, "max_attempts", nscd2->max_attempts);
+            gm_json_int(buf, "state_type", nscd2->state_type);
+            gm_json_int(buf, "state", nscd2->state);
+            gm_json_int(buf, "timeout", nscd2->timeout);
+            gm_json_str(buf, "command_name", nscd2->command_name);
+            gm_json_str(buf, "command_args", nscd2->command_args);
+            gm_json_str(buf, "command_line", nscd2->command_line);
+            gm_json_timeval(buf, "start_time", &nscd2->start_time);
+            gm_json_timeval(buf, "end_time", &nscd2->end_time);
+            gm_json_int(buf, "early_timeout", nscd2->early_timeout);
+            gm_json_double(buf, "execution_time", nscd2->execution_time);
+            gm_json_double(buf, "latency", nscd2->latency);
+            gm_json_int(buf, "return_code", nscd2->return_code);
+            gm_json_str(buf, "output", nscd2->output);
+            gm_json_str(buf, "long_output", nscd2->long_output);
+            gm_json_str(buf, "perf_data", nscd2->perf_data);
+            break;
+        case NEBCALLBACK_HOST_CHECK_DATA:                   /* 14 */
+            nhcd = (nebstruct_host_check_data *)data;
+            json_header(buf, callback_type, nhcd->type, nhcd->flags, nhcd->attr, &nhcd->timestamp);
+            gm_json_str(buf, "host_name", nhcd->host_name);
+            gm_json_int(buf, "check_type", nhcd->check_type);
+            gm_json_int(buf, "current_attempt", nhcd->current_attempt);
+            gm_json_int(buf, "max_attempts", nhcd->max_attempts);
+            gm_json_int(buf, "state_type", nhcd->state_type);
+            gm_json_int(buf, "state", nhcd->state);
+            gm_json_int(buf, "timeout", nhcd->timeout);
+            gm_json_str(buf, "command_name", nhcd->command_name);
+            gm_json_str(buf, "command_args", nhcd->command_args);
+            gm_json_str(buf, "command_line", nhcd->command_line);
+            gm_json_timeval(buf, "start_time", &nhcd->start_time);
+            gm_json_timeval(buf, "end_time", &nhcd->end_time);
+            gm_json_int(buf, "early_timeout", nhcd->early_timeout);
+            gm_json_double(buf, "execution_time", nhcd->execution_time);
+            gm_json_double(buf, "latency", nhcd->latency);
+            gm_json_int(buf, "return_code", nhcd->return_code);
+            gm_json_str(buf, "output", nhcd->output);
+            gm_json_str(buf, "long_output", nhcd->long_output);
+            gm_json_str(buf, "perf_data", nhcd->perf_data);
+            break;
+        case NEBCALLBACK_COMMENT_DATA:                      /* 15 */
+            ncd = (nebstruct_comment_data *)data;
+            json_header(buf, callback_type, ncd->type, ncd->flags, ncd->attr, &ncd->timestamp);
+            gm_json_int(buf, "comment_type", ncd->comment_type);
+            gm_json_str(buf, "host_name", ncd->host_name);
+            gm_json_str(buf, "service_description", ncd->service_description);
+            gm_json_int(buf, "entry_time", (long long)ncd->entry_time);
+            gm_json_str(buf, "author_name", ncd->author_name);
+            gm_json_str(buf, "comment_data", ncd->comment_data);
+            gm_json_int(buf, "persistent", ncd->persistent);
+            gm_json_int(buf, "source", ncd->source);
+            gm_json_int(buf, "entry_type", ncd->entry_type);
+            gm_json_int(buf, "expires", ncd->expires);
+            gm_json_int(buf, "expire_time", (long long)ncd->expire_time);
+            gm_json_int(buf, "comment_id", ncd->comment_id);
+            break;
+        case NEBCALLBACK_DOWNTIME_DATA:                     /* 16 */
+            ndd = (nebstruct_downtime_data *)data;
+            json_header(buf, callback_type, ndd->type, ndd->flags, ndd->attr, &ndd->timestamp);
+            gm_json_int(buf, "downtime_type", ndd->downtime_type);
+            gm_json_str(buf, "host_name", ndd->host_name);
+            gm_json_str(buf, "service_description", ndd->service_description);
+            gm_json_int(buf, "entry_time", (long long)ndd->entry_time);
+            gm_json_str(buf, "author_name", ndd->author_name);
+            gm_json_str(buf, "comment_data", ndd->comment_data);
+            gm_json_int(buf, "start_time", (long long)ndd->start_time);
+            gm_json_int(buf, "end_time", (long long)ndd->end_time);
+            gm_json_int(buf, "fixed", ndd->fixed);
+            gm_json_int(buf, "duration", ndd->duration);
+            gm_json_int(buf, "triggered_by", ndd->triggered_by);
+            gm_json_int(buf, "downtime_id", ndd->downtime_id);
+            break;
+        case NEBCALLBACK_FLAPPING_DATA:                     /* 17 */
+            nfd = (nebstruct_flapping_data *)data;
+            json_header(buf, callback_type, nfd->type, nfd->flags, nfd->attr, &nfd->timestamp);
+            gm_json_int(buf, "flapping_type", nfd->flapping_type);
+            gm_json_str(buf, "host_name", nfd->host_name);
+            gm_json_str(buf, "service_description", nfd->service_description);
+            gm_json_double(buf, "percent_change", nfd->percent_change);
+            gm_json_double(buf, "high_threshold", nfd->high_threshold);
+            gm_json_double(buf, "low_threshold", nfd->low_threshold);
+            gm_json_int(buf, "comment_id", nfd->comment_id);
+            break;
+        case NEBCALLBACK_PROGRAM_STATUS_DATA:               /* 18 */
+            npsd = (nebstruct_program_status_data *)data;
+            json_header(buf, callback_type, npsd->type, npsd->flags, npsd->attr, &npsd->timestamp);
+            gm_json_int(buf, "program_start", (long long)npsd->program_start);
+            gm_json_int(buf, "pid", npsd->pid);
+            gm_json_int(buf, "daemon_mode", npsd->daemon_mode);
+            gm_json_int(buf, "last_log_rotation", (long long)npsd->last_log_rotation);
+            gm_json_int(buf, "notifications_enabled", npsd->notifications_enabled);
+            gm_json_int(buf, "active_service_checks_enabled", npsd->active_service_checks_enabled);
+            gm_json_int(buf, "passive_service_checks_enabled", npsd->passive_service_checks_enabled);
+            gm_json_int(buf, "active_host_checks_enabled", npsd->active_host_checks_enabled);
+            gm_json_int(buf, "passive_host_checks_enabled", npsd->passive_host_checks_enabled);
+            gm_json_int(buf, "event_handlers_enabled", npsd->event_handlers_enabled);
+            gm_json_int(buf, "flap_detection_enabled", npsd->flap_detection_enabled);
+            gm_json_int(buf, "process_performance_data", npsd->process_performance_data);
+            gm_json_int(buf, "obsess_over_hosts", npsd->obsess_over_hosts);
+            gm_json_int(buf, "obsess_over_services", npsd->obsess_over_services);
+            gm_json_int(buf, "modified_host_attributes", npsd->modified_host_attributes);
+            gm_json_int(buf, "modified_service_attributes", npsd->modified_service_attributes);
+            gm_json_str(buf, "global_host_event_handler", npsd->global_host_event_handler);
+            gm_json_str(buf, "global_service_event_handler", npsd->global_service_event_handler);
+            break;
+        case NEBCALLBACK_HOST_STATUS_DATA:                  /* 19 */
+            nhsd = (nebstruct_host_status_data *)data;
+            json_header(buf, callback_type, nhsd->type, nhsd->flags, nhsd->attr, &nhsd->timestamp);
+            json_host(buf, (host *)nhsd->object_ptr);
+            break;
+        case NEBCALLBACK_SERVICE_STATUS_DATA:               /* 20 */
+            nssd = (nebstruct_service_status_data *)data;
+            json_header(buf, callback_type, nssd->type, nssd->flags, nssd->attr, &nssd->timestamp);
+            json_service(buf, (service *)nssd->object_ptr);
+            break;
+        case NEBCALLBACK_ADAPTIVE_PROGRAM_DATA:             /* 21 */
+            napd = (nebstruct_adaptive_program_data *)data;
+            json_header(buf, callback_type, napd->type, napd->flags, napd->attr, &napd->timestamp);
+            gm_json_int(buf, "command_type", napd->command_type);
+            gm_json_int(buf, "modified_host_attribute", napd->modified_host_attribute);
+            gm_json_int(buf, "modified_host_attributes", napd->modified_host_attributes);
+            gm_json_int(buf, "modified_service_attribute", napd->modified_service_attribute);
+            gm_json_int(buf, "modified_service_attributes", napd->modified_service_attributes);
+            break;
+        case NEBCALLBACK_ADAPTIVE_HOST_DATA:                /* 22 */
+            nahd = (nebstruct_adaptive_host_data *)data;
+            json_header(buf, callback_type, nahd->type, nahd->flags, nahd->attr, &nahd->timestamp);
+            gm_json_int(buf, "command_type", nahd->command_type);
+            gm_json_int(buf, "modified_attribute", nahd->modified_attribute);
+            gm_json_int(buf, "modified_attributes", nahd->modified_attributes);
+            if(nahd->object_ptr != NULL)
+                gm_json_str(buf, "host_name", ((host *)nahd->object_ptr)->name);
+            break;
+        case NEBCALLBACK_ADAPTIVE_SERVICE_DATA:             /* 23 */
+            nasd = (nebstruct_adaptive_service_data *)data;
+            json_header(buf, callback_type, nasd->type, nasd->flags, nasd->attr, &nasd->timestamp);
+            gm_json_int(buf, "command_type", nasd->command_type);
+            gm_json_int(buf, "modified_attribute", nasd->modified_attribute);
+            gm_json_int(buf, "modified_attributes", nasd->modified_attributes);
+            if(nasd->object_ptr != NULL) {
+                gm_json_str(buf, "host_name", ((service *)nasd->object_ptr)->host_name);
+                gm_json_str(buf, "service_description", ((service *)nasd->object_ptr)->description);
+            }
+            break;
+        case NEBCALLBACK_EXTERNAL_COMMAND_DATA:             /* 24 */
+            necd = (nebstruct_external_command_data *)data;
+            json_header(buf, callback_type, necd->type, necd->flags, necd->attr, &necd->timestamp);
+            gm_json_int(buf, "command_type", necd->command_type);
+            gm_json_int(buf, "entry_time", (long long)necd->entry_time);
+            gm_json_str(buf, "command_string", necd->command_string);
+            gm_json_str(buf, "command_args", necd->command_args);
+            break;
+        case NEBCALLBACK_AGGREGATED_STATUS_DATA:            /* 25 */
+            nagsd = (nebstruct_aggregated_status_data *)data;
+            json_header(buf, callback_type, nagsd->type, nagsd->flags, nagsd->attr, &nagsd->timestamp);
+            break;
+        case NEBCALLBACK_RETENTION_DATA:                    /* 26 */
+            nrd = (nebstruct_retention_data *)data;
+            json_header(buf, callback_type, nrd->type, nrd->flags, nrd->attr, &nrd->timestamp);
+            break;
+        case NEBCALLBACK_CONTACT_NOTIFICATION_DATA:         /* 27 */
+            ncnd = (nebstruct_contact_notification_data *)data;
+            json_header(buf, callback_type, ncnd->type, ncnd->flags, ncnd->attr, &ncnd->timestamp);
+            gm_json_int(buf, "notification_type", ncnd->notification_type);
+            gm_json_timeval(buf, "start_time", &ncnd->start_time);
+            gm_json_timeval(buf, "end_time", &ncnd->end_time);
+            gm_json_str(buf, "host_name", ncnd->host_name);
+            gm_json_str(buf, "service_description", ncnd->service_description);
+            gm_json_str(buf, "contact_name", ncnd->contact_name);
+            gm_json_int(buf, "reason_type", ncnd->reason_type);
+            gm_json_int(buf, "state", ncnd->state);
+            gm_json_str(buf, "output", ncnd->output);
+            gm_json_str(buf, "ack_author", ncnd->ack_author);
+            gm_json_str(buf, "ack_data", ncnd->ack_data);
+            gm_json_int(buf, "escalated", ncnd->escalated);
+            break;
+        case NEBCALLBACK_CONTACT_NOTIFICATION_METHOD_DATA:  /* 28 */
+            ncnmd = (nebstruct_contact_notification_method_data *)data;
+            json_header(buf, callback_type, ncnmd->type, ncnmd->flags, ncnmd->attr, &ncnmd->timestamp);
+            gm_json_int(buf, "notification_type", ncnmd->notification_type);
+            gm_json_timeval(buf, "start_time", &ncnmd->start_time);
+            gm_json_timeval(buf, "end_time", &ncnmd->end_time);
+            gm_json_str(buf, "host_name", ncnmd->host_name);
+            gm_json_str(buf, "service_description", ncnmd->service_description);
+            gm_json_str(buf, "contact_name", ncnmd->contact_name);
+            gm_json_str(buf, "command_name", ncnmd->command_name);
+            gm_json_str(buf, "command_args", ncnmd->command_args);
+            gm_json_int(buf, "reason_type", ncnmd->reason_type);
+            gm_json_int(buf, "state", ncnmd->state);
+            gm_json_str(buf, "output", ncnmd->output);
+            gm_json_str(buf, "ack_author", ncnmd->ack_author);
+            gm_json_str(buf, "ack_data", ncnmd->ack_data);
+            gm_json_int(buf, "escalated", ncnmd->escalated);
+            break;
+        case NEBCALLBACK_ACKNOWLEDGEMENT_DATA:              /* 29 */
+            nackd = (nebstruct_acknowledgement_data *)data;
+            json_header(buf, callback_type, nackd->type, nackd->flags, nackd->attr, &nackd->timestamp);
+            gm_json_int(buf, "acknowledgement_type", nackd->acknowledgement_type);
+            gm_json_str(buf, "host_name", nackd->host_name);
+            gm_json_str(buf, "service_description", nackd->service_description);
+            gm_json_int(buf, "state", nackd->state);
+            gm_json_str(buf, "author_name", nackd->author_name);
+            gm_json_str(buf, "comment_data", nackd->comment_data);
+            gm_json_int(buf, "is_sticky", nackd->is_sticky);
+            gm_json_int(buf, "persistent_comment", nackd->persistent_comment);
+            gm_json_int(buf, "notify_contacts", nackd->notify_contacts);
+            break;
+        case NEBCALLBACK_STATE_CHANGE_DATA:                 /* 30 */
+            nstd = (nebstruct_statechange_data *)data;
+            json_header(buf, callback_type, nstd->type, nstd->flags, nstd->attr, &nstd->timestamp);
+            gm_json_int(buf, "statechange_type", nstd->statechange_type);
+            gm_json_str(buf, "host_name", nstd->host_name);
+            gm_json_str(buf, "service_description", nstd->service_description);
+            gm_json_int(buf, "state", nstd->state);
+            gm_json_int(buf, "state_type", nstd->state_type);
+            gm_json_int(buf, "current_attempt", nstd->current_attempt);
+            gm_json_int(buf, "max_attempts", nstd->max_attempts);
+            gm_json_str(buf, "output", nstd->output);
+            break;
+        case NEBCALLBACK_CONTACT_STATUS_DATA:               /* 31 */
+            ncsd = (nebstruct_contact_status_data *)data;
+            json_header(buf, callback_type, ncsd->type, ncsd->flags, ncsd->attr, &ncsd->timestamp);
+            cntct = (contact *)ncsd->object_ptr;
+            if(cntct != NULL) {
+                gm_json_str(buf, "contact_name", cntct->name);
+                gm_json_int(buf, "host_notifications_enabled", cntct->host_notifications_enabled);
+                gm_json_int(buf, "service_notifications_enabled", cntct->service_notifications_enabled);
+                gm_json_int(buf, "last_host_notification", (long long)cntct->last_host_notification);
+                gm_json_int(buf, "last_service_notification", (long long)cntct->last_service_notification);
+                gm_json_int(buf, "modified_attributes", cntct->modified_attributes);
+            }
+            break;
+        case NEBCALLBACK_ADAPTIVE_CONTACT_DATA:             /* 32 */
+            nacd = (nebstruct_adaptive_contact_data *)data;
+            json_header(buf, callback_type, nacd->type, nacd->flags, nacd->attr, &nacd->timestamp);
+            gm_json_int(buf, "command_type", nacd->command_type);
+            gm_json_int(buf, "modified_attribute", nacd->modified_attribute);
+            gm_json_int(buf, "modified_attributes", nacd->modified_attributes);
+            gm_json_int(buf, "modified_host_attribute", nacd->modified_host_attribute);
+            gm_json_int(buf, "modified_host_attributes", nacd->modified_host_attributes);
+            gm_json_int(buf, "modified_service_attribute", nacd->modified_service_attribute);
+            gm_json_int(buf, "modified_service_attributes", nacd->modified_service_attributes);
+            if(nacd->object_ptr != NULL)
+                gm_json_str(buf, "contact_name", ((contact *)nacd->object_ptr)->name);
+            break;
+        default:
+            gm_log( GM_LOG_ERROR, "handle_export() unknown export type: %d\n", callback_type );
+            return(GM_ERROR);
+    }
+
+    gm_json_close(buf);
+    return(GM_OK);
+}
+
+
+/* send data to all export queues */
+void export_send(int callback_type, gm_buffer_t * buf) {
+    int i;
+    for(i = 0; i < mod_gm_opt->exports[callback_type]->elem_number; i++) {
+        mod_gm_submit_job(mod_gm_opt->exports[callback_type]->name[i], /* queue name */
+                          NULL,
+                          buf->data,
+                          GM_JOB_PRIO_NORMAL,
+                          GM_DEFAULT_JOB_RETRIES,
+                          0
+                        );
+    }
+}
+
+
+/* allocate pending tables */
+void export_coalesce_init(void) {
+    export_coalesce_free();
+    if(mod_gm_opt->export_coalesce_window <= 0)
+        return;
+
+    if(mod_gm_opt->exports[NEBCALLBACK_HOST_STATUS_DATA]->elem_number > 0) {
+        pending_hosts_num = num_objects.hosts;
+        pending_hosts     = gm_malloc((pending_hosts_num > 0 ? pending_hosts_num : 1) * sizeof(export_pending_t));
+        dirty_hosts       = gm_malloc((pending_hosts_num > 0 ? pending_hosts_num : 1) * sizeof(unsigned int));
+        memset(pending_hosts, 0, pending_hosts_num * sizeof(export_pending_t));
+    }
+    if(mod_gm_opt->exports[NEBCALLBACK_SERVICE_STATUS_DATA]->elem_number > 0) {
+        pending_services_num = num_objects.services;
+        pending_services     = gm_malloc((pending_services_num > 0 ? pending_services_num : 1) * sizeof(export_pending_t));
+        dirty_services       = gm_malloc((pending_services_num > 0 ? pending_services_num : 1) * sizeof(unsigned int));
+        memset(pending_services, 0, pending_services_num * sizeof(export_pending_t));
+    }
+    dirty_hosts_num    = 0;
+    dirty_services_num = 0;
+    coalesce_buffer    = gm_buffer_new();
+    last_flush         = time(NULL);
+
+    gm_log( GM_LOG_DEBUG, "coalescing status exports for %u hosts and %u services\n", pending_hosts_num, pending_services_num );
+}
+
+
+/* remember the latest update of an object */
+static int mark_pending(export_pending_t * pending, unsigned int num, unsigned int * dirty, unsigned int * dirty_num, unsigned int id, int type, int flags, int attr, struct timeval * timestamp) {
+    if(pending == NULL || id >= num)
+        return(FALSE);
+    if(!pending[id].pending) {
+        pending[id].pending = TRUE;
+        dirty[(*dirty_num)++] = id;
+    }
+    pending[id].type      = type;
+    pending[id].flags     = flags;
+    pending[id].attr      = attr;
+    pending[id].timestamp = *timestamp;
+    return(TRUE);
+}
+
+
+/* hold back status updates */
+int export_coalesce_add(int callback_type, void * data) {
+    nebstruct_host_status_data * nhsd;
+    nebstruct_service_status_data * nssd;
+
+    if(callback_type == NEBCALLBACK_HOST_STATUS_DATA) {
+        nhsd = (nebstruct_host_status_data *)data;
+        if(nhsd->object_ptr == NULL)
+            return(FALSE);
+        return(mark_pending(pending_hosts, pending_hosts_num, dirty_hosts, &dirty_hosts_num, ((host *)nhsd->object_ptr)->id,
+                            nhsd->type, nhsd->flags, nhsd->attr, &nhsd->timestamp));
+    }
+    if(callback_type == NEBCALLBACK_SERVICE_STATUS_DATA) {
+        nssd = (nebstruct_service_status_data *)data;
+        if(nssd->object_ptr == NULL)
+            return(FALSE);
+        return(mark_pending(pending_services, pending_services_num, dirty_services, &dirty_services_num, ((service *)nssd->object_ptr)->id,
+                            nssd->type, nssd->flags, nssd->attr, &nssd->timestamp));
+    }
+    return(FALSE);
+}
+
+
+/* send latest status of all updated objects */
+void export_coalesce_flush(void) {
+    unsigned int x, id;
+    nebstruct_host_status_data nhsd;
+    nebstruct_service_status_data nssd;
+
+    last_flush = time(NULL);
+
+    for(x = 0; x < dirty_hosts_num; x++) {
+        id = dirty_hosts[x];
+        memset(&nhsd, 0, sizeof(nhsd));
+        nhsd.type       = pending_hosts[id].type;
+        nhsd.flags      = pending_hosts[id].flags;
+        nhsd.attr       = pending_hosts[id].attr;
+        nhsd.timestamp  = pending_hosts[id].timestamp;
+        nhsd.object_ptr = host_ary[id];
+        pending_hosts[id].pending = FALSE;
+        gm_buffer_reset(coalesce_buffer);
+        if(export_serialize(coalesce_buffer, NEBCALLBACK_HOST_STATUS_DATA, &nhsd) == GM_OK)
+            export_send(NEBCALLBACK_HOST_STATUS_DATA, coalesce_buffer);
+    }
+    for(x = 0; x < dirty_services_num; x++) {
+        id = dirty_services[x];
+        memset(&nssd, 0, sizeof(nssd));
+        nssd.type       = pending_services[id].type;
+        nssd.flags      = pending_services[id].flags;
+        nssd.attr       = pending_services[id].attr;
+        nssd.timestamp  = pending_services[id].timestamp;
+        nssd.object_ptr = service_ary[id];
+        pending_services[id].pending = FALSE;
+        gm_buffer_reset(coalesce_buffer);
+        if(export_serialize(coalesce_buffer, NEBCALLBACK_SERVICE_STATUS_DATA, &nssd) == GM_OK)
+            export_send(NEBCALLBACK_SERVICE_STATUS_DATA, coalesce_buffer);
+    }
+    if(dirty_hosts_num + dirty_services_num > 0)
+        gm_log( GM_LOG_TRACE, "export_coalesce_flush() sent %u host and %u service status updates\n", dirty_hosts_num, dirty_services_num );
+    dirty_hosts_num    = 0;
+    dirty_services_num = 0;
+}
+
+
+/* flush once the window has passed */
+void export_coalesce_tick(time_t now) {
+    if(now - last_flush >= mod_gm_opt->export_coalesce_window)
+        export_coalesce_flush();
+}
+
+
+/* send pending updates and free everything */
+void export_coalesce_free(void) {
+    if(coalesce_buffer != NULL)
+        export_coalesce_flush();
+    gm_free(pending_hosts);
+    gm_free(pending_services);
+    gm_free(dirty_hosts);
+    gm_free(dirty_services);
+    gm_buffer_free(&coalesce_buffer);
+    pending_hosts_num    = 0;
+    pending_services_num = 0;
+    dirty_hosts_num      = 0;
+    dirty_services_num   = 0;
+}
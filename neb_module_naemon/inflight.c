@@ -0,0 +1,295 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/* include header */
+#include "inflight.h"
+#include "shard.h"
+#include "utils.h"
+
+#define INFLIGHT_WHEEL_MASK (INFLIGHT_WHEEL_SIZE - 1)
+
+/* a submitted check without result */
+typedef struct inflight_job_struct {
+    unsigned int   hash;                            /* hash of host name and service description */
+    host         * hst;                             /* host */
+    service      * svc;                             /* service or NULL for host checks */
+    int            queue;                           /* index into the queue list */
+    time_t         deadline;                        /* job is orphaned after this time */
+    struct inflight_job_struct * next;              /* next job in the same bucket */
+    struct inflight_job_struct * wheel_next;        /* next job in the same wheel slot */
+    struct inflight_job_struct * wheel_prev;        /* previous job in the same wheel slot */
+} inflight_job_t;
+
+static pthread_mutex_t inflight_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* jobs by object */
+static inflight_job_t ** buckets = NULL;
+static unsigned int buckets_size = 0;
+
+/* jobs by deadline */
+static inflight_job_t * wheel[INFLIGHT_WHEEL_SIZE];
+static time_t last_expire = 0;
+
+/* outstanding jobs per queue */
+static char ** queue_names  = NULL;
+static int   * queue_counts = NULL;
+static int queues_num       = 0;
+static int queues_size      = 0;
+static int total_count      = 0;
+
+/* return index of a queue, adds unknown queues */
+static int queue_index(const char * queue) {
+    int x;
+    for(x = 0; x < queues_num; x++) {
+        if(!strcmp(queue_names[x], queue))
+            return(x);
+    }
+    if(queues_num == queues_size) {
+        queues_size  = queues_size == 0 ? 8 : queues_size * 2;
+        queue_names  = gm_realloc(queue_names, queues_size * sizeof(char *));
+        queue_counts = gm_realloc(queue_counts, queues_size * sizeof(int));
+    }
+    queue_names[queues_num]  = gm_strdup(queue);
+    queue_counts[queues_num] = 0;
+    return(queues_num++);
+}
+
+/* true if the job belongs to the given object */
+static int job_matches(inflight_job_t * job, unsigned int hash, const char * host_name, const char * service_description) {
+    if(job->hash != hash || strcmp(job->hst->name, host_name))
+        return(FALSE);
+    if(job->svc == NULL || service_description == NULL)
+        return(job->svc == NULL && service_description == NULL);
+    return(!strcmp(job->svc->description, service_description));
+}
+
+/* unlink a job from its bucket, returns the job or NULL */
+static inflight_job_t * bucket_remove(unsigned int hash, const char * host_name, const char * service_description) {
+    inflight_job_t ** pos = &buckets[hash & (buckets_size - 1)];
+    inflight_job_t * job;
+    for(job = *pos; job != NULL; pos = &job->next, job = job->next) {
+        if(job_matches(job, hash, host_name, service_description)) {
+            *pos = job->next;
+            return(job);
+        }
+    }
+    return(NULL);
+}
+
+static void wheel_insert(inflight_job_t * job) {
+    inflight_job_t ** slot = &wheel[job->deadline & INFLIGHT_WHEEL_MASK];
+    job->wheel_prev = NULL;
+    job->wheel_next = *slot;
+    if(*slot != NULL)
+        (*slot)->wheel_prev = job;
+    *slot = job;
+}
+
+static void wheel_remove(inflight_job_t * job) {
+    if(job->wheel_prev != NULL)
+        job->wheel_prev->wheel_next = job->wheel_next;
+    else
+        wheel[job->deadline & INFLIGHT_WHEEL_MASK] = job->wheel_next;
+    if(job->wheel_next != NULL)
+        job->wheel_next->wheel_prev = job->wheel_prev;
+}
+
+/* remove a job which is already unlinked from its bucket */
+static void release_job(inflight_job_t * job) {
+    wheel_remove(job);
+    queue_counts[job->queue]--;
+    total_count--;
+    gm_free(job);
+}
+
+/* allocate the job table */
+void inflight_init(time_t now) {
+    unsigned int objects;
+    int x;
+
+    inflight_free();
+
+    pthread_mutex_lock(&inflight_lock);
+    objects = num_objects.hosts + num_objects.services;
+    buckets_size = 64;
+    while(buckets_size < objects)
+        buckets_size *= 2;
+    buckets = gm_malloc(buckets_size * sizeof(inflight_job_t *));
+    memset(buckets, 0, buckets_size * sizeof(inflight_job_t *));
+    for(x = 0; x < INFLIGHT_WHEEL_SIZE; x++)
+        wheel[x] = NULL;
+    last_expire = now;
+    pthread_mutex_unlock(&inflight_lock);
+}
+
+/* forget all jobs */
+void inflight_free(void) {
+    inflight_job_t * job;
+    unsigned int x;
+    int y;
+
+    pthread_mutex_lock(&inflight_lock);
+    for(x = 0; x < buckets_size; x++) {
+        while(buckets[x] != NULL) {
+            job = buckets[x];
+            buckets[x] = job->next;
+            gm_free(job);
+        }
+    }
+    gm_free(buckets);
+    buckets_size = 0;
+    for(y = 0; y < INFLIGHT_WHEEL_SIZE; y++)
+        wheel[y] = NULL;
+
+    for(y = 0; y < queues_num; y++)
+        gm_free(queue_names[y]);
+    gm_free(queue_names);
+    gm_free(queue_counts);
+    queues_num  = 0;
+    queues_size = 0;
+    total_count = 0;
+    pthread_mutex_unlock(&inflight_lock);
+}
+
+/* remember a submitted check */
+void inflight_add(host * hst, service * svc, const char * queue, time_t deadline) {
+    const char * service_description = svc == NULL ? NULL : svc->description;
+    unsigned int hash = gm_shard_hash(hst->name, service_description);
+    inflight_job_t * job;
+
+    pthread_mutex_lock(&inflight_lock);
+    if(buckets_size == 0) {
+        pthread_mutex_unlock(&inflight_lock);
+        return;
+    }
+
+    /* a new check replaces the outstanding one */
+    job = bucket_remove(hash, hst->name, service_description);
+    if(job != NULL) {
+        wheel_remove(job);
+        queue_counts[job->queue]--;
+    } else {
+        job = gm_malloc(sizeof(inflight_job_t));
+        total_count++;
+    }
+
+    /* deadlines which are already due are picked up by the next run */
+    if(deadline <= last_expire)
+        deadline = last_expire + 1;
+
+    job->hash     = hash;
+    job->hst      = hst;
+    job->svc      = svc;
+    job->queue    = queue_index(queue == NULL ? "" : queue);
+    job->deadline = deadline;
+    job->next     = buckets[hash & (buckets_size - 1)];
+    buckets[hash & (buckets_size - 1)] = job;
+    wheel_insert(job);
+    queue_counts[job->queue]++;
+    pthread_mutex_unlock(&inflight_lock);
+}
+
+/* forget a job once its result arrived */
+int inflight_remove(const char * host_name, const char * service_description) {
+    inflight_job_t * job;
+
+    if(host_name == NULL)
+        return(FALSE);
+
+    pthread_mutex_lock(&inflight_lock);
+    if(buckets_size == 0) {
+        pthread_mutex_unlock(&inflight_lock);
+        return(FALSE);
+    }
+    job = bucket_remove(gm_shard_hash(host_name, service_description), host_name, service_description);
+    if(job != NULL)
+        release_job(job);
+    pthread_mutex_unlock(&inflight_lock);
+    return(job != NULL ? TRUE : FALSE);
+}
+
+/* expire all jobs of a single wheel slot */
+static int expire_slot(int slot, time_t now, inflight_orphan_cb callback) {
+    inflight_job_t * job = wheel[slot];
+    inflight_job_t * next;
+    int expired = 0;
+
+    for(; job != NULL; job = next) {
+        next = job->wheel_next;
+        /* jobs for later rounds of the wheel stay */
+        if(job->deadline > now)
+            continue;
+        bucket_remove(job->hash, job->hst->name, job->svc == NULL ? NULL : job->svc->description);
+        if(callback != NULL)
+            callback(job->hst, job->svc, queue_names[job->queue]);
+        release_job(job);
+        expired++;
+    }
+    return(expired);
+}
+
+/* turn overdue jobs into orphans */
+int inflight_expire(time_t now, inflight_orphan_cb callback) {
+    int expired = 0;
+    int x;
+    time_t t;
+
+    pthread_mutex_lock(&inflight_lock);
+    if(buckets_size == 0 || now <= last_expire) {
+        pthread_mutex_unlock(&inflight_lock);
+        return(0);
+    }
+
+    if(now - last_expire >= INFLIGHT_WHEEL_SIZE) {
+        for(x = 0; x < INFLIGHT_WHEEL_SIZE; x++)
+            expired += expire_slot(x, now, callback);
+    } else {
+        for(t = last_expire + 1; t <= now; t++)
+            expired += expire_slot(t & INFLIGHT_WHEEL_MASK, now, callback);
+    }
+    last_expire = now;
+    pthread_mutex_unlock(&inflight_lock);
+
+    return(expired);
+}
+
+/* number of outstanding jobs */
+int inflight_count(const char * queue) {
+    int count = 0;
+    int x;
+
+    pthread_mutex_lock(&inflight_lock);
+    if(queue == NULL) {
+        count = total_count;
+    } else {
+        for(x = 0; x < queues_num; x++) {
+            if(!strcmp(queue_names[x], queue)) {
+                count = queue_counts[x];
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&inflight_lock);
+    return(count);
+}
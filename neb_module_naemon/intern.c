@@ -0,0 +1,129 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/* include header */
+#include "intern.h"
+#include "shard.h"
+#include "utils.h"
+
+/* a host or service */
+typedef struct intern_entry_struct {
+    unsigned int   hash;                /* hash of host name and service description, 0 marks free slots */
+    host         * hst;                 /* host */
+    service      * svc;                 /* service or NULL for hosts */
+} intern_entry_t;
+
+/* open addressing table, at most half full */
+typedef struct intern_table_struct {
+    intern_entry_t * entries;
+    unsigned int     size;              /* power of 2 */
+} intern_table_t;
+
+static intern_table_t * table = NULL;
+
+/* true if the entry belongs to the given object */
+static int entry_matches(intern_entry_t * entry, unsigned int hash, const char * host_name, const char * service_description) {
+    if(entry->hash != hash || strcmp(entry->hst->name, host_name))
+        return(FALSE);
+    if(entry->svc == NULL || service_description == NULL)
+        return(entry->svc == NULL && service_description == NULL);
+    return(!strcmp(entry->svc->description, service_description));
+}
+
+static void table_insert(intern_table_t * t, host * hst, service * svc) {
+    unsigned int hash = gm_shard_hash(hst->name, svc == NULL ? NULL : svc->description);
+    unsigned int slot = hash & (t->size - 1);
+    while(t->entries[slot].hash != 0) {
+        /* duplicate objects cannot be created, but better be safe */
+        if(entry_matches(&t->entries[slot], hash, hst->name, svc == NULL ? NULL : svc->description))
+            return;
+        slot = (slot + 1) & (t->size - 1);
+    }
+    t->entries[slot].hash = hash;
+    t->entries[slot].hst  = hst;
+    t->entries[slot].svc  = svc;
+}
+
+/* build the table */
+void intern_init(void) {
+    intern_table_t * t;
+    unsigned int objects;
+    unsigned int x;
+
+    if(table != NULL)
+        return;
+
+    t = gm_malloc(sizeof(intern_table_t));
+    objects = num_objects.hosts + num_objects.services;
+    t->size = 64;
+    while(t->size < objects * 2)
+        t->size *= 2;
+    t->entries = gm_malloc(t->size * sizeof(intern_entry_t));
+    memset(t->entries, 0, t->size * sizeof(intern_entry_t));
+
+    for(x = 0; x < num_objects.hosts; x++) {
+        if(host_ary[x] != NULL)
+            table_insert(t, host_ary[x], NULL);
+    }
+    for(x = 0; x < num_objects.services; x++) {
+        if(service_ary[x] != NULL && service_ary[x]->host_ptr != NULL)
+            table_insert(t, service_ary[x]->host_ptr, service_ary[x]);
+    }
+
+    /* result threads are running already */
+    __atomic_store_n(&table, t, __ATOMIC_RELEASE);
+    gm_log( GM_LOG_DEBUG, "interned %u hosts and services\n", objects );
+}
+
+/* free the table */
+void intern_free(void) {
+    if(table == NULL)
+        return;
+    gm_free(table->entries);
+    gm_free(table);
+}
+
+/* find the object of a result */
+int intern_lookup(const char * host_name, const char * service_description, host ** hst, service ** svc) {
+    intern_table_t * t = __atomic_load_n(&table, __ATOMIC_ACQUIRE);
+    intern_entry_t * entry;
+    unsigned int hash, slot;
+
+    *hst = NULL;
+    *svc = NULL;
+    if(t == NULL)
+        return(GM_OK);
+
+    hash = gm_shard_hash(host_name, service_description);
+    slot = hash & (t->size - 1);
+    for(entry = &t->entries[slot]; entry->hash != 0; entry = &t->entries[slot]) {
+        if(entry_matches(entry, hash, host_name, service_description)) {
+            *hst = entry->hst;
+            *svc = entry->svc;
+            return(GM_OK);
+        }
+        slot = (slot + 1) & (t->size - 1);
+    }
+    return(GM_ERROR);
+}
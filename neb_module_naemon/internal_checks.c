@@ -0,0 +1,425 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/* include header */
+#include "internal_checks.h"
+#include "utils.h"
+
+extern mod_gm_opt_t *mod_gm_opt;
+
+#define INTERNAL_CHECK_HANDLERS 3
+
+/* parsed command line of a single host or service */
+typedef struct internal_check_struct {
+    char    * command_line;     /* command line the entry has been parsed from, NULL if not parsed yet */
+    int       handler;          /* GM_INTERNAL_CHECK_* flag or 0 if this is no internal check */
+    int       return_code;      /* fixed return code of check_dummy and constant checks */
+    char    * output;           /* fixed output or error message */
+    host    * copy_host;        /* source object of check_copy_state */
+    service * copy_service;     /* source service of check_copy_state or NULL */
+} internal_check_t;
+
+/* parsed checks per object id */
+static internal_check_t * host_checks    = NULL;
+static internal_check_t * service_checks = NULL;
+static unsigned int host_checks_num    = 0;
+static unsigned int service_checks_num = 0;
+
+/* statistics */
+static const char * handler_names[INTERNAL_CHECK_HANDLERS] = { "check_dummy", "constant", "check_copy_state" };
+static unsigned long handler_served[INTERNAL_CHECK_HANDLERS] = { 0, 0, 0 };
+static unsigned long handler_logged[INTERNAL_CHECK_HANDLERS] = { 0, 0, 0 };
+static time_t last_stats_log = 0;
+
+/* map GM_INTERNAL_CHECK_* flag to index, -1 for unknown flags */
+static int handler_index(int handler) {
+    switch(handler) {
+        case GM_INTERNAL_CHECK_DUMMY:      return(0);
+        case GM_INTERNAL_CHECK_CONSTANT:   return(1);
+        case GM_INTERNAL_CHECK_COPY_STATE: return(2);
+    }
+    return(-1);
+}
+
+/* return the last path element of a command */
+static const char * command_basename(const char * cmd) {
+    const char * base = strrchr(cmd, '/');
+    return(base == NULL ? cmd : base+1);
+}
+
+/* reset a parsed entry */
+static void clear_entry(internal_check_t * entry) {
+    gm_free(entry->command_line);
+    gm_free(entry->output);
+    entry->handler      = 0;
+    entry->return_code  = 3;
+    entry->copy_host    = NULL;
+    entry->copy_service = NULL;
+}
+
+/* check_dummy <state> [<output>] */
+static int parse_check_dummy(internal_check_t * entry, char * cmd_line) {
+    int check_for_shell_chars = FALSE;
+    char *check = strtok( cmd_line, " " );
+
+    if(check == NULL || strstr(check, "/check_dummy") == NULL)
+        return(FALSE);
+
+    char *arg1  = strtok( NULL, " " );
+    char *output = strtok( NULL, "");
+    if(arg1 == NULL)
+        arg1 = "";
+    // return code starts with double quote, take string until next double quote
+    if(arg1[0] == '"') {
+        arg1++;
+        arg1 = strtok( arg1, "\"" );
+        if(arg1 == NULL)
+            arg1 = "";
+    }
+    // return code starts with single quote, take string until next single quote
+    else if(arg1[0] == '\'') {
+        arg1++;
+        arg1 = strtok( arg1, "'" );
+        if(arg1 == NULL)
+            arg1 = "";
+    }
+
+    if(output == NULL)
+        output = "";
+
+    // string starts with double quote, take string until next double quote
+    if(output[0] == '"') {
+        output++;
+        output = strtok( output, "\"" );
+        check_for_shell_chars = TRUE;
+        if(output == NULL)
+            output = "";
+    }
+    // string starts with single quote, take string until next single quote
+    else if(output[0] == '\'') {
+        output++;
+        output = strtok( output, "'" );
+        if(output == NULL)
+            output = "";
+    }
+    // string starts with something else, parse till first whitespace
+    else {
+        char *remain = strtok( output, " \t");
+        if(remain != NULL) {
+            output = remain;
+        }
+        check_for_shell_chars = TRUE;
+    }
+
+    if(check_for_shell_chars && strpbrk(output, "$&();<>`\"'|") != NULL)
+        return(FALSE);
+
+    entry->handler     = GM_INTERNAL_CHECK_DUMMY;
+    entry->return_code = 3;
+    if(!strcmp(arg1, "-V") || !strcmp(arg1, "--version")) {
+        gm_asprintf(&entry->output, "internal mod-gearman check_dummy, v%s\n", GM_VERSION);
+    }
+    else if(!strcmp(arg1, "-h") || !strcmp(arg1, "--help") || strspn (arg1, "0123456789 ") != strlen (arg1)) {
+        gm_asprintf(&entry->output, "usage: check_dummy <state> <output>\nsee check_dummy --help for complete help.");
+    } else {
+        switch(atoi(arg1)) {
+            case 0:
+                gm_asprintf(&entry->output, "OK: %s\n", output);
+                entry->return_code = 0;
+                break;
+            case 1:
+                gm_asprintf(&entry->output, "WARNING: %s\n", output);
+                entry->return_code = 1;
+                break;
+            case 2:
+                gm_asprintf(&entry->output, "CRITICAL: %s\n", output);
+                entry->return_code = 2;
+                break;
+            case 3:
+                gm_asprintf(&entry->output, "UNKNOWN: %s\n", output);
+                entry->return_code = 3;
+                break;
+            default:
+                gm_asprintf(&entry->output, "UNKNOWN: Status %s is not a supported error state", arg1);
+                break;
+        }
+    }
+    return(TRUE);
+}
+
+/* true and false without any arguments */
+static int parse_constant(internal_check_t * entry, char * cmd_line) {
+    char *check = strtok( cmd_line, " \t" );
+    const char * base;
+
+    if(check == NULL || strtok( NULL, " \t" ) != NULL)
+        return(FALSE);
+
+    base = command_basename(check);
+    if(!strcmp(base, "true"))
+        entry->return_code = 0;
+    else if(!strcmp(base, "false"))
+        entry->return_code = 1;
+    else
+        return(FALSE);
+
+    entry->handler = GM_INTERNAL_CHECK_CONSTANT;
+    entry->output  = gm_strdup("");
+    return(TRUE);
+}
+
+/* return next argument, quoted arguments may contain whitespace */
+static char * next_argument(char ** cmd_line) {
+    char * start = *cmd_line;
+    char * end;
+
+    while(*start == ' ' || *start == '\t')
+        start++;
+    if(*start == '\0')
+        return(NULL);
+
+    if(*start == '"' || *start == '\'') {
+        end = strchr(start+1, *start);
+        if(end == NULL)
+            return(NULL);
+        start++;
+    } else {
+        end = start + strcspn(start, " \t");
+    }
+    *cmd_line = *end == '\0' ? end : end+1;
+    *end = '\0';
+    return(start);
+}
+
+/* check_copy_state <host> [<service>] */
+static int parse_copy_state(internal_check_t * entry, char * cmd_line) {
+    char * check = next_argument(&cmd_line);
+    char * host_name;
+    char * service_description;
+
+    if(check == NULL || strcmp(command_basename(check), "check_copy_state"))
+        return(FALSE);
+
+    host_name           = next_argument(&cmd_line);
+    service_description = next_argument(&cmd_line);
+    if(host_name == NULL || next_argument(&cmd_line) != NULL)
+        return(FALSE);
+
+    entry->handler     = GM_INTERNAL_CHECK_COPY_STATE;
+    entry->return_code = 3;
+    entry->copy_host   = find_host(host_name);
+    if(entry->copy_host == NULL) {
+        gm_asprintf(&entry->output, "UNKNOWN: host %s does not exist\n", host_name);
+        return(TRUE);
+    }
+    if(service_description != NULL) {
+        entry->copy_service = find_service(host_name, service_description);
+        if(entry->copy_service == NULL) {
+            entry->copy_host = NULL;
+            gm_asprintf(&entry->output, "UNKNOWN: service %s on host %s does not exist\n", service_description, host_name);
+        }
+    }
+    return(TRUE);
+}
+
+/* parse a command line into the given entry */
+static void parse_entry(internal_check_t * entry, const char * command_line) {
+    char * cmd_line;
+
+    clear_entry(entry);
+    entry->command_line = gm_strdup(command_line);
+
+    cmd_line = gm_strdup(command_line);
+    if(strstr(command_line, "/check_dummy") != NULL && parse_check_dummy(entry, cmd_line) == TRUE) {
+        gm_free(cmd_line);
+        return;
+    }
+    strcpy(cmd_line, command_line);
+    if(parse_constant(entry, cmd_line) == TRUE) {
+        gm_free(cmd_line);
+        return;
+    }
+    strcpy(cmd_line, command_line);
+    if(strstr(command_line, "check_copy_state") != NULL && parse_copy_state(entry, cmd_line) == TRUE) {
+        gm_free(cmd_line);
+        return;
+    }
+    gm_free(cmd_line);
+
+    /* no internal check, remember that as well */
+    gm_free(entry->output);
+    entry->handler = 0;
+}
+
+/* return cache entry of an object, NULL if it did not exist at startup */
+static internal_check_t * check_entry(host * hst, service * svc) {
+    if(svc != NULL)
+        return(svc->id < service_checks_num ? &service_checks[svc->id] : NULL);
+    return(hst->id < host_checks_num ? &host_checks[hst->id] : NULL);
+}
+
+/* state and output of the source object */
+static void copy_state(internal_check_t * entry, int * return_code, char ** output) {
+    const char * plugin_output;
+    const char * perf_data;
+
+    if(entry->copy_service != NULL) {
+        if(!entry->copy_service->has_been_checked) {
+            gm_asprintf(output, "UNKNOWN: service %s on host %s has not been checked yet\n", entry->copy_service->description, entry->copy_service->host_name);
+            *return_code = 3;
+            return;
+        }
+        *return_code  = entry->copy_service->current_state;
+        plugin_output = entry->copy_service->plugin_output;
+        perf_data     = entry->copy_service->perf_data;
+    } else {
+        if(!entry->copy_host->has_been_checked) {
+            gm_asprintf(output, "UNKNOWN: host %s has not been checked yet\n", entry->copy_host->name);
+            *return_code = 3;
+            return;
+        }
+        /* host down and unreachable are both critical */
+        *return_code  = entry->copy_host->current_state == STATE_UP ? 0 : 2;
+        plugin_output = entry->copy_host->plugin_output;
+        perf_data     = entry->copy_host->perf_data;
+    }
+
+    if(perf_data != NULL && *perf_data != '\0')
+        gm_asprintf(output, "%s|%s\n", plugin_output == NULL ? "" : plugin_output, perf_data);
+    else
+        gm_asprintf(output, "%s\n", plugin_output == NULL ? "" : plugin_output);
+}
+
+/* log served checks every log_stats_interval seconds */
+static void log_stats(time_t now) {
+    int x;
+    unsigned long total = 0;
+
+    for(x = 0; x < INTERNAL_CHECK_HANDLERS; x++)
+        total += handler_served[x] - handler_logged[x];
+    if(total == 0)
+        return;
+
+    gm_log(GM_LOG_INFO, "internal check statistics: check_dummy: %7lu   constant: %7lu   check_copy_state: %7lu\n",
+           handler_served[0] - handler_logged[0],
+           handler_served[1] - handler_logged[1],
+           handler_served[2] - handler_logged[2]
+          );
+    for(x = 0; x < INTERNAL_CHECK_HANDLERS; x++)
+        handler_logged[x] = handler_served[x];
+    last_stats_log = now;
+}
+
+/* answer a check internally if possible */
+int internal_check_execute(const char * command_line, host * hst, service * svc, int * return_code, char ** output) {
+    internal_check_t * entry = check_entry(hst, svc);
+    internal_check_t uncached = { NULL, 0, 3, NULL, NULL, NULL };
+    int idx;
+    time_t now;
+
+    if(command_line == NULL)
+        return(GM_ERROR);
+
+    /* objects created after startup are parsed every time */
+    if(entry == NULL) {
+        entry = &uncached;
+        parse_entry(entry, command_line);
+    }
+    else if(entry->command_line == NULL || strcmp(entry->command_line, command_line)) {
+        parse_entry(entry, command_line);
+    }
+
+    if((entry->handler & mod_gm_opt->internal_checks) == 0) {
+        clear_entry(&uncached);
+        return(GM_ERROR);
+    }
+
+    if(entry->handler == GM_INTERNAL_CHECK_COPY_STATE && entry->copy_host != NULL) {
+        copy_state(entry, return_code, output);
+    } else {
+        *return_code = entry->return_code;
+        *output      = gm_strdup(entry->output);
+    }
+
+    idx = handler_index(entry->handler);
+    handler_served[idx]++;
+    gm_log( GM_LOG_DEBUG, "using internal %s for cmd: '%s'\n", handler_names[idx], command_line);
+    clear_entry(&uncached);
+
+    if(mod_gm_opt->log_stats_interval > 0) {
+        now = time(NULL);
+        if(last_stats_log == 0)
+            last_stats_log = now;
+        else if(now >= last_stats_log + mod_gm_opt->log_stats_interval)
+            log_stats(now);
+    }
+
+    return(GM_OK);
+}
+
+/* number of checks answered by a handler */
+unsigned long internal_checks_served(int handler) {
+    int idx = handler_index(handler);
+    if(idx < 0)
+        return(0);
+    return(handler_served[idx]);
+}
+
+/* allocate the per object cache */
+void internal_checks_init(void) {
+    unsigned int x;
+
+    internal_checks_free();
+
+    host_checks_num    = num_objects.hosts;
+    service_checks_num = num_objects.services;
+    host_checks        = gm_malloc((host_checks_num > 0 ? host_checks_num : 1) * sizeof(internal_check_t));
+    service_checks     = gm_malloc((service_checks_num > 0 ? service_checks_num : 1) * sizeof(internal_check_t));
+    for(x = 0; x < host_checks_num; x++) {
+        host_checks[x].command_line = NULL;
+        host_checks[x].output       = NULL;
+        clear_entry(&host_checks[x]);
+    }
+    for(x = 0; x < service_checks_num; x++) {
+        service_checks[x].command_line = NULL;
+        service_checks[x].output       = NULL;
+        clear_entry(&service_checks[x]);
+    }
+}
+
+/* free the cache */
+void internal_checks_free(void) {
+    unsigned int x;
+
+    log_stats(time(NULL));
+
+    for(x = 0; x < host_checks_num; x++)
+        clear_entry(&host_checks[x]);
+    for(x = 0; x < service_checks_num; x++)
+        clear_entry(&service_checks[x]);
+    gm_free(host_checks);
+    gm_free(service_checks);
+    host_checks_num    = 0;
+    service_checks_num = 0;
+}
@@ -0,0 +1,160 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/* include header */
+#include "latency_scheduler.h"
+#include "utils.h"
+
+#define LATENCY_WHEEL_MASK (LATENCY_WHEEL_SIZE - 1)
+
+/* upcoming submissions of a single queue, one slot per second */
+typedef struct latency_wheel_struct {
+    char         * queue;                       /* target queue */
+    unsigned int   slots[LATENCY_WHEEL_SIZE];   /* submissions per second */
+} latency_wheel_t;
+
+static latency_wheel_t ** wheels = NULL;
+static int wheels_num            = 0;
+static int wheels_size           = 0;
+static latency_wheel_t * last_wheel = NULL;
+static time_t wheel_now          = 0;          /* first second covered by the wheels */
+
+/* return the wheel of a queue, creates new wheels on demand */
+static latency_wheel_t * get_wheel(const char * queue) {
+    int x;
+
+    if(queue == NULL)
+        queue = "";
+    if(last_wheel != NULL && !strcmp(last_wheel->queue, queue))
+        return(last_wheel);
+
+    for(x = 0; x < wheels_num; x++) {
+        if(!strcmp(wheels[x]->queue, queue)) {
+            last_wheel = wheels[x];
+            return(last_wheel);
+        }
+    }
+
+    if(wheels_num == wheels_size) {
+        wheels_size = wheels_size == 0 ? 8 : wheels_size * 2;
+        wheels = gm_realloc(wheels, wheels_size * sizeof(latency_wheel_t *));
+    }
+    last_wheel = gm_malloc(sizeof(latency_wheel_t));
+    memset(last_wheel->slots, 0, sizeof(last_wheel->slots));
+    last_wheel->queue = gm_strdup(queue);
+    wheels[wheels_num++] = last_wheel;
+    return(last_wheel);
+}
+
+/* true if the second is covered by the wheels */
+static int in_range(time_t when) {
+    return(when >= wheel_now && when < wheel_now + LATENCY_WHEEL_SIZE);
+}
+
+/* reset the timing wheel */
+void latency_scheduler_init(time_t now) {
+    latency_scheduler_free();
+    wheel_now = now;
+}
+
+/* move the wheel forward */
+void latency_scheduler_advance(time_t now) {
+    int x;
+    time_t t;
+
+    if(now <= wheel_now)
+        return;
+
+    /* slots of elapsed seconds are reused for the end of the wheel */
+    if(now - wheel_now >= LATENCY_WHEEL_SIZE) {
+        for(x = 0; x < wheels_num; x++)
+            memset(wheels[x]->slots, 0, sizeof(wheels[x]->slots));
+    } else {
+        for(t = wheel_now; t < now; t++) {
+            for(x = 0; x < wheels_num; x++)
+                wheels[x]->slots[t & LATENCY_WHEEL_MASK] = 0;
+        }
+    }
+    wheel_now = now;
+}
+
+/* count a scheduled submission */
+void latency_scheduler_add(const char * queue, time_t when) {
+    if(!in_range(when))
+        return;
+    get_wheel(queue)->slots[when & LATENCY_WHEEL_MASK]++;
+}
+
+/* count a submission in the least loaded second of the window */
+time_t latency_scheduler_place(const char * queue, time_t when, int delay_max) {
+    latency_wheel_t * wheel = get_wheel(queue);
+    unsigned int * slot;
+    unsigned int best_load = 0;
+    time_t best = when + 1;
+    time_t first, last, t;
+
+    if(delay_max < 1)
+        delay_max = 1;
+    first = when + 1;
+    if(first < wheel_now)
+        first = wheel_now;
+    last = when + delay_max;
+    if(last >= wheel_now + LATENCY_WHEEL_SIZE)
+        last = wheel_now + LATENCY_WHEEL_SIZE - 1;
+
+    /* earliest second with the lowest load wins */
+    for(t = first; t <= last; t++) {
+        slot = &wheel->slots[t & LATENCY_WHEEL_MASK];
+        if(t == first || *slot < best_load) {
+            best      = t;
+            best_load = *slot;
+            if(best_load == 0)
+                break;
+        }
+    }
+
+    if(in_range(best))
+        wheel->slots[best & LATENCY_WHEEL_MASK]++;
+    return(best);
+}
+
+/* submissions scheduled for a second */
+unsigned int latency_scheduler_load(const char * queue, time_t when) {
+    if(!in_range(when))
+        return(0);
+    return(get_wheel(queue)->slots[when & LATENCY_WHEEL_MASK]);
+}
+
+/* free all timing wheels */
+void latency_scheduler_free(void) {
+    int x;
+    for(x = 0; x < wheels_num; x++) {
+        gm_free(wheels[x]->queue);
+        gm_free(wheels[x]);
+    }
+    gm_free(wheels);
+    wheels_num  = 0;
+    wheels_size = 0;
+    last_wheel  = NULL;
+}
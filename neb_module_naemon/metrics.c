@@ -0,0 +1,373 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/* include header */
+#include "metrics.h"
+#include "shard.h"
+#include "utils.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+extern mod_gm_opt_t *mod_gm_opt;
+extern int submit_queue_length;
+extern int spool_jobs;
+extern unsigned long spool_bytes;
+
+/* permissions of the metrics socket, the core user and its group may scrape it */
+#define METRICS_SOCKET_MODE 0660
+
+/* upper bounds of the duration histograms in microseconds */
+static const long long histogram_bounds[] = { 100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000 };
+#define HISTOGRAM_BUCKETS ((int)(sizeof(histogram_bounds) / sizeof(histogram_bounds[0])))
+
+/* duration histogram, buckets are not cumulative */
+typedef struct metrics_histogram_struct {
+    unsigned long      buckets[HISTOGRAM_BUCKETS + 1];  /* last bucket is +Inf */
+    unsigned long long sum;                             /* sum of all durations in microseconds */
+    unsigned long      count;                           /* number of observations */
+} metrics_histogram_t;
+
+/* statistics of a single queue */
+typedef struct metrics_queue_struct {
+    char                * name;         /* queue name, set once */
+    unsigned long         jobs;         /* jobs accepted by gearmand */
+    unsigned long         errors;       /* jobs which could not be sent */
+    unsigned long         admission[GM_ADMISSION_POSTPONE + 1]; /* checks while overloaded by decision */
+    metrics_histogram_t   duration;     /* submit duration per job */
+} metrics_queue_t;
+
+static metrics_queue_t queues[METRICS_MAX_QUEUES];
+static unsigned long results_received  = 0;
+static unsigned long results_added     = 0;
+static unsigned long results_injected  = 0;
+static unsigned long results_coalesced = 0;
+static unsigned long results_unknown   = 0;
+static metrics_histogram_t injection_duration;
+
+/* server thread */
+static int metrics_fd = -1;
+static int metrics_should_terminate = FALSE;
+static pthread_t metrics_thr;
+
+static void histogram_observe(metrics_histogram_t * hist, long long duration) {
+    int x;
+    if(duration < 0)
+        duration = 0;
+    for(x = 0; x < HISTOGRAM_BUCKETS; x++) {
+        if(duration <= histogram_bounds[x])
+            break;
+    }
+    __atomic_add_fetch(&hist->buckets[x], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&hist->sum, (unsigned long long)duration, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&hist->count, 1, __ATOMIC_RELAXED);
+}
+
+/* return the statistics of a queue, creates them on first use without locking */
+static metrics_queue_t * get_queue(const char * name) {
+    unsigned int slot = gm_shard_hash(name, NULL) % (METRICS_MAX_QUEUES - 1);
+    char * current;
+    char * copy = NULL;
+    int x;
+
+    for(x = 0; x < METRICS_MAX_QUEUES - 1; x++) {
+        current = __atomic_load_n(&queues[slot].name, __ATOMIC_ACQUIRE);
+        if(current == NULL) {
+            if(copy == NULL)
+                copy = gm_strdup(name);
+            if(__atomic_compare_exchange_n(&queues[slot].name, &current, copy, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                return(&queues[slot]);
+            /* someone else took the slot, current holds its name now */
+        }
+        if(!strcmp(current, name)) {
+            gm_free(copy);
+            return(&queues[slot]);
+        }
+        slot = (slot + 1) % (METRICS_MAX_QUEUES - 1);
+    }
+    gm_free(copy);
+
+    /* table is full, the last slot collects everything else */
+    return(&queues[METRICS_MAX_QUEUES - 1]);
+}
+
+/* count a job sent to gearmand */
+void metrics_submit(const char * queue, int success, long long duration) {
+    metrics_queue_t * q = get_queue(queue == NULL ? "" : queue);
+    if(success == TRUE)
+        __atomic_add_fetch(&q->jobs, 1, __ATOMIC_RELAXED);
+    else
+        __atomic_add_fetch(&q->errors, 1, __ATOMIC_RELAXED);
+    histogram_observe(&q->duration, duration);
+}
+
+/* count a decision for a check to an overloaded queue */
+void metrics_admission(const char * queue, int decision) {
+    metrics_queue_t * q;
+    if(decision < 0 || decision > GM_ADMISSION_POSTPONE)
+        return;
+    q = get_queue(queue == NULL ? "" : queue);
+    __atomic_add_fetch(&q->admission[decision], 1, __ATOMIC_RELAXED);
+}
+
+/* count a result received from a worker */
+void metrics_result_received(void) {
+    __atomic_add_fetch(&results_received, 1, __ATOMIC_RELAXED);
+}
+
+/* count a result for an unknown host or service */
+void metrics_result_unknown(void) {
+    __atomic_add_fetch(&results_unknown, 1, __ATOMIC_RELAXED);
+}
+
+/* count a result added to the result list */
+void metrics_result_added(void) {
+    __atomic_add_fetch(&results_added, 1, __ATOMIC_RELAXED);
+}
+
+/* count results moved into the core */
+void metrics_results_injected(int count, long long duration) {
+    __atomic_add_fetch(&results_injected, (unsigned long)count, __ATOMIC_RELAXED);
+    histogram_observe(&injection_duration, duration);
+}
+
+/* count stale results dropped before reaching the core */
+void metrics_results_coalesced(int count) {
+    __atomic_add_fetch(&results_coalesced, (unsigned long)count, __ATOMIC_RELAXED);
+}
+
+static void render_header(gm_buffer_t * buf, const char * name, const char * type, const char * help) {
+    gm_buffer_printf(buf, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void render_histogram(gm_buffer_t * buf, const char * name, const char * labels, metrics_histogram_t * hist) {
+    unsigned long cumulative = 0;
+    int x;
+    for(x = 0; x <= HISTOGRAM_BUCKETS; x++) {
+        cumulative += __atomic_load_n(&hist->buckets[x], __ATOMIC_RELAXED);
+        if(x < HISTOGRAM_BUCKETS)
+            gm_buffer_printf(buf, "%s_bucket{%s%sle=\"%g\"} %lu\n", name, labels, *labels ? "," : "", histogram_bounds[x] / 1000000.0, cumulative);
+        else
+            gm_buffer_printf(buf, "%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, *labels ? "," : "", cumulative);
+    }
+    gm_buffer_printf(buf, "%s_sum%s%s%s %.6f\n", name, *labels ? "{" : "", labels, *labels ? "}" : "", __atomic_load_n(&hist->sum, __ATOMIC_RELAXED) / 1000000.0);
+    gm_buffer_printf(buf, "%s_count%s%s%s %lu\n", name, *labels ? "{" : "", labels, *labels ? "}" : "", cumulative);
+}
+
+/* escape a queue name as label value */
+static void queue_label(char * label, size_t size, const char * name) {
+    size_t len = 0;
+    len += snprintf(label, size, "queue=\"");
+    for(; *name != '\0' && len + 4 < size; name++) {
+        if(*name == '"' || *name == '\\')
+            label[len++] = '\\';
+        label[len++] = *name;
+    }
+    label[len++] = '"';
+    label[len]   = '\0';
+}
+
+/* write all metrics */
+void metrics_render(gm_buffer_t * buf) {
+    char label[GM_SMALLBUFSIZE];
+    unsigned long added, injected, coalesced;
+    char * name;
+    int x;
+
+    render_header(buf, "mod_gearman_submit_jobs_total", "counter", "Jobs accepted by gearmand.");
+    for(x = 0; x < METRICS_MAX_QUEUES; x++) {
+        name = __atomic_load_n(&queues[x].name, __ATOMIC_ACQUIRE);
+        if(name == NULL && x < METRICS_MAX_QUEUES - 1)
+            continue;
+        queue_label(label, sizeof(label), name == NULL ? "other" : name);
+        gm_buffer_printf(buf, "mod_gearman_submit_jobs_total{%s} %lu\n", label, __atomic_load_n(&queues[x].jobs, __ATOMIC_RELAXED));
+    }
+    render_header(buf, "mod_gearman_submit_errors_total", "counter", "Jobs which could not be sent to gearmand.");
+    for(x = 0; x < METRICS_MAX_QUEUES; x++) {
+        name = __atomic_load_n(&queues[x].name, __ATOMIC_ACQUIRE);
+        if(name == NULL && x < METRICS_MAX_QUEUES - 1)
+            continue;
+        queue_label(label, sizeof(label), name == NULL ? "other" : name);
+        gm_buffer_printf(buf, "mod_gearman_submit_errors_total{%s} %lu\n", label, __atomic_load_n(&queues[x].errors, __ATOMIC_RELAXED));
+    }
+    render_header(buf, "mod_gearman_submit_duration_seconds", "histogram", "Time to send a job to gearmand, batches are split evenly over their jobs.");
+    for(x = 0; x < METRICS_MAX_QUEUES; x++) {
+        name = __atomic_load_n(&queues[x].name, __ATOMIC_ACQUIRE);
+        if(name == NULL && x < METRICS_MAX_QUEUES - 1)
+            continue;
+        queue_label(label, sizeof(label), name == NULL ? "other" : name);
+        render_histogram(buf, "mod_gearman_submit_duration_seconds", label, &queues[x].duration);
+    }
+    render_header(buf, "mod_gearman_admission_total", "counter", "Checks for overloaded queues by decision.");
+    for(x = 0; x < METRICS_MAX_QUEUES; x++) {
+        name = __atomic_load_n(&queues[x].name, __ATOMIC_ACQUIRE);
+        if(name == NULL && x < METRICS_MAX_QUEUES - 1)
+            continue;
+        queue_label(label, sizeof(label), name == NULL ? "other" : name);
+        gm_buffer_printf(buf, "mod_gearman_admission_total{%s,decision=\"enqueue\"} %lu\n", label, __atomic_load_n(&queues[x].admission[GM_ADMISSION_ENQUEUE], __ATOMIC_RELAXED));
+        gm_buffer_printf(buf, "mod_gearman_admission_total{%s,decision=\"local\"} %lu\n", label, __atomic_load_n(&queues[x].admission[GM_ADMISSION_LOCAL], __ATOMIC_RELAXED));
+        gm_buffer_printf(buf, "mod_gearman_admission_total{%s,decision=\"postpone\"} %lu\n", label, __atomic_load_n(&queues[x].admission[GM_ADMISSION_POSTPONE], __ATOMIC_RELAXED));
+    }
+
+    render_header(buf, "mod_gearman_submit_queue_length", "gauge", "Jobs waiting for a submit thread.");
+    gm_buffer_printf(buf, "mod_gearman_submit_queue_length %d\n", __atomic_load_n(&submit_queue_length, __ATOMIC_RELAXED));
+    render_header(buf, "mod_gearman_spool_jobs", "gauge", "Jobs waiting in the spool for gearmand.");
+    gm_buffer_printf(buf, "mod_gearman_spool_jobs %d\n", __atomic_load_n(&spool_jobs, __ATOMIC_RELAXED));
+    render_header(buf, "mod_gearman_spool_bytes", "gauge", "Size of the spooled jobs.");
+    gm_buffer_printf(buf, "mod_gearman_spool_bytes %lu\n", __atomic_load_n(&spool_bytes, __ATOMIC_RELAXED));
+
+    /* read injected first, so the backlog never gets negative */
+    injected  = __atomic_load_n(&results_injected, __ATOMIC_RELAXED);
+    coalesced = __atomic_load_n(&results_coalesced, __ATOMIC_RELAXED);
+    added     = __atomic_load_n(&results_added, __ATOMIC_RELAXED);
+    render_header(buf, "mod_gearman_results_received_total", "counter", "Results received from workers.");
+    gm_buffer_printf(buf, "mod_gearman_results_received_total %lu\n", __atomic_load_n(&results_received, __ATOMIC_RELAXED));
+    render_header(buf, "mod_gearman_results_unknown_total", "counter", "Results dropped because the host or service does not exist.");
+    gm_buffer_printf(buf, "mod_gearman_results_unknown_total %lu\n", __atomic_load_n(&results_unknown, __ATOMIC_RELAXED));
+    render_header(buf, "mod_gearman_result_backlog", "gauge", "Results waiting to be moved into the core.");
+    gm_buffer_printf(buf, "mod_gearman_result_backlog %lu\n", added > injected + coalesced ? added - injected - coalesced : 0);
+    render_header(buf, "mod_gearman_results_coalesced_total", "counter", "Stale results dropped because a newer result for the same object arrived.");
+    gm_buffer_printf(buf, "mod_gearman_results_coalesced_total %lu\n", coalesced);
+    render_header(buf, "mod_gearman_result_injection_seconds", "histogram", "Time spent moving results into the core per run.");
+    render_histogram(buf, "mod_gearman_result_injection_seconds", "", &injection_duration);
+}
+
+/* answer a single client */
+static void serve_client(int fd, gm_buffer_t * buf) {
+    struct pollfd pfd;
+    char request[GM_SMALLBUFSIZE];
+    ssize_t len = 0;
+    size_t written = 0;
+    ssize_t ret;
+
+    /* http clients send a request first, plain clients just read */
+    pfd.fd     = fd;
+    pfd.events = POLLIN;
+    if(poll(&pfd, 1, 100) > 0)
+        len = read(fd, request, sizeof(request) - 1);
+
+    gm_buffer_reset(buf);
+    if(len >= 4 && !strncmp(request, "GET ", 4))
+        gm_buffer_printf(buf, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n");
+    metrics_render(buf);
+
+    while(written < buf->len) {
+        ret = write(fd, buf->data + written, buf->len - written);
+        if(ret < 0 && errno == EINTR)
+            continue;
+        if(ret <= 0)
+            break;
+        written += ret;
+    }
+}
+
+/* main loop of the metrics thread */
+static void *metrics_worker( __attribute__((__unused__)) void * data ) {
+    gm_buffer_t * buf = gm_buffer_new();
+    struct pollfd pfd;
+    int client_fd;
+
+    gm_log( GM_LOG_DEBUG, "metrics thr-%ld started\n", pthread_self() );
+
+    while(__atomic_load_n(&metrics_should_terminate, __ATOMIC_RELAXED) == FALSE) {
+        pfd.fd     = metrics_fd;
+        pfd.events = POLLIN;
+        if(poll(&pfd, 1, 500) <= 0)
+            continue;
+        client_fd = accept(metrics_fd, NULL, NULL);
+        if(client_fd < 0)
+            continue;
+        serve_client(client_fd, buf);
+        close(client_fd);
+    }
+
+    gm_buffer_free(&buf);
+    gm_log( GM_LOG_DEBUG, "metrics thr-%ld finished\n", pthread_self() );
+    return(NULL);
+}
+
+/* create the metrics socket and start the thread */
+int start_metrics(void) {
+    struct sockaddr_un addr;
+    int ret;
+
+    metrics_should_terminate = FALSE;
+    if(mod_gm_opt->metrics_socket == NULL)
+        return(GM_OK);
+
+    if(strlen(mod_gm_opt->metrics_socket) >= sizeof(addr.sun_path)) {
+        gm_log( GM_LOG_ERROR, "metrics_socket path too long: %s\n", mod_gm_opt->metrics_socket );
+        return(GM_ERROR);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, mod_gm_opt->metrics_socket);
+    unlink(mod_gm_opt->metrics_socket);
+
+    if((metrics_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+       || bind(metrics_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+       || chmod(mod_gm_opt->metrics_socket, METRICS_SOCKET_MODE) != 0
+       || listen(metrics_fd, 8) != 0) {
+        gm_log( GM_LOG_ERROR, "cannot create metrics_socket %s: %s\n", mod_gm_opt->metrics_socket, strerror(errno) );
+        if(metrics_fd >= 0)
+            close(metrics_fd);
+        metrics_fd = -1;
+        return(GM_ERROR);
+    }
+
+    if((ret = pthread_create(&metrics_thr, NULL, &metrics_worker, NULL)) != 0) {
+        gm_log( GM_LOG_ERROR, "failed to create metrics thread: %s\n", strerror(ret));
+        close(metrics_fd);
+        metrics_fd = -1;
+        return(GM_ERROR);
+    }
+    gm_log( GM_LOG_DEBUG, "serving metrics on %s\n", mod_gm_opt->metrics_socket );
+    return(GM_OK);
+}
+
+/* stop the metrics thread */
+void stop_metrics(void) {
+    if(metrics_fd < 0)
+        return;
+
+    __atomic_store_n(&metrics_should_terminate, TRUE, __ATOMIC_RELAXED);
+    if(pthread_join(metrics_thr, NULL) != 0) {
+        gm_log( GM_LOG_ERROR, "failed to join metrics thread: %s\n", strerror(errno) );
+    }
+    close(metrics_fd);
+    metrics_fd = -1;
+    unlink(mod_gm_opt->metrics_socket);
+}
+
+/* free the queue names */
+void metrics_free(void) {
+    int x;
+    for(x = 0; x < METRICS_MAX_QUEUES; x++) {
+        gm_free(queues[x].name);
+    }
+    memset(queues, 0, sizeof(queues));
+}
@@ -23,8 +23,27 @@
 
 /* include header */
 #include "result_thread.h"
+#include "submit_thread.h"
+#include "spool.h"
+#include "shard.h"
+#include "route_cache.h"
+#include "perfdata_batch.h"
+#include "perfdata_template.h"
+#include "export.h"
+#include "internal_checks.h"
+#include "latency_scheduler.h"
+#include "inflight.h"
+#include "metrics.h"
+#include "gm_buffer.h"
+#include "gm_payload.h"
 #include "mod_gearman.h"
 #include "gearman_utils.h"
+#include "mpsc_queue.h"
+#include "result_coalesce.h"
+#include "admission.h"
+#include "wire_negotiation.h"
+#include "result_pool.h"
+#include "intern.h"
 
 mod_gm_opt_t *mod_gm_opt;
 char hostname[GM_SMALLBUFSIZE];
@@ -44,18 +63,27 @@ extern int            currently_running_service_checks;
 extern int            process_performance_data;
 extern int            log_notifications;
 extern int            log_global_notifications;
+extern iobroker_set * nagios_iobs;
 
 /* global variables */
-static objectlist * mod_gm_result_list = NULL;
-static pthread_mutex_t mod_gm_result_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+static mpsc_queue_t mod_gm_result_list = MPSC_QUEUE_INITIALIZER;
+/* left over results from the last run, one lane per job priority, only used by the core thread */
+static mpsc_queue_node_t * mod_gm_pending_results[GM_JOB_PRIO_HIGH]      = { NULL };
+static mpsc_queue_node_t * mod_gm_pending_results_tail[GM_JOB_PRIO_HIGH] = { NULL };
+static int mod_gm_pending_results_num = 0;
+static int mod_gm_result_wakeup[2] = { -1, -1 };                /* pipe used by the result threads to wake up the core */
+static int mod_gm_result_wakeup_registered = FALSE;
+
 static pthread_mutex_t mod_gm_log_lock = PTHREAD_MUTEX_INITIALIZER;
 void *gearman_module_handle=NULL;
 
 int gm_should_terminate = FALSE;
-pthread_t * result_thr;
 char target_queue[GM_SMALLBUFSIZE];
-char temp_buffer[GM_MAX_OUTPUT];
-char uniq[GM_SMALLBUFSIZE];
+static gm_buffer_t * job_buffer = NULL;        /* assembles jobs, only used by the core thread */
+static gm_buffer_t * export_buffer = NULL;     /* separate buffer, exports may run while a job is assembled */
+static gm_buffer_t * perfdata_buffer = NULL;   /* expanded perfdata templates */
+static perfdata_template_t * host_perfdata_tpl    = NULL;
+static perfdata_template_t * service_perfdata_tpl = NULL;
 time_t gm_last_log_rotation = -1;
 
 static const char *gearman_worker_source_name(void *source) {
@@ -84,12 +112,24 @@ static int   handle_notifications( int,void * );
 static int   handle_perfdata(int, void *);
 static int   handle_export(int, void *);
 static void  set_target_queue( host *, service * );
+static unsigned int check_shard_key( char *, char * );
+static void  build_check_job( host *, service *, long long, int, char * );
 static int   handle_process_events( int, void * );
+static int   handle_external_command( int, void * );
 static int   handle_progam_status_data_events( int, void * );
 static void  move_results_to_core(struct nm_event_execution_properties *evprop);
+static void  flush_perfdata_batch(struct nm_event_execution_properties *evprop);
+static void  flush_export_coalesce(struct nm_event_execution_properties *evprop);
+static int   handle_result_wakeup(int sd, int events, void *arg);
+static int   open_result_wakeup(void);
+static void  close_result_wakeup(void);
+static void  wakeup_result_injection(void);
 static int   handle_hst_check_result(int event_type, void *data);
 static int   handle_svc_check_result(int event_type, void *data);
-static int   try_check_dummy(const char *, host *, service * );
+static int   try_internal_check(const char *, host *, service * );
+static int   add_orphan_result(host *, service *, const char *);
+static void  orphan_inflight_job(host *, service *, const char *);
+static void  expire_inflight_jobs(struct nm_event_execution_properties *evprop);
 static int   xpddefault_preprocess_file_templates(char *);
 void shutdown_threads(void);
 void process_check_result_list(void);
@@ -177,6 +217,9 @@ int nebmodule_init( int flags, char *args, nebmodule *handle ) {
         mod_ctx = NULL;
     }
 
+    job_buffer    = gm_buffer_new();
+    export_buffer = gm_buffer_new();
+
     /* create client */
     client = create_client_blocking(mod_gm_opt->server_list);
     if(client == NULL) {
@@ -185,16 +228,56 @@ int nebmodule_init( int flags, char *args, nebmodule *handle ) {
     }
     current_client = client;
 
+    if(open_result_wakeup() != GM_OK) {
+        gm_log( GM_LOG_INFO, "Warning: cannot create result wakeup pipe, results will be moved to the core once a second\n" );
+    }
+
     if(start_threads() != GM_OK) {
         gm_log( GM_LOG_ERROR, "failed to start result threads\n" );
         return NEB_ERROR;
     }
 
+    if(start_spool() != GM_OK) {
+        gm_log( GM_LOG_ERROR, "failed to start spool\n" );
+        return NEB_ERROR;
+    }
+
+    if(start_submit_threads() != GM_OK) {
+        gm_log( GM_LOG_ERROR, "failed to start submit threads\n" );
+        return NEB_ERROR;
+    }
+
+    if(start_metrics() != GM_OK) {
+        gm_log( GM_LOG_ERROR, "failed to start metrics socket\n" );
+        return NEB_ERROR;
+    }
+
+    if(start_admission() != GM_OK) {
+        gm_log( GM_LOG_ERROR, "failed to start admission control\n" );
+        return NEB_ERROR;
+    }
+
+    if(start_wire_negotiation() != GM_OK) {
+        gm_log( GM_LOG_ERROR, "failed to start wire format negotiation\n" );
+        return NEB_ERROR;
+    }
+
     /* register callback for process event where everything else starts */
     neb_register_callback(NEBCALLBACK_PROCESS_DATA,        gearman_module_handle, 0, handle_process_events );
     neb_register_callback(NEBCALLBACK_PROGRAM_STATUS_DATA, gearman_module_handle, 0, handle_progam_status_data_events);
     schedule_event(1, move_results_to_core, NULL);
 
+    if(mod_gm_opt->perfdata != GM_DISABLED) {
+        perfdata_buffer      = gm_buffer_new();
+        host_perfdata_tpl    = perfdata_template_compile(mod_gm_opt->host_perfdata_template, FALSE);
+        service_perfdata_tpl = perfdata_template_compile(mod_gm_opt->service_perfdata_template, TRUE);
+    }
+
+    if(mod_gm_opt->perfdata != GM_DISABLED && mod_gm_opt->perfdata_batch_size > 1) {
+        perfdata_batch_init();
+        schedule_event(1, flush_perfdata_batch, NULL);
+    }
+
     /* log at least one line into the core logfile */
     if(strlen(GIT_HASH) > 0)
         nm_log( NSLOG_INFO_MESSAGE, "mod_gearman: initialized version %s (build: %s) (libgearman %s)\n", GM_VERSION, GIT_HASH, gearman_version() );
@@ -231,6 +314,10 @@ static void register_neb_callbacks(void) {
     if ( mod_gm_opt->notifications == GM_ENABLED )
         neb_register_callback( NEBCALLBACK_CONTACT_NOTIFICATION_METHOD_DATA, gearman_module_handle, 0, handle_notifications );
 
+    /* cached target queues and priorities depend on custom variables */
+    if ( route_cache_uses_custom_variables() == TRUE )
+        neb_register_callback( NEBCALLBACK_EXTERNAL_COMMAND_DATA, gearman_module_handle, 0, handle_external_command );
+
     if ( mod_gm_opt->latency_flatten_window > 0 ) {
         neb_register_callback( NEBCALLBACK_HOST_CHECK_DATA, gearman_module_handle, 0, handle_hst_check_result );
         neb_register_callback( NEBCALLBACK_SERVICE_CHECK_DATA, gearman_module_handle, 0, handle_svc_check_result );
@@ -266,6 +353,9 @@ int nebmodule_deinit( int flags, int reason ) {
     if ( mod_gm_opt->notifications == GM_ENABLED )
         neb_deregister_callback( NEBCALLBACK_CONTACT_NOTIFICATION_METHOD_DATA, gearman_module_handle );
 
+    if ( route_cache_uses_custom_variables() == TRUE )
+        neb_deregister_callback( NEBCALLBACK_EXTERNAL_COMMAND_DATA, gearman_module_handle );
+
     if ( mod_gm_opt->perfdata != GM_DISABLED ) {
         neb_deregister_callback( NEBCALLBACK_HOST_CHECK_DATA, gearman_module_handle );
         neb_deregister_callback( NEBCALLBACK_SERVICE_CHECK_DATA, gearman_module_handle );
@@ -279,10 +369,25 @@ int nebmodule_deinit( int flags, int reason ) {
 
     gm_log( GM_LOG_DEBUG, "deregistered callbacks\n" );
 
+    /* send remaining perfdata and status exports while the submit threads are still running */
+    perfdata_batch_free();
+    export_coalesce_free();
     shutdown_threads();
 
     // clean check result list
     process_check_result_list();
+    close_result_wakeup();
+    intern_free();
+    route_cache_free();
+    internal_checks_free();
+    latency_scheduler_free();
+    inflight_free();
+    metrics_free();
+    gm_buffer_free(&job_buffer);
+    gm_buffer_free(&export_buffer);
+    gm_buffer_free(&perfdata_buffer);
+    perfdata_template_free(&host_perfdata_tpl);
+    perfdata_template_free(&service_perfdata_tpl);
 
     /* cleanup */
     gm_free_client(&client);
@@ -308,24 +413,19 @@ int nebmodule_deinit( int flags, int reason ) {
 }
 
 void shutdown_threads(void) {
-    int x = 0;
-
     gm_should_terminate = TRUE;
-    if(result_thr == NULL) {
-        return;
-    }
+
+    /* flush and stop submit threads */
+    shutdown_submit_threads();
+
+    /* jobs which could not be sent are spooled by now */
+    stop_spool();
+    stop_metrics();
+    stop_admission();
+    stop_wire_negotiation();
 
     /* stop result threads */
-    for(x = 0; x < mod_gm_opt->result_workers; x++) {
-        if(pthread_cancel(result_thr[x]) != OK) {
-            gm_log( GM_LOG_ERROR, "failed to join cancel thread: %s\n", strerror(errno) );
-        }
-        if(pthread_join(result_thr[x], NULL) != OK) {
-            gm_log( GM_LOG_ERROR, "failed to join result thread: %s\n", strerror(errno) );
-        }
-    }
-    gm_free(result_thr);
-    result_thr = NULL;
+    shutdown_result_threads();
 }
 
 /* insert results list into naemon core */
@@ -338,70 +438,258 @@ static void move_results_to_core(struct nm_event_execution_properties *evprop) {
     schedule_event(1, move_results_to_core, NULL);
 }
 
+/* send perfdata batches which have been waiting long enough */
+static void flush_perfdata_batch(struct nm_event_execution_properties *evprop) {
+    if(evprop->execution_type != EVENT_EXEC_NORMAL) {
+        return;
+    }
+
+    perfdata_batch_tick(time(NULL));
+    schedule_event(1, flush_perfdata_batch, NULL);
+}
+
+/* send coalesced status exports */
+static void flush_export_coalesce(struct nm_event_execution_properties *evprop) {
+    if(evprop->execution_type != EVENT_EXEC_NORMAL) {
+        return;
+    }
+
+    export_coalesce_tick(time(NULL));
+    schedule_event(1, flush_export_coalesce, NULL);
+}
+
+/* submit orphaned results for overdue jobs */
+static void expire_inflight_jobs(struct nm_event_execution_properties *evprop) {
+    int expired;
+
+    if(evprop->execution_type != EVENT_EXEC_NORMAL) {
+        return;
+    }
+
+    expired = inflight_expire(time(NULL), orphan_inflight_job);
+    if(expired > 0)
+        gm_log( GM_LOG_INFO, "%d checks did not return in time and have been marked orphaned, %d jobs still in flight\n", expired, inflight_count(NULL));
+    schedule_event(1, expire_inflight_jobs, NULL);
+}
+
+/* drop stale results from a new batch, returns the remaining list */
+static mpsc_queue_node_t * coalesce_results(mpsc_queue_node_t * list) {
+    mpsc_queue_node_t * node;
+    mod_gm_result_t * res;
+    check_result ** results;
+    int x, num, kept;
+
+    num = 0;
+    for(node = list; node != NULL; node = node->next)
+        num++;
+    if(num < 2)
+        return(list);
+
+    results = gm_malloc(num * sizeof(check_result *));
+    x = 0;
+    for(node = list; node != NULL; node = node->next)
+        results[x++] = &mpsc_queue_entry(node, mod_gm_result_t, node)->result;
+
+    kept = result_coalesce(results, num, mod_gm_opt->result_coalesce_keep_state_changes == GM_ENABLED ? TRUE : FALSE);
+
+    /* relink the kept results and free the others */
+    list = NULL;
+    for(x = kept - 1; x >= 0; x--) {
+        res = (mod_gm_result_t *)results[x];
+        res->node.next = list;
+        list = &res->node;
+    }
+    for(x = kept; x < num; x++)
+        result_pool_put((mod_gm_result_t *)results[x]);
+    gm_free(results);
+
+    if(num > kept) {
+        metrics_results_coalesced(num - kept);
+        gm_log( GM_LOG_DEBUG, "coalesced %d results into %d\n", num, kept );
+    }
+    return(list);
+}
+
+/* return the job priority of a check, forced checks excluded */
+static int check_priority(host * hst, service * svc) {
+    int prio = route_cache_priority(hst, svc);
+    if(prio != 0)
+        return(prio);
+    return(svc != NULL ? GM_JOB_PRIO_LOW : GM_JOB_PRIO_NORMAL);
+}
+
+/* return the lane of a result, usually resolved by the result thread already */
+static int result_lane(mod_gm_result_t * res) {
+    check_result * cr = &res->result;
+    host * hst;
+    service * svc = NULL;
+
+    if(res->lane >= 0)
+        return(res->lane);
+    if(mod_gm_opt->priority_cust_var == NULL && mod_gm_opt->priority_hostgroups_num == 0)
+        return(GM_JOB_PRIO_LOW - 1);
+
+    /* results received before the object table was built or priorities not cached yet */
+    if((hst = find_host(cr->host_name)) == NULL)
+        return(GM_JOB_PRIO_LOW - 1);
+    if(cr->object_check_type == SERVICE_CHECK && (svc = find_service(cr->host_name, cr->service_description)) == NULL)
+        return(GM_JOB_PRIO_LOW - 1);
+    return(check_priority(hst, svc) - 1);
+}
+
+/* append new results to their lanes */
+static void add_pending_results(mpsc_queue_node_t * list) {
+    mpsc_queue_node_t * next;
+    int lane;
+
+    for(; list != NULL; list = next) {
+        next = list->next;
+        list->next = NULL;
+        lane = result_lane(mpsc_queue_entry(list, mod_gm_result_t, node));
+        if(mod_gm_pending_results[lane] == NULL)
+            mod_gm_pending_results[lane] = list;
+        else
+            mod_gm_pending_results_tail[lane]->next = list;
+        mod_gm_pending_results_tail[lane] = list;
+        mod_gm_pending_results_num++;
+    }
+}
+
 void process_check_result_list(void) {
-    objectlist *tmp_list = NULL;
-    objectlist *cur = NULL;
+    mpsc_queue_node_t *new_results = NULL;
+    mod_gm_result_t *cur = NULL;
     struct timeval tval_before, tval_after, tval_result;
+    long budget = 0;
     int count = 0;
+    int lane = GM_JOB_PRIO_HIGH - 1;
 
     gettimeofday(&tval_before, NULL);
     gm_log( GM_LOG_TRACE3, "move_results_to_core()\n" );
 
-    /* safely move result list aside */
-    pthread_mutex_lock(&mod_gm_result_list_mutex);
-    tmp_list = mod_gm_result_list;
-    mod_gm_result_list = NULL;
-    pthread_mutex_unlock(&mod_gm_result_list_mutex);
+    /* safely move result list aside and append it to the left overs */
+    new_results = mpsc_queue_take_all(&mod_gm_result_list);
+    if(new_results != NULL && mod_gm_opt->result_coalesce == GM_ENABLED && gm_should_terminate == FALSE)
+        new_results = coalesce_results(new_results);
+    add_pending_results(new_results);
 
-    if(tmp_list == NULL)
+    if(mod_gm_pending_results_num == 0)
         return;
 
-    /* process result list */
-    while(tmp_list) {
-        cur = tmp_list;
-        tmp_list = tmp_list->next;
+    /* results are simply cleaned on shutdown, so no need for a budget then */
+    if(gm_should_terminate == FALSE)
+        budget = mod_gm_opt->result_injection_budget * 1000L;
+
+    /* process result lists, higher priorities first */
+    while(mod_gm_pending_results_num > 0) {
+        while(mod_gm_pending_results[lane] == NULL)
+            lane--;
+        cur = mpsc_queue_entry(mod_gm_pending_results[lane], mod_gm_result_t, node);
+        mod_gm_pending_results[lane] = mod_gm_pending_results[lane]->next;
+        if(mod_gm_pending_results[lane] == NULL)
+            mod_gm_pending_results_tail[lane] = NULL;
+        mod_gm_pending_results_num--;
 
         // simply clean the results, we cannot put them back to core anymore
         if(gm_should_terminate == FALSE)
-            process_check_result(cur->object_ptr);
+            process_check_result(&cur->result);
 
-        free_check_result(cur->object_ptr);
-        free(cur->object_ptr);
-        free(cur);
+        result_pool_put(cur);
         count++;
+
+        /* do not block the core for too long, continue on the next run */
+        if(budget > 0 && count % 32 == 0 && mod_gm_pending_results_num > 0) {
+            gettimeofday(&tval_after, NULL);
+            timersub(&tval_after, &tval_before, &tval_result);
+            if(tval_result.tv_sec * 1000000L + tval_result.tv_usec >= budget)
+                break;
+        }
     }
-    free(tmp_list);
+
+    if(mod_gm_pending_results_num > 0)
+        wakeup_result_injection();
 
     gettimeofday(&tval_after, NULL);
     timersub(&tval_after, &tval_before, &tval_result);
+    metrics_results_injected(count, tval_result.tv_sec * 1000000LL + tval_result.tv_usec);
+
+    gm_log( GM_LOG_DEBUG, "move_results_to_core processed %d results in %ld.%06lds, %d results postponed\n", count, (long int)tval_result.tv_sec, (long int)tval_result.tv_usec, mod_gm_pending_results_num );
+}
+
+/* create the pipe used to wake up the core */
+static int open_result_wakeup(void) {
+    int x;
+    if(pipe(mod_gm_result_wakeup) != 0) {
+        gm_log( GM_LOG_ERROR, "failed to create result wakeup pipe: %s\n", strerror(errno) );
+        mod_gm_result_wakeup[0] = -1;
+        mod_gm_result_wakeup[1] = -1;
+        return(GM_ERROR);
+    }
+    for(x = 0; x < 2; x++) {
+        fcntl(mod_gm_result_wakeup[x], F_SETFL, fcntl(mod_gm_result_wakeup[x], F_GETFL) | O_NONBLOCK);
+        fcntl(mod_gm_result_wakeup[x], F_SETFD, FD_CLOEXEC);
+    }
+    return(GM_OK);
+}
+
+/* close the wakeup pipe */
+static void close_result_wakeup(void) {
+    int x;
+    /* the event loop may not have ended properly, never leave a closed fd in the iobroker */
+    if(mod_gm_result_wakeup_registered == TRUE) {
+        iobroker_unregister(nagios_iobs, mod_gm_result_wakeup[0]);
+        mod_gm_result_wakeup_registered = FALSE;
+    }
+    for(x = 0; x < 2; x++) {
+        if(mod_gm_result_wakeup[x] != -1)
+            close(mod_gm_result_wakeup[x]);
+        mod_gm_result_wakeup[x] = -1;
+    }
+}
+
+/* wake up the core to move results, safe to call from any thread */
+static void wakeup_result_injection(void) {
+    char c = 1;
+    if(mod_gm_result_wakeup[1] == -1)
+        return;
+    /* a full pipe means there is a wakeup pending already */
+    if(write(mod_gm_result_wakeup[1], &c, 1) == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+        gm_log( GM_LOG_ERROR, "failed to wake up core: %s\n", strerror(errno) );
+}
+
+/* called from the core io broker when new results are available */
+static int handle_result_wakeup(int sd, __attribute__((__unused__)) int events, __attribute__((__unused__)) void *arg) {
+    char buf[256];
+
+    /* drain the pipe before fetching the results, so no wakeup gets lost */
+    while(read(sd, buf, sizeof(buf)) > 0)
+        ;
+
+    process_check_result_list();
+    return(0);
+}
 
-    gm_log( GM_LOG_DEBUG, "move_results_to_core processed %d results in %ld.%06lds\n", count, (long int)tval_result.tv_sec, (long int)tval_result.tv_usec );
+/* create new check result for the result list */
+check_result * mod_gm_new_check_result(void) {
+    return(&result_pool_get(NULL)->result);
 }
 
-/* add list to gearman result list */
+/* add check result to gearman result list */
 void mod_gm_add_result_to_list(check_result * newcheckresult) {
-    pthread_mutex_lock(&mod_gm_result_list_mutex);
-    prepend_object_to_objectlist(&mod_gm_result_list, newcheckresult);
-    pthread_mutex_unlock(&mod_gm_result_list_mutex);
+    mod_gm_result_t * res = (mod_gm_result_t *)newcheckresult;
+    metrics_result_added();
+    /* only the first result needs to wake up the core */
+    if(mpsc_queue_push(&mod_gm_result_list, &res->node) == TRUE && mod_gm_result_wakeup_registered == TRUE)
+        wakeup_result_injection();
 }
 
 /* start our threads */
 static int start_threads(void) {
-    int x;
-    int ret = 0;
     if( mod_gm_opt->result_workers <= 0 ) {
         return(GM_OK);
     }
-    result_thr = gm_malloc(mod_gm_opt->result_workers * sizeof *result_thr);
 
     /* create result worker */
-    for(x = 0; x < mod_gm_opt->result_workers; x++) {
-        if((ret = pthread_create(&result_thr[x], NULL, &result_worker, NULL)) != OK) {
-            gm_log( GM_LOG_ERROR, "failed to create result thread: %s\n", strerror(ret));
-            return(GM_ERROR);
-        }
-    }
-    return(GM_OK);
+    return(start_result_threads());
 }
 
 /* handle process events */
@@ -428,15 +716,46 @@ static int handle_process_events( int event_type, void *data ) {
 
     ps = ( struct nebstruct_process_struct * )data;
     if(ps->type == NEBTYPE_PROCESS_EVENTLOOPEND ) {
+        perfdata_batch_flush();
+        export_coalesce_free();
         shutdown_threads();
+        intern_free();
+        route_cache_free();
+        internal_checks_free();
+        latency_scheduler_free();
+        inflight_free();
+        if(mod_gm_result_wakeup_registered == TRUE) {
+            iobroker_unregister(nagios_iobs, mod_gm_result_wakeup[0]);
+            mod_gm_result_wakeup_registered = FALSE;
+        }
         return NEB_OK;
     }
     if(ps->type != NEBTYPE_PROCESS_EVENTLOOPSTART ) {
         return NEB_OK;
     }
 
+    route_cache_init();
+    intern_init();
+    internal_checks_init();
+    if(mod_gm_opt->latency_flatten_window > 0)
+        latency_scheduler_init(time(NULL));
+    if(mod_gm_opt->orphan_grace > 0) {
+        inflight_init(time(NULL));
+        schedule_event(1, expire_inflight_jobs, NULL);
+    }
     register_neb_callbacks();
 
+    /* let the result threads wake up the core loop whenever new results arrive */
+    if(mod_gm_result_wakeup[0] != -1 && nagios_iobs != NULL) {
+        if(iobroker_register(nagios_iobs, mod_gm_result_wakeup[0], NULL, handle_result_wakeup) == 0) {
+            mod_gm_result_wakeup_registered = TRUE;
+            /* results may have arrived already */
+            wakeup_result_injection();
+        } else {
+            gm_log( GM_LOG_ERROR, "failed to register result wakeup pipe, results will be moved to the core once a second\n" );
+        }
+    }
+
     /* verify names of supplied groups
         * this cannot be done befor naemon has finished reading his config
         * verify local servicegroups names
@@ -484,6 +803,27 @@ static int handle_process_events( int event_type, void *data ) {
         if(mod_gm_opt->exports[x]->elem_number > 0)
             neb_register_callback(x, gearman_module_handle, 0, handle_export);
     }
+    if(mod_gm_opt->export_coalesce_window > 0 && mod_gm_opt->exports_count > 0) {
+        export_coalesce_init();
+        schedule_event(1, flush_export_coalesce, NULL);
+    }
+
+    return NEB_OK;
+}
+
+
+/* custom variables changed, resolve target queues and priorities again */
+static int handle_external_command( int event_type, void *data ) {
+    nebstruct_external_command_data * ds = ( nebstruct_external_command_data * )data;
+
+    if ( event_type != NEBCALLBACK_EXTERNAL_COMMAND_DATA )
+        return NEB_OK;
+
+    /* resolving is lazy, so it does not matter if this runs before or after the change */
+    if ( ds->command_type == CMD_CHANGE_CUSTOM_HOST_VAR || ds->command_type == CMD_CHANGE_CUSTOM_SVC_VAR ) {
+        gm_log( GM_LOG_DEBUG, "custom variable changed, resetting target queue and priority cache\n" );
+        route_cache_invalidate();
+    }
 
     return NEB_OK;
 }
@@ -494,6 +834,7 @@ static int handle_eventhandler( int event_type, void *data ) {
     nebstruct_event_handler_data * ds;
     host * hst    = NULL;
     service * svc = NULL;
+    int ret;
     struct timeval core_time;
     gettimeofday(&core_time,NULL);
 
@@ -548,28 +889,21 @@ static int handle_eventhandler( int event_type, void *data ) {
 
     gm_log( GM_LOG_DEBUG, "eventhandler for queue %s\n", target_queue );
 
-    temp_buffer[0]='\x0';
-    snprintf( temp_buffer,GM_MAX_OUTPUT-1,
-                "type=eventhandler\nstart_time=%Lf\ncore_time=%Lf\ncommand_line=%s\n\n\n",
-                timeval2double(&core_time),
-                timeval2double(&core_time),
-                ds->command_line
-    );
+    gm_payload_begin(job_buffer, wire_format_for_queue(target_queue));
+    gm_payload_append(job_buffer, GM_PAYLOAD_TYPE, "eventhandler");
+    gm_payload_append_time(job_buffer, GM_PAYLOAD_START_TIME, timeval2usec(&core_time));
+    gm_payload_append_time(job_buffer, GM_PAYLOAD_CORE_TIME, timeval2usec(&core_time));
+    gm_payload_append(job_buffer, GM_PAYLOAD_COMMAND_LINE, ds->command_line);
+    gm_payload_end(job_buffer);
 
-    if(add_job_to_queue(&client,
-                         mod_gm_opt->server_list,
-                         target_queue,
-                         NULL,
-                         temp_buffer,
-                         GM_JOB_PRIO_NORMAL,
-                         GM_DEFAULT_JOB_RETRIES,
-                         mod_gm_opt->transportmode,
-                         mod_ctx,
-                         0,
-                         mod_gm_opt->log_stats_interval
-                        ) == GM_OK) {
+    ret = mod_gm_submit_job(target_queue, NULL, job_buffer->data, GM_JOB_PRIO_NORMAL, GM_DEFAULT_JOB_RETRIES, 0);
+    if(ret == GM_OK) {
         gm_log( GM_LOG_TRACE, "handle_eventhandler() finished successfully\n" );
     }
+    else if(ret == GM_QUEUE_FULL) {
+        gm_log( GM_LOG_DEBUG, "submit queue full, running eventhandler locally\n" );
+        return NEB_OK;
+    }
     else {
         gm_log( GM_LOG_ERROR, "failed to send eventhandler to gearmand\n" );
     }
@@ -594,6 +928,7 @@ static int handle_notifications( int event_type, void *data ) {
     nagios_macros mac;
     char *tmp;
     char *contact_name = NULL;
+    int ret;
     struct timeval core_time;
     gettimeofday(&core_time,NULL);
 
@@ -752,31 +1087,23 @@ static int handle_notifications( int event_type, void *data ) {
     processed_command = replace_str(tmp, "\n", "\\n");
     free(tmp);
 
-    temp_buffer[0]='\x0';
-    snprintf( temp_buffer,GM_MAX_OUTPUT-1,
-                "type=notification\nstart_time=%Lf\ncore_time=%Lf\ncontact=%s\ncommand_line=%s\nplugin_output=%s\nlong_plugin_output=%s\n\n\n",
-                timeval2double(&ds->start_time),
-                timeval2double(&core_time),
-                contact_name,
-                processed_command,
-                ds->output,
-                svc != NULL ? svc->long_plugin_output : hst->long_plugin_output
-    );
-
-    if(add_job_to_queue(&client,
-                         mod_gm_opt->server_list,
-                         target_queue,
-                         NULL,
-                         temp_buffer,
-                         GM_JOB_PRIO_HIGH,
-                         GM_DEFAULT_JOB_RETRIES,
-                         mod_gm_opt->transportmode,
-                         mod_ctx,
-                         0,
-                         mod_gm_opt->log_stats_interval
-                        ) == GM_OK) {
+    gm_payload_begin(job_buffer, wire_format_for_queue(target_queue));
+    gm_payload_append(job_buffer, GM_PAYLOAD_TYPE, "notification");
+    gm_payload_append_time(job_buffer, GM_PAYLOAD_START_TIME, timeval2usec(&ds->start_time));
+    gm_payload_append_time(job_buffer, GM_PAYLOAD_CORE_TIME, timeval2usec(&core_time));
+    gm_payload_append(job_buffer, GM_PAYLOAD_CONTACT, contact_name);
+    gm_payload_append(job_buffer, GM_PAYLOAD_COMMAND_LINE, processed_command);
+    gm_payload_append(job_buffer, GM_PAYLOAD_PLUGIN_OUTPUT, ds->output);
+    gm_payload_append(job_buffer, GM_PAYLOAD_LONG_PLUGIN_OUTPUT, svc != NULL ? svc->long_plugin_output : hst->long_plugin_output);
+    gm_payload_end(job_buffer);
+
+    ret = mod_gm_submit_job(target_queue, NULL, job_buffer->data, GM_JOB_PRIO_HIGH, GM_DEFAULT_JOB_RETRIES, 0);
+    if(ret == GM_OK) {
         gm_log( GM_LOG_TRACE, "handle_notifications() finished successfully\n" );
     }
+    else if(ret == GM_QUEUE_FULL) {
+        gm_log( GM_LOG_DEBUG, "submit queue full, running notification locally\n" );
+    }
     else {
         gm_log( GM_LOG_ERROR, "failed to send notification to gearmand\n" );
     }
@@ -785,8 +1112,8 @@ static int handle_notifications( int event_type, void *data ) {
     my_free(raw_command);
     my_free(processed_command);
 
-    /* log the notification to program log file */
-    if ((ds->contact_name == NULL && log_global_notifications == TRUE) || (ds->contact_name != NULL && log_notifications == TRUE)) {
+    /* log the notification to program log file, the core does that itself for local notifications */
+    if (ret != GM_QUEUE_FULL && ((ds->contact_name == NULL && log_global_notifications == TRUE) || (ds->contact_name != NULL && log_notifications == TRUE))) {
         if(svc != NULL) {
             switch(ds->reason_type) {
                 case NOTIFICATION_CUSTOM:
@@ -876,18 +1203,38 @@ static int handle_notifications( int event_type, void *data ) {
     /* this gets set in add_notification() */
     free(mac.x[MACRO_NOTIFICATIONRECIPIENTS]);
 
+    if(ret == GM_QUEUE_FULL)
+        return NEB_OK;
+
     /* tell naemon to not execute */
     return NEBERROR_CALLBACKOVERRIDE;
 }
 
 
+/* assemble a check job from the cached static fields and the current values */
+static void build_check_job( host *hst, service *svc, long long core_time, int timeout, char *command_line ) {
+    const char * prefix;
+    size_t len;
+
+    prefix = route_cache_job_prefix(hst, svc, wire_format_for_queue(route_cache_lookup(hst, svc)), &len);
+    /* the prefix starts with the header of the wire format */
+    gm_buffer_reset(job_buffer);
+    gm_buffer_append(job_buffer, prefix, len);
+    gm_payload_append_time(job_buffer, GM_PAYLOAD_CORE_TIME, core_time);
+    gm_payload_append_int(job_buffer, GM_PAYLOAD_TIMEOUT, timeout);
+    gm_payload_append(job_buffer, GM_PAYLOAD_COMMAND_LINE, command_line);
+    gm_payload_end(job_buffer);
+}
+
+
 /* handle host check events */
 static int handle_host_check( int event_type, void *data ) {
     nebstruct_host_check_data * hostdata;
     char *processed_command=NULL;
     host * hst;
-    check_result * chk_result;
     int check_options;
+    int admission;
+    int ret;
     struct timeval core_time;
 
     gettimeofday(&core_time,NULL);
@@ -951,7 +1298,19 @@ static int handle_host_check( int event_type, void *data ) {
     }
 
     /* intercept dummy checks */
-    if(mod_gm_opt->internal_check_dummy && try_check_dummy(processed_command, hst, NULL) == GM_OK) {
+    if(mod_gm_opt->internal_checks && try_internal_check(processed_command, hst, NULL) == GM_OK) {
+        return NEBERROR_CALLBACKOVERRIDE;
+    }
+
+    /* do not add to the backlog of overloaded queues */
+    admission = admission_check(target_queue);
+    if(admission == GM_ADMISSION_LOCAL) {
+        gm_log( GM_LOG_DEBUG, "queue %s overloaded, running host check locally: %s\n", target_queue, hst->name );
+        return NEB_OK;
+    }
+    else if(admission == GM_ADMISSION_POSTPONE) {
+        gm_log( GM_LOG_DEBUG, "queue %s overloaded, postponing host check: %s\n", target_queue, hst->name );
+        schedule_host_check(hst, time(NULL) + mod_gm_opt->admission_postpone_delay, CHECK_OPTION_ALLOW_POSTPONE);
         return NEBERROR_CALLBACKOVERRIDE;
     }
 
@@ -960,33 +1319,29 @@ static int handle_host_check( int event_type, void *data ) {
 
     gm_log( GM_LOG_TRACE, "cmd_line: %s\n", processed_command );
 
-    temp_buffer[0]='\x0';
-    snprintf( temp_buffer,GM_MAX_OUTPUT-1,"type=host\nresult_queue=%s\ntarget_queue=%s\nhost_name=%s\ncore_time=%Lf\ntimeout=%d\ncommand_line=%s\n\n\n",
-              mod_gm_opt->result_queue,
-              target_queue,
-              hst->name,
-              timeval2double(&core_time) - hostdata->latency, // can only assume planned start date since next_check already advanced to next check and last_check still points to previous check
-              hostdata->timeout,
-              processed_command
-            );
-
-    if(mod_gm_opt->use_uniq_jobs == GM_ENABLED) {
-        make_uniq(uniq, "%s", hst->name);
-    }
-    if(add_job_to_queue(&client,
-                         mod_gm_opt->server_list,
-                         target_queue,
-                        (mod_gm_opt->use_uniq_jobs == GM_ENABLED ? uniq : NULL),
-                         temp_buffer,
-                         GM_JOB_PRIO_NORMAL,
-                         GM_DEFAULT_JOB_RETRIES,
-                         mod_gm_opt->transportmode,
-                         mod_ctx,
-                         0,
-                         mod_gm_opt->log_stats_interval
-                        ) == GM_OK) {
+    /* can only assume planned start date since next_check already advanced to next check and last_check still points to previous check */
+    build_check_job(hst, NULL, timeval2usec(&core_time) - (long long)(hostdata->latency * 1000000), hostdata->timeout, processed_command);
+
+    /* track the job before sending it, the result may arrive any time after that */
+    if(mod_gm_opt->orphan_grace > 0)
+        inflight_add(hst, NULL, target_queue, time(NULL) + hostdata->timeout + mod_gm_opt->orphan_grace);
+    ret = mod_gm_submit_job(target_queue,
+                            (mod_gm_opt->use_uniq_jobs == GM_ENABLED ? (char *)route_cache_uniq(hst, NULL, -1) : NULL),
+                            job_buffer->data,
+                            check_priority(hst, NULL),
+                            GM_DEFAULT_JOB_RETRIES,
+                            check_shard_key(hst->name, NULL)
+                           );
+    if(ret != GM_OK && mod_gm_opt->orphan_grace > 0)
+        inflight_remove(hst->name, NULL);
+    if(ret == GM_QUEUE_FULL) {
+        /* unset the execution flag, the core will run it */
+        hst->is_executing=FALSE;
+
+        gm_log( GM_LOG_DEBUG, "submit queue full, running host check locally: %s\n", hst->name );
+        return NEB_OK;
     }
-    else {
+    else if(ret != GM_OK) {
         /* unset the execution flag */
         hst->is_executing=FALSE;
 
@@ -997,26 +1352,8 @@ static int handle_host_check( int event_type, void *data ) {
     /* orphaned check - submit fake result to mark host as orphaned */
     if(mod_gm_opt->orphan_host_checks == GM_ENABLED && check_options & CHECK_OPTION_ORPHAN_CHECK) {
         gm_log( GM_LOG_DEBUG, "host check for %s orphaned\n", hst->name );
-        if ( ( chk_result = ( check_result * )gm_malloc( sizeof *chk_result ) ) == 0 )
+        if(add_orphan_result(hst, NULL, target_queue) != GM_OK)
             return NEBERROR_CALLBACKCANCEL;
-        snprintf( temp_buffer,GM_MAX_OUTPUT-1,"(host check orphaned, is the mod-gearman worker on queue '%s' running?)\n", target_queue);
-        init_check_result(chk_result);
-        chk_result->host_name           = gm_strdup( hst->name );
-        chk_result->scheduled_check     = TRUE;
-        chk_result->engine              = &mod_gearman_check_engine;
-        chk_result->output_file         = 0;
-        chk_result->output_file_fp      = NULL;
-        chk_result->output              = gm_strdup(temp_buffer);
-        chk_result->return_code         = mod_gm_opt->orphan_return;
-        chk_result->check_options       = CHECK_OPTION_NONE;
-        chk_result->object_check_type   = HOST_CHECK;
-        chk_result->check_type          = HOST_CHECK_ACTIVE;
-        chk_result->start_time.tv_sec   = (unsigned long)time(NULL);
-        chk_result->finish_time.tv_sec  = (unsigned long)time(NULL);
-        chk_result->timeout             = 0;
-        chk_result->latency             = 0;
-        mod_gm_add_result_to_list( chk_result );
-        chk_result = NULL;
     }
 
     /* tell naemon to not execute */
@@ -1031,9 +1368,10 @@ static int handle_svc_check( int event_type, void *data ) {
     service * svc = NULL;
     char *processed_command=NULL;
     nebstruct_service_check_data * svcdata;
-    int prio = GM_JOB_PRIO_LOW;
-    check_result * chk_result;
+    int prio;
     int check_options;
+    int admission;
+    int ret;
     struct timeval core_time;
 
     gettimeofday(&core_time,NULL);
@@ -1098,7 +1436,19 @@ static int handle_svc_check( int event_type, void *data ) {
     }
 
     /* intercept dummy checks */
-    if(mod_gm_opt->internal_check_dummy && try_check_dummy(processed_command, hst, svc) == GM_OK) {
+    if(mod_gm_opt->internal_checks && try_internal_check(processed_command, hst, svc) == GM_OK) {
+        return NEBERROR_CALLBACKOVERRIDE;
+    }
+
+    /* do not add to the backlog of overloaded queues */
+    admission = admission_check(target_queue);
+    if(admission == GM_ADMISSION_LOCAL) {
+        gm_log( GM_LOG_DEBUG, "queue %s overloaded, running service check locally: %s - %s\n", target_queue, svc->host_name, svc->description );
+        return NEB_OK;
+    }
+    else if(admission == GM_ADMISSION_POSTPONE) {
+        gm_log( GM_LOG_DEBUG, "queue %s overloaded, postponing service check: %s - %s\n", target_queue, svc->host_name, svc->description );
+        schedule_service_check(svc, time(NULL) + mod_gm_opt->admission_postpone_delay, CHECK_OPTION_ALLOW_POSTPONE);
         return NEBERROR_CALLBACKOVERRIDE;
     }
 
@@ -1107,38 +1457,37 @@ static int handle_svc_check( int event_type, void *data ) {
 
     gm_log( GM_LOG_TRACE, "cmd_line: %s\n", processed_command );
 
-    temp_buffer[0]='\x0';
-    snprintf( temp_buffer,GM_MAX_OUTPUT-1,"type=service\nresult_queue=%s\ntarget_queue=%s\nhost_name=%s\nservice_description=%s\ncore_time=%Lf\ntimeout=%d\ncommand_line=%s\n\n\n",
-              mod_gm_opt->result_queue,
-              target_queue,
-              svcdata->host_name,
-              svcdata->service_description,
-              timeval2double(&core_time) - svcdata->latency, // can only assume planned start date since next_check already advanced to next check and last_check still points to previous check
-              svcdata->timeout,
-              processed_command
-            );
+    /* can only assume planned start date since next_check already advanced to next check and last_check still points to previous check */
+    build_check_job(hst, svc, timeval2usec(&core_time) - (long long)(svcdata->latency * 1000000), svcdata->timeout, processed_command);
+
+    prio = check_priority(hst, svc);
 
     /* execute forced checks with high prio as they are propably user requested */
     if(check_options & CHECK_OPTION_FORCE_EXECUTION)
         prio = GM_JOB_PRIO_HIGH;
 
-    if(mod_gm_opt->use_uniq_jobs == GM_ENABLED) {
-        make_uniq(uniq, "%s-%s", svcdata->host_name, svcdata->service_description);
-    }
-    if(add_job_to_queue(&client,
-                         mod_gm_opt->server_list,
-                         target_queue,
-                        (mod_gm_opt->use_uniq_jobs == GM_ENABLED ? uniq : NULL),
-                         temp_buffer,
-                         prio,
-                         GM_DEFAULT_JOB_RETRIES,
-                         mod_gm_opt->transportmode,
-                         mod_ctx,
-                         0,
-                         mod_gm_opt->log_stats_interval
-                        ) == GM_OK) {
+    /* track the job before sending it, the result may arrive any time after that */
+    if(mod_gm_opt->orphan_grace > 0)
+        inflight_add(hst, svc, target_queue, time(NULL) + svcdata->timeout + mod_gm_opt->orphan_grace);
+    ret = mod_gm_submit_job(target_queue,
+                            (mod_gm_opt->use_uniq_jobs == GM_ENABLED ? (char *)route_cache_uniq(hst, svc, -1) : NULL),
+                            job_buffer->data,
+                            prio,
+                            GM_DEFAULT_JOB_RETRIES,
+                            check_shard_key(svcdata->host_name, svcdata->service_description)
+                           );
+    if(ret != GM_OK && mod_gm_opt->orphan_grace > 0)
+        inflight_remove(svc->host_name, svc->description);
+    if(ret == GM_OK) {
         gm_log( GM_LOG_TRACE, "handle_svc_check() finished successfully\n" );
     }
+    else if(ret == GM_QUEUE_FULL) {
+        /* unset the execution flag, the core will run it */
+        svc->is_executing=FALSE;
+
+        gm_log( GM_LOG_DEBUG, "submit queue full, running service check locally: %s - %s\n", svc->host_name, svc->description );
+        return NEB_OK;
+    }
     else {
         /* unset the execution flag */
         svc->is_executing=FALSE;
@@ -1150,27 +1499,8 @@ static int handle_svc_check( int event_type, void *data ) {
     /* orphaned check - submit fake result to mark service as orphaned */
     if(mod_gm_opt->orphan_service_checks == GM_ENABLED && check_options & CHECK_OPTION_ORPHAN_CHECK) {
         gm_log( GM_LOG_DEBUG, "service check for %s - %s orphaned\n", svc->host_name, svc->description );
-        if ( ( chk_result = ( check_result * )gm_malloc( sizeof *chk_result ) ) == 0 )
+        if(add_orphan_result(hst, svc, target_queue) != GM_OK)
             return NEBERROR_CALLBACKCANCEL;
-        snprintf( temp_buffer,GM_MAX_OUTPUT-1,"(service check orphaned, is the mod-gearman worker on queue '%s' running?)\n", target_queue);
-        init_check_result(chk_result);
-        chk_result->host_name           = gm_strdup( svc->host_name );
-        chk_result->service_description = gm_strdup( svc->description );
-        chk_result->scheduled_check     = TRUE;
-        chk_result->engine              = &mod_gearman_check_engine;
-        chk_result->output_file         = 0;
-        chk_result->output_file_fp      = NULL;
-        chk_result->output              = gm_strdup(temp_buffer);
-        chk_result->return_code         = mod_gm_opt->orphan_return;
-        chk_result->check_options       = CHECK_OPTION_NONE;
-        chk_result->object_check_type   = SERVICE_CHECK;
-        chk_result->check_type          = SERVICE_CHECK_ACTIVE;
-        chk_result->start_time.tv_sec   = (unsigned long)time(NULL);
-        chk_result->finish_time.tv_sec  = (unsigned long)time(NULL);
-        chk_result->latency             = 0;
-        chk_result->timeout             = 0;
-        mod_gm_add_result_to_list( chk_result );
-        chk_result = NULL;
     }
 
     /* tell naemon to not execute */
@@ -1206,21 +1536,25 @@ static int handle_hst_check_result( int event_type, void *data ) {
         return NEB_ERROR;
     }
 
-    if(chk_result->latency < 1)
+    if(mod_gm_opt->latency_flatten_window <= 0)
         return NEB_OK;
 
-    if(mod_gm_opt->latency_flatten_window <= 0)
+    /* count the next submission, so postponed checks avoid busy seconds */
+    const char * queue = route_cache_lookup(hst, NULL);
+    latency_scheduler_advance(time(NULL));
+    if(chk_result->latency < 1) {
+        latency_scheduler_add(queue, hst->next_check);
         return NEB_OK;
+    }
 
     int delay_max = (int)(chk_result->latency);
     if(delay_max < 5)
         delay_max = 5;
     if(delay_max > mod_gm_opt->latency_flatten_window)
         delay_max = mod_gm_opt->latency_flatten_window;
-    int delay = ranged_urand(1, delay_max);
-    if(delay < 1)
-        delay = 1; // minimum to 1 second
-    schedule_host_check(hst, hst->next_check + delay, CHECK_OPTION_ALLOW_POSTPONE);
+    time_t next_check = latency_scheduler_place(queue, hst->next_check, delay_max);
+    int delay = (int)(next_check - hst->next_check);
+    schedule_host_check(hst, next_check, CHECK_OPTION_ALLOW_POSTPONE);
     gm_log( GM_LOG_DEBUG, "delayed host %s by %d seconds (latency: %.3fs)\n", chk_result->host_name, delay, chk_result->latency);
     return NEB_OK;
 }
@@ -1252,21 +1586,25 @@ static int handle_svc_check_result( int event_type, void *data ) {
         return NEB_ERROR;
     }
 
-    if(chk_result->latency < 1)
+    if(mod_gm_opt->latency_flatten_window <= 0)
         return NEB_OK;
 
-    if(mod_gm_opt->latency_flatten_window <= 0)
+    /* count the next submission, so postponed checks avoid busy seconds */
+    const char * queue = route_cache_lookup(svc->host_ptr, svc);
+    latency_scheduler_advance(time(NULL));
+    if(chk_result->latency < 1) {
+        latency_scheduler_add(queue, svc->next_check);
         return NEB_OK;
+    }
 
     int delay_max = (int)(chk_result->latency);
     if(delay_max < 5)
         delay_max = 5;
     if(delay_max > mod_gm_opt->latency_flatten_window)
         delay_max = mod_gm_opt->latency_flatten_window;
-    int delay = ranged_urand(1, delay_max);
-    if(delay < 1)
-        delay = 1; // minimum to 1 second
-    schedule_service_check(svc, svc->next_check + delay, CHECK_OPTION_ALLOW_POSTPONE);
+    time_t next_check = latency_scheduler_place(queue, svc->next_check, delay_max);
+    int delay = (int)(next_check - svc->next_check);
+    schedule_service_check(svc, next_check, CHECK_OPTION_ALLOW_POSTPONE);
     gm_log( GM_LOG_DEBUG, "delayed service %s - %s by %d seconds (latency: %.3fs)\n", chk_result->host_name, chk_result->service_description, delay, chk_result->latency);
     return NEB_OK;
 }
@@ -1369,109 +1707,18 @@ static int verify_options(mod_gm_opt_t *opt) {
 
 /* return the prefered target function for our worker */
 static void set_target_queue( host *hst, service *svc ) {
-    int x=0;
-    customvariablesmember *temp_customvariablesmember = NULL;
-
-    /* empty our target */
-    target_queue[0] = '\x0';
-
-    /* grab target queue from custom variable */
-    if( mod_gm_opt->queue_cust_var ) {
-        if( svc ) {
-            temp_customvariablesmember = svc->custom_variables;
-            for(; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
-                if(!strcmp(mod_gm_opt->queue_cust_var, temp_customvariablesmember->variable_name)) {
-                    if(!strcmp(temp_customvariablesmember->variable_value, "local")) {
-                        gm_log( GM_LOG_TRACE, "bypassing local check from service custom variable\n" );
-                        return;
-                    }
-                    gm_log( GM_LOG_TRACE, "got target queue from service custom variable: %s\n", temp_customvariablesmember->variable_value );
-                    snprintf( target_queue, GM_SMALLBUFSIZE-1, "%s", temp_customvariablesmember->variable_value );
-                    return;
-                }
-            }
-        }
-
-        /* search in host custom variables */
-        temp_customvariablesmember = hst->custom_variables;
-        for(; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
-            if(!strcmp(mod_gm_opt->queue_cust_var, temp_customvariablesmember->variable_name)) {
-                if(!strcmp(temp_customvariablesmember->variable_value, "local")) {
-                    gm_log( GM_LOG_TRACE, "bypassing local check from host custom variable\n" );
-                    return;
-                }
-                gm_log( GM_LOG_TRACE, "got target queue from host custom variable: %s\n", temp_customvariablesmember->variable_value );
-                snprintf( target_queue, GM_SMALLBUFSIZE-1, "%s", temp_customvariablesmember->variable_value );
-                return;
-            }
-        }
-    }
-
-    /* look for matching local servicegroups */
-    if ( svc ) {
-        while ( mod_gm_opt->local_servicegroups_list[x] != NULL ) {
-            servicegroup * temp_servicegroup = find_servicegroup( mod_gm_opt->local_servicegroups_list[x] );
-            if ( temp_servicegroup != NULL && is_service_member_of_servicegroup( temp_servicegroup,svc )==TRUE ) {
-                gm_log( GM_LOG_TRACE, "service is member of local servicegroup: %s\n", mod_gm_opt->local_servicegroups_list[x] );
-                return;
-            }
-            x++;
-        }
-    }
-
-    /* look for matching local hostgroups */
-    x = 0;
-    while ( mod_gm_opt->local_hostgroups_list[x] != NULL ) {
-        hostgroup * temp_hostgroup = find_hostgroup( mod_gm_opt->local_hostgroups_list[x] );
-        if ( temp_hostgroup != NULL && is_host_member_of_hostgroup( temp_hostgroup,hst )==TRUE ) {
-            gm_log( GM_LOG_TRACE, "server is member of local hostgroup: %s\n", mod_gm_opt->local_hostgroups_list[x] );
-            return;
-        }
-        x++;
-    }
+    snprintf( target_queue, GM_SMALLBUFSIZE-1, "%s", route_cache_lookup( hst, svc ) );
+    return;
+}
 
-    /* look for matching servicegroups */
-    x = 0;
-    if ( svc ) {
-        while ( mod_gm_opt->servicegroups_list[x] != NULL ) {
-            servicegroup * temp_servicegroup = find_servicegroup( mod_gm_opt->servicegroups_list[x] );
-            if ( temp_servicegroup != NULL && is_service_member_of_servicegroup( temp_servicegroup,svc )==TRUE ) {
-                gm_log( GM_LOG_TRACE, "service is member of servicegroup: %s\n", mod_gm_opt->servicegroups_list[x] );
-                snprintf( target_queue, GM_SMALLBUFSIZE-1, "servicegroup_%s", mod_gm_opt->servicegroups_list[x] );
-                return;
-            }
-            x++;
-        }
-    }
 
-    /* look for matching hostgroups */
-    x = 0;
-    while ( mod_gm_opt->hostgroups_list[x] != NULL ) {
-        hostgroup * temp_hostgroup = find_hostgroup( mod_gm_opt->hostgroups_list[x] );
-        if ( temp_hostgroup != NULL && is_host_member_of_hostgroup( temp_hostgroup,hst )==TRUE ) {
-            gm_log( GM_LOG_TRACE, "server is member of hostgroup: %s\n", mod_gm_opt->hostgroups_list[x] );
-            snprintf( target_queue, GM_SMALLBUFSIZE-1, "hostgroup_%s", mod_gm_opt->hostgroups_list[x] );
-            return;
-        }
-        x++;
-    }
-
-    if ( svc ) {
-        /* pass into the general service queue */
-        if ( mod_gm_opt->services == GM_ENABLED ) {
-            snprintf( target_queue, GM_SMALLBUFSIZE-1, "service" );
-            return;
-        }
-    }
-    else {
-        /* pass into the general host queue */
-        if ( mod_gm_opt->hosts == GM_ENABLED ) {
-            snprintf( target_queue, GM_SMALLBUFSIZE-1, "host" );
-            return;
-        }
-    }
-
-    return;
+/* return the shard key for a check, 0 if sharding is disabled */
+static unsigned int check_shard_key( char * host_name, char * service_description ) {
+    if(mod_gm_opt->sharding == GM_SHARD_NONE)
+        return(0);
+    if(mod_gm_opt->sharding == GM_SHARD_SERVICE && service_description != NULL)
+        return(gm_shard_hash(host_name, service_description));
+    return(gm_shard_hash(host_name, NULL));
 }
 
 
@@ -1485,6 +1732,7 @@ int handle_perfdata(int event_type, void *data) {
     nagios_macros mac;
     char *raw_output = NULL;
     char *processed_output = NULL;
+    char *output = NULL;
 
     gm_log( GM_LOG_TRACE, "handle_perfdata(%d)\n", event_type );
     if(process_performance_data == 0) {
@@ -1509,6 +1757,16 @@ int handle_perfdata(int event_type, void *data) {
                     break;
                 }
 
+                /* precompiled template only reads the referenced fields */
+                if(host_perfdata_tpl != NULL) {
+                    gm_buffer_reset(perfdata_buffer);
+                    perfdata_template_render(host_perfdata_tpl, perfdata_buffer, hst, NULL);
+                    output = perfdata_buffer->data;
+                    gm_log( GM_LOG_TRACE, "handle_perfdata() processed host template: %s\n", output );
+                    has_perfdata = TRUE;
+                    break;
+                }
+
                 memset(&mac, 0, sizeof(mac));
                 grab_host_macros_r(&mac, hst);
 
@@ -1522,6 +1780,7 @@ int handle_perfdata(int event_type, void *data) {
                 }
 
                 gm_log( GM_LOG_TRACE, "handle_perfdata() processed host template: %s\n", processed_output );
+                output = processed_output;
                 has_perfdata = TRUE;
             }
             break;
@@ -1541,6 +1800,15 @@ int handle_perfdata(int event_type, void *data) {
                     break;
                 }
 
+                if(service_perfdata_tpl != NULL) {
+                    gm_buffer_reset(perfdata_buffer);
+                    perfdata_template_render(service_perfdata_tpl, perfdata_buffer, svc->host_ptr, svc);
+                    output = perfdata_buffer->data;
+                    gm_log( GM_LOG_TRACE, "handle_perfdata() processed service template: %s\n", output );
+                    has_perfdata = TRUE;
+                    break;
+                }
+
                 memset(&mac, 0, sizeof(mac));
                 grab_service_macros_r(&mac, svc);
 
@@ -1554,6 +1822,7 @@ int handle_perfdata(int event_type, void *data) {
                 }
 
                 gm_log( GM_LOG_TRACE, "handle_perfdata() processed service template: %s\n", processed_output );
+                output = processed_output;
                 has_perfdata = TRUE;
             }
             break;
@@ -1562,35 +1831,33 @@ int handle_perfdata(int event_type, void *data) {
             break;
     }
 
-    if(has_perfdata == TRUE) {
+    if(has_perfdata == TRUE && mod_gm_opt->perfdata_batch_size > 1) {
+        if(event_type == NEBCALLBACK_HOST_CHECK_DATA)
+            perfdata_batch_add(hostchkdata->host_name, NULL, output);
+        else
+            perfdata_batch_add(srvchkdata->host_name, srvchkdata->service_description, output);
+    }
+    else if(has_perfdata == TRUE) {
         int i = 0;
         for (i = 0; i < mod_gm_opt->perfdata_queues_num; i++) {
             char *perfdata_queue = mod_gm_opt->perfdata_queues_list[i];
+            char *uniq = NULL;
 
             /* generate uuid including the queue name. it seems like pushing the same uuid into different queues still overwrites them. */
             if(mod_gm_opt->perfdata_mode == GM_PERFDATA_OVERWRITE) {
-                switch (event_type) {
-                    case NEBCALLBACK_HOST_CHECK_DATA:
-                        make_uniq(uniq, "%s-%s", perfdata_queue, hostchkdata->host_name);
-                        break;
-                    case NEBCALLBACK_SERVICE_CHECK_DATA:
-                        make_uniq(uniq, "%s-%s-%s", perfdata_queue, srvchkdata->host_name, srvchkdata->service_description);
-                        break;
-                }
+                if(svc != NULL)
+                    uniq = (char *)route_cache_uniq(svc->host_ptr, svc, i);
+                else
+                    uniq = (char *)route_cache_uniq(hst, NULL, i);
             }
 
             /* add our job onto the queue */
-            if(add_job_to_queue(&client,
-                                 mod_gm_opt->server_list,
-                                 perfdata_queue,
-                                 (mod_gm_opt->perfdata_mode == GM_PERFDATA_OVERWRITE ? uniq : NULL),
-                                 processed_output,
+            if(mod_gm_submit_job(perfdata_queue,
+                                 uniq,
+                                 output,
                                  GM_JOB_PRIO_NORMAL,
                                  GM_DEFAULT_JOB_RETRIES,
-                                 mod_gm_opt->transportmode,
-                                 mod_ctx,
-                                 0,
-                                 mod_gm_opt->log_stats_interval
+                                 0
                                 ) == GM_OK) {
                 gm_log( GM_LOG_TRACE, "handle_perfdata() successfully added data to %s\n", perfdata_queue );
             }
@@ -1609,135 +1876,25 @@ int handle_perfdata(int event_type, void *data) {
 
 /* handle generic exports */
 int handle_export(int callback_type, void *data) {
-    int debug_level_orig, return_code;
-    char * buffer;
-    char * type;
-    char * event_type;
-    nebstruct_log_data          * nld;
-    nebstruct_process_data      * npd;
-    nebstruct_timed_event_data  * nted;
-
-    temp_buffer[0]          = '\x0';
+    int debug_level_orig, return_code, i;
+
+    /* do not log from here, logging might trigger another export */
+    debug_level_orig        = mod_gm_opt->debug_level;
     mod_gm_opt->debug_level = -1;
-    debug_level_orig    = mod_gm_opt->debug_level;
-    return_code         = 0;
+    return_code             = 0;
 
-    /* what type of event/data do we have? */
-    switch (callback_type) {
-        case NEBCALLBACK_PROCESS_DATA:                      /*  7 */
-            npd    = (nebstruct_process_data *)data;
-            type   = nebtype2str(npd->type);
-            snprintf( temp_buffer,GM_MAX_OUTPUT-1, "{\"callback_type\":\"%s\",\"type\":\"%s\",\"flags\":%d,\"attr\":%d,\"timestamp\":%Lf}",
-                    "NEBCALLBACK_PROCESS_DATA",
-                    type,
-                    npd->flags,
-                    npd->attr,
-                    timeval2double(&npd->timestamp)
-                    );
-            free(type);
-            break;
-        case NEBCALLBACK_TIMED_EVENT_DATA:                  /*  8 */
-            nted       = (nebstruct_timed_event_data *)data;
-            event_type = eventtype2str(nted->event_type);
-            type       = nebtype2str(nted->type);
-            snprintf( temp_buffer,GM_MAX_OUTPUT-1, "{\"callback_type\":\"%s\",\"event_type\":\"%s\",\"type\":\"%s\",\"flags\":%d,\"attr\":%d,\"timestamp\":%Lf,\"recurring\":%d,\"run_time\":%d}",
-                    "NEBCALLBACK_TIMED_EVENT_DATA",
-                    event_type,
-                    type,
-                    nted->flags,
-                    nted->attr,
-                    timeval2double(&nted->timestamp),
-                    nted->recurring,
-                    (int)nted->run_time
-                    );
-            free(event_type);
-            free(type);
-            break;
-        case NEBCALLBACK_LOG_DATA:                          /*  9 */
-            nld    = (nebstruct_log_data *)data;
-            buffer = escapestring(nld->data);
-            type   = nebtype2str(nld->type);
-            snprintf( temp_buffer,GM_MAX_OUTPUT-1, "{\"callback_type\":\"%s\",\"type\":\"%s\",\"flags\":%d,\"attr\":%d,\"timestamp\":%Lf,\"entry_time\":%d,\"data_type\":%d,\"data\":\"%s\"}",
-                    "NEBCALLBACK_LOG_DATA",
-                    type,
-                    nld->flags,
-                    nld->attr,
-                    timeval2double(&nld->timestamp),
-                    (int)nld->entry_time,
-                    nld->data_type,
-                    buffer);
-            free(type);
-            free(buffer);
-            break;
-        case NEBCALLBACK_SYSTEM_COMMAND_DATA:               /* 10 */
-            break;
-        case NEBCALLBACK_EVENT_HANDLER_DATA:                /* 11 */
-            break;
-        case NEBCALLBACK_NOTIFICATION_DATA:                 /* 12 */
-            break;
-        case NEBCALLBACK_SERVICE_CHECK_DATA:                /* 13 */
-            break;
-        case NEBCALLBACK_HOST_CHECK_DATA:                   /* 14 */
-            break;
-        case NEBCALLBACK_COMMENT_DATA:                      /* 15 */
-            break;
-        case NEBCALLBACK_DOWNTIME_DATA:                     /* 16 */
-            break;
-        case NEBCALLBACK_FLAPPING_DATA:                     /* 17 */
-            break;
-        case NEBCALLBACK_PROGRAM_STATUS_DATA:               /* 18 */
-            break;
-        case NEBCALLBACK_HOST_STATUS_DATA:                  /* 19 */
-            break;
-        case NEBCALLBACK_SERVICE_STATUS_DATA:               /* 20 */
-            break;
-        case NEBCALLBACK_ADAPTIVE_PROGRAM_DATA:             /* 21 */
-            break;
-        case NEBCALLBACK_ADAPTIVE_HOST_DATA:                /* 22 */
-            break;
-        case NEBCALLBACK_ADAPTIVE_SERVICE_DATA:             /* 23 */
-            break;
-        case NEBCALLBACK_EXTERNAL_COMMAND_DATA:             /* 24 */
-            break;
-        case NEBCALLBACK_AGGREGATED_STATUS_DATA:            /* 25 */
-            break;
-        case NEBCALLBACK_RETENTION_DATA:                    /* 26 */
-            break;
-        case NEBCALLBACK_CONTACT_NOTIFICATION_DATA:         /* 27 */
-            break;
-        case NEBCALLBACK_CONTACT_NOTIFICATION_METHOD_DATA:  /* 28 */
-            break;
-        case NEBCALLBACK_ACKNOWLEDGEMENT_DATA:              /* 29 */
-            break;
-        case NEBCALLBACK_STATE_CHANGE_DATA:                 /* 30 */
-            break;
-        case NEBCALLBACK_CONTACT_STATUS_DATA:               /* 31 */
-            break;
-        case NEBCALLBACK_ADAPTIVE_CONTACT_DATA:             /* 32 */
-            break;
-        default:
-            gm_log( GM_LOG_ERROR, "handle_export() unknown export type: %d\n", callback_type );
-            mod_gm_opt->debug_level = debug_level_orig;
-            return 0;
+    if(callback_type < 0 || callback_type >= GM_NEBTYPESSIZE) {
+        mod_gm_opt->debug_level = debug_level_orig;
+        return 0;
     }
+    for(i = 0; i < mod_gm_opt->exports[callback_type]->elem_number; i++)
+        return_code = mod_gm_opt->exports[callback_type]->return_code[i];
 
-    if(temp_buffer[0] != '\x0') {
-        int i = 0;
-        for(i = 0; i<mod_gm_opt->exports[callback_type]->elem_number; i++) {
-            return_code = mod_gm_opt->exports[callback_type]->return_code[i];
-            add_job_to_queue(&client,
-                              mod_gm_opt->server_list,
-                              mod_gm_opt->exports[callback_type]->name[i], /* queue name */
-                              NULL,
-                              temp_buffer,
-                              GM_JOB_PRIO_NORMAL,
-                              GM_DEFAULT_JOB_RETRIES,
-                              mod_gm_opt->transportmode,
-                              mod_ctx,
-                              0,
-                              mod_gm_opt->log_stats_interval
-                            );
-        }
+    /* status updates are sent later, only the latest one per object */
+    if(export_coalesce_add(callback_type, data) == FALSE) {
+        gm_buffer_reset(export_buffer);
+        if(export_serialize(export_buffer, callback_type, data) == GM_OK)
+            export_send(callback_type, export_buffer);
     }
 
     mod_gm_opt->debug_level = debug_level_orig;
@@ -2011,81 +2168,67 @@ char * eventtype2str(int i) {
     return gm_strdup("UNKNOWN");
 }
 
-/* intercept check_dummy calls and directly answer them */
-static int try_check_dummy(const char * command_line, host * hst, service * svc) {
+/* submit a fake result to mark a check as orphaned */
+static int add_orphan_result(host * hst, service * svc, const char * queue) {
     check_result * chk_result;
-    int return_code = 3;
-    int check_for_shell_chars = FALSE;
 
-    if(strstr(command_line, "/check_dummy") == NULL) {
-        return(GM_ERROR);
-    }
-
-    gm_log( GM_LOG_DEBUG, "using internal check dummy for cmd: '%s'\n", command_line);
-
-    char *cmd_line, *cmd_line_orig;
-    cmd_line_orig = cmd_line = gm_strdup(command_line);
-    char *check = strtok( cmd_line, " " );
-
-    if(strstr(check, "/check_dummy") == NULL) {
-        my_free(cmd_line_orig);
+    if ( ( chk_result = mod_gm_new_check_result() ) == NULL )
         return(GM_ERROR);
+    chk_result->host_name           = gm_strdup( hst->name );
+    chk_result->scheduled_check     = TRUE;
+    chk_result->engine              = &mod_gearman_check_engine;
+    chk_result->output_file         = 0;
+    chk_result->output_file_fp      = NULL;
+    chk_result->return_code         = mod_gm_opt->orphan_return;
+    chk_result->check_options       = CHECK_OPTION_NONE;
+    if(svc == NULL) {
+        gm_asprintf(&chk_result->output, "(host check orphaned, is the mod-gearman worker on queue '%s' running?)\n", queue);
+        chk_result->object_check_type   = HOST_CHECK;
+        chk_result->check_type          = HOST_CHECK_ACTIVE;
+    } else {
+        chk_result->service_description = gm_strdup( svc->description );
+        gm_asprintf(&chk_result->output, "(service check orphaned, is the mod-gearman worker on queue '%s' running?)\n", queue);
+        chk_result->object_check_type   = SERVICE_CHECK;
+        chk_result->check_type          = SERVICE_CHECK_ACTIVE;
     }
+    chk_result->start_time.tv_sec   = (unsigned long)time(NULL);
+    chk_result->finish_time.tv_sec  = (unsigned long)time(NULL);
+    chk_result->timeout             = 0;
+    chk_result->latency             = 0;
+    mod_gm_add_result_to_list( chk_result );
 
+    return(GM_OK);
+}
 
-    char *arg1  = strtok( NULL, " " );
-    char *output = strtok( NULL, "");
-    if(arg1 == NULL)
-        arg1 = "";
-    // return code starts with double quote, take string until next double quote
-    if(arg1[0] == '"') {
-        arg1++;
-        arg1 = strtok( arg1, "\"" );
-        if(arg1 == NULL)
-            arg1 = "";
-    }
-    // return code starts with single quote, take string until next single quote
-    else if(arg1[0] == '\'') {
-        arg1++;
-        arg1 = strtok( arg1, "'" );
+/* called for in-flight jobs which did not get a result in time */
+static void orphan_inflight_job(host * hst, service * svc, const char * queue) {
+    if(svc == NULL) {
+        if(mod_gm_opt->orphan_host_checks != GM_ENABLED)
+            return;
+        gm_log( GM_LOG_DEBUG, "host check for %s overdue, marking it orphaned\n", hst->name );
+    } else {
+        if(mod_gm_opt->orphan_service_checks != GM_ENABLED)
+            return;
+        gm_log( GM_LOG_DEBUG, "service check for %s - %s overdue, marking it orphaned\n", svc->host_name, svc->description );
     }
+    add_orphan_result(hst, svc, queue);
+}
 
-    if(output == NULL)
-        output = "";
-
-    // string starts with double quote, take string until next double quote
-    if(output[0] == '"') {
-        output++;
-        output = strtok( output, "\"" );
-        check_for_shell_chars = TRUE;
-        if(output == NULL)
-            output = "";
-    }
-    // string starts with single quote, take string until next single quote
-    else if(output[0] == '\'') {
-        output++;
-        output = strtok( output, "'" );
-    }
-    // string starts with something else, parse till first whitespace
-    else {
-        char *remain = strtok( output, " \t");
-        if(remain != NULL) {
-            output = remain;
-        }
-        check_for_shell_chars = TRUE;
-    }
+/* answer trivial checks without sending them to a worker */
+static int try_internal_check(const char * command_line, host * hst, service * svc) {
+    check_result * chk_result;
+    int return_code = 3;
+    char * output = NULL;
 
-    if(check_for_shell_chars && strpbrk(output, "$&();<>`\"'|") != NULL) {
-        my_free(cmd_line_orig);
+    if(internal_check_execute(command_line, hst, svc, &return_code, &output) != GM_OK) {
         return(GM_ERROR);
     }
 
-    if ( ( chk_result = ( check_result * )gm_malloc( sizeof *chk_result ) ) == 0 ) {
-        my_free(cmd_line_orig);
+    if ( ( chk_result = mod_gm_new_check_result() ) == NULL ) {
+        gm_free(output);
         return(GM_ERROR);
     }
 
-    init_check_result(chk_result);
     chk_result->host_name           = gm_strdup( hst->name );
     if(svc != NULL) {
         chk_result->service_description = gm_strdup( svc->description );
@@ -2105,41 +2248,9 @@ static int try_check_dummy(const char * command_line, host * hst, service * svc)
     chk_result->start_time.tv_sec   = (unsigned long)time(NULL);
     chk_result->finish_time.tv_sec  = (unsigned long)time(NULL);
     chk_result->latency             = 0;
+    chk_result->return_code         = return_code;
+    chk_result->output              = output;
 
-    if(!strcmp(arg1, "-V") || !strcmp(arg1, "--version")) {
-        gm_asprintf(&chk_result->output, "internal mod-gearman check_dummy, v%s\n", GM_VERSION);
-        chk_result->return_code = 3;
-    }
-    else if(!strcmp(arg1, "-h") || !strcmp(arg1, "--help") || strspn (arg1, "0123456789 ") != strlen (arg1)) {
-        gm_asprintf(&chk_result->output, "usage: check_dummy <state> <output>\nsee check_dummy --help for complete help.");
-        chk_result->return_code = 3;
-    } else {
-        return_code = atoi(arg1);
-        switch(return_code) {
-            case 0:
-                gm_asprintf(&chk_result->output, "OK: %s\n", output);
-                chk_result->return_code = 0;
-                break;
-            case 1:
-                gm_asprintf(&chk_result->output, "WARNING: %s\n", output);
-                chk_result->return_code = 1;
-                break;
-            case 2:
-                gm_asprintf(&chk_result->output, "CRITICAL: %s\n", output);
-                chk_result->return_code = 2;
-                break;
-            case 3:
-                gm_asprintf(&chk_result->output, "UNKNOWN: %s\n", output);
-                chk_result->return_code = 3;
-                break;
-            default:
-                gm_asprintf(&chk_result->output, "UNKNOWN: Status %s is not a supported error state", arg1);
-                chk_result->return_code = 3;
-                break;
-        }
-    }
-
-    my_free(cmd_line_orig);
     mod_gm_add_result_to_list( chk_result );
     chk_result = NULL;
 
@@ -0,0 +1,208 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+
+/* include header */
+#include "perfdata_batch.h"
+#include "submit_thread.h"
+#include "shard.h"
+#include "gm_buffer.h"
+#include "utils.h"
+
+extern mod_gm_opt_t *mod_gm_opt;
+
+/* single perfdata record waiting in the batch */
+typedef struct perfdata_record_struct {
+    unsigned int   hash;                /* hash of host and service */
+    char         * host_name;
+    char         * service_description; /* NULL for host records */
+    char         * data;                /* processed template */
+    size_t         len;                 /* length of data */
+} perfdata_record_t;
+
+static perfdata_record_t * records = NULL;
+static int records_num   = 0;
+static int records_size  = 0;
+static size_t batch_bytes = 0;
+static time_t batch_start = 0;          /* time the oldest record was added */
+
+/* open addressing table of record index + 1, used to find duplicates in overwrite mode */
+static int * dedup_table = NULL;
+static unsigned int dedup_mask = 0;
+
+static gm_buffer_t * batch_buffer = NULL;
+
+
+/* allocate the batch */
+void perfdata_batch_init(void) {
+    unsigned int size = 1;
+
+    if(records != NULL || mod_gm_opt->perfdata_batch_size <= 1)
+        return;
+
+    records_size = mod_gm_opt->perfdata_batch_size;
+    records      = gm_malloc(records_size * sizeof(perfdata_record_t));
+    records_num  = 0;
+    batch_bytes  = 0;
+
+    /* keep the table at most half full */
+    while(size < (unsigned int)records_size * 2)
+        size <<= 1;
+    dedup_table = gm_malloc(size * sizeof(int));
+    memset(dedup_table, 0, size * sizeof(int));
+    dedup_mask = size - 1;
+
+    batch_buffer = gm_buffer_new();
+
+    gm_log( GM_LOG_DEBUG, "perfdata batching enabled: %d records, %d bytes, %ds\n", mod_gm_opt->perfdata_batch_size, mod_gm_opt->perfdata_batch_bytes, mod_gm_opt->perfdata_batch_delay );
+}
+
+
+/* return matching record for host and service or NULL and the free slot in the table */
+static perfdata_record_t * find_record(unsigned int hash, const char * host_name, const char * service_description, unsigned int * slot) {
+    unsigned int pos = hash & dedup_mask;
+    perfdata_record_t * rec;
+
+    while(dedup_table[pos] != 0) {
+        rec = &records[dedup_table[pos] - 1];
+        if(rec->hash == hash
+           && !strcmp(rec->host_name, host_name)
+           && (rec->service_description == NULL ? service_description == NULL
+                                                : (service_description != NULL && !strcmp(rec->service_description, service_description)))) {
+            return(rec);
+        }
+        pos = (pos + 1) & dedup_mask;
+    }
+    *slot = pos;
+    return(NULL);
+}
+
+
+/* add a record to the batch */
+void perfdata_batch_add(const char * host_name, const char * service_description, const char * data) {
+    perfdata_record_t * rec;
+    unsigned int hash, slot = 0;
+    size_t len = strlen(data);
+
+    if(records == NULL)
+        return;
+
+    /* send what we have if this record would not fit anymore */
+    if(records_num > 0 && batch_bytes + len > (size_t)mod_gm_opt->perfdata_batch_bytes)
+        perfdata_batch_flush();
+
+    hash = gm_shard_hash(host_name, service_description);
+    if(mod_gm_opt->perfdata_mode == GM_PERFDATA_OVERWRITE) {
+        rec = find_record(hash, host_name, service_description, &slot);
+        if(rec != NULL) {
+            gm_log( GM_LOG_TRACE, "perfdata_batch_add() replaced record for %s%s%s\n", host_name, service_description == NULL ? "" : " - ", service_description == NULL ? "" : service_description );
+            batch_bytes -= rec->len;
+            batch_bytes += len;
+            gm_free(rec->data);
+            rec->data = gm_strdup(data);
+            rec->len  = len;
+            /* a growing record can push the batch over the limit as well */
+            if(batch_bytes >= (size_t)mod_gm_opt->perfdata_batch_bytes)
+                perfdata_batch_flush();
+            return;
+        }
+        dedup_table[slot] = records_num + 1;
+    }
+
+    if(records_num == 0)
+        batch_start = time(NULL);
+
+    rec = &records[records_num++];
+    rec->hash                = hash;
+    rec->host_name           = gm_strdup(host_name);
+    rec->service_description = service_description == NULL ? NULL : gm_strdup(service_description);
+    rec->data                = gm_strdup(data);
+    rec->len                 = len;
+    batch_bytes += len;
+
+    if(records_num >= records_size || batch_bytes >= (size_t)mod_gm_opt->perfdata_batch_bytes)
+        perfdata_batch_flush();
+}
+
+
+/* send the batch to all perfdata queues */
+void perfdata_batch_flush(void) {
+    int i;
+    perfdata_record_t * rec;
+
+    if(records == NULL || records_num == 0)
+        return;
+
+    gm_buffer_reset(batch_buffer);
+    for(i = 0; i < records_num; i++) {
+        rec = &records[i];
+        gm_buffer_append(batch_buffer, rec->data, rec->len);
+        gm_free(rec->data);
+        gm_free(rec->host_name);
+        gm_free(rec->service_description);
+    }
+
+    /* the batch mixes many hosts, so no uniq key is used. Duplicates have been removed already. */
+    for(i = 0; i < mod_gm_opt->perfdata_queues_num; i++) {
+        if(mod_gm_submit_job(mod_gm_opt->perfdata_queues_list[i],
+                             NULL,
+                             batch_buffer->data,
+                             GM_JOB_PRIO_NORMAL,
+                             GM_DEFAULT_JOB_RETRIES,
+                             0
+                            ) == GM_OK) {
+            gm_log( GM_LOG_TRACE, "perfdata_batch_flush() successfully added %d records to %s\n", records_num, mod_gm_opt->perfdata_queues_list[i] );
+        }
+        else {
+            gm_log( GM_LOG_ERROR, "failed to send perfdata batch to gearmand\n" );
+        }
+    }
+
+    if(mod_gm_opt->perfdata_mode == GM_PERFDATA_OVERWRITE)
+        memset(dedup_table, 0, (dedup_mask + 1) * sizeof(int));
+    records_num = 0;
+    batch_bytes = 0;
+}
+
+
+/* send the batch if it is old enough */
+void perfdata_batch_tick(time_t now) {
+    if(records == NULL || records_num == 0)
+        return;
+    if(now - batch_start >= mod_gm_opt->perfdata_batch_delay)
+        perfdata_batch_flush();
+}
+
+
+/* send remaining records and free the batch */
+void perfdata_batch_free(void) {
+    if(records == NULL)
+        return;
+    perfdata_batch_flush();
+    gm_free(records);
+    gm_free(dedup_table);
+    gm_buffer_free(&batch_buffer);
+    records_size = 0;
+    dedup_mask   = 0;
+}
@@ -0,0 +1,311 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+
+/* include header */
+#include "perfdata_template.h"
+#include "utils.h"
+
+/* supported macros */
+enum {
+    PT_TIMET,
+    PT_HOSTNAME,
+    PT_HOSTDISPLAYNAME,
+    PT_HOSTALIAS,
+    PT_HOSTADDRESS,
+    PT_HOSTOUTPUT,
+    PT_LONGHOSTOUTPUT,
+    PT_HOSTPERFDATA,
+    PT_HOSTCHECKCOMMAND,
+    PT_HOSTSTATE,
+    PT_HOSTSTATEID,
+    PT_HOSTSTATETYPE,
+    PT_HOSTATTEMPT,
+    PT_MAXHOSTATTEMPTS,
+    PT_HOSTLATENCY,
+    PT_HOSTEXECUTIONTIME,
+    PT_SERVICEDESC,
+    PT_SERVICEDISPLAYNAME,
+    PT_SERVICEOUTPUT,
+    PT_LONGSERVICEOUTPUT,
+    PT_SERVICEPERFDATA,
+    PT_SERVICECHECKCOMMAND,
+    PT_SERVICESTATE,
+    PT_SERVICESTATEID,
+    PT_SERVICESTATETYPE,
+    PT_SERVICEATTEMPT,
+    PT_MAXSERVICEATTEMPTS,
+    PT_SERVICELATENCY,
+    PT_SERVICEEXECUTIONTIME,
+    PT_MACRO_NUM
+};
+
+/* macro names, same order as above */
+static const char * macro_names[PT_MACRO_NUM] = {
+    "TIMET",
+    "HOSTNAME",
+    "HOSTDISPLAYNAME",
+    "HOSTALIAS",
+    "HOSTADDRESS",
+    "HOSTOUTPUT",
+    "LONGHOSTOUTPUT",
+    "HOSTPERFDATA",
+    "HOSTCHECKCOMMAND",
+    "HOSTSTATE",
+    "HOSTSTATEID",
+    "HOSTSTATETYPE",
+    "HOSTATTEMPT",
+    "MAXHOSTATTEMPTS",
+    "HOSTLATENCY",
+    "HOSTEXECUTIONTIME",
+    "SERVICEDESC",
+    "SERVICEDISPLAYNAME",
+    "SERVICEOUTPUT",
+    "LONGSERVICEOUTPUT",
+    "SERVICEPERFDATA",
+    "SERVICECHECKCOMMAND",
+    "SERVICESTATE",
+    "SERVICESTATEID",
+    "SERVICESTATETYPE",
+    "SERVICEATTEMPT",
+    "MAXSERVICEATTEMPTS",
+    "SERVICELATENCY",
+    "SERVICEEXECUTIONTIME",
+};
+
+static const char * host_state_names[]    = { "UP", "DOWN", "UNREACHABLE" };
+static const char * service_state_names[] = { "OK", "WARNING", "CRITICAL", "UNKNOWN" };
+
+
+/* return macro id or -1 */
+static int find_macro(const char * name, size_t len, int service) {
+    int x;
+    for(x = 0; x < PT_MACRO_NUM; x++) {
+        if(strlen(macro_names[x]) == len && !strncmp(macro_names[x], name, len)) {
+            /* service macros are empty for hosts, leave them to the core */
+            if(!service && x >= PT_SERVICEDESC)
+                return(-1);
+            return(x);
+        }
+    }
+    return(-1);
+}
+
+
+static void add_token(perfdata_template_t * tpl, int macro, const char * text, size_t len) {
+    perfdata_token_t * tok;
+
+    /* merge adjacent literal text */
+    if(macro == -1 && tpl->tokens_num > 0) {
+        tok = &tpl->tokens[tpl->tokens_num-1];
+        if(tok->macro == -1 && tok->text + tok->len == text) {
+            tok->len += len;
+            return;
+        }
+    }
+    tpl->tokens = gm_realloc(tpl->tokens, (tpl->tokens_num+1) * sizeof(perfdata_token_t));
+    tok = &tpl->tokens[tpl->tokens_num++];
+    tok->macro = macro;
+    tok->text  = text;
+    tok->len   = len;
+}
+
+
+/* split template into tokens */
+perfdata_template_t * perfdata_template_compile(const char * tmpl, int service) {
+    perfdata_template_t * tpl;
+    const char * start, * end;
+    int macro;
+
+    if(tmpl == NULL)
+        return(NULL);
+
+    tpl = gm_malloc(sizeof(perfdata_template_t));
+    tpl->source     = gm_strdup(tmpl);
+    tpl->tokens     = NULL;
+    tpl->tokens_num = 0;
+
+    start = tpl->source;
+    while(*start != '\0') {
+        end = strchr(start, '$');
+        if(end == NULL) {
+            add_token(tpl, -1, start, strlen(start));
+            break;
+        }
+        if(end > start)
+            add_token(tpl, -1, start, end - start);
+
+        start = end + 1;
+        end   = strchr(start, '$');
+        if(end == NULL) {
+            /* unterminated macro, let the core decide */
+            perfdata_template_free(&tpl);
+            return(NULL);
+        }
+        if(end == start) {
+            /* $$ is a literal dollar sign */
+            add_token(tpl, -1, end, 1);
+        } else {
+            macro = find_macro(start, end - start, service);
+            if(macro == -1) {
+                gm_log( GM_LOG_DEBUG, "perfdata template uses unsupported macro $%.*s$, using core macro processing\n", (int)(end - start), start );
+                perfdata_template_free(&tpl);
+                return(NULL);
+            }
+            add_token(tpl, macro, NULL, 0);
+        }
+        start = end + 1;
+    }
+
+    return(tpl);
+}
+
+
+/* unset fields expand to an empty string like in the core */
+static void append_field(gm_buffer_t * buf, const char * value) {
+    if(value != NULL)
+        gm_buffer_append(buf, value, strlen(value));
+}
+
+
+static void append_state(gm_buffer_t * buf, const char ** names, int names_num, int state) {
+    if(state >= 0 && state < names_num)
+        gm_buffer_append_str(buf, names[state]);
+    else
+        gm_buffer_append_str(buf, "(unknown)");
+}
+
+
+/* expand compiled template */
+void perfdata_template_render(perfdata_template_t * tpl, gm_buffer_t * buf, host * hst, service * svc) {
+    int x;
+    perfdata_token_t * tok;
+
+    for(x = 0; x < tpl->tokens_num; x++) {
+        tok = &tpl->tokens[x];
+        switch(tok->macro) {
+            case -1:
+                gm_buffer_append(buf, tok->text, tok->len);
+                break;
+            case PT_TIMET:
+                gm_buffer_append_int(buf, (long long)time(NULL));
+                break;
+            case PT_HOSTNAME:
+                append_field(buf, hst->name);
+                break;
+            case PT_HOSTDISPLAYNAME:
+                append_field(buf, hst->display_name);
+                break;
+            case PT_HOSTALIAS:
+                append_field(buf, hst->alias);
+                break;
+            case PT_HOSTADDRESS:
+                append_field(buf, hst->address);
+                break;
+            case PT_HOSTOUTPUT:
+                append_field(buf, hst->plugin_output);
+                break;
+            case PT_LONGHOSTOUTPUT:
+                append_field(buf, hst->long_plugin_output);
+                break;
+            case PT_HOSTPERFDATA:
+                append_field(buf, hst->perf_data);
+                break;
+            case PT_HOSTCHECKCOMMAND:
+                append_field(buf, hst->check_command);
+                break;
+            case PT_HOSTSTATE:
+                append_state(buf, host_state_names, 3, hst->current_state);
+                break;
+            case PT_HOSTSTATEID:
+                gm_buffer_append_int(buf, hst->current_state);
+                break;
+            case PT_HOSTSTATETYPE:
+                gm_buffer_append_str(buf, hst->state_type == HARD_STATE ? "HARD" : "SOFT");
+                break;
+            case PT_HOSTATTEMPT:
+                gm_buffer_append_int(buf, hst->current_attempt);
+                break;
+            case PT_MAXHOSTATTEMPTS:
+                gm_buffer_append_int(buf, hst->max_attempts);
+                break;
+            case PT_HOSTLATENCY:
+                gm_buffer_printf(buf, "%.3f", hst->latency);
+                break;
+            case PT_HOSTEXECUTIONTIME:
+                gm_buffer_printf(buf, "%.3f", hst->execution_time);
+                break;
+            case PT_SERVICEDESC:
+                append_field(buf, svc->description);
+                break;
+            case PT_SERVICEDISPLAYNAME:
+                append_field(buf, svc->display_name);
+                break;
+            case PT_SERVICEOUTPUT:
+                append_field(buf, svc->plugin_output);
+                break;
+            case PT_LONGSERVICEOUTPUT:
+                append_field(buf, svc->long_plugin_output);
+                break;
+            case PT_SERVICEPERFDATA:
+                append_field(buf, svc->perf_data);
+                break;
+            case PT_SERVICECHECKCOMMAND:
+                append_field(buf, svc->check_command);
+                break;
+            case PT_SERVICESTATE:
+                append_state(buf, service_state_names, 4, svc->current_state);
+                break;
+            case PT_SERVICESTATEID:
+                gm_buffer_append_int(buf, svc->current_state);
+                break;
+            case PT_SERVICESTATETYPE:
+                gm_buffer_append_str(buf, svc->state_type == HARD_STATE ? "HARD" : "SOFT");
+                break;
+            case PT_SERVICEATTEMPT:
+                gm_buffer_append_int(buf, svc->current_attempt);
+                break;
+            case PT_MAXSERVICEATTEMPTS:
+                gm_buffer_append_int(buf, svc->max_attempts);
+                break;
+            case PT_SERVICELATENCY:
+                gm_buffer_printf(buf, "%.3f", svc->latency);
+                break;
+            case PT_SERVICEEXECUTIONTIME:
+                gm_buffer_printf(buf, "%.3f", svc->execution_time);
+                break;
+        }
+    }
+    gm_buffer_append(buf, "\n", 1);
+}
+
+
+/* free compiled template */
+void perfdata_template_free(perfdata_template_t ** tpl) {
+    if(*tpl == NULL)
+        return;
+    gm_free((*tpl)->tokens);
+    gm_free((*tpl)->source);
+    gm_free(*tpl);
+}
@@ -0,0 +1,167 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+
+/* include header */
+#include "result_coalesce.h"
+#include "utils.h"
+
+/* a result with its position in the batch */
+typedef struct coalesce_entry_struct {
+    check_result * cr;
+    int            index;
+} coalesce_entry_t;
+
+static int cmp_str(const char * a, const char * b) {
+    if(a == NULL || b == NULL)
+        return((a != NULL) - (b != NULL));
+    return(strcmp(a, b));
+}
+
+/* sort by object, then by finish time and position */
+static int cmp_entry(const void * p1, const void * p2) {
+    const coalesce_entry_t * a = p1;
+    const coalesce_entry_t * b = p2;
+    int ret;
+
+    if(a->cr->object_check_type != b->cr->object_check_type)
+        return(a->cr->object_check_type - b->cr->object_check_type);
+    if((ret = cmp_str(a->cr->host_name, b->cr->host_name)) != 0)
+        return(ret);
+    if(a->cr->object_check_type == SERVICE_CHECK && (ret = cmp_str(a->cr->service_description, b->cr->service_description)) != 0)
+        return(ret);
+    if(a->cr->finish_time.tv_sec != b->cr->finish_time.tv_sec)
+        return(a->cr->finish_time.tv_sec < b->cr->finish_time.tv_sec ? -1 : 1);
+    if(a->cr->finish_time.tv_usec != b->cr->finish_time.tv_usec)
+        return(a->cr->finish_time.tv_usec < b->cr->finish_time.tv_usec ? -1 : 1);
+    return(a->index - b->index);
+}
+
+static int cmp_int(const void * p1, const void * p2) {
+    return(*(const int *)p1 - *(const int *)p2);
+}
+
+/* state a result would lead to, hosts are only up or not */
+static int result_state(check_result * cr) {
+    if(cr->object_check_type == HOST_CHECK)
+        return(cr->return_code == 0 ? 0 : 1);
+    if(cr->return_code < 0 || cr->return_code > 3)
+        return(3);
+    return(cr->return_code);
+}
+
+/* current state of the object in the core, -1 if unknown */
+static int current_state(check_result * cr) {
+    host * hst;
+    service * svc;
+
+    if(cr->object_check_type == HOST_CHECK) {
+        hst = find_host(cr->host_name);
+        if(hst == NULL)
+            return(-1);
+        return(hst->current_state == 0 ? 0 : 1);
+    }
+    svc = find_service(cr->host_name, cr->service_description);
+    if(svc == NULL)
+        return(-1);
+    return(svc->current_state);
+}
+
+/* keep only the newest result per object */
+int result_coalesce(check_result ** results, int num, int keep_state_changes) {
+    coalesce_entry_t * entries;
+    check_result ** placed;
+    check_result ** dropped;
+    char * keep;
+    int * slots;
+    int x, y, z, start, state, kept, num_dropped, num_slots;
+
+    if(num < 2)
+        return(num);
+
+    entries = gm_malloc(num * sizeof(coalesce_entry_t));
+    for(x = 0; x < num; x++) {
+        entries[x].cr    = results[x];
+        entries[x].index = x;
+    }
+    qsort(entries, num, sizeof(coalesce_entry_t), cmp_entry);
+
+    keep = gm_malloc(num);
+    memset(keep, 0, num);
+    placed = gm_malloc(num * sizeof(check_result *));
+    slots  = gm_malloc(num * sizeof(int));
+    start  = 0;
+    for(x = 1; x <= num; x++) {
+        if(x < num
+           && entries[x].cr->object_check_type == entries[start].cr->object_check_type
+           && !cmp_str(entries[x].cr->host_name, entries[start].cr->host_name)
+           && (entries[x].cr->object_check_type != SERVICE_CHECK || !cmp_str(entries[x].cr->service_description, entries[start].cr->service_description)))
+            continue;
+
+        /* entries[start] to entries[x-1] belong to the same object, the last one is the newest */
+        keep[entries[x-1].index] = TRUE;
+        if(keep_state_changes == TRUE && x - start > 1) {
+            state = current_state(entries[start].cr);
+            for(y = start; y < x - 1; y++) {
+                if(state != -1 && result_state(entries[y].cr) != state)
+                    keep[entries[y].index] = TRUE;
+                state = result_state(entries[y].cr);
+            }
+        }
+
+        /* the kept results of this object take its arrival positions in finish time order */
+        num_slots = 0;
+        for(y = start; y < x; y++) {
+            if(keep[entries[y].index])
+                slots[num_slots++] = entries[y].index;
+        }
+        qsort(slots, num_slots, sizeof(int), cmp_int);
+        z = 0;
+        for(y = start; y < x; y++) {
+            if(keep[entries[y].index])
+                placed[slots[z++]] = entries[y].cr;
+        }
+        start = x;
+    }
+
+    /* kept results go to the front in arrival order, so results of different
+     * objects are injected first in first out, dropped results are moved behind them */
+    dropped     = gm_malloc(num * sizeof(check_result *));
+    num_dropped = 0;
+    kept        = 0;
+    for(x = 0; x < num; x++) {
+        if(keep[x])
+            results[kept++] = placed[x];
+        else
+            dropped[num_dropped++] = results[x];
+    }
+    memcpy(&results[kept], dropped, num_dropped * sizeof(check_result *));
+
+    gm_free(dropped);
+    gm_free(slots);
+    gm_free(placed);
+    gm_free(keep);
+    gm_free(entries);
+    return(kept);
+}
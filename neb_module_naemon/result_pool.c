@@ -0,0 +1,200 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/* include header */
+#include "result_pool.h"
+#include "utils.h"
+
+/* free a result with all its strings */
+static void free_result(mod_gm_result_t * res) {
+    gm_free(res->strings);
+    free(res);
+}
+
+/* free the pool and all unused results */
+static void destroy_pool(result_pool_t * pool) {
+    mpsc_queue_node_t * node;
+    mpsc_queue_node_t * next;
+
+    for(node = pool->free; node != NULL; node = next) {
+        next = node->next;
+        free_result(mpsc_queue_entry(node, mod_gm_result_t, node));
+    }
+    for(node = mpsc_queue_take_all(&pool->returned); node != NULL; node = next) {
+        next = node->next;
+        free_result(mpsc_queue_entry(node, mod_gm_result_t, node));
+    }
+    free(pool);
+}
+
+/* drop one reference, the last one frees the pool */
+static void unref_pool(result_pool_t * pool) {
+    if(__atomic_sub_fetch(&pool->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        destroy_pool(pool);
+}
+
+/* move results given back by the core to the free list */
+static void refill_pool(result_pool_t * pool) {
+    mpsc_queue_node_t * node;
+    mpsc_queue_node_t * next;
+
+    for(node = mpsc_queue_take_all(&pool->returned); node != NULL; node = next) {
+        next = node->next;
+        if(pool->free_num >= GM_RESULT_POOL_SIZE) {
+            free_result(mpsc_queue_entry(node, mod_gm_result_t, node));
+            continue;
+        }
+        node->next = pool->free;
+        pool->free = node;
+        pool->free_num++;
+    }
+}
+
+/* create new pool */
+result_pool_t * result_pool_new(void) {
+    result_pool_t * pool = gm_malloc(sizeof(result_pool_t));
+    pool->free     = NULL;
+    pool->free_num = 0;
+    mpsc_queue_init(&pool->returned);
+    pool->refs     = 1;
+    pool->allocs   = 0;
+    pool->reused   = 0;
+    return(pool);
+}
+
+/* owner gives up the pool */
+void result_pool_close(result_pool_t * pool) {
+    mpsc_queue_node_t * node;
+    mpsc_queue_node_t * next;
+
+    if(pool == NULL)
+        return;
+
+    /* unused results are not needed anymore, results in use keep the pool alive */
+    refill_pool(pool);
+    for(node = pool->free; node != NULL; node = next) {
+        next = node->next;
+        free_result(mpsc_queue_entry(node, mod_gm_result_t, node));
+    }
+    pool->free     = NULL;
+    pool->free_num = 0;
+    unref_pool(pool);
+}
+
+/* get initialized result */
+mod_gm_result_t * result_pool_get(result_pool_t * pool) {
+    mod_gm_result_t * res = NULL;
+
+    if(pool != NULL) {
+        if(pool->free == NULL)
+            refill_pool(pool);
+        if(pool->free != NULL) {
+            res = mpsc_queue_entry(pool->free, mod_gm_result_t, node);
+            pool->free = pool->free->next;
+            pool->free_num--;
+            pool->reused++;
+        }
+        __atomic_add_fetch(&pool->refs, 1, __ATOMIC_RELAXED);
+    }
+
+    if(res == NULL) {
+        res = gm_malloc(sizeof(mod_gm_result_t));
+        res->strings      = NULL;
+        res->strings_size = 0;
+        if(pool != NULL)
+            pool->allocs++;
+    }
+
+    init_check_result(&res->result);
+    res->node.next   = NULL;
+    res->pool        = pool;
+    res->interned    = FALSE;
+    res->lane        = -1;
+    res->strings_len = 0;
+    return(res);
+}
+
+/* make room for the strings of a fresh result */
+void result_pool_reserve(mod_gm_result_t * res, size_t size) {
+    if(res->strings_len > 0 || size <= res->strings_size)
+        return;
+
+    /* round up, so slightly longer output does not need a new buffer each time */
+    if(size < GM_RESULT_POOL_STRINGS_MIN)
+        size = GM_RESULT_POOL_STRINGS_MIN;
+    size = (size + GM_RESULT_POOL_STRINGS_MIN - 1) / GM_RESULT_POOL_STRINGS_MIN * GM_RESULT_POOL_STRINGS_MIN;
+
+    gm_free(res->strings);
+    res->strings      = gm_malloc(size);
+    res->strings_size = size;
+    if(res->pool != NULL)
+        res->pool->allocs++;
+}
+
+/* copy string into the storage of a result */
+char * result_pool_strdup(mod_gm_result_t * res, const char * str, size_t len) {
+    char * copy;
+
+    if(res->strings_len + len + 1 > res->strings_size) {
+        if(res->pool != NULL)
+            res->pool->allocs++;
+        return(gm_strndup(str, len));
+    }
+    copy = res->strings + res->strings_len;
+    memcpy(copy, str, len);
+    copy[len] = '\x0';
+    res->strings_len += len + 1;
+    return(copy);
+}
+
+/* forget strings from the storage, so free_check_result only frees the others */
+static void release_string(mod_gm_result_t * res, char ** str) {
+    if(*str != NULL && *str >= res->strings && *str < res->strings + res->strings_size)
+        *str = NULL;
+}
+
+/* give result back */
+void result_pool_put(mod_gm_result_t * res) {
+    result_pool_t * pool = res->pool;
+
+    if(res->interned == TRUE) {
+        res->result.host_name           = NULL;
+        res->result.service_description = NULL;
+    }
+    release_string(res, &res->result.host_name);
+    release_string(res, &res->result.service_description);
+    release_string(res, &res->result.output);
+    free_check_result(&res->result);
+
+    if(pool == NULL) {
+        free_result(res);
+        return;
+    }
+
+    if(res->strings_size > GM_RESULT_POOL_STRINGS_MAX)
+        free_result(res);
+    else
+        mpsc_queue_push(&pool->returned, &res->node);
+    unref_pool(pool);
+}
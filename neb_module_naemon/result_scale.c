@@ -0,0 +1,55 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/* include header */
+#include "result_scale.h"
+
+/* number of threads needed for the current load */
+int result_threads_target(int current, int min, int max, int waiting, double busy) {
+    int target = current;
+    if(current < max && (waiting > current * GM_RESULT_SCALE_BACKLOG || busy > GM_RESULT_SCALE_BUSY_HIGH)) {
+        /* grow fast during bursts */
+        target = current + (current / 2 > 1 ? current / 2 : 1);
+    }
+    else if(current > min && waiting <= 0 && busy < GM_RESULT_SCALE_BUSY_LOW) {
+        /* shrink slowly */
+        target = current - 1;
+    }
+    if(target > max)
+        target = max;
+    if(target < min)
+        target = min;
+    return(target);
+}
+
+/* share of the interval the threads spent processing results */
+double result_threads_busy_ratio(unsigned long long busy, int threads, int interval) {
+    double ratio;
+    if(threads <= 0 || interval <= 0)
+        return(0);
+    ratio = (double)busy / (interval * 1000000.0 * threads);
+    if(ratio > 1)
+        ratio = 1;
+    return(ratio);
+}
@@ -24,9 +24,16 @@
 
 /* include header */
 #include "result_thread.h"
+#include "result_scale.h"
 #include "utils.h"
 #include "mod_gearman.h"
 #include "gearman_utils.h"
+#include "gm_payload.h"
+#include "inflight.h"
+#include "metrics.h"
+#include "result_pool.h"
+#include "intern.h"
+#include "route_cache.h"
 
 extern mod_gm_opt_t *mod_gm_opt;
 extern char hostname[GM_SMALLBUFSIZE];
@@ -36,9 +43,39 @@ extern float current_submit_rate;
 extern float current_avg_submit_duration;
 extern double current_submit_max;
 extern int gm_should_terminate;
+extern int submit_queue_length;
+extern unsigned long submit_queue_dropped;
+extern unsigned long submit_queue_local;
+extern int spool_jobs;
+extern unsigned long spool_bytes;
+extern unsigned long spool_replayed;
+extern unsigned long spool_dropped;
+extern unsigned long spool_expired;
 
 __thread EVP_CIPHER_CTX * result_ctx = NULL; /* make ssl context local in each thread */
 
+/* result thread pool */
+typedef struct result_thread_struct {
+    pthread_t          thr;         /* thread id */
+    unsigned long long busy;        /* microseconds spent processing results */
+} result_thread_t;
+
+static result_thread_t * result_threads = NULL;     /* one slot for each possible thread */
+static int result_threads_num    = 0;               /* number of running threads */
+static int result_threads_min    = 0;
+static int result_threads_max    = 0;
+static __thread result_thread_t * current_result_thread = NULL;
+static __thread result_pool_t * result_pool = NULL;
+
+/* controller thread */
+static pthread_t scaler_thr;
+static int scaler_running          = FALSE;
+static int scaler_should_terminate = FALSE;
+static pthread_mutex_t scaler_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t scaler_cond   = PTHREAD_COND_INITIALIZER;
+
+static void *handle_result( gearman_job_st *, void *, size_t *, gearman_return_t * );
+
 static const char *gearman_worker_source_name(void *source) {
     if(!source)
         return "unknown internal source (voodoo, perhaps?)";
@@ -63,6 +100,7 @@ static void cancel_worker_thread(void * data) {
     gearman_worker_st **worker = (gearman_worker_st**) data;
     gm_free_worker(worker);
     mod_gm_crypt_deinit(result_ctx);
+    result_pool_close(result_pool);
 
     return;
 }
@@ -72,11 +110,12 @@ void *result_worker( void * data ) {
     gearman_worker_st *worker = NULL;
     gearman_return_t ret;
 
+    current_result_thread = (result_thread_t *)data;
     gm_log( GM_LOG_DEBUG, "worker thr-%ld started\n", pthread_self() );
-    gm_log( GM_LOG_TRACE, "worker args: %s\n", (char*)data );
     gethostname(hostname, GM_SMALLBUFSIZE-1);
 
     result_ctx = mod_gm_crypt_init(mod_gm_opt->crypt_key);
+    result_pool = result_pool_new();
 
     pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
     pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
@@ -86,16 +125,17 @@ void *result_worker( void * data ) {
 
     while( gm_should_terminate == FALSE ) {
         ret = gearman_worker_work(worker);
+        if(ret == GEARMAN_IO_WAIT || ret == GEARMAN_NO_JOBS || ret == GEARMAN_UNKNOWN_STATE) {
+            if( gm_should_terminate == TRUE )
+                break;
+            /* nothing to do right now, sleep in poll() on the server connections
+             * until gearmand answers our PRE_SLEEP with a NOOP or the timeout hits */
+            ret = gearman_worker_wait(worker);
+        }
         switch(ret) {
         case GEARMAN_SUCCESS:
         case GEARMAN_TIMEOUT:
-            break;
-        case GEARMAN_UNKNOWN_STATE:
-        case GEARMAN_NO_JOBS:
         case GEARMAN_IO_WAIT:
-            if( gm_should_terminate == TRUE )
-                break;
-            usleep(100000); // wait 100ms
             break;
         case GEARMAN_WORK_FAIL:
         default:
@@ -116,21 +156,43 @@ void *result_worker( void * data ) {
     gm_free_worker(&worker);
 
     mod_gm_crypt_deinit(result_ctx);
+    result_pool_close(result_pool);
     gm_log( GM_LOG_DEBUG, "worker thr-%ld finished\n", pthread_self() );
 
     return NULL;
 }
 
-/* put back the result into the core */
-void *get_results( gearman_job_st *job, __attribute__((__unused__)) void *context, size_t *result_size, gearman_return_t *ret_ptr ) {
+/* put back the result into the core and account the time spent */
+void *get_results( gearman_job_st *job, void *context, size_t *result_size, gearman_return_t *ret_ptr ) {
+    struct timeval start, end;
+    void * result;
+
+    gettimeofday(&start, NULL);
+    result = handle_result(job, context, result_size, ret_ptr);
+    gettimeofday(&end, NULL);
+    if(current_result_thread != NULL)
+        __atomic_add_fetch(&current_result_thread->busy, (unsigned long long)(timeval2usec(&end) - timeval2usec(&start)), __ATOMIC_RELAXED);
+    return(result);
+}
+
+/* decrypt and parse a result */
+static void *handle_result( gearman_job_st *job, __attribute__((__unused__)) void *context, size_t *result_size, gearman_return_t *ret_ptr ) {
     int transportmode;
     const char *workload;
     char *decrypted_data = NULL;
     char *decrypted_data_c;
     struct timeval now, core_start_time;
+    mod_gm_result_t * res;
     check_result * chk_result;
     int active_check = TRUE;
-    char *ptr;
+    gm_payload_t payload;
+    char *value;
+    long long num;
+    struct timeval tv;
+    int plain_size;
+    char *host_name, *service_description;
+    host *hst = NULL;
+    service *svc = NULL;
     double now_f, core_starttime_f, starttime_f, finishtime_f, exec_time, latency;
     size_t wsize = 0;
 
@@ -163,23 +225,34 @@ void *get_results( gearman_job_st *job, __attribute__((__unused__)) void *contex
     } else {
         transportmode = mod_gm_opt->transportmode;
     }
-    mod_gm_decrypt(result_ctx, &decrypted_data, workload, wsize, transportmode);
+    plain_size = mod_gm_decrypt(result_ctx, &decrypted_data, workload, wsize, transportmode);
     decrypted_data_c = decrypted_data;
 
     if(!strcmp(workload, "check")) {
         char * result = gm_malloc(GM_BUFFERSIZE);
         *result_size = GM_BUFFERSIZE;
-        snprintf(result, GM_BUFFERSIZE, "0:OK - result worker running on %s. Sending %.1f jobs/s (avg duration:%.3fms). Version: %s|worker=%i;;;0;%i avg_submit_duration=%.6fs;;;0;%.6f jobs=%luc errors=%luc",
+        snprintf(result, GM_BUFFERSIZE, "0:OK - result worker running on %s. Sending %.1f jobs/s (avg duration:%.3fms). Version: %s|worker=%i;;;0;%i avg_submit_duration=%.6fs;;;0;%.6f jobs=%luc errors=%luc submit_queue=%d;;;0;%d submit_dropped=%luc submit_local=%luc spool=%d;;;0; spool_size=%luB;;;0;%ld spool_replayed=%luc spool_dropped=%luc spool_expired=%luc inflight=%d",
                                             hostname,
                                             current_submit_rate,
                                             (current_avg_submit_duration*1000),
                                             GM_VERSION,
-                                            mod_gm_opt->result_workers,
-                                            mod_gm_opt->result_workers,
+                                            __atomic_load_n(&result_threads_num, __ATOMIC_RELAXED),
+                                            result_threads_max,
                                             current_avg_submit_duration,
                                             current_submit_max,
                                             total_submit_jobs,
-                                            total_submit_errors
+                                            total_submit_errors,
+                                            submit_queue_length,
+                                            mod_gm_opt->submit_workers > 0 ? mod_gm_opt->submit_queue_size : 0,
+                                            submit_queue_dropped,
+                                            submit_queue_local,
+                                            spool_jobs,
+                                            spool_bytes,
+                                            mod_gm_opt->spool_dir != NULL ? (long)mod_gm_opt->spool_max_size * 1024 * 1024 : 0L,
+                                            spool_replayed,
+                                            spool_dropped,
+                                            spool_expired,
+                                            inflight_count(NULL)
         );
         pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL); // restore thread cancellation
         return((void*)result);
@@ -190,7 +263,7 @@ void *get_results( gearman_job_st *job, __attribute__((__unused__)) void *contex
         pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL); // restore thread cancellation
         return NULL;
     }
-    gm_log( GM_LOG_TRACE, "%zu --->\n%s\n<---\n", strlen(decrypted_data), decrypted_data );
+    gm_log( GM_LOG_TRACE, "%zu --->\n%s\n<---\n", gm_payload_size(decrypted_data), decrypted_data );
 
     /*
      * save this result to a file, so when nagios crashes,
@@ -203,20 +276,15 @@ void *get_results( gearman_job_st *job, __attribute__((__unused__)) void *contex
         if(fd == NULL) {
             perror("fopen");
         } else {
-            fputs( decrypted_data, fd );
+            fwrite( decrypted_data, 1, gm_payload_size(decrypted_data), fd );
             fclose( fd );
         }
     }
 #endif
 
-    /* naemon will free it after processing */
-    if ( ( chk_result = ( check_result * )gm_malloc( sizeof *chk_result ) ) == 0 ) {
-        *ret_ptr = GEARMAN_WORK_FAIL;
-        gm_free(decrypted_data_c);
-        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL); // restore thread cancellation
-        return NULL;
-    }
-    init_check_result(chk_result);
+    /* given back to the pool once the core has processed it */
+    res        = result_pool_get(result_pool);
+    chk_result = &res->result;
     chk_result->scheduled_check     = TRUE;
     chk_result->output_file         = 0;
     chk_result->output_file_fp      = NULL;
@@ -225,73 +293,71 @@ void *get_results( gearman_job_st *job, __attribute__((__unused__)) void *contex
     core_start_time.tv_usec         = 0;
     chk_result->latency             = 0;
 
-    while ( (ptr = strsep(&decrypted_data, "\n" )) != NULL ) {
-        char *key   = strsep( &ptr, "=" );
-        char *value = strsep( &ptr, "\x0" );
+    gm_payload_decode(&payload, decrypted_data, plain_size > 0 ? plain_size : 0);
 
-        if ( key == NULL )
-            continue;
+    host_name           = gm_payload_value(&payload, GM_PAYLOAD_HOST_NAME);
+    service_description = gm_payload_value(&payload, GM_PAYLOAD_SERVICE_DESCRIPTION);
 
-        if ( !strcmp( key, "output" ) ) {
-            if ( value == NULL ) {
-                gm_free(chk_result->output);
-                chk_result->output = gm_strdup("(null)");
-            }
-            else {
-
-                char *tmp_newline = replace_str(value, "\\n", "\n");
-                if (tmp_newline == NULL) {
-                    gm_free(chk_result->output);
-                    chk_result->output = gm_strdup("(null)");
-                } else {
-                    gm_free(chk_result->output);
-                    chk_result->output = gm_strdup( tmp_newline );
-                }
-
-                gm_free(tmp_newline);
-            }
+    /* results for unknown objects would be dropped by the core anyway */
+    if ( host_name != NULL && intern_lookup(host_name, service_description, &hst, &svc) != GM_OK ) {
+        if ( service_description != NULL ) {
+            gm_log( GM_LOG_DEBUG, "dropped result for unknown service: %s - %s\n", host_name, service_description );
+        } else {
+            gm_log( GM_LOG_DEBUG, "dropped result for unknown host: %s\n", host_name );
         }
+        metrics_result_received();
+        metrics_result_unknown();
+        result_pool_put(res);
+        gm_free(decrypted_data_c);
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL); // restore thread cancellation
+        return NULL;
+    }
 
-        if ( value == NULL || !strcmp( value, "") )
-            break;
-
-        if ( !strcmp( key, "host_name" ) ) {
-            gm_free(chk_result->host_name);
-            chk_result->host_name = gm_strdup( value );
-        } else if ( !strcmp( key, "service_description" ) ) {
-            gm_free(chk_result->service_description);
-            chk_result->service_description = gm_strdup( value );
-        } else if ( !strcmp( key, "source" ) ) {
-            chk_result->source = value;
-        } else if ( !strcmp( key, "check_options" ) ) {
-            chk_result->check_options = atoi( value );
-        } else if ( !strcmp( key, "scheduled_check" ) ) {
-            chk_result->scheduled_check = atoi( value );
-        } else if ( !strcmp( key, "type" ) && !strcmp( value, "passive" ) ) {
-            active_check=FALSE;
-        } else if ( !strcmp( key, "exited_ok" ) ) {
-            chk_result->exited_ok = atoi( value );
-        } else if ( !strcmp( key, "early_timeout" ) ) {
-            chk_result->early_timeout = atoi( value );
-        } else if ( !strcmp( key, "return_code" ) ) {
-            chk_result->return_code = atoi( value );
-        } else if ( !strcmp( key, "core_start_time" ) ) {
-            string2timeval(value, &core_start_time);
-        } else if ( !strcmp( key, "start_time" ) ) {
-            string2timeval(value, &chk_result->start_time);
-        } else if ( !strcmp( key, "finish_time" ) ) {
-            string2timeval(value, &chk_result->finish_time);
-        } else if ( !strcmp( key, "latency" ) ) { // used by send_gearman
-            chk_result->latency = atof( value );
-        }
+    /* binary results carry the raw output */
+    if ( payload.value[GM_PAYLOAD_OUTPUT] != NULL && payload.format == GM_PAYLOAD_FORMAT_TEXT )
+        payload.len[GM_PAYLOAD_OUTPUT] = gm_payload_unescape(payload.value[GM_PAYLOAD_OUTPUT], payload.len[GM_PAYLOAD_OUTPUT]);
+    result_pool_reserve(res, payload.len[GM_PAYLOAD_OUTPUT] + 1 + (hst == NULL ? payload.len[GM_PAYLOAD_HOST_NAME] + payload.len[GM_PAYLOAD_SERVICE_DESCRIPTION] + 2 : 0));
+    if ( payload.value[GM_PAYLOAD_OUTPUT] != NULL )
+        chk_result->output = result_pool_strdup( res, payload.value[GM_PAYLOAD_OUTPUT], payload.len[GM_PAYLOAD_OUTPUT] );
+
+    /* point to the names of the objects, copy them only until the table has been built */
+    if ( hst != NULL ) {
+        chk_result->host_name = hst->name;
+        if ( svc != NULL )
+            chk_result->service_description = svc->description;
+        res->interned = TRUE;
+        res->lane     = route_cache_result_lane(hst, svc);
+    } else {
+        if ( host_name != NULL )
+            chk_result->host_name = result_pool_strdup( res, host_name, payload.len[GM_PAYLOAD_HOST_NAME] );
+        if ( service_description != NULL )
+            chk_result->service_description = result_pool_strdup( res, service_description, payload.len[GM_PAYLOAD_SERVICE_DESCRIPTION] );
     }
+    if ( (value = gm_payload_value(&payload, GM_PAYLOAD_SOURCE)) != NULL )
+        chk_result->source = value;
+    if ( gm_payload_int(&payload, GM_PAYLOAD_CHECK_OPTIONS, &num) )
+        chk_result->check_options = num;
+    if ( gm_payload_int(&payload, GM_PAYLOAD_SCHEDULED_CHECK, &num) )
+        chk_result->scheduled_check = num;
+    if ( (value = gm_payload_value(&payload, GM_PAYLOAD_TYPE)) != NULL && !strcmp( value, "passive" ) )
+        active_check = FALSE;
+    if ( gm_payload_int(&payload, GM_PAYLOAD_EXITED_OK, &num) )
+        chk_result->exited_ok = num;
+    if ( gm_payload_int(&payload, GM_PAYLOAD_EARLY_TIMEOUT, &num) )
+        chk_result->early_timeout = num;
+    if ( gm_payload_int(&payload, GM_PAYLOAD_RETURN_CODE, &num) )
+        chk_result->return_code = num;
+    gm_payload_time(&payload, GM_PAYLOAD_CORE_START_TIME, &core_start_time);
+    gm_payload_time(&payload, GM_PAYLOAD_START_TIME, &chk_result->start_time);
+    gm_payload_time(&payload, GM_PAYLOAD_FINISH_TIME, &chk_result->finish_time);
+    if ( gm_payload_time(&payload, GM_PAYLOAD_LATENCY, &tv) ) // used by send_gearman
+        chk_result->latency = timeval2double(&tv);
 
     if ( chk_result->host_name == NULL || chk_result->output == NULL ) {
         *ret_ptr= GEARMAN_WORK_FAIL;
         gm_log( GM_LOG_ERROR, "discarded invalid job (%s), check your encryption settings\n", gearman_job_handle( job ) );
         pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL); // restore thread cancellation
-        free_check_result(chk_result);
-        gm_free(chk_result);
+        result_pool_put(res);
         return NULL;
     }
 
@@ -307,6 +373,12 @@ void *get_results( gearman_job_st *job, __attribute__((__unused__)) void *contex
             chk_result->check_type       = HOST_CHECK_PASSIVE;
     }
 
+    metrics_result_received();
+
+    /* the job is done, even if the result is processed later */
+    if(mod_gm_opt->orphan_grace > 0 && active_check == TRUE)
+        inflight_remove(chk_result->host_name, chk_result->service_description);
+
     /* fill some maybe missing options */
     if(chk_result->start_time.tv_sec  == 0) {
         chk_result->start_time.tv_sec = (unsigned long)time(NULL);
@@ -374,7 +446,150 @@ int set_worker( gearman_worker_st **worker ) {
         return GM_ERROR;
     }
 
+    /* non blocking mode, waiting for jobs is done by gearman_worker_wait() */
+    gearman_worker_add_options(w, GEARMAN_WORKER_NON_BLOCKING);
     gearman_worker_set_timeout(w, 30000);
 
     return GM_OK;
 }
+
+/* start one more result thread */
+static int start_result_thread(void) {
+    int ret;
+    result_thread_t * slot = &result_threads[result_threads_num];
+    if((ret = pthread_create(&slot->thr, NULL, &result_worker, slot)) != 0) {
+        gm_log( GM_LOG_ERROR, "failed to create result thread: %s\n", strerror(ret));
+        return(GM_ERROR);
+    }
+    __atomic_store_n(&result_threads_num, result_threads_num + 1, __ATOMIC_RELAXED);
+    return(GM_OK);
+}
+
+/* stop the last result thread, results are never cancelled while being processed */
+static void stop_result_thread(void) {
+    result_thread_t * slot = &result_threads[result_threads_num - 1];
+    if(pthread_cancel(slot->thr) != 0) {
+        gm_log( GM_LOG_ERROR, "failed to cancel result thread: %s\n", strerror(errno) );
+    }
+    if(pthread_join(slot->thr, NULL) != 0) {
+        gm_log( GM_LOG_ERROR, "failed to join result thread: %s\n", strerror(errno) );
+    }
+    __atomic_store_n(&result_threads_num, result_threads_num - 1, __ATOMIC_RELAXED);
+}
+
+/* number of results waiting in the result queue on all servers, -1 if unknown */
+static int result_queue_waiting(void) {
+    mod_gm_server_status_t * stats;
+    char * message = NULL;
+    char * version = NULL;
+    int waiting = -1;
+    int x, y;
+
+    for(x = 0; x < mod_gm_opt->server_num; x++) {
+        stats = gm_malloc(sizeof(mod_gm_server_status_t));
+        stats->function_num = 0;
+        stats->worker_num   = 0;
+        if(get_gearman_server_data(stats, &message, &version, mod_gm_opt->server_list[x]->host, mod_gm_opt->server_list[x]->port) == STATE_OK) {
+            for(y = 0; y < stats->function_num; y++) {
+                if(!strcmp(stats->function[y].queue, mod_gm_opt->result_queue))
+                    waiting = (waiting < 0 ? 0 : waiting) + stats->function[y].waiting;
+            }
+        }
+        free_mod_gm_status_server(stats);
+        gm_free(message);
+        gm_free(version);
+    }
+    return(waiting);
+}
+
+/* main loop of the controller thread */
+static void *result_scaler( __attribute__((__unused__)) void * data ) {
+    unsigned long long busy, last_busy = 0;
+    struct timeval now;
+    struct timespec deadline;
+    double busy_ratio;
+    int waiting, target, x;
+
+    gm_log( GM_LOG_DEBUG, "result scaler thr-%ld started\n", pthread_self() );
+
+    while(TRUE) {
+        pthread_mutex_lock(&scaler_mutex);
+        gettimeofday(&now, NULL);
+        deadline.tv_sec  = now.tv_sec + GM_RESULT_SCALE_INTERVAL;
+        deadline.tv_nsec = now.tv_usec * 1000;
+        while(scaler_should_terminate == FALSE && pthread_cond_timedwait(&scaler_cond, &scaler_mutex, &deadline) != ETIMEDOUT)
+            ;
+        if(scaler_should_terminate == TRUE) {
+            pthread_mutex_unlock(&scaler_mutex);
+            break;
+        }
+        pthread_mutex_unlock(&scaler_mutex);
+
+        busy = 0;
+        for(x = 0; x < result_threads_max; x++)
+            busy += __atomic_load_n(&result_threads[x].busy, __ATOMIC_RELAXED);
+        busy_ratio = result_threads_busy_ratio(busy - last_busy, result_threads_num, GM_RESULT_SCALE_INTERVAL);
+        last_busy  = busy;
+        waiting    = result_queue_waiting();
+
+        target = result_threads_target(result_threads_num, result_threads_min, result_threads_max, waiting, busy_ratio);
+        if(target != result_threads_num)
+            gm_log( GM_LOG_INFO, "scaling result threads from %d to %d (waiting results: %d, busy: %.0f%%)\n", result_threads_num, target, waiting, busy_ratio * 100 );
+        while(result_threads_num < target && start_result_thread() == GM_OK)
+            ;
+        while(result_threads_num > target)
+            stop_result_thread();
+    }
+
+    gm_log( GM_LOG_DEBUG, "result scaler thr-%ld finished\n", pthread_self() );
+    return(NULL);
+}
+
+/* start the result threads */
+int start_result_threads(void) {
+    int x, ret;
+
+    result_threads_min = mod_gm_opt->result_workers;
+    result_threads_max = mod_gm_opt->result_workers_max > result_threads_min ? mod_gm_opt->result_workers_max : result_threads_min;
+    if(result_threads_min <= 0)
+        return(GM_OK);
+
+    result_threads     = gm_malloc(result_threads_max * sizeof(result_thread_t));
+    result_threads_num = 0;
+    for(x = 0; x < result_threads_max; x++)
+        result_threads[x].busy = 0;
+
+    for(x = 0; x < result_threads_min; x++) {
+        if(start_result_thread() != GM_OK)
+            return(GM_ERROR);
+    }
+
+    if(result_threads_max > result_threads_min) {
+        scaler_should_terminate = FALSE;
+        if((ret = pthread_create(&scaler_thr, NULL, &result_scaler, NULL)) != 0) {
+            gm_log( GM_LOG_ERROR, "failed to create result scaler thread: %s\n", strerror(ret));
+            return(GM_ERROR);
+        }
+        scaler_running = TRUE;
+        gm_log( GM_LOG_DEBUG, "scaling result threads between %d and %d\n", result_threads_min, result_threads_max );
+    }
+    return(GM_OK);
+}
+
+/* stop the controller and all result threads */
+void shutdown_result_threads(void) {
+    if(scaler_running == TRUE) {
+        pthread_mutex_lock(&scaler_mutex);
+        scaler_should_terminate = TRUE;
+        pthread_cond_signal(&scaler_cond);
+        pthread_mutex_unlock(&scaler_mutex);
+        if(pthread_join(scaler_thr, NULL) != 0) {
+            gm_log( GM_LOG_ERROR, "failed to join result scaler thread: %s\n", strerror(errno) );
+        }
+        scaler_running = FALSE;
+    }
+
+    while(result_threads_num > 0)
+        stop_result_thread();
+    gm_free(result_threads);
+}
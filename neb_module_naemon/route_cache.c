@@ -0,0 +1,531 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/* include header */
+#include "route_cache.h"
+#include "utils.h"
+#include "gm_crypt.h"
+#include "gm_payload.h"
+
+#define ROUTE_UNIQ_SIZE 33      /* hex sum plus terminating null byte */
+
+extern mod_gm_opt_t *mod_gm_opt;
+
+/* group lists resolved to objects, NULL for unknown groups */
+typedef struct route_group_list_struct {
+    void  ** groups;            /* hostgroup or servicegroup pointers */
+    char  ** queues;            /* queue name for each group */
+    int      num;               /* number of groups */
+} route_group_list_t;
+
+static route_group_list_t route_hostgroups       = { NULL, NULL, 0 };
+static route_group_list_t route_servicegroups    = { NULL, NULL, 0 };
+static route_group_list_t route_local_hostgroups = { NULL, NULL, 0 };
+static route_group_list_t route_local_servicegroups = { NULL, NULL, 0 };
+static route_group_list_t route_priority_hostgroups = { NULL, NULL, 0 };
+static int route_groups_resolved = FALSE;
+
+/* queue names from custom variables, shared by all objects using them */
+static char ** route_names     = NULL;
+static int route_names_num     = 0;
+static int route_names_size    = 0;
+
+/* cached routing of a single host or service */
+typedef struct route_entry_struct {
+    const char * queue;         /* resolved target queue, NULL if not resolved yet */
+    char       * prefix;        /* static part of the check job, NULL if not built yet */
+    size_t       prefix_len;    /* length of the prefix */
+    int          prefix_format; /* GM_PAYLOAD_FORMAT_* of the prefix */
+    int          priority;      /* priority class, -1 if not resolved yet, 0 if none is set */
+    char       * uniq;          /* unique keys, check job first and then one per perfdata queue, NULL if not built yet */
+} route_entry_t;
+
+/* routing per object id */
+static route_entry_t * host_routes    = NULL;
+static route_entry_t * service_routes = NULL;
+static unsigned int host_routes_num    = 0;
+static unsigned int service_routes_num = 0;
+
+/* hostgroup match per host id, does not depend on custom variables */
+static const char ** host_groups     = NULL;
+static unsigned int host_groups_num  = 0;
+
+static const char route_local[]    = "";
+static const char route_no_group[] = "";    /* host is in none of the hostgroups */
+
+/* prefix and unique key for objects created after startup */
+static char * route_prefix_uncached = NULL;
+static char route_uniq_uncached[ROUTE_UNIQ_SIZE];
+
+/* resolve a list of group names */
+static void resolve_group_list(route_group_list_t * list, char * names[GM_LISTSIZE], int num, int is_hostgroup, const char * prefix) {
+    int x;
+    list->num    = num;
+    list->groups = gm_malloc((num > 0 ? num : 1) * sizeof(void *));
+    list->queues = gm_malloc((num > 0 ? num : 1) * sizeof(char *));
+    for(x = 0; x < num; x++) {
+        if(is_hostgroup)
+            list->groups[x] = find_hostgroup(names[x]);
+        else
+            list->groups[x] = find_servicegroup(names[x]);
+        list->queues[x] = NULL;
+        if(prefix != NULL)
+            gm_asprintf(&list->queues[x], "%s_%s", prefix, names[x]);
+    }
+}
+
+static void free_group_list(route_group_list_t * list) {
+    int x;
+    for(x = 0; x < list->num; x++)
+        gm_free(list->queues[x]);
+    gm_free(list->queues);
+    gm_free(list->groups);
+    list->num = 0;
+}
+
+/* group lookups only work after the core has read its config */
+static void resolve_groups(void) {
+    if(route_groups_resolved == TRUE)
+        return;
+    resolve_group_list(&route_local_servicegroups, mod_gm_opt->local_servicegroups_list, mod_gm_opt->local_servicegroups_num, FALSE, NULL);
+    resolve_group_list(&route_local_hostgroups,    mod_gm_opt->local_hostgroups_list,    mod_gm_opt->local_hostgroups_num,    TRUE,  NULL);
+    resolve_group_list(&route_servicegroups,       mod_gm_opt->servicegroups_list,       mod_gm_opt->servicegroups_num,       FALSE, "servicegroup");
+    resolve_group_list(&route_hostgroups,          mod_gm_opt->hostgroups_list,          mod_gm_opt->hostgroups_num,          TRUE,  "hostgroup");
+    resolve_group_list(&route_priority_hostgroups, mod_gm_opt->priority_hostgroups_list, mod_gm_opt->priority_hostgroups_num, TRUE,  NULL);
+    route_groups_resolved = TRUE;
+}
+
+/* return a stable copy of a queue name */
+static const char * intern_route_name(const char * name) {
+    int x;
+    for(x = 0; x < route_names_num; x++) {
+        if(!strcmp(route_names[x], name))
+            return(route_names[x]);
+    }
+    if(route_names_num == route_names_size) {
+        route_names_size = route_names_size == 0 ? 16 : route_names_size * 2;
+        route_names = gm_realloc(route_names, route_names_size * sizeof(char *));
+    }
+    route_names[route_names_num] = gm_strdup(name);
+    return(route_names[route_names_num++]);
+}
+
+/* return the queue from the custom variable, NULL if not set */
+static const char * custom_variable_queue(customvariablesmember * var, const char * type) {
+    for(; var != NULL; var = var->next) {
+        if(!strcmp(mod_gm_opt->queue_cust_var, var->variable_name)) {
+            if(!strcmp(var->variable_value, "local")) {
+                gm_log( GM_LOG_TRACE, "bypassing local check from %s custom variable\n", type );
+                return(route_local);
+            }
+            gm_log( GM_LOG_TRACE, "got target queue from %s custom variable: %s\n", type, var->variable_value );
+            return(intern_route_name(var->variable_value));
+        }
+    }
+    return(NULL);
+}
+
+/* hostgroup part of the target queue, only depends on the host */
+static const char * resolve_host_groups(host * hst, int use_cache) {
+    const char ** slot = NULL;
+    const char * queue = route_no_group;
+    int x;
+
+    if(use_cache == TRUE && hst->id < host_groups_num) {
+        slot = &host_groups[hst->id];
+        if(*slot != NULL)
+            return(*slot);
+    }
+
+    /* look for matching local hostgroups */
+    for(x = 0; x < route_local_hostgroups.num; x++) {
+        if ( route_local_hostgroups.groups[x] != NULL && is_host_member_of_hostgroup( route_local_hostgroups.groups[x], hst )==TRUE ) {
+            gm_log( GM_LOG_TRACE, "server is member of local hostgroup: %s\n", mod_gm_opt->local_hostgroups_list[x] );
+            queue = route_local;
+            break;
+        }
+    }
+
+    /* look for matching hostgroups */
+    if(queue == route_no_group) {
+        for(x = 0; x < route_hostgroups.num; x++) {
+            if ( route_hostgroups.groups[x] != NULL && is_host_member_of_hostgroup( route_hostgroups.groups[x], hst )==TRUE ) {
+                gm_log( GM_LOG_TRACE, "server is member of hostgroup: %s\n", mod_gm_opt->hostgroups_list[x] );
+                queue = route_hostgroups.queues[x];
+                break;
+            }
+        }
+    }
+
+    if(slot != NULL)
+        *slot = queue;
+    return(queue);
+}
+
+/* resolve the prefered target queue */
+static const char * resolve_queue(host * hst, service * svc, int use_cache) {
+    const char * queue;
+    const char * group_queue;
+    int x;
+
+    resolve_groups();
+
+    /* grab target queue from custom variable */
+    if( mod_gm_opt->queue_cust_var ) {
+        if( svc && (queue = custom_variable_queue(svc->custom_variables, "service")) != NULL )
+            return(queue);
+
+        /* search in host custom variables */
+        if( (queue = custom_variable_queue(hst->custom_variables, "host")) != NULL )
+            return(queue);
+    }
+
+    /* look for matching local servicegroups */
+    if ( svc ) {
+        for(x = 0; x < route_local_servicegroups.num; x++) {
+            if ( route_local_servicegroups.groups[x] != NULL && is_service_member_of_servicegroup( route_local_servicegroups.groups[x], svc )==TRUE ) {
+                gm_log( GM_LOG_TRACE, "service is member of local servicegroup: %s\n", mod_gm_opt->local_servicegroups_list[x] );
+                return(route_local);
+            }
+        }
+    }
+
+    /* local hostgroups win over servicegroups */
+    group_queue = resolve_host_groups(hst, use_cache);
+    if ( group_queue == route_local )
+        return(route_local);
+
+    /* look for matching servicegroups */
+    if ( svc ) {
+        for(x = 0; x < route_servicegroups.num; x++) {
+            if ( route_servicegroups.groups[x] != NULL && is_service_member_of_servicegroup( route_servicegroups.groups[x], svc )==TRUE ) {
+                gm_log( GM_LOG_TRACE, "service is member of servicegroup: %s\n", mod_gm_opt->servicegroups_list[x] );
+                return(route_servicegroups.queues[x]);
+            }
+        }
+    }
+
+    /* matching hostgroups */
+    if ( group_queue != route_no_group )
+        return(group_queue);
+
+    if ( svc ) {
+        /* pass into the general service queue */
+        if ( mod_gm_opt->services == GM_ENABLED )
+            return("service");
+    }
+    else {
+        /* pass into the general host queue */
+        if ( mod_gm_opt->hosts == GM_ENABLED )
+            return("host");
+    }
+
+    return(route_local);
+}
+
+/* queues and priorities from custom variables */
+int route_cache_uses_custom_variables(void) {
+    return(mod_gm_opt->queue_cust_var != NULL || mod_gm_opt->priority_cust_var != NULL ? TRUE : FALSE);
+}
+
+/* resolve target queue without any caching */
+const char * route_cache_resolve(host * hst, service * svc) {
+    return(resolve_queue(hst, svc, FALSE));
+}
+
+/* return cache entry of an object, NULL if it did not exist at startup */
+static route_entry_t * route_entry(host * hst, service * svc) {
+    if(svc != NULL)
+        return(svc->id < service_routes_num ? &service_routes[svc->id] : NULL);
+    return(hst->id < host_routes_num ? &host_routes[hst->id] : NULL);
+}
+
+/* return cached target queue */
+const char * route_cache_lookup(host * hst, service * svc) {
+    route_entry_t * entry = route_entry(hst, svc);
+
+    if(entry == NULL)
+        return(resolve_queue(hst, svc, TRUE));
+
+    if(entry->queue == NULL)
+        entry->queue = resolve_queue(hst, svc, TRUE);
+    return(entry->queue);
+}
+
+/* return the priority class from the custom variable, 0 if not set */
+static int custom_variable_priority(customvariablesmember * var, const char * type) {
+    int priority;
+    for(; var != NULL; var = var->next) {
+        if(!strcmp(mod_gm_opt->priority_cust_var, var->variable_name)) {
+            priority = parse_priority(var->variable_value);
+            if(priority == 0) {
+                gm_log( GM_LOG_TRACE, "ignoring invalid priority from %s custom variable: %s\n", type, var->variable_value );
+                return(0);
+            }
+            gm_log( GM_LOG_TRACE, "got priority from %s custom variable: %s\n", type, var->variable_value );
+            return(priority);
+        }
+    }
+    return(0);
+}
+
+/* resolve the priority class */
+static int resolve_priority(host * hst, service * svc) {
+    int priority;
+    int x;
+
+    resolve_groups();
+
+    if( mod_gm_opt->priority_cust_var ) {
+        if( svc && (priority = custom_variable_priority(svc->custom_variables, "service")) != 0 )
+            return(priority);
+        if( (priority = custom_variable_priority(hst->custom_variables, "host")) != 0 )
+            return(priority);
+    }
+
+    for(x = 0; x < route_priority_hostgroups.num; x++) {
+        if ( route_priority_hostgroups.groups[x] != NULL && is_host_member_of_hostgroup( route_priority_hostgroups.groups[x], hst )==TRUE ) {
+            gm_log( GM_LOG_TRACE, "server is member of priority hostgroup: %s\n", mod_gm_opt->priority_hostgroups_list[x] );
+            return(mod_gm_opt->priority_hostgroups_prio[x]);
+        }
+    }
+
+    return(0);
+}
+
+/* return cached priority class */
+int route_cache_priority(host * hst, service * svc) {
+    route_entry_t * entry;
+
+    if(mod_gm_opt->priority_cust_var == NULL && mod_gm_opt->priority_hostgroups_num == 0)
+        return(0);
+
+    entry = route_entry(hst, svc);
+    if(entry == NULL)
+        return(resolve_priority(hst, svc));
+
+    if(__atomic_load_n(&entry->priority, __ATOMIC_RELAXED) == -1)
+        __atomic_store_n(&entry->priority, resolve_priority(hst, svc), __ATOMIC_RELAXED);
+    return(entry->priority);
+}
+
+/* return the result lane from the cached priority, results share one lane unless priorities are configured */
+int route_cache_result_lane(host * hst, service * svc) {
+    route_entry_t * entry;
+    int priority;
+
+    if(mod_gm_opt->priority_cust_var == NULL && mod_gm_opt->priority_hostgroups_num == 0)
+        return(GM_JOB_PRIO_LOW - 1);
+
+    entry = route_entry(hst, svc);
+    if(entry == NULL)
+        return(-1);
+    priority = __atomic_load_n(&entry->priority, __ATOMIC_RELAXED);
+    if(priority == -1)
+        return(-1);
+    if(priority == 0)
+        priority = svc != NULL ? GM_JOB_PRIO_LOW : GM_JOB_PRIO_NORMAL;
+    return(priority - 1);
+}
+
+/* render the fields of a check job which only change with the configuration */
+static char * build_job_prefix(host * hst, service * svc, const char * queue, int format, size_t * len) {
+    gm_buffer_t * buf = gm_buffer_new();
+    char * prefix;
+
+    gm_payload_begin(buf, format);
+    gm_payload_append(buf, GM_PAYLOAD_TYPE, svc != NULL ? "service" : "host");
+    gm_payload_append(buf, GM_PAYLOAD_RESULT_QUEUE, mod_gm_opt->result_queue);
+    gm_payload_append(buf, GM_PAYLOAD_TARGET_QUEUE, queue);
+    gm_payload_append(buf, GM_PAYLOAD_HOST_NAME, hst->name);
+    if(svc != NULL)
+        gm_payload_append(buf, GM_PAYLOAD_SERVICE_DESCRIPTION, svc->description);
+
+    /* copy, the buffer is much larger than the prefix and binary prefixes contain zero bytes */
+    prefix = gm_malloc(buf->len + 1);
+    memcpy(prefix, buf->data, buf->len + 1);
+    *len   = buf->len;
+    gm_buffer_free(&buf);
+    return(prefix);
+}
+
+/* return cached job prefix */
+const char * route_cache_job_prefix(host * hst, service * svc, int format, size_t * len) {
+    route_entry_t * entry = route_entry(hst, svc);
+    const char * queue = route_cache_lookup(hst, svc);
+
+    if(entry == NULL) {
+        gm_free(route_prefix_uncached);
+        route_prefix_uncached = build_job_prefix(hst, svc, queue, format, len);
+        return(route_prefix_uncached);
+    }
+
+    /* the format of a queue changes when its workers are upgraded or downgraded */
+    if(entry->prefix != NULL && entry->prefix_format != format)
+        gm_free(entry->prefix);
+    if(entry->prefix == NULL) {
+        entry->prefix        = build_job_prefix(hst, svc, queue, format, &entry->prefix_len);
+        entry->prefix_format = format;
+    }
+    *len = entry->prefix_len;
+    return(entry->prefix);
+}
+
+/* hash the unique key of a job, same input as the former make_uniq() */
+static void build_uniq(char * dest, host * hst, service * svc, int perfdata_queue) {
+    char * text;
+    if(perfdata_queue < 0 && svc == NULL) {
+        mod_gm_fasthexsum(dest, hst->name, strlen(hst->name));
+        return;
+    }
+    if(perfdata_queue < 0)
+        gm_asprintf(&text, "%s-%s", svc->host_name, svc->description);
+    else if(svc == NULL)
+        gm_asprintf(&text, "%s-%s", mod_gm_opt->perfdata_queues_list[perfdata_queue], hst->name);
+    else
+        gm_asprintf(&text, "%s-%s-%s", mod_gm_opt->perfdata_queues_list[perfdata_queue], svc->host_name, svc->description);
+    mod_gm_fasthexsum(dest, text, strlen(text));
+    free(text);
+}
+
+/* return cached unique key */
+const char * route_cache_uniq(host * hst, service * svc, int perfdata_queue) {
+    route_entry_t * entry = route_entry(hst, svc);
+    char * slot;
+    int num;
+
+    if(entry == NULL) {
+        build_uniq(route_uniq_uncached, hst, svc, perfdata_queue);
+        return(route_uniq_uncached);
+    }
+
+    /* names never change, so the keys are kept until the cache is freed */
+    if(entry->uniq == NULL) {
+        num = 1 + mod_gm_opt->perfdata_queues_num;
+        entry->uniq = gm_malloc(num * ROUTE_UNIQ_SIZE);
+        memset(entry->uniq, 0, num * ROUTE_UNIQ_SIZE);
+    }
+    slot = entry->uniq + (perfdata_queue + 1) * ROUTE_UNIQ_SIZE;
+    if(*slot == '\0')
+        build_uniq(slot, hst, svc, perfdata_queue);
+    return(slot);
+}
+
+/* resolve all hosts and services */
+void route_cache_init(void) {
+    unsigned int x;
+
+    route_cache_free();
+    resolve_groups();
+
+    host_routes_num    = num_objects.hosts;
+    service_routes_num = num_objects.services;
+    host_groups_num    = num_objects.hosts;
+    host_routes        = gm_malloc((host_routes_num > 0 ? host_routes_num : 1) * sizeof(route_entry_t));
+    service_routes     = gm_malloc((service_routes_num > 0 ? service_routes_num : 1) * sizeof(route_entry_t));
+    host_groups        = gm_malloc((host_groups_num > 0 ? host_groups_num : 1) * sizeof(char *));
+    for(x = 0; x < host_groups_num; x++)
+        host_groups[x] = NULL;
+    for(x = 0; x < host_routes_num; x++) {
+        host_routes[x].prefix = NULL;
+        host_routes[x].uniq   = NULL;
+    }
+    for(x = 0; x < service_routes_num; x++) {
+        service_routes[x].prefix = NULL;
+        service_routes[x].uniq   = NULL;
+    }
+    route_cache_invalidate();
+
+    for(x = 0; x < host_routes_num; x++) {
+        if(host_ary[x] != NULL)
+            route_cache_lookup(host_ary[x], NULL);
+    }
+    for(x = 0; x < service_routes_num; x++) {
+        if(service_ary[x] != NULL && service_ary[x]->host_ptr != NULL)
+            route_cache_lookup(service_ary[x]->host_ptr, service_ary[x]);
+    }
+
+    /* the result threads only read cached priorities */
+    if(mod_gm_opt->priority_cust_var != NULL || mod_gm_opt->priority_hostgroups_num > 0) {
+        for(x = 0; x < host_routes_num; x++) {
+            if(host_ary[x] != NULL)
+                route_cache_priority(host_ary[x], NULL);
+        }
+        for(x = 0; x < service_routes_num; x++) {
+            if(service_ary[x] != NULL && service_ary[x]->host_ptr != NULL)
+                route_cache_priority(service_ary[x]->host_ptr, service_ary[x]);
+        }
+    }
+
+    gm_log( GM_LOG_DEBUG, "resolved target queues for %u hosts and %u services\n", host_routes_num, service_routes_num );
+}
+
+/* forget resolved queues */
+void route_cache_invalidate(void) {
+    unsigned int x;
+    for(x = 0; x < host_routes_num; x++) {
+        host_routes[x].queue    = NULL;
+        __atomic_store_n(&host_routes[x].priority, -1, __ATOMIC_RELAXED);
+        gm_free(host_routes[x].prefix);
+    }
+    for(x = 0; x < service_routes_num; x++) {
+        service_routes[x].queue    = NULL;
+        __atomic_store_n(&service_routes[x].priority, -1, __ATOMIC_RELAXED);
+        gm_free(service_routes[x].prefix);
+    }
+}
+
+/* free the cache */
+void route_cache_free(void) {
+    unsigned int y;
+    int x;
+
+    route_cache_invalidate();
+    for(y = 0; y < host_routes_num; y++)
+        gm_free(host_routes[y].uniq);
+    for(y = 0; y < service_routes_num; y++)
+        gm_free(service_routes[y].uniq);
+    gm_free(host_routes);
+    gm_free(service_routes);
+    gm_free(route_prefix_uncached);
+    gm_free(host_groups);
+    host_routes_num    = 0;
+    service_routes_num = 0;
+    host_groups_num    = 0;
+
+    for(x = 0; x < route_names_num; x++)
+        gm_free(route_names[x]);
+    gm_free(route_names);
+    route_names_num  = 0;
+    route_names_size = 0;
+
+    if(route_groups_resolved == TRUE) {
+        free_group_list(&route_local_servicegroups);
+        free_group_list(&route_local_hostgroups);
+        free_group_list(&route_servicegroups);
+        free_group_list(&route_hostgroups);
+        free_group_list(&route_priority_hostgroups);
+        route_groups_resolved = FALSE;
+    }
+}
@@ -0,0 +1,491 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/* include header */
+#include "spool.h"
+#include "utils.h"
+#include "gearman_utils.h"
+
+extern mod_gm_opt_t *mod_gm_opt;
+
+/* spool statistics */
+int spool_jobs                = 0;
+unsigned long spool_bytes     = 0;
+unsigned long spool_written   = 0;
+unsigned long spool_replayed  = 0;
+unsigned long spool_dropped   = 0;
+unsigned long spool_expired   = 0;
+
+static gm_spool_segment_t spool_writer;
+static gm_spool_segment_t spool_reader;
+static unsigned long spool_next_seq    = 0;     /* sequence number of the next new segment */
+static int spool_segments              = 0;     /* number of segment files on disk */
+static int spool_active                = FALSE;
+static int spool_should_terminate      = FALSE;
+static time_t spool_log_time           = 0;
+static pthread_mutex_t spool_mutex     = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t spool_cond       = PTHREAD_COND_INITIALIZER;
+static pthread_t spool_thr;
+
+/* align record sizes to 8 byte */
+#define SPOOL_ALIGN(x) (((x) + 7) & ~((size_t)7))
+
+/* reset segment structure, keeps the sequence number */
+static void init_segment(gm_spool_segment_t * seg) {
+    seg->fd     = -1;
+    seg->map    = NULL;
+    seg->size   = 0;
+    seg->offset = 0;
+}
+
+/* return full path of a segment file */
+static char * segment_path(unsigned long seq) {
+    char * path;
+    gm_asprintf(&path, "%s/%s%010lu", mod_gm_opt->spool_dir, GM_SPOOL_FILE_PREFIX, seq);
+    return(path);
+}
+
+/* open and map a segment file */
+static int open_segment(gm_spool_segment_t * seg, unsigned long seq, int create) {
+    struct stat st;
+    char * path = segment_path(seq);
+
+    init_segment(seg);
+    seg->seq = seq;
+    seg->fd  = open(path, create ? O_RDWR|O_CREAT|O_EXCL : O_RDWR, 0600);
+    if(seg->fd == -1) {
+        if(create || errno != ENOENT)
+            gm_log( GM_LOG_ERROR, "cannot open spool file %s: %s\n", path, strerror(errno) );
+        gm_free(path);
+        return(GM_ERROR);
+    }
+    fcntl(seg->fd, F_SETFD, FD_CLOEXEC);
+
+    if(create && ftruncate(seg->fd, GM_SPOOL_SEGMENT_SIZE) != 0) {
+        gm_log( GM_LOG_ERROR, "cannot resize spool file %s: %s\n", path, strerror(errno) );
+        close(seg->fd);
+        unlink(path);
+        gm_free(path);
+        init_segment(seg);
+        return(GM_ERROR);
+    }
+
+    if(fstat(seg->fd, &st) != 0 || st.st_size < (off_t)sizeof(gm_spool_record_t)) {
+        gm_log( GM_LOG_ERROR, "invalid spool file %s\n", path );
+        close(seg->fd);
+        gm_free(path);
+        init_segment(seg);
+        return(GM_ERROR);
+    }
+    seg->size = st.st_size;
+
+    seg->map = mmap(NULL, seg->size, PROT_READ|PROT_WRITE, MAP_SHARED, seg->fd, 0);
+    if(seg->map == MAP_FAILED) {
+        gm_log( GM_LOG_ERROR, "cannot map spool file %s: %s\n", path, strerror(errno) );
+        close(seg->fd);
+        gm_free(path);
+        init_segment(seg);
+        return(GM_ERROR);
+    }
+    gm_free(path);
+    return(GM_OK);
+}
+
+/* unmap and close a segment, optionally remove the file */
+static void close_segment(gm_spool_segment_t * seg, int remove) {
+    char * path;
+    if(seg->map != NULL) {
+        msync(seg->map, seg->size, MS_ASYNC);
+        munmap(seg->map, seg->size);
+    }
+    if(seg->fd != -1)
+        close(seg->fd);
+    if(remove) {
+        path = segment_path(seg->seq);
+        if(unlink(path) == 0)
+            spool_segments--;
+        gm_free(path);
+    }
+    init_segment(seg);
+}
+
+/* return complete record at given offset or NULL */
+static gm_spool_record_t * record_at(gm_spool_segment_t * seg, size_t offset) {
+    gm_spool_record_t * rec;
+    if(seg->map == NULL || offset + sizeof(gm_spool_record_t) > seg->size)
+        return(NULL);
+    rec = (gm_spool_record_t *)(seg->map + offset);
+    if(rec->magic != GM_SPOOL_MAGIC || rec->size < sizeof(gm_spool_record_t) || offset + rec->size > seg->size)
+        return(NULL);
+    return(rec);
+}
+
+/* log dropped jobs, but only once a minute */
+static void log_spool_drop(const char * reason) {
+    time_t now = time(NULL);
+    if(now < spool_log_time + 60)
+        return;
+    spool_log_time = now;
+    gm_log( GM_LOG_ERROR, "cannot spool job: %s (dropped %lu jobs so far)\n", reason, spool_dropped );
+}
+
+/* find existing segments and count the jobs in there */
+static void scan_spool_dir(void) {
+    DIR * dir;
+    struct dirent * entry;
+    gm_spool_segment_t seg;
+    gm_spool_record_t * rec;
+    unsigned long seq;
+    unsigned long first = 0;
+    int found = FALSE;
+
+    spool_segments = 0;
+    spool_next_seq = 0;
+    if((dir = opendir(mod_gm_opt->spool_dir)) == NULL) {
+        gm_log( GM_LOG_ERROR, "cannot open spool_dir %s: %s\n", mod_gm_opt->spool_dir, strerror(errno) );
+        return;
+    }
+    while((entry = readdir(dir)) != NULL) {
+        if(strncmp(entry->d_name, GM_SPOOL_FILE_PREFIX, strlen(GM_SPOOL_FILE_PREFIX)) != 0)
+            continue;
+        seq = strtoul(entry->d_name + strlen(GM_SPOOL_FILE_PREFIX), NULL, 10);
+        if(found == FALSE || seq < first)
+            first = seq;
+        if(seq >= spool_next_seq)
+            spool_next_seq = seq + 1;
+        found = TRUE;
+        spool_segments++;
+    }
+    closedir(dir);
+
+    if(found == FALSE)
+        return;
+
+    /* count remaining jobs */
+    for(seq = first; seq < spool_next_seq; seq++) {
+        if(open_segment(&seg, seq, FALSE) != GM_OK)
+            continue;
+        while((rec = record_at(&seg, seg.offset)) != NULL) {
+            if(!rec->consumed) {
+                spool_jobs++;
+                spool_bytes += rec->size;
+            }
+            seg.offset += rec->size;
+        }
+        close_segment(&seg, FALSE);
+    }
+    spool_reader.seq = first;
+    if(spool_jobs > 0)
+        gm_log( GM_LOG_INFO, "found %d spooled jobs in %d files, will replay them once gearmand is available\n", spool_jobs, spool_segments );
+}
+
+/* open the spool and start the replay thread */
+int start_spool(void) {
+    int ret;
+
+    spool_should_terminate = FALSE;
+    if(mod_gm_opt->spool_dir == NULL)
+        return(GM_OK);
+
+    if(mkdir(mod_gm_opt->spool_dir, 0700) != 0 && errno != EEXIST) {
+        gm_log( GM_LOG_ERROR, "cannot create spool_dir %s: %s\n", mod_gm_opt->spool_dir, strerror(errno) );
+        return(GM_ERROR);
+    }
+
+    init_segment(&spool_writer);
+    init_segment(&spool_reader);
+    spool_writer.seq = 0;
+    spool_reader.seq = 0;
+    spool_jobs  = 0;
+    spool_bytes = 0;
+    scan_spool_dir();
+
+    spool_active = TRUE;
+    if((ret = pthread_create(&spool_thr, NULL, &spool_replay_worker, NULL)) != 0) {
+        gm_log( GM_LOG_ERROR, "failed to create spool replay thread: %s\n", strerror(ret));
+        spool_active = FALSE;
+        return(GM_ERROR);
+    }
+    gm_log( GM_LOG_DEBUG, "started spool replay thread for %s\n", mod_gm_opt->spool_dir );
+    return(GM_OK);
+}
+
+/* stop the replay thread and close all files */
+void stop_spool(void) {
+    unsigned long seq;
+    gm_spool_segment_t seg;
+
+    if(spool_active == FALSE)
+        return;
+
+    pthread_mutex_lock(&spool_mutex);
+    spool_should_terminate = TRUE;
+    pthread_cond_broadcast(&spool_cond);
+    pthread_mutex_unlock(&spool_mutex);
+
+    if(pthread_join(spool_thr, NULL) != 0) {
+        gm_log( GM_LOG_ERROR, "failed to join spool replay thread: %s\n", strerror(errno) );
+    }
+
+    pthread_mutex_lock(&spool_mutex);
+    spool_active = FALSE;
+    close_segment(&spool_reader, FALSE);
+    close_segment(&spool_writer, FALSE);
+
+    /* nothing left, so clean up, older segments have been removed already */
+    if(spool_jobs == 0) {
+        init_segment(&seg);
+        for(seq = spool_reader.seq; seq < spool_next_seq && spool_segments > 0; seq++) {
+            seg.seq = seq;
+            close_segment(&seg, TRUE);
+        }
+    } else {
+        gm_log( GM_LOG_INFO, "%d jobs remain in the spool\n", spool_jobs );
+    }
+    pthread_mutex_unlock(&spool_mutex);
+}
+
+/* spool available? */
+int mod_gm_spool_enabled(void) {
+    return(spool_active);
+}
+
+/* anything waiting for replay? */
+int mod_gm_spool_is_empty(void) {
+    return(__atomic_load_n(&spool_jobs, __ATOMIC_RELAXED) == 0 ? TRUE : FALSE);
+}
+
+/* append job to the spool */
+int mod_gm_spool_job(char * queue, char * uniq, char * data, int priority) {
+    gm_spool_record_t * rec;
+    size_t queue_len = strlen(queue) + 1;
+    size_t uniq_len  = uniq == NULL ? 0 : strlen(uniq) + 1;
+    size_t data_len  = strlen(data) + 1;
+    size_t size      = SPOOL_ALIGN(sizeof(gm_spool_record_t) + queue_len + uniq_len + data_len);
+    char * ptr;
+
+    pthread_mutex_lock(&spool_mutex);
+    if(spool_active == FALSE || spool_should_terminate == TRUE) {
+        spool_dropped++;
+        pthread_mutex_unlock(&spool_mutex);
+        return(GM_ERROR);
+    }
+
+    if(size > GM_SPOOL_SEGMENT_SIZE) {
+        spool_dropped++;
+        log_spool_drop("job too large");
+        pthread_mutex_unlock(&spool_mutex);
+        return(GM_ERROR);
+    }
+
+    /* start a new segment */
+    if(spool_writer.map == NULL || spool_writer.offset + size > spool_writer.size) {
+        if(((unsigned long)spool_segments + 1) * GM_SPOOL_SEGMENT_SIZE > (unsigned long)mod_gm_opt->spool_max_size * 1024 * 1024) {
+            spool_dropped++;
+            log_spool_drop("spool_max_size reached");
+            pthread_mutex_unlock(&spool_mutex);
+            return(GM_ERROR);
+        }
+        close_segment(&spool_writer, FALSE);
+        if(open_segment(&spool_writer, spool_next_seq, TRUE) != GM_OK) {
+            spool_dropped++;
+            pthread_mutex_unlock(&spool_mutex);
+            return(GM_ERROR);
+        }
+        spool_next_seq++;
+        spool_segments++;
+    }
+
+    rec = (gm_spool_record_t *)(spool_writer.map + spool_writer.offset);
+    rec->size      = size;
+    rec->consumed  = 0;
+    rec->priority  = priority;
+    rec->timestamp = (int64_t)time(NULL);
+    rec->queue_len = queue_len;
+    rec->uniq_len  = uniq_len;
+    rec->data_len  = data_len;
+    rec->reserved  = 0;
+    ptr = (char *)rec + sizeof(gm_spool_record_t);
+    memcpy(ptr, queue, queue_len);
+    ptr += queue_len;
+    if(uniq_len > 0) {
+        memcpy(ptr, uniq, uniq_len);
+        ptr += uniq_len;
+    }
+    memcpy(ptr, data, data_len);
+    /* mark as complete last, so half written records are never replayed */
+    __atomic_store_n(&rec->magic, GM_SPOOL_MAGIC, __ATOMIC_RELEASE);
+
+    spool_writer.offset += size;
+    spool_bytes += size;
+    spool_written++;
+    __atomic_add_fetch(&spool_jobs, 1, __ATOMIC_RELAXED);
+    pthread_cond_signal(&spool_cond);
+    pthread_mutex_unlock(&spool_mutex);
+
+    gm_log( GM_LOG_TRACE, "spooled job for %s, %d jobs in spool\n", queue, spool_jobs );
+    return(GM_OK);
+}
+
+/* mark record as done */
+static void consume_record(gm_spool_record_t * rec) {
+    rec->consumed = 1;
+    spool_bytes  -= rec->size;
+    __atomic_sub_fetch(&spool_jobs, 1, __ATOMIC_RELAXED);
+}
+
+/* return the next record which still has to be replayed, starting at offset
+ * in the current reader segment. Expired records will be skipped. */
+static gm_spool_record_t * pending_record_at(size_t * offset, time_t now) {
+    gm_spool_record_t * rec;
+    while((rec = record_at(&spool_reader, *offset)) != NULL) {
+        if(!rec->consumed && mod_gm_opt->spool_max_age > 0 && rec->timestamp + mod_gm_opt->spool_max_age < now) {
+            consume_record(rec);
+            spool_expired++;
+        }
+        if(!rec->consumed)
+            return(rec);
+        *offset += rec->size;
+    }
+    return(NULL);
+}
+
+/* move reader forward to the next unconsumed record, switches segments if required.
+ * returns the record or NULL if there is nothing left */
+static gm_spool_record_t * next_spool_record(time_t now) {
+    gm_spool_record_t * rec;
+
+    while(TRUE) {
+        if(spool_reader.map == NULL) {
+            /* skip missing segments */
+            while(spool_reader.seq < spool_next_seq && open_segment(&spool_reader, spool_reader.seq, FALSE) != GM_OK)
+                spool_reader.seq++;
+            if(spool_reader.map == NULL)
+                return(NULL);
+        }
+
+        if((rec = pending_record_at(&spool_reader.offset, now)) != NULL)
+            return(rec);
+
+        /* end of segment, remove it unless it is the last one */
+        if(spool_reader.seq + 1 >= spool_next_seq)
+            return(NULL);
+        close_segment(&spool_reader, TRUE);
+        spool_reader.seq++;
+    }
+}
+
+/* main loop of the replay thread */
+void *spool_replay_worker( __attribute__((__unused__)) void * data ) {
+    gearman_client_st *replay_client = NULL;
+    gm_submit_job_t ** jobs;
+    gm_submit_job_t * job_list;
+    gm_spool_record_t ** recs;
+    gm_spool_record_t * rec;
+    int batch_size = mod_gm_opt->submit_batch_size;
+    int num, x, failed;
+    size_t offset;
+    time_t now;
+    struct timespec deadline;
+
+    gm_log( GM_LOG_DEBUG, "spool replay thr-%ld started\n", pthread_self() );
+
+    jobs     = gm_malloc(batch_size * sizeof *jobs);
+    job_list = gm_malloc(batch_size * sizeof *job_list);
+    recs     = gm_malloc(batch_size * sizeof *recs);
+    for(x = 0; x < batch_size; x++)
+        jobs[x] = &job_list[x];
+
+    pthread_mutex_lock(&spool_mutex);
+    while(spool_should_terminate == FALSE) {
+        if(spool_jobs == 0) {
+            pthread_cond_wait(&spool_cond, &spool_mutex);
+            continue;
+        }
+
+        /* collect a batch from the current segment, records stay mapped until
+         * only this thread moves the reader */
+        num = 0;
+        now = time(NULL);
+        rec = next_spool_record(now);
+        offset = spool_reader.offset;
+        while(rec != NULL && num < batch_size) {
+            recs[num] = rec;
+            jobs[num]->queue    = (char *)rec + sizeof(gm_spool_record_t);
+            jobs[num]->uniq     = rec->uniq_len > 0 ? jobs[num]->queue + rec->queue_len : NULL;
+            jobs[num]->data     = jobs[num]->queue + rec->queue_len + rec->uniq_len;
+            jobs[num]->priority = rec->priority;
+            jobs[num]->retries  = 0;
+            num++;
+            offset += rec->size;
+            rec = pending_record_at(&offset, now);
+        }
+        if(num == 0) {
+            /* everything expired or counter out of sync with the files */
+            if(spool_jobs > 0) {
+                gm_log( GM_LOG_DEBUG, "spool is empty, resetting job counter from %d\n", spool_jobs );
+                spool_jobs  = 0;
+                spool_bytes = 0;
+            }
+            continue;
+        }
+        pthread_mutex_unlock(&spool_mutex);
+
+        if(replay_client == NULL)
+            replay_client = create_client_blocking(mod_gm_opt->server_list);
+        if(replay_client != NULL)
+            add_jobs_to_queue(&replay_client, mod_gm_opt->server_list, jobs, num, GM_ENCODE_NONE, NULL, 0, mod_gm_opt->log_stats_interval);
+
+        pthread_mutex_lock(&spool_mutex);
+        failed = 0;
+        for(x = 0; x < num; x++) {
+            if(replay_client != NULL && jobs[x]->status == GM_OK) {
+                consume_record(recs[x]);
+                spool_replayed++;
+            } else {
+                failed++;
+            }
+        }
+        if(failed == 0 && spool_jobs == 0)
+            gm_log( GM_LOG_INFO, "replayed all spooled jobs\n" );
+
+        /* gearmand still not available, try again later */
+        if(failed > 0) {
+            gm_log( GM_LOG_DEBUG, "failed to replay %d spooled jobs, retrying in %ds\n", failed, GM_SPOOL_RETRY_INTERVAL );
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += GM_SPOOL_RETRY_INTERVAL;
+            while(spool_should_terminate == FALSE && pthread_cond_timedwait(&spool_cond, &spool_mutex, &deadline) != ETIMEDOUT)
+                ;
+        }
+    }
+    pthread_mutex_unlock(&spool_mutex);
+
+    gm_free(jobs);
+    gm_free(job_list);
+    gm_free(recs);
+    gm_free_client(&replay_client);
+    gm_log( GM_LOG_DEBUG, "spool replay thr-%ld finished\n", pthread_self() );
+
+    return NULL;
+}
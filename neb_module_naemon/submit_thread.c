@@ -0,0 +1,540 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+/* include header */
+#include "submit_thread.h"
+#include "spool.h"
+#include "metrics.h"
+#include "shard.h"
+#include "utils.h"
+#include "mod_gearman.h"
+#include "gearman_utils.h"
+#include "gm_payload.h"
+
+extern mod_gm_opt_t *mod_gm_opt;
+extern gearman_client_st *client;
+extern EVP_CIPHER_CTX * mod_ctx;
+
+/* submit queue statistics */
+int submit_queue_length            = 0;
+int submit_queue_max_length        = 0;
+unsigned long submit_queue_blocked = 0;
+unsigned long submit_queue_local   = 0;
+unsigned long submit_queue_dropped = 0;
+
+static gm_submit_job_t ** submit_queue = NULL;
+static int submit_queue_size           = 0;
+static int submit_queue_head           = 0;
+static int submit_should_terminate     = FALSE;
+static time_t submit_queue_log_time    = 0;
+static time_t submit_failed_log_time   = 0;
+static pthread_mutex_t submit_queue_mutex    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t submit_queue_not_empty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t submit_queue_not_full  = PTHREAD_COND_INITIALIZER;
+static pthread_t * submit_thr = NULL;
+static int submit_thr_num      = 0;     /* number of started submit threads */
+
+/* sharding */
+static gm_shard_ring_t * shard_ring = NULL;
+static gm_server_t * (*shard_servers)[GM_LISTSIZE] = NULL;  /* single server list for each server */
+static time_t shard_down_until[GM_LISTSIZE];                /* skip failed servers until then */
+static gearman_client_st ** shard_core_clients = NULL;      /* used without submit threads */
+
+__thread EVP_CIPHER_CTX * submit_ctx = NULL; /* make ssl context local in each thread */
+
+/* free a queued job */
+static void free_submit_job(gm_submit_job_t * job) {
+    if(job == NULL)
+        return;
+    gm_free(job->queue);
+    gm_free(job->uniq);
+    gm_free(job->data);
+    gm_free(job);
+}
+
+/* encrypt job and put it into the spool */
+static int spool_submit_job(EVP_CIPHER_CTX * ctx, char * queue, char * uniq, char * data, int priority) {
+    char * crypted_data;
+    int rc;
+    /* would never be accepted by gearmand and block the replay */
+    if(strlen(queue) > GEARMAN_FUNCTION_MAX_SIZE - 1 || (uniq != NULL && strlen(uniq) > GEARMAN_MAX_UNIQUE_SIZE))
+        return(GM_ERROR);
+    if(mod_gm_encrypt(ctx, &crypted_data, data, mod_gm_opt->transportmode) <= 0) {
+        gm_log( GM_LOG_ERROR, "encrypting job failed\n" );
+        gm_free(crypted_data);
+        return(GM_ERROR);
+    }
+    rc = mod_gm_spool_job(queue, uniq, crypted_data, priority);
+    gm_free(crypted_data);
+    return(rc);
+}
+
+/* one client per server, created on first use */
+static gearman_client_st ** new_shard_clients(void) {
+    gearman_client_st ** clients;
+    int x;
+    clients = gm_malloc(mod_gm_opt->server_num * sizeof *clients);
+    for(x = 0; x < mod_gm_opt->server_num; x++)
+        clients[x] = NULL;
+    return(clients);
+}
+
+static void free_shard_clients(gearman_client_st *** clients) {
+    int x;
+    if(*clients == NULL)
+        return;
+    for(x = 0; x < mod_gm_opt->server_num; x++)
+        gm_free_client(&(*clients)[x]);
+    gm_free(*clients);
+}
+
+/* build the hash ring, sharding needs at least two servers */
+static void init_sharding(void) {
+    int x, y;
+
+    if(mod_gm_opt->sharding == GM_SHARD_NONE || mod_gm_opt->server_num < 2)
+        return;
+
+    shard_ring    = gm_shard_ring_create(mod_gm_opt->server_list, mod_gm_opt->server_num, GM_SHARD_REPLICAS);
+    shard_servers = gm_malloc(mod_gm_opt->server_num * sizeof *shard_servers);
+    for(x = 0; x < mod_gm_opt->server_num; x++) {
+        for(y = 0; y < GM_LISTSIZE; y++)
+            shard_servers[x][y] = NULL;
+        shard_servers[x][0] = mod_gm_opt->server_list[x];
+        shard_down_until[x] = 0;
+    }
+    shard_core_clients = new_shard_clients();
+    gm_log( GM_LOG_DEBUG, "sharding checks by %s over %d servers\n", mod_gm_opt->sharding == GM_SHARD_SERVICE ? "service" : "host", mod_gm_opt->server_num );
+}
+
+static void deinit_sharding(void) {
+    free_shard_clients(&shard_core_clients);
+    gm_shard_ring_free(&shard_ring);
+    gm_free(shard_servers);
+}
+
+/* skip a failed server for a while, its keys move to the next servers on the ring */
+static void set_shard_down(int server, time_t now) {
+    time_t until = __atomic_exchange_n(&shard_down_until[server], now + GM_SHARD_RETRY_INTERVAL, __ATOMIC_RELAXED);
+    if(until < now)
+        gm_log( GM_LOG_ERROR, "sending jobs to %s:%d failed, moving its checks to the remaining servers for %ds\n", mod_gm_opt->server_list[server]->host, mod_gm_opt->server_list[server]->port, GM_SHARD_RETRY_INTERVAL );
+}
+
+/* send jobs to the server responsible for their shard key */
+static int add_jobs_to_shards(gearman_client_st ** clients, gearman_client_st ** fallback, gm_submit_job_t ** jobs, int num, EVP_CIPHER_CTX * ctx) {
+    gm_submit_job_t ** group;
+    int * target;
+    int down[GM_LISTSIZE];
+    int x, s, n, sent, moved;
+    int rc = GM_OK;
+    time_t now = time(NULL);
+
+    group  = gm_malloc(num * sizeof *group);
+    target = gm_malloc(num * sizeof *target);
+
+    /* jobs without shard key may go to any server */
+    n = 0;
+    for(x = 0; x < num; x++) {
+        jobs[x]->status = GM_ERROR;
+        if(jobs[x]->shard == 0)
+            group[n++] = jobs[x];
+    }
+    if(n > 0) {
+        if(*fallback == NULL)
+            *fallback = create_client_blocking(mod_gm_opt->server_list);
+        if(*fallback != NULL)
+            add_jobs_to_queue(fallback, mod_gm_opt->server_list, group, n, mod_gm_opt->transportmode, ctx, 0, mod_gm_opt->log_stats_interval);
+    }
+
+    for(s = 0; s < mod_gm_opt->server_num; s++)
+        down[s] = now < __atomic_load_n(&shard_down_until[s], __ATOMIC_RELAXED) ? TRUE : FALSE;
+
+    /* every pass takes at least one more server out, so this ends once all are down */
+    do {
+        moved = 0;
+        for(x = 0; x < num; x++) {
+            target[x] = -1;
+            if(jobs[x]->shard != 0 && jobs[x]->status != GM_OK)
+                target[x] = gm_shard_ring_lookup(shard_ring, jobs[x]->shard, down);
+        }
+        for(s = 0; s < mod_gm_opt->server_num; s++) {
+            n = 0;
+            for(x = 0; x < num; x++) {
+                if(target[x] == s)
+                    group[n++] = jobs[x];
+            }
+            if(n == 0)
+                continue;
+            if(clients[s] == NULL)
+                clients[s] = create_client_blocking(shard_servers[s]);
+            if(clients[s] != NULL && add_jobs_to_queue(&clients[s], shard_servers[s], group, n, mod_gm_opt->transportmode, ctx, 0, mod_gm_opt->log_stats_interval) == GM_OK)
+                continue;
+
+            /* server is only down if it did not take a single job */
+            sent = 0;
+            for(x = 0; x < n; x++) {
+                if(group[x]->status == GM_OK)
+                    sent++;
+            }
+            if(sent == 0) {
+                down[s] = TRUE;
+                set_shard_down(s, now);
+                moved += n;
+            }
+        }
+        if(moved > 0)
+            gm_log( GM_LOG_TRACE, "add_jobs_to_shards() moving %d jobs to the remaining servers\n", moved );
+    } while(moved > 0);
+
+    for(x = 0; x < num; x++) {
+        if(jobs[x]->status != GM_OK)
+            rc = GM_ERROR;
+    }
+    gm_free(group);
+    gm_free(target);
+    return(rc);
+}
+
+/* count sent jobs, the duration of a batch is split evenly over its jobs */
+static void record_submit_metrics(gm_submit_job_t ** jobs, int num, struct timeval * start) {
+    struct timeval end;
+    long long duration;
+    int x;
+
+    gettimeofday(&end, NULL);
+    duration = (timeval2usec(&end) - timeval2usec(start)) / (num > 0 ? num : 1);
+    for(x = 0; x < num; x++)
+        metrics_submit(jobs[x]->queue, jobs[x]->status == GM_OK ? TRUE : FALSE, duration);
+}
+
+/* log queue overflows, but only once a minute */
+static void log_submit_queue_overflow(const char * action) {
+    time_t now = time(NULL);
+    if(now < submit_queue_log_time + 60)
+        return;
+    submit_queue_log_time = now;
+    gm_log( GM_LOG_ERROR, "submit queue full (%d jobs), %s new jobs (dropped: %lu, local: %lu so far)\n", submit_queue_size, action, submit_queue_dropped, submit_queue_local );
+}
+
+/* count and log jobs which could not be sent and are not spooled, but only once a minute */
+static void drop_failed_jobs(gm_submit_job_t ** jobs, int num) {
+    time_t now;
+    int x, failed = 0;
+
+    for(x = 0; x < num; x++) {
+        if(jobs[x]->status != GM_OK)
+            failed++;
+    }
+    if(failed == 0)
+        return;
+
+    pthread_mutex_lock(&submit_queue_mutex);
+    submit_queue_dropped += failed;
+    now = time(NULL);
+    if(now >= submit_failed_log_time + 60) {
+        submit_failed_log_time = now;
+        gm_log( GM_LOG_ERROR, "failed to send %d jobs, dropping them (dropped: %lu so far)\n", failed, submit_queue_dropped );
+    }
+    pthread_mutex_unlock(&submit_queue_mutex);
+}
+
+/* start our submit threads */
+int start_submit_threads(void) {
+    int x;
+    int ret = 0;
+
+    submit_should_terminate = FALSE;
+    init_sharding();
+    if( mod_gm_opt->submit_workers <= 0 ) {
+        return(GM_OK);
+    }
+
+    submit_queue_size   = mod_gm_opt->submit_queue_size;
+    submit_queue_head   = 0;
+    submit_queue_length = 0;
+    submit_queue        = gm_malloc(submit_queue_size * sizeof *submit_queue);
+    for(x = 0; x < submit_queue_size; x++)
+        submit_queue[x] = NULL;
+
+    submit_thr     = gm_malloc(mod_gm_opt->submit_workers * sizeof *submit_thr);
+    submit_thr_num = 0;
+    for(x = 0; x < mod_gm_opt->submit_workers; x++) {
+        if((ret = pthread_create(&submit_thr[x], NULL, &submit_worker, NULL)) != 0) {
+            gm_log( GM_LOG_ERROR, "failed to create submit thread: %s\n", strerror(ret));
+            /* stop the threads which did start */
+            shutdown_submit_threads();
+            return(GM_ERROR);
+        }
+        submit_thr_num++;
+    }
+    gm_log( GM_LOG_DEBUG, "started %d submit threads with a queue size of %d\n", mod_gm_opt->submit_workers, submit_queue_size );
+    return(GM_OK);
+}
+
+/* stop submit threads, unsent jobs will be flushed unless gearmand is unreachable */
+void shutdown_submit_threads(void) {
+    int x;
+    int remaining = 0;
+
+    if(submit_thr == NULL) {
+        deinit_sharding();
+        return;
+    }
+
+    pthread_mutex_lock(&submit_queue_mutex);
+    submit_should_terminate = TRUE;
+    pthread_cond_broadcast(&submit_queue_not_empty);
+    pthread_cond_broadcast(&submit_queue_not_full);
+    pthread_mutex_unlock(&submit_queue_mutex);
+
+    for(x = 0; x < submit_thr_num; x++) {
+        if(pthread_join(submit_thr[x], NULL) != 0) {
+            gm_log( GM_LOG_ERROR, "failed to join submit thread: %s\n", strerror(errno) );
+        }
+    }
+    gm_free(submit_thr);
+    submit_thr_num = 0;
+
+    /* spool or free whatever could not be sent anymore */
+    for(x = 0; x < submit_queue_size; x++) {
+        if(submit_queue[x] != NULL) {
+            if(!mod_gm_spool_enabled() || spool_submit_job(mod_ctx, submit_queue[x]->queue, submit_queue[x]->uniq, submit_queue[x]->data, submit_queue[x]->priority) != GM_OK)
+                remaining++;
+            free_submit_job(submit_queue[x]);
+        }
+    }
+    gm_free(submit_queue);
+    submit_queue_length = 0;
+    deinit_sharding();
+
+    if(remaining > 0)
+        gm_log( GM_LOG_ERROR, "discarded %d unsent jobs from the submit queue\n", remaining );
+}
+
+/* put job into the submit queue */
+int mod_gm_submit_job(char * queue, char * uniq, char * data, int priority, int retries, unsigned int shard) {
+    gm_submit_job_t * job;
+    gm_submit_job_t direct_job;
+    struct timeval now, start;
+    struct timespec deadline;
+    int timeout = mod_gm_opt->gearman_connection_timeout;
+
+    /* no submit threads, send it directly */
+    if(submit_thr == NULL) {
+        /* keep the order while the spool is replayed */
+        if(mod_gm_spool_enabled() && !mod_gm_spool_is_empty())
+            return(spool_submit_job(mod_ctx, queue, uniq, data, priority));
+        direct_job.queue    = queue;
+        direct_job.uniq     = uniq;
+        direct_job.data     = data;
+        direct_job.priority = priority;
+        direct_job.retries  = retries;
+        direct_job.shard    = shard;
+        job = &direct_job;
+        gettimeofday(&start, NULL);
+        if(shard_ring != NULL && shard != 0) {
+            add_jobs_to_shards(shard_core_clients, &client, &job, 1, mod_ctx);
+        } else {
+            direct_job.status = add_job_to_queue(&client,
+                                                 mod_gm_opt->server_list,
+                                                 queue,
+                                                 uniq,
+                                                 data,
+                                                 priority,
+                                                 retries,
+                                                 mod_gm_opt->transportmode,
+                                                 mod_ctx,
+                                                 0,
+                                                 mod_gm_opt->log_stats_interval
+                                               );
+        }
+        record_submit_metrics(&job, 1, &start);
+        if(direct_job.status == GM_OK)
+            return(GM_OK);
+        if(mod_gm_spool_enabled())
+            return(spool_submit_job(mod_ctx, queue, uniq, data, priority));
+        return(GM_ERROR);
+    }
+
+    job           = gm_malloc(sizeof(gm_submit_job_t));
+    job->queue    = gm_strdup(queue);
+    job->uniq     = uniq == NULL ? NULL : gm_strdup(uniq);
+    job->data     = gm_malloc(gm_payload_size(data) + 1);
+    memcpy(job->data, data, gm_payload_size(data) + 1);
+    job->priority = priority;
+    job->retries  = retries;
+    job->shard    = shard;
+
+    pthread_mutex_lock(&submit_queue_mutex);
+    if(submit_queue_length >= submit_queue_size) {
+        switch(mod_gm_opt->submit_queue_overflow) {
+            case GM_SUBMIT_OVERFLOW_LOCAL:
+                submit_queue_local++;
+                log_submit_queue_overflow("executing locally");
+                pthread_mutex_unlock(&submit_queue_mutex);
+                free_submit_job(job);
+                return(GM_QUEUE_FULL);
+            case GM_SUBMIT_OVERFLOW_DROP:
+                submit_queue_dropped++;
+                log_submit_queue_overflow("dropping");
+                pthread_mutex_unlock(&submit_queue_mutex);
+                free_submit_job(job);
+                return(GM_ERROR);
+            default:
+                /* block, but not longer than a normal submission could take */
+                submit_queue_blocked++;
+                gettimeofday(&now, NULL);
+                deadline.tv_sec  = now.tv_sec + timeout / 1000;
+                deadline.tv_nsec = now.tv_usec * 1000 + (long)(timeout % 1000) * 1000000;
+                if(deadline.tv_nsec >= 1000000000) {
+                    deadline.tv_sec++;
+                    deadline.tv_nsec -= 1000000000;
+                }
+                while(submit_queue_length >= submit_queue_size && submit_should_terminate == FALSE) {
+                    if(timeout <= 0) {
+                        pthread_cond_wait(&submit_queue_not_full, &submit_queue_mutex);
+                    }
+                    else if(pthread_cond_timedwait(&submit_queue_not_full, &submit_queue_mutex, &deadline) == ETIMEDOUT) {
+                        break;
+                    }
+                }
+                if(submit_queue_length >= submit_queue_size) {
+                    submit_queue_dropped++;
+                    log_submit_queue_overflow("dropping");
+                    pthread_mutex_unlock(&submit_queue_mutex);
+                    free_submit_job(job);
+                    return(GM_ERROR);
+                }
+                break;
+        }
+    }
+
+    submit_queue[(submit_queue_head + submit_queue_length) % submit_queue_size] = job;
+    submit_queue_length++;
+    if(submit_queue_length > submit_queue_max_length)
+        submit_queue_max_length = submit_queue_length;
+    pthread_cond_signal(&submit_queue_not_empty);
+    pthread_mutex_unlock(&submit_queue_mutex);
+
+    gm_log( GM_LOG_TRACE, "mod_gm_submit_job() queued job for %s, queue length: %d\n", queue, submit_queue_length );
+    return(GM_OK);
+}
+
+/* main loop of the submit threads */
+void *submit_worker( __attribute__((__unused__)) void * data ) {
+    gearman_client_st *submit_client = NULL;
+    gearman_client_st **shard_clients = NULL;
+    gm_submit_job_t ** jobs;
+    struct timeval start;
+    int batch_size = mod_gm_opt->submit_batch_size;
+    int num, x;
+    int rc = GM_OK;
+
+    gm_log( GM_LOG_DEBUG, "submit thr-%ld started\n", pthread_self() );
+
+    submit_ctx    = mod_gm_crypt_init(mod_gm_opt->crypt_key);
+    submit_client = create_client_blocking(mod_gm_opt->server_list);
+    jobs          = gm_malloc(batch_size * sizeof *jobs);
+    if(shard_ring != NULL)
+        shard_clients = new_shard_clients();
+
+    while(TRUE) {
+        pthread_mutex_lock(&submit_queue_mutex);
+        while(submit_queue_length == 0 && submit_should_terminate == FALSE) {
+            pthread_cond_wait(&submit_queue_not_empty, &submit_queue_mutex);
+        }
+
+        /* finish when the queue is empty or gearmand is gone while shutting down */
+        if(submit_queue_length == 0 || (submit_should_terminate == TRUE && rc != GM_OK)) {
+            pthread_mutex_unlock(&submit_queue_mutex);
+            break;
+        }
+
+        /* take as many jobs as we can send at once */
+        num = 0;
+        while(num < batch_size && submit_queue_length > 0) {
+            jobs[num++] = submit_queue[submit_queue_head];
+            submit_queue[submit_queue_head] = NULL;
+            submit_queue_head = (submit_queue_head + 1) % submit_queue_size;
+            submit_queue_length--;
+        }
+        pthread_cond_broadcast(&submit_queue_not_full);
+        pthread_mutex_unlock(&submit_queue_mutex);
+
+        /* keep the order while the spool is replayed */
+        if(mod_gm_spool_enabled() && !mod_gm_spool_is_empty()) {
+            for(x = 0; x < num; x++)
+                jobs[x]->status = GM_ERROR;
+            rc = GM_ERROR;
+        } else if(shard_ring != NULL) {
+            gettimeofday(&start, NULL);
+            rc = add_jobs_to_shards(shard_clients, &submit_client, jobs, num, submit_ctx);
+            record_submit_metrics(jobs, num, &start);
+        } else {
+            if(submit_client == NULL)
+                submit_client = create_client_blocking(mod_gm_opt->server_list);
+            if(submit_client == NULL) {
+                gm_log( GM_LOG_ERROR, "cannot create client, failed to send %d jobs\n", num );
+                gettimeofday(&start, NULL);
+                for(x = 0; x < num; x++)
+                    jobs[x]->status = GM_ERROR;
+                record_submit_metrics(jobs, num, &start);
+                rc = GM_ERROR;
+            } else {
+                gettimeofday(&start, NULL);
+                rc = add_jobs_to_queue(&submit_client,
+                                       mod_gm_opt->server_list,
+                                       jobs,
+                                       num,
+                                       mod_gm_opt->transportmode,
+                                       submit_ctx,
+                                       0,
+                                       mod_gm_opt->log_stats_interval
+                                     );
+                record_submit_metrics(jobs, num, &start);
+            }
+        }
+
+        /* spool everything which could not be sent */
+        if(rc != GM_OK && mod_gm_spool_enabled()) {
+            rc = GM_OK;
+            for(x = 0; x < num; x++) {
+                if(jobs[x]->status != GM_OK && spool_submit_job(submit_ctx, jobs[x]->queue, jobs[x]->uniq, jobs[x]->data, jobs[x]->priority) != GM_OK)
+                    rc = GM_ERROR;
+            }
+        } else if(rc != GM_OK) {
+            drop_failed_jobs(jobs, num);
+        }
+        for(x = 0; x < num; x++)
+            free_submit_job(jobs[x]);
+    }
+
+    gm_free(jobs);
+    gm_free_client(&submit_client);
+    free_shard_clients(&shard_clients);
+    mod_gm_crypt_deinit(submit_ctx);
+    gm_log( GM_LOG_DEBUG, "submit thr-%ld finished\n", pthread_self() );
+
+    return NULL;
+}
@@ -0,0 +1,223 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/* include header */
+#include "wire_negotiation.h"
+#include "gearman_utils.h"
+#include "gm_payload.h"
+#include "shard.h"
+#include "utils.h"
+
+#define WIRE_MAX_QUEUES 256
+
+extern mod_gm_opt_t *mod_gm_opt;
+
+/* state of a single target queue */
+typedef struct wire_queue_struct {
+    char * name;                /* queue name, set once by the core thread */
+    char * binary_name;         /* name of the binary function, set before the name */
+    int    format;              /* GM_PAYLOAD_FORMAT_* of new jobs */
+} wire_queue_t;
+
+static wire_queue_t queues[WIRE_MAX_QUEUES];
+
+/* polling thread */
+static pthread_t wire_thr;
+static int wire_running          = FALSE;
+static int wire_should_terminate = FALSE;
+static pthread_mutex_t wire_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wire_cond   = PTHREAD_COND_INITIALIZER;
+
+/* return the state of a queue, creates it if requested */
+static wire_queue_t * get_queue(const char * name, int create) {
+    unsigned int slot = gm_shard_hash(name, NULL) % WIRE_MAX_QUEUES;
+    char * current;
+    int x;
+
+    for(x = 0; x < WIRE_MAX_QUEUES; x++) {
+        current = __atomic_load_n(&queues[slot].name, __ATOMIC_ACQUIRE);
+        if(current == NULL) {
+            if(create == FALSE)
+                return(NULL);
+            /* only the core thread adds queues, so no need for a compare and swap */
+            gm_asprintf(&queues[slot].binary_name, "%s%s", name, GM_PAYLOAD_BINARY_SUFFIX);
+            __atomic_store_n(&queues[slot].name, gm_strdup(name), __ATOMIC_RELEASE);
+            return(&queues[slot]);
+        }
+        if(!strcmp(current, name))
+            return(&queues[slot]);
+        slot = (slot + 1) % WIRE_MAX_QUEUES;
+    }
+    return(NULL);
+}
+
+/* decide if a queue may get binary jobs */
+int wire_format_capable(int workers, int binary_workers) {
+    return(workers > 0 && binary_workers >= workers);
+}
+
+/* update a queue with new poll data */
+static void update_queue(wire_queue_t * q, int workers, int binary_workers) {
+    int format = wire_format_capable(workers, binary_workers) ? GM_PAYLOAD_FORMAT_BINARY : GM_PAYLOAD_FORMAT_TEXT;
+
+    if(format == __atomic_load_n(&q->format, __ATOMIC_RELAXED))
+        return;
+    __atomic_store_n(&q->format, format, __ATOMIC_RELAXED);
+    if(format == GM_PAYLOAD_FORMAT_BINARY)
+        gm_log( GM_LOG_INFO, "queue %s: all %d workers accept binary jobs\n", q->name, workers );
+    else
+        gm_log( GM_LOG_INFO, "queue %s: %d of %d workers accept binary jobs, sending text\n", q->name, binary_workers, workers );
+}
+
+/* update a queue by name */
+void wire_format_update(const char * queue, int workers, int binary_workers) {
+    wire_queue_t * q = get_queue(queue, FALSE);
+    if(q != NULL)
+        update_queue(q, workers, binary_workers);
+}
+
+/* return the format of new jobs for a queue */
+int wire_format_for_queue(const char * queue) {
+    wire_queue_t * q;
+
+    if(mod_gm_opt->wire_format != GM_PAYLOAD_FORMAT_BINARY)
+        return(GM_PAYLOAD_FORMAT_TEXT);
+
+    /* unknown queues get text until the next poll has seen their workers */
+    q = get_queue(queue, TRUE);
+    if(q == NULL)
+        return(GM_PAYLOAD_FORMAT_TEXT);
+    return(__atomic_load_n(&q->format, __ATOMIC_RELAXED));
+}
+
+/* poll all servers and update all known queues */
+static void poll_servers(void) {
+    mod_gm_server_status_t * stats[GM_LISTSIZE];
+    char * message = NULL;
+    char * version = NULL;
+    char * name;
+    char * binary_name;
+    int x, y, z, answered, workers, binary_workers;
+
+    answered = 0;
+    for(x = 0; x < mod_gm_opt->server_num; x++) {
+        stats[answered] = gm_malloc(sizeof(mod_gm_server_status_t));
+        stats[answered]->function_num = 0;
+        stats[answered]->worker_num   = 0;
+        if(get_gearman_server_data(stats[answered], &message, &version, mod_gm_opt->server_list[x]->host, mod_gm_opt->server_list[x]->port) == STATE_OK)
+            answered++;
+        else
+            free_mod_gm_status_server(stats[answered]);
+        gm_free(message);
+        gm_free(version);
+    }
+
+    /* keep the last state if no server answered */
+    if(answered > 0) {
+        for(x = 0; x < WIRE_MAX_QUEUES; x++) {
+            name = __atomic_load_n(&queues[x].name, __ATOMIC_ACQUIRE);
+            if(name == NULL)
+                continue;
+            binary_name    = queues[x].binary_name;
+            workers        = 0;
+            binary_workers = 0;
+            for(y = 0; y < answered; y++) {
+                for(z = 0; z < stats[y]->function_num; z++) {
+                    if(!strcmp(stats[y]->function[z].queue, name))
+                        workers += stats[y]->function[z].worker;
+                    else if(!strcmp(stats[y]->function[z].queue, binary_name))
+                        binary_workers += stats[y]->function[z].worker;
+                }
+            }
+            update_queue(&queues[x], workers, binary_workers);
+        }
+    }
+
+    for(y = 0; y < answered; y++)
+        free_mod_gm_status_server(stats[y]);
+}
+
+/* main loop of the polling thread */
+static void *wire_worker( __attribute__((__unused__)) void * data ) {
+    struct timeval now;
+    struct timespec deadline;
+
+    gm_log( GM_LOG_DEBUG, "wire negotiation thr-%ld started\n", pthread_self() );
+
+    while(TRUE) {
+        pthread_mutex_lock(&wire_mutex);
+        gettimeofday(&now, NULL);
+        deadline.tv_sec  = now.tv_sec + GM_WIRE_NEGOTIATION_INTERVAL;
+        deadline.tv_nsec = now.tv_usec * 1000;
+        while(wire_should_terminate == FALSE && pthread_cond_timedwait(&wire_cond, &wire_mutex, &deadline) != ETIMEDOUT)
+            ;
+        if(wire_should_terminate == TRUE) {
+            pthread_mutex_unlock(&wire_mutex);
+            break;
+        }
+        pthread_mutex_unlock(&wire_mutex);
+
+        poll_servers();
+    }
+
+    gm_log( GM_LOG_DEBUG, "wire negotiation thr-%ld finished\n", pthread_self() );
+    return(NULL);
+}
+
+/* start the polling thread */
+int start_wire_negotiation(void) {
+    int ret;
+
+    wire_should_terminate = FALSE;
+    if(mod_gm_opt->wire_format != GM_PAYLOAD_FORMAT_BINARY)
+        return(GM_OK);
+
+    if((ret = pthread_create(&wire_thr, NULL, &wire_worker, NULL)) != 0) {
+        gm_log( GM_LOG_ERROR, "failed to create wire negotiation thread: %s\n", strerror(ret));
+        return(GM_ERROR);
+    }
+    wire_running = TRUE;
+    return(GM_OK);
+}
+
+/* stop the polling thread */
+void stop_wire_negotiation(void) {
+    int x;
+
+    if(wire_running == TRUE) {
+        pthread_mutex_lock(&wire_mutex);
+        wire_should_terminate = TRUE;
+        pthread_cond_signal(&wire_cond);
+        pthread_mutex_unlock(&wire_mutex);
+        if(pthread_join(wire_thr, NULL) != 0) {
+            gm_log( GM_LOG_ERROR, "failed to join wire negotiation thread: %s\n", strerror(errno) );
+        }
+        wire_running = FALSE;
+    }
+
+    for(x = 0; x < WIRE_MAX_QUEUES; x++) {
+        gm_free(queues[x].name);
+        gm_free(queues[x].binary_name);
+        memset(&queues[x], 0, sizeof(wire_queue_t));
+    }
+}
@@ -10,6 +10,9 @@
 #include <check_utils.h>
 #include <gm_crypt.h>
 #include "gearman_utils.h"
+#include <gm_buffer.h>
+#include <gm_json.h>
+#include <gm_payload.h>
 
 #include <worker_dummy_functions.c>
 
@@ -36,7 +39,7 @@ static inline long ns_now(void) {
 }
 
 int main(void) {
-    plan(138);
+    plan(160);
 
     /* lowercase */
     char test[100];
@@ -270,6 +273,14 @@ int main(void) {
     ok(mod_gm_opt->server_list[2]->port == 4730, "duplicate server");
     ok(mod_gm_opt->server_num == 3, "server_number = %d", mod_gm_opt->server_num);
 
+    renew_opts();
+    strcpy(test, "spool_max_size=1");
+    parse_args_line(mod_gm_opt, test, 0);
+    ok(mod_gm_opt->spool_max_size == 4, "spool_max_size rounded up to one segment: %d", mod_gm_opt->spool_max_size);
+    strcpy(test, "spool_max_size=10");
+    parse_args_line(mod_gm_opt, test, 0);
+    ok(mod_gm_opt->spool_max_size == 10, "spool_max_size=10: %d", mod_gm_opt->spool_max_size);
+
     /* escape newlines */
     char * escaped = gm_escape_newlines(" test\n", GM_DISABLED);
     is(escaped, " test\\n", "untrimmed escape string");
@@ -287,6 +298,13 @@ int main(void) {
     mod_gm_hexsum(sum, test);
     is(sum, "E4D909C290D0FB1CA068FFADDF22CBD0", "md5sum()");
 
+    /* murmur3 hash sum */
+    strcpy(test, "The quick brown fox jumps over the lazy dog");
+    mod_gm_fasthexsum(sum, test, strlen(test));
+    is(sum, "6C1B07BC7BBC4BE347939AC4A93C437A", "fasthexsum()");
+    mod_gm_fasthexsum(sum, test, 17);
+    is(sum, "AEE957E77663F9910CEB83AE8DE5449B", "fasthexsum() with tail");
+
     /* starts_with */
     strcpy(test, "test123");
     test2 = strdup("test");
@@ -326,6 +344,83 @@ int main(void) {
     long end = ns_now();
     printf("make_uniq ns/call: %.2f\n", (double)(end - start) / iters);
 
+    /* growable buffer */
+    gm_buffer_t * buf = gm_buffer_new();
+    struct timeval tv = { 1700000000, 42 };
+    char expect[GM_BUFFERSIZE];
+    snprintf(expect, sizeof(expect), "core_time=%Lf\ntimeout=%d\n", timeval2double(&tv) - 0.5, -60);
+    gm_buffer_append_str(buf, "core_time=");
+    gm_buffer_append_time(buf, timeval2usec(&tv) - 500000);
+    gm_buffer_append_str(buf, "\ntimeout=");
+    gm_buffer_append_int(buf, -60);
+    gm_buffer_append(buf, "\n", 1);
+    is(buf->data, expect, "gm_buffer_append_time() formats like %%Lf");
+    ok(buf->len == strlen(expect), "gm_buffer length");
+    gm_buffer_reset(buf);
+    tv.tv_sec = 0; tv.tv_usec = 999999;
+    gm_buffer_append_time(buf, timeval2usec(&tv));
+    is(buf->data, "0.999999", "gm_buffer_append_time(0.999999)");
+    gm_buffer_reset(buf);
+    for(i = 0; i < 10000; i++)
+        gm_buffer_printf(buf, "%08d\n", i);
+    ok(buf->len == 90000, "gm_buffer grows: %zu", buf->len);
+    ok(!strncmp(buf->data + 89991, "00009999\n", 9), "gm_buffer content after growing");
+    gm_buffer_reset(buf);
+    ok(buf->size <= GM_BUFFER_SHRINK_SIZE, "gm_buffer shrinks on reset: %zu", buf->size);
+
+    /* json writer */
+    gm_buffer_reset(buf);
+    gm_json_open(buf);
+    gm_json_str(buf, "plain", "no special chars");
+    gm_json_int(buf, "int", -5);
+    gm_json_str(buf, "null", NULL);
+    gm_json_close(buf);
+    is(buf->data, "{\"plain\":\"no special chars\",\"int\":-5,\"null\":null}", "gm_json object");
+    gm_buffer_reset(buf);
+    gm_json_escape(buf, "a\"b\\c\nd\te\x01" "f\x7f");
+    is(buf->data, "a\\\"b\\\\c\\nd\\te\\u0001f\\u007f", "gm_json_escape()");
+    gm_buffer_reset(buf);
+    gm_json_open(buf);
+    gm_json_double(buf, "nan", NAN);
+    gm_json_close(buf);
+    is(buf->data, "{\"nan\":null}", "gm_json_double(NAN)");
+
+    /* key/value payload */
+    {
+        gm_payload_t payload;
+        int x, collisions = 0;
+        for(x = 0; x < GM_PAYLOAD_KEY_NUM; x++) {
+            if(gm_payload_probes(x) != 1)
+                collisions++;
+            if(gm_payload_key(gm_payload_keys[x], strlen(gm_payload_keys[x])) != x)
+                collisions++;
+        }
+        cmp_ok(collisions, "==", 0, "payload keys are found without collisions");
+        ok(gm_payload_key("host", 4) == -1 && gm_payload_key("host_name2", 10) == -1 && gm_payload_key("", 0) == -1, "unknown payload keys");
+
+        gm_buffer_reset(buf);
+        gm_payload_append(buf, GM_PAYLOAD_TYPE, "service");
+        gm_payload_append(buf, GM_PAYLOAD_HOST_NAME, "host1");
+        gm_payload_append(buf, GM_PAYLOAD_SERVICE_DESCRIPTION, "disk = /");
+        gm_payload_append_time(buf, GM_PAYLOAD_CORE_TIME, 1300000000500000LL);
+        gm_payload_append_int(buf, GM_PAYLOAD_TIMEOUT, 60);
+        gm_buffer_append(buf, "unknown_key=1\n", 14);
+        gm_payload_append(buf, GM_PAYLOAD_OUTPUT, "line1\\nline2\\\\x");
+        gm_payload_end(buf);
+        is(buf->data, "type=service\nhost_name=host1\nservice_description=disk = /\ncore_time=1300000000.500000\ntimeout=60\nunknown_key=1\noutput=line1\\nline2\\\\x\n\n\n", "payload encoded");
+        cmp_ok(gm_payload_parse(&payload, buf->data, buf->len), "==", 6, "payload parsed");
+        ok(!strcmp(payload.value[GM_PAYLOAD_SERVICE_DESCRIPTION], "disk = /") && !strcmp(payload.value[GM_PAYLOAD_CORE_TIME], "1300000000.500000"), "payload values");
+        ok(gm_payload_value(&payload, GM_PAYLOAD_COMMAND_LINE) == NULL && payload.value[GM_PAYLOAD_HOST_NAME] > buf->data && payload.value[GM_PAYLOAD_HOST_NAME] < buf->data + buf->len, "payload values point into the buffer");
+        payload.len[GM_PAYLOAD_OUTPUT] = gm_payload_unescape(payload.value[GM_PAYLOAD_OUTPUT], payload.len[GM_PAYLOAD_OUTPUT]);
+        ok(!strcmp(payload.value[GM_PAYLOAD_OUTPUT], "line1\nline2\\\\x") && payload.len[GM_PAYLOAD_OUTPUT] == 14, "payload output unescaped in place");
+
+        gm_buffer_reset(buf);
+        gm_buffer_append_str(buf, "host_name=host1\noutput=\nreturn_code=2\n");
+        cmp_ok(gm_payload_parse(&payload, buf->data, buf->len), "==", 1, "empty value ends the payload");
+    }
+    gm_buffer_free(&buf);
+    ok(buf == NULL, "gm_buffer_free()");
+
 
     mod_gm_free_opt(mod_gm_opt);
 
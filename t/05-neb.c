@@ -34,6 +34,9 @@ timed_event *schedule_event(__attribute__((unused)) time_t delay, __attribute__(
 int process_performance_data;
 int log_notifications;
 int log_global_notifications;
+iobroker_set *nagios_iobs = NULL;
+int iobroker_register(__attribute__((unused)) iobroker_set *iobs, __attribute__((unused)) int sd, __attribute__((unused)) void *arg, __attribute__((unused)) int (*handler)(int, int, void *)) { return(0); }
+int iobroker_unregister(__attribute__((unused)) iobroker_set *iobs, __attribute__((unused)) int sd) { return(0); }
 
 #pragma GCC diagnostic push    //Save actual diagnostics state
 #pragma GCC diagnostic ignored "-Wpedantic"    //Disable pedantic
@@ -2,7 +2,7 @@
 
 use warnings;
 use strict;
-use Test::More tests => 9;
+use Test::More tests => 11;
 use Carp qw/confess/;
 use Time::HiRes qw( gettimeofday tv_interval sleep );
 
@@ -48,6 +48,18 @@ my $rate    = int($NR_TST_JOBS / $elapsed);
 ok($elapsed, 'filling gearman queue with '.$NR_TST_JOBS.' jobs took: '.$elapsed.' seconds');
 ok($rate > 500, 'fill rate '.$rate.'/s');
 
+# compare with sending one job per round trip
+open($ph, "|./send_gearman --server=localhost:$TESTPORT --result_queue=bench_unpipelined --submit_batch_size=1") or die("failed to open send_gearman: $!");
+$t0 = [gettimeofday];
+for my $x (1..$NR_TST_JOBS) {
+    print $ph "hostname\t1\ttest\n";
+}
+close($ph);
+my $elapsed_single = tv_interval ( $t0 );
+my $rate_single    = int($NR_TST_JOBS / $elapsed_single);
+ok($elapsed_single, 'filling gearman queue with '.$NR_TST_JOBS.' single jobs took: '.$elapsed_single.' seconds');
+ok($rate_single > 0, 'single fill rate '.$rate_single.'/s, pipelined fill rate '.$rate.'/s');
+
 # now clear the queue
 `>worker.log`;
 $t0 = [gettimeofday];
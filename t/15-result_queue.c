@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <t/tap.h>
+#include <t/test_naemon_stubs.h>
+#include <common.h>
+#include <utils.h>
+#include <mpsc_queue.h>
+
+#include <worker_dummy_functions.c>
+
+#include <libgearman/gearman.h>
+
+mod_gm_opt_t *mod_gm_opt;
+char hostname[GM_SMALLBUFSIZE];
+gearman_client_st *current_client;
+gearman_client_st *current_client_dup;
+
+#define RESULTS_PER_PRODUCER 200000
+#define MAX_PRODUCERS        8
+
+/* fake result, similar to the neb module check result container */
+typedef struct test_result_struct {
+    int               producer;
+    int               seq;
+    char              payload[64];
+    mpsc_queue_node_t node;
+} test_result_t;
+
+/* old style list node, one extra allocation per result */
+typedef struct test_list_struct {
+    void                    * object_ptr;
+    struct test_list_struct * next;
+} test_list_t;
+
+static mpsc_queue_t    result_queue = MPSC_QUEUE_INITIALIZER;
+static test_list_t   * result_list  = NULL;
+static pthread_mutex_t result_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int             use_mpsc     = TRUE;
+static volatile int    producers_started = 0;
+static volatile int    start_producing   = FALSE;
+
+static test_result_t * new_result(int producer, int seq) {
+    test_result_t * res = gm_malloc(sizeof *res);
+    res->producer = producer;
+    res->seq      = seq;
+    snprintf(res->payload, sizeof(res->payload), "result %d/%d", producer, seq);
+    return(res);
+}
+
+static void *producer(void * data) {
+    int id = *(int *)data;
+    int x;
+    test_list_t * item;
+    test_result_t * res;
+
+    __atomic_add_fetch(&producers_started, 1, __ATOMIC_SEQ_CST);
+    while(!__atomic_load_n(&start_producing, __ATOMIC_ACQUIRE))
+        ;
+
+    for(x = 0; x < RESULTS_PER_PRODUCER; x++) {
+        res = new_result(id, x);
+        if(use_mpsc) {
+            mpsc_queue_push(&result_queue, &res->node);
+        } else {
+            item = gm_malloc(sizeof *item);
+            item->object_ptr = res;
+            pthread_mutex_lock(&result_list_mutex);
+            item->next  = result_list;
+            result_list = item;
+            pthread_mutex_unlock(&result_list_mutex);
+        }
+    }
+    return NULL;
+}
+
+/* consume everything, returns number of ordering errors */
+static int consume(int expected, int * received) {
+    int last_seq[MAX_PRODUCERS];
+    int errors = 0;
+    int x;
+    mpsc_queue_node_t * nodes;
+    test_list_t * list, * cur;
+    test_result_t * res;
+
+    for(x = 0; x < MAX_PRODUCERS; x++)
+        last_seq[x] = -1;
+
+    *received = 0;
+    while(*received < expected) {
+        if(use_mpsc) {
+            nodes = mpsc_queue_take_all(&result_queue);
+            while(nodes != NULL) {
+                res   = mpsc_queue_entry(nodes, test_result_t, node);
+                nodes = nodes->next;
+                if(res->seq != last_seq[res->producer] + 1)
+                    errors++;
+                last_seq[res->producer] = res->seq;
+                free(res);
+                (*received)++;
+            }
+        } else {
+            pthread_mutex_lock(&result_list_mutex);
+            list = result_list;
+            result_list = NULL;
+            pthread_mutex_unlock(&result_list_mutex);
+            /* prepended list, arrives in reverse order */
+            while(list != NULL) {
+                cur  = list;
+                list = list->next;
+                free(cur->object_ptr);
+                free(cur);
+                (*received)++;
+            }
+        }
+        if(*received < expected)
+            usleep(1000);
+    }
+    return(errors);
+}
+
+static double run(int mpsc, int threads, int * received, int * errors) {
+    pthread_t thr[MAX_PRODUCERS];
+    int ids[MAX_PRODUCERS];
+    struct timeval start, end;
+    int x;
+
+    use_mpsc          = mpsc;
+    producers_started = 0;
+    start_producing   = FALSE;
+    for(x = 0; x < threads; x++) {
+        ids[x] = x;
+        pthread_create(&thr[x], NULL, &producer, &ids[x]);
+    }
+    while(__atomic_load_n(&producers_started, __ATOMIC_SEQ_CST) < threads)
+        usleep(100);
+
+    gettimeofday(&start, NULL);
+    __atomic_store_n(&start_producing, TRUE, __ATOMIC_RELEASE);
+    *errors = consume(threads * RESULTS_PER_PRODUCER, received);
+    gettimeofday(&end, NULL);
+
+    for(x = 0; x < threads; x++)
+        pthread_join(thr[x], NULL);
+
+    return(end.tv_sec - start.tv_sec + (end.tv_usec - start.tv_usec) / 1000000.0);
+}
+
+/* main tests */
+int main(void) {
+    int threads, received, errors;
+    double duration_mutex, duration_mpsc;
+
+    plan(8);
+
+    mod_gm_opt = gm_malloc(sizeof(mod_gm_opt_t));
+    set_default_options(mod_gm_opt);
+
+    for(threads = 1; threads <= MAX_PRODUCERS; threads *= 2) {
+        duration_mutex = run(FALSE, threads, &received, &errors);
+        cmp_ok(received, "==", threads * RESULTS_PER_PRODUCER, "mutex list: received all results from %d producers", threads);
+
+        duration_mpsc = run(TRUE, threads, &received, &errors);
+        ok(received == threads * RESULTS_PER_PRODUCER && errors == 0, "mpsc queue: received all results from %d producers in order (%d ordering errors)", threads, errors);
+
+        diag("result_workers: %d, mutex list: %.0f results/s, mpsc queue: %.0f results/s",
+             threads,
+             (threads * RESULTS_PER_PRODUCER) / duration_mutex,
+             (threads * RESULTS_PER_PRODUCER) / duration_mpsc
+        );
+    }
+
+    mod_gm_free_opt(mod_gm_opt);
+    return exit_status();
+}
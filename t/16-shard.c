@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <t/tap.h>
+#include <t/test_naemon_stubs.h>
+#include <common.h>
+#include <utils.h>
+#include <shard.h>
+
+#include <worker_dummy_functions.c>
+
+#include <libgearman/gearman.h>
+
+mod_gm_opt_t *mod_gm_opt;
+char hostname[GM_SMALLBUFSIZE];
+gearman_client_st *current_client;
+gearman_client_st *current_client_dup;
+
+#define NUM_SERVERS 4
+#define NUM_HOSTS   20000
+
+/* main tests */
+int main(void) {
+    gm_shard_ring_t * ring;
+    int count[NUM_SERVERS];
+    int target[NUM_HOSTS];
+    int down[NUM_SERVERS];
+    char host[GM_SMALLBUFSIZE];
+    char arg[GM_SMALLBUFSIZE];
+    int x, server, min, max, moved, wrong;
+
+    plan(10);
+
+    mod_gm_opt = gm_malloc(sizeof(mod_gm_opt_t));
+    set_default_options(mod_gm_opt);
+    for(x = 0; x < NUM_SERVERS; x++) {
+        snprintf(arg, sizeof(arg), "server=gearmand%d:4730", x);
+        parse_args_line(mod_gm_opt, arg, 0);
+    }
+    strcpy(arg, "sharding=service");
+    parse_args_line(mod_gm_opt, arg, 0);
+    cmp_ok(mod_gm_opt->sharding, "==", GM_SHARD_SERVICE, "parsed sharding option");
+    strcpy(arg, "sharding=hosts");
+    ok(parse_args_line(mod_gm_opt, arg, 0) == GM_ERROR && mod_gm_opt->sharding == GM_SHARD_SERVICE, "unknown sharding mode is rejected");
+    cmp_ok(mod_gm_opt->server_num, "==", NUM_SERVERS, "parsed server list");
+
+    /* keys are stable and never 0 */
+    ok(gm_shard_hash("localhost", NULL) == gm_shard_hash("localhost", NULL), "host hash is stable");
+    ok(gm_shard_hash("localhost", "ping") != gm_shard_hash("localhost", "http"), "services of one host get different keys");
+
+    ring = gm_shard_ring_create(mod_gm_opt->server_list, mod_gm_opt->server_num, GM_SHARD_REPLICAS);
+
+    /* all hosts are spread evenly */
+    for(x = 0; x < NUM_SERVERS; x++) {
+        count[x] = 0;
+        down[x]  = FALSE;
+    }
+    for(x = 0; x < NUM_HOSTS; x++) {
+        snprintf(host, sizeof(host), "host%d.example.com", x);
+        target[x] = gm_shard_ring_lookup(ring, gm_shard_hash(host, NULL), NULL);
+        count[target[x]]++;
+    }
+    min = max = count[0];
+    for(x = 1; x < NUM_SERVERS; x++) {
+        if(count[x] < min) min = count[x];
+        if(count[x] > max) max = count[x];
+    }
+    ok(min > NUM_HOSTS / NUM_SERVERS * 0.75 && max < NUM_HOSTS / NUM_SERVERS * 1.25, "hosts spread over all servers (min: %d, max: %d)", min, max);
+
+    /* only keys of the failed server move */
+    down[1] = TRUE;
+    moved = 0;
+    wrong = 0;
+    for(x = 0; x < NUM_HOSTS; x++) {
+        snprintf(host, sizeof(host), "host%d.example.com", x);
+        server = gm_shard_ring_lookup(ring, gm_shard_hash(host, NULL), down);
+        if(server != target[x]) {
+            moved++;
+            if(target[x] != 1)
+                wrong++;
+        }
+        if(server == 1)
+            wrong++;
+    }
+    cmp_ok(moved, "==", count[1], "only hosts of the failed server moved");
+    cmp_ok(wrong, "==", 0, "no other host changed its server");
+
+    /* all servers down */
+    for(x = 0; x < NUM_SERVERS; x++)
+        down[x] = TRUE;
+    cmp_ok(gm_shard_ring_lookup(ring, gm_shard_hash("localhost", NULL), down), "==", -1, "no server left");
+
+    gm_shard_ring_free(&ring);
+    ok(ring == NULL, "ring freed");
+
+    mod_gm_free_opt(mod_gm_opt);
+    return exit_status();
+}
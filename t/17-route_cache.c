@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <t/tap.h>
+#include <t/test_naemon_stubs.h>
+
+#include "common.h"
+#include "utils.h"
+#include "gm_crypt.h"
+#include "route_cache.h"
+#include "gm_payload.h"
+#include <worker_dummy_functions.c>
+
+#include <libgearman/gearman.h>
+
+mod_gm_opt_t *mod_gm_opt;
+char hostname[GM_SMALLBUFSIZE];
+gearman_client_st *current_client;
+gearman_client_st *current_client_dup;
+
+#define NUM_HOSTGROUPS        200
+#define NUM_HOSTS             10000
+#define SERVICES_PER_HOST     10
+#define NUM_SERVICES          (NUM_HOSTS * SERVICES_PER_HOST)
+
+static hostgroup * hostgroups[NUM_HOSTGROUPS];
+static char ** hostgroup_members[NUM_HOSTGROUPS];   /* sorted host names */
+static int hostgroup_members_num[NUM_HOSTGROUPS];
+
+static int cmp_name(const void * a, const void * b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int cmp_group(const void * a, const void * b) {
+    return strcmp(*(char * const *)a, (*(hostgroup * const *)b)->group_name);
+}
+
+/* fake some core functions, lookups by name like the core does */
+hostgroup * find_hostgroup(const char * name) {
+    hostgroup ** hg = bsearch(&name, hostgroups, NUM_HOSTGROUPS, sizeof(hostgroup *), cmp_group);
+    return(hg == NULL ? NULL : *hg);
+}
+servicegroup * find_servicegroup(__attribute__((__unused__)) const char * name) {
+    return(NULL);
+}
+int is_host_member_of_hostgroup(hostgroup * group, host * hst) {
+    return(bsearch(&hst->name, hostgroup_members[group->id], hostgroup_members_num[group->id], sizeof(char *), cmp_name) != NULL ? TRUE : FALSE);
+}
+int is_service_member_of_servicegroup(__attribute__((__unused__)) servicegroup * group, __attribute__((__unused__)) service * svc) {
+    return(FALSE);
+}
+
+/* hostgroups on top of the shared fake objects */
+static void create_hostgroups(void) {
+    char option[GM_BUFFERSIZE];
+    int x, g;
+
+    /* hostgroup names sort like their index, so the fake lookup can use bsearch */
+    snprintf(option, sizeof(option), "hostgroups=");
+    for(x = 0; x < NUM_HOSTGROUPS; x++) {
+        hostgroups[x] = gm_malloc(sizeof(hostgroup));
+        memset(hostgroups[x], 0, sizeof(hostgroup));
+        hostgroups[x]->id = x;
+        gm_asprintf(&hostgroups[x]->group_name, "hg%04d", x);
+        hostgroup_members[x]     = gm_malloc((NUM_HOSTS / NUM_HOSTGROUPS + 1) * sizeof(char *));
+        hostgroup_members_num[x] = 0;
+        snprintf(option + strlen(option), sizeof(option) - strlen(option), "%s%s", x == 0 ? "" : ",", hostgroups[x]->group_name);
+    }
+    parse_args_line(mod_gm_opt, option, 0);
+
+    for(x = 0; x < NUM_HOSTS; x++) {
+        g = x % NUM_HOSTGROUPS;
+        hostgroup_members[g][hostgroup_members_num[g]++] = host_ary[x]->name;
+    }
+    for(x = 0; x < NUM_HOSTGROUPS; x++)
+        qsort(hostgroup_members[x], hostgroup_members_num[x], sizeof(char *), cmp_name);
+}
+
+static void free_hostgroups(void) {
+    int x;
+    for(x = 0; x < NUM_HOSTGROUPS; x++) {
+        free(hostgroups[x]->group_name);
+        free(hostgroups[x]);
+        free(hostgroup_members[x]);
+    }
+}
+
+static int cmp_key(const void * a, const void * b) {
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+static double elapsed(struct timeval start) {
+    struct timeval end;
+    gettimeofday(&end, NULL);
+    return(end.tv_sec - start.tv_sec + (end.tv_usec - start.tv_usec) / 1000000.0);
+}
+
+/* main tests */
+int main(void) {
+    char option[GM_SMALLBUFSIZE];
+    customvariablesmember var;
+    struct timeval start;
+    double duration_resolve, duration_cached;
+    char uniq[GM_SMALLBUFSIZE];
+    char expected[GM_SMALLBUFSIZE];
+    const char ** keys;
+    const char * prefix;
+    gm_buffer_t * job;
+    gm_payload_t payload;
+    size_t len;
+    int x, errors;
+
+    plan(20);
+
+    mod_gm_opt = gm_malloc(sizeof(mod_gm_opt_t));
+    set_default_options(mod_gm_opt);
+    strcpy(option, "queue_custom_variable=worker");
+    parse_args_line(mod_gm_opt, option, 0);
+    strcpy(option, "priority_custom_variable=gearman_prio");
+    parse_args_line(mod_gm_opt, option, 0);
+    strcpy(option, "priority_hostgroups=high:hg0001,hg0002");
+    parse_args_line(mod_gm_opt, option, 0);
+    strcpy(option, "perfdata=graphite");
+    parse_args_line(mod_gm_opt, option, 0);
+    test_create_objects(NUM_HOSTS, SERVICES_PER_HOST, "host%05d", "service%d");
+    create_hostgroups();
+
+    gettimeofday(&start, NULL);
+    route_cache_init();
+    diag("resolved %d hosts and %d services at startup in %.3fs", NUM_HOSTS, NUM_SERVICES, elapsed(start));
+
+    /* cached queues must match what would have been resolved */
+    errors = 0;
+    for(x = 0; x < NUM_SERVICES; x++) {
+        if(strcmp(route_cache_lookup(service_ary[x]->host_ptr, service_ary[x]), route_cache_resolve(service_ary[x]->host_ptr, service_ary[x])))
+            errors++;
+    }
+    cmp_ok(errors, "==", 0, "cached service queues match resolved queues");
+    is(route_cache_lookup(host_ary[201], NULL), "hostgroup_hg0001", "host queue from hostgroup");
+    is(route_cache_lookup(host_ary[201], service_ary[2010]), "hostgroup_hg0001", "service queue from hostgroup");
+
+    /* result lanes are available to the result threads right after startup */
+    ok(route_cache_result_lane(host_ary[201], service_ary[2010]) == GM_JOB_PRIO_HIGH - 1
+       && route_cache_result_lane(host_ary[200], service_ary[2000]) == GM_JOB_PRIO_LOW - 1
+       && route_cache_result_lane(host_ary[200], NULL) == GM_JOB_PRIO_NORMAL - 1, "result lanes cached at startup");
+    route_cache_invalidate();
+    ok(route_cache_result_lane(host_ary[201], service_ary[2010]) == -1 && route_cache_priority(host_ary[201], service_ary[2010]) == GM_JOB_PRIO_HIGH
+       && route_cache_result_lane(host_ary[201], service_ary[2010]) == GM_JOB_PRIO_HIGH - 1, "result lane resolved again after invalidate");
+    route_cache_lookup(host_ary[201], service_ary[2010]);
+
+    /* custom variables are only picked up after invalidating the cache */
+    var.variable_name    = "WORKER";
+    var.variable_value   = "special";
+    var.has_been_modified = FALSE;
+    var.next             = NULL;
+    service_ary[2010]->custom_variables = &var;
+    is(route_cache_lookup(host_ary[201], service_ary[2010]), "hostgroup_hg0001", "changed custom variable not seen before invalidate");
+    route_cache_invalidate();
+    is(route_cache_lookup(host_ary[201], service_ary[2010]), "special", "changed custom variable used after invalidate");
+    var.variable_value   = "local";
+    route_cache_invalidate();
+    is(route_cache_lookup(host_ary[201], service_ary[2010]), "", "custom variable local bypasses gearman");
+    service_ary[2010]->custom_variables = NULL;
+    route_cache_invalidate();
+
+    /* priority classes from hostgroups and custom variables */
+    cmp_ok(route_cache_priority(host_ary[201], service_ary[2010]), "==", GM_JOB_PRIO_HIGH, "priority from hostgroup");
+    cmp_ok(route_cache_priority(host_ary[200], service_ary[2000]), "==", 0, "no priority without match");
+    var.variable_name    = "GEARMAN_PRIO";
+    var.variable_value   = "Low";
+    service_ary[2010]->custom_variables = &var;
+    route_cache_invalidate();
+    cmp_ok(route_cache_priority(host_ary[201], service_ary[2010]), "==", GM_JOB_PRIO_LOW, "service custom variable wins over hostgroup");
+    var.variable_value   = "urgent";
+    route_cache_invalidate();
+    cmp_ok(route_cache_priority(host_ary[201], service_ary[2010]), "==", GM_JOB_PRIO_HIGH, "invalid priority is ignored");
+    service_ary[2010]->custom_variables = NULL;
+    route_cache_invalidate();
+
+    /* priorities from custom variables need invalidation even without queue custom variables */
+    gm_free(mod_gm_opt->queue_cust_var);
+    ok(route_cache_uses_custom_variables() == TRUE, "priority custom variable needs invalidation");
+    gm_free(mod_gm_opt->priority_cust_var);
+    ok(route_cache_uses_custom_variables() == FALSE, "no invalidation without custom variables");
+    strcpy(option, "queue_custom_variable=worker");
+    parse_args_line(mod_gm_opt, option, 0);
+    strcpy(option, "priority_custom_variable=gearman_prio");
+    parse_args_line(mod_gm_opt, option, 0);
+
+    /* unique job keys */
+    mod_gm_fasthexsum(expected, "host00201-service0", strlen("host00201-service0"));
+    is(route_cache_uniq(host_ary[201], service_ary[2010], -1), expected, "service key hashes host and service name");
+    mod_gm_fasthexsum(expected, "graphite-host00201", strlen("graphite-host00201"));
+    is(route_cache_uniq(host_ary[201], NULL, 0), expected, "perfdata key includes the queue name");
+    ok(route_cache_uniq(host_ary[201], NULL, -1) != route_cache_uniq(host_ary[201], NULL, 0), "check and perfdata keys are cached separately");
+    keys = gm_malloc((NUM_HOSTS + NUM_SERVICES) * sizeof(char *));
+    for(x = 0; x < NUM_HOSTS; x++)
+        keys[x] = route_cache_uniq(host_ary[x], NULL, -1);
+    for(x = 0; x < NUM_SERVICES; x++)
+        keys[NUM_HOSTS + x] = route_cache_uniq(service_ary[x]->host_ptr, service_ary[x], -1);
+    qsort(keys, NUM_HOSTS + NUM_SERVICES, sizeof(char *), cmp_key);
+    errors = 0;
+    for(x = 1; x < NUM_HOSTS + NUM_SERVICES; x++) {
+        if(!strcmp(keys[x-1], keys[x]))
+            errors++;
+    }
+    cmp_ok(errors, "==", 0, "all job keys are unique");
+    free(keys);
+
+    /* binary job prefixes are completed like text prefixes */
+    job = gm_buffer_new();
+    prefix = route_cache_job_prefix(host_ary[201], service_ary[2010], GM_PAYLOAD_FORMAT_BINARY, &len);
+    gm_buffer_append(job, prefix, len);
+    gm_payload_append_int(job, GM_PAYLOAD_TIMEOUT, 60);
+    gm_payload_end(job);
+    gm_payload_decode(&payload, job->data, job->len);
+    ok(payload.format == GM_PAYLOAD_FORMAT_BINARY && payload.found == 6
+       && !strcmp(gm_payload_value(&payload, GM_PAYLOAD_SERVICE_DESCRIPTION), service_ary[2010]->description), "binary job prefix");
+
+    /* the cached prefix follows the negotiated format of the queue */
+    prefix = route_cache_job_prefix(host_ary[201], service_ary[2010], GM_PAYLOAD_FORMAT_TEXT, &len);
+    gm_buffer_reset(job);
+    gm_buffer_append(job, prefix, len);
+    gm_payload_append_int(job, GM_PAYLOAD_TIMEOUT, 60);
+    gm_payload_end(job);
+    gm_payload_decode(&payload, job->data, job->len);
+    ok(payload.format == GM_PAYLOAD_FORMAT_TEXT && payload.found == 6, "prefix rebuilt when the format changes");
+    gm_buffer_free(&job);
+
+    /* benchmark the unique key per submit */
+    gettimeofday(&start, NULL);
+    for(x = 0; x < NUM_SERVICES; x++)
+        make_uniq(uniq, "%s-%s", service_ary[x]->host_name, service_ary[x]->description);
+    duration_resolve = elapsed(start);
+    gettimeofday(&start, NULL);
+    for(x = 0; x < NUM_SERVICES; x++)
+        route_cache_uniq(service_ary[x]->host_ptr, service_ary[x], -1);
+    duration_cached = elapsed(start);
+    diag("%d services: md5 uniq %.3fus/submit, cached uniq %.3fus/submit",
+         NUM_SERVICES,
+         duration_resolve / NUM_SERVICES * 1000000,
+         duration_cached / NUM_SERVICES * 1000000
+    );
+
+    /* benchmark one callback worth of routing per service */
+    gettimeofday(&start, NULL);
+    for(x = 0; x < NUM_SERVICES; x++)
+        route_cache_resolve(service_ary[x]->host_ptr, service_ary[x]);
+    duration_resolve = elapsed(start);
+
+    /* fill the cache again */
+    for(x = 0; x < NUM_SERVICES; x++)
+        route_cache_lookup(service_ary[x]->host_ptr, service_ary[x]);
+    gettimeofday(&start, NULL);
+    for(x = 0; x < NUM_SERVICES; x++)
+        route_cache_lookup(service_ary[x]->host_ptr, service_ary[x]);
+    duration_cached = elapsed(start);
+
+    diag("%d hostgroups, %d services: resolve %.3fus/callback, cached %.3fus/callback",
+         NUM_HOSTGROUPS, NUM_SERVICES,
+         duration_resolve / NUM_SERVICES * 1000000,
+         duration_cached / NUM_SERVICES * 1000000
+    );
+
+    route_cache_free();
+    free_hostgroups();
+    test_free_objects();
+    mod_gm_free_opt(mod_gm_opt);
+    return exit_status();
+}
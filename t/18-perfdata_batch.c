@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <t/tap.h>
+#include <t/test_naemon_stubs.h>
+#include <common.h>
+#include <utils.h>
+#include <perfdata_batch.h>
+#include <submit_thread.h>
+
+#include <worker_dummy_functions.c>
+
+#include <libgearman/gearman.h>
+
+mod_gm_opt_t *mod_gm_opt;
+char hostname[GM_SMALLBUFSIZE];
+gearman_client_st *current_client;
+gearman_client_st *current_client_dup;
+
+/* jobs sent by the batch */
+static int  jobs_sent = 0;
+static char last_queue[GM_SMALLBUFSIZE];
+static char last_data[GM_BUFFERSIZE];
+
+int mod_gm_submit_job(char * queue, char * uniq, char * data, int priority, int retries, unsigned int shard) {
+    (void)uniq; (void)priority; (void)retries; (void)shard;
+    jobs_sent++;
+    snprintf(last_queue, sizeof(last_queue), "%s", queue);
+    snprintf(last_data, sizeof(last_data), "%s", data);
+    return(GM_OK);
+}
+
+static void add(const char * host, const char * service, const char * data) {
+    perfdata_batch_add(host, service, data);
+}
+
+static void set_option(const char * option) {
+    char arg[GM_SMALLBUFSIZE];
+    snprintf(arg, sizeof(arg), "%s", option);
+    parse_args_line(mod_gm_opt, arg, 0);
+}
+
+/* main tests */
+int main(void) {
+    char host[GM_SMALLBUFSIZE];
+    int x;
+
+    plan(12);
+
+    mod_gm_opt = gm_malloc(sizeof(mod_gm_opt_t));
+    set_default_options(mod_gm_opt);
+    set_option("perfdata=yes");
+    set_option("perfdata_batch_size=3");
+    set_option("perfdata_batch_bytes=40");
+    set_option("perfdata_batch_delay=5");
+    cmp_ok(mod_gm_opt->perfdata_batch_size, "==", 3, "parsed perfdata_batch_size");
+    cmp_ok(mod_gm_opt->perfdata_batch_bytes, "==", 40, "parsed perfdata_batch_bytes");
+    perfdata_batch_init();
+
+    /* full batch */
+    add("host1", NULL, "h1\n");
+    add("host1", "ping", "s1\n");
+    cmp_ok(jobs_sent, "==", 0, "incomplete batch is held back");
+    add("host2", "ping", "s2\n");
+    cmp_ok(jobs_sent, "==", 1, "full batch has been sent");
+    ok(!strcmp(last_queue, GM_PERFDATA_QUEUE) && !strcmp(last_data, "h1\ns1\ns2\n"), "batch contains all records in order");
+
+    /* overwrite mode keeps the latest record only */
+    add("host1", "ping", "old\n");
+    add("host1", "ping", "new\n");
+    perfdata_batch_flush();
+    ok(jobs_sent == 2 && !strcmp(last_data, "new\n"), "newer record replaced the older one");
+
+    /* size limit */
+    add("host1", NULL, "0123456789012345678901234567890\n");
+    add("host2", NULL, "0123456789\n");
+    ok(jobs_sent == 3 && !strcmp(last_data, "0123456789012345678901234567890\n"), "batch has been sent before exceeding the byte limit");
+
+    /* delay */
+    perfdata_batch_tick(time(NULL));
+    cmp_ok(jobs_sent, "==", 3, "young batch is held back");
+    perfdata_batch_tick(time(NULL) + 5);
+    ok(jobs_sent == 4 && !strcmp(last_data, "0123456789\n"), "old batch has been sent");
+
+    /* a replaced record which reaches the byte limit */
+    add("host1", "ping", "");
+    add("host2", NULL, "0123456789\n");
+    add("host1", "ping", "0123456789012345678901234567\n");
+    ok(jobs_sent == 5 && !strcmp(last_data, "0123456789012345678901234567\n0123456789\n"), "batch has been sent after a record grew to the byte limit");
+
+    /* append mode keeps all records */
+    mod_gm_opt->perfdata_mode = GM_PERFDATA_APPEND;
+    add("host1", "ping", "a\n");
+    add("host1", "ping", "b\n");
+    perfdata_batch_free();
+    ok(jobs_sent == 6 && !strcmp(last_data, "a\nb\n"), "append mode keeps duplicates, remaining records sent on shutdown");
+
+    /* jobs per record */
+    mod_gm_opt->perfdata_mode         = GM_PERFDATA_OVERWRITE;
+    mod_gm_opt->perfdata_batch_size   = 100;
+    mod_gm_opt->perfdata_batch_bytes  = GM_DEFAULT_PERFDATA_BATCH_BYTES;
+    perfdata_batch_init();
+    jobs_sent = 0;
+    for(x = 0; x < 10000; x++) {
+        snprintf(host, sizeof(host), "host%d", x);
+        add(host, "ping", "rta=0.1ms;100;500;0 pl=0%;20;60;0\n");
+    }
+    perfdata_batch_free();
+    cmp_ok(jobs_sent, "==", 100, "10000 records sent in 100 jobs");
+
+    mod_gm_free_opt(mod_gm_opt);
+    return exit_status();
+}
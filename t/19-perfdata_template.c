@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <t/tap.h>
+#include <t/test_naemon_stubs.h>
+#include <common.h>
+#include <utils.h>
+#include <gm_buffer.h>
+#include <perfdata_template.h>
+
+#include <worker_dummy_functions.c>
+
+#include <libgearman/gearman.h>
+
+mod_gm_opt_t *mod_gm_opt;
+char hostname[GM_SMALLBUFSIZE];
+gearman_client_st *current_client;
+gearman_client_st *current_client_dup;
+
+/* main tests */
+int main(void) {
+    perfdata_template_t * tpl;
+    gm_buffer_t * buf;
+    host hst;
+    service svc;
+    char expect[GM_BUFFERSIZE];
+    time_t now;
+
+    plan(8);
+
+    mod_gm_opt = gm_malloc(sizeof(mod_gm_opt_t));
+    set_default_options(mod_gm_opt);
+    buf = gm_buffer_new();
+
+    memset(&hst, 0, sizeof(hst));
+    hst.name            = "host1";
+    hst.perf_data       = "rta=0.1ms";
+    hst.check_command   = "check-host-alive";
+    hst.current_state   = STATE_DOWN;
+    hst.state_type      = SOFT_STATE;
+    hst.current_attempt = 2;
+    hst.latency         = 0.25;
+
+    memset(&svc, 0, sizeof(svc));
+    svc.host_name      = "host1";
+    svc.description    = "ping";
+    svc.perf_data      = "pl=0%";
+    svc.check_command  = "check_ping!100,20%!500,60%";
+    svc.current_state  = STATE_CRITICAL;
+    svc.state_type     = HARD_STATE;
+    svc.host_ptr       = &hst;
+
+    /* default host template */
+    tpl = perfdata_template_compile(mod_gm_opt->host_perfdata_template, FALSE);
+    ok(tpl != NULL, "default host template compiled");
+    now = time(NULL);
+    perfdata_template_render(tpl, buf, &hst, NULL);
+    snprintf(expect, sizeof(expect), "DATATYPE::HOSTPERFDATA\tTIMET::%ld\tHOSTNAME::host1\tHOSTPERFDATA::rta=0.1ms\tHOSTCHECKCOMMAND::check-host-alive\tHOSTSTATE::DOWN\tHOSTSTATETYPE::SOFT\n", (long)now);
+    is(buf->data, expect, "host template expanded");
+    perfdata_template_free(&tpl);
+
+    /* default service template */
+    tpl = perfdata_template_compile(mod_gm_opt->service_perfdata_template, TRUE);
+    ok(tpl != NULL, "default service template compiled");
+    gm_buffer_reset(buf);
+    now = time(NULL);
+    perfdata_template_render(tpl, buf, &hst, &svc);
+    snprintf(expect, sizeof(expect), "DATATYPE::SERVICEPERFDATA\tTIMET::%ld\tHOSTNAME::host1\tSERVICEDESC::ping\tSERVICEPERFDATA::pl=0%%\tSERVICECHECKCOMMAND::check_ping!100,20%%!500,60%%\tHOSTSTATE::DOWN\tHOSTSTATETYPE::SOFT\tSERVICESTATE::CRITICAL\tSERVICESTATETYPE::HARD\n", (long)now);
+    is(buf->data, expect, "service template expanded");
+    perfdata_template_free(&tpl);
+
+    /* literals and unset fields */
+    tpl = perfdata_template_compile("cost $$5 $HOSTATTEMPT$ $HOSTLATENCY$ [$LONGHOSTOUTPUT$]", FALSE);
+    gm_buffer_reset(buf);
+    perfdata_template_render(tpl, buf, &hst, NULL);
+    is(buf->data, "cost $5 2 0.250 []\n", "dollar signs, numbers and empty fields");
+    perfdata_template_free(&tpl);
+
+    /* everything else is left to the core */
+    ok(perfdata_template_compile("$HOSTNAME$ $_HOSTCUSTOM$", FALSE) == NULL, "custom variables are not compiled");
+    ok(perfdata_template_compile("$SERVICEDESC$", FALSE) == NULL, "service macros are not compiled for hosts");
+    ok(perfdata_template_compile("$HOSTNAME", FALSE) == NULL, "unterminated macros are not compiled");
+
+    gm_buffer_free(&buf);
+    mod_gm_free_opt(mod_gm_opt);
+    return exit_status();
+}
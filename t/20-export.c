@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <t/tap.h>
+#include <t/test_naemon_stubs.h>
+#include <common.h>
+#include <utils.h>
+#include <gm_buffer.h>
+#include <export.h>
+#include <submit_thread.h>
+
+#include <worker_dummy_functions.c>
+
+#include <libgearman/gearman.h>
+
+mod_gm_opt_t *mod_gm_opt;
+char hostname[GM_SMALLBUFSIZE];
+gearman_client_st *current_client;
+gearman_client_st *current_client_dup;
+
+#define NUM_SERVICES     100
+#define UPDATES          100000
+
+/* jobs sent by the exporter */
+static int  jobs_sent = 0;
+static char last_queue[GM_SMALLBUFSIZE];
+static char last_data[GM_BUFFERSIZE];
+
+int mod_gm_submit_job(char * queue, char * uniq, char * data, int priority, int retries, unsigned int shard) {
+    (void)uniq; (void)priority; (void)retries; (void)shard;
+    jobs_sent++;
+    snprintf(last_queue, sizeof(last_queue), "%s", queue);
+    snprintf(last_data, sizeof(last_data), "%s", data);
+    return(GM_OK);
+}
+
+/* main tests */
+int main(void) {
+    gm_buffer_t * buf;
+    nebstruct_log_data nld;
+    nebstruct_service_status_data nssd;
+    nebstruct_statechange_data nstd;
+    host hst;
+    service svc[NUM_SERVICES];
+    service * services[NUM_SERVICES];
+    char name[NUM_SERVICES][GM_SMALLBUFSIZE];
+    char arg[GM_SMALLBUFSIZE];
+    int x;
+
+    plan(9);
+
+    mod_gm_opt = gm_malloc(sizeof(mod_gm_opt_t));
+    set_default_options(mod_gm_opt);
+    snprintf(arg, sizeof(arg), "export=status:0:%d,%d", NEBCALLBACK_SERVICE_STATUS_DATA, NEBCALLBACK_LOG_DATA);
+    parse_args_line(mod_gm_opt, arg, 0);
+    snprintf(arg, sizeof(arg), "export_coalesce_window=5");
+    parse_args_line(mod_gm_opt, arg, 0);
+    cmp_ok(mod_gm_opt->export_coalesce_window, "==", 5, "parsed export_coalesce_window");
+    buf = gm_buffer_new();
+
+    /* log data, same format as before */
+    memset(&nld, 0, sizeof(nld));
+    nld.type              = NEBTYPE_LOG_DATA;
+    nld.timestamp.tv_sec  = 1700000000;
+    nld.timestamp.tv_usec = 5;
+    nld.entry_time        = 1700000000;
+    nld.data_type         = 2;
+    nld.data              = "SERVICE ALERT: \"quoted\"\n";
+    ok(export_serialize(buf, NEBCALLBACK_LOG_DATA, &nld) == GM_OK, "serialized log data");
+    is(buf->data, "{\"callback_type\":\"NEBCALLBACK_LOG_DATA\",\"type\":\"UNKNOWN\",\"flags\":0,\"attr\":0,\"timestamp\":1700000000.000005,\"entry_time\":1700000000,\"data_type\":2,\"data\":\"SERVICE ALERT: \\\"quoted\\\"\\n\"}", "log data json");
+
+    /* previously not exported callbacks */
+    memset(&nstd, 0, sizeof(nstd));
+    nstd.host_name           = "host1";
+    nstd.service_description = "ping";
+    nstd.state               = 2;
+    nstd.output              = "CRITICAL";
+    gm_buffer_reset(buf);
+    ok(export_serialize(buf, NEBCALLBACK_STATE_CHANGE_DATA, &nstd) == GM_OK && strstr(buf->data, "\"service_description\":\"ping\",\"state\":2,") != NULL, "serialized state change");
+    gm_buffer_reset(buf);
+    ok(export_serialize(buf, 999, &nstd) == GM_ERROR && buf->len == 0, "unknown callback type");
+
+    /* fake core with services */
+    memset(&hst, 0, sizeof(hst));
+    hst.name = "host1";
+    for(x = 0; x < NUM_SERVICES; x++) {
+        memset(&svc[x], 0, sizeof(service));
+        snprintf(name[x], GM_SMALLBUFSIZE, "service %d", x);
+        svc[x].id          = x;
+        svc[x].host_name   = "host1";
+        svc[x].description = name[x];
+        svc[x].host_ptr    = &hst;
+        services[x]        = &svc[x];
+    }
+    num_objects.services = NUM_SERVICES;
+    service_ary          = services;
+    export_coalesce_init();
+
+    /* status updates are held back */
+    jobs_sent = 0;
+    memset(&nssd, 0, sizeof(nssd));
+    nssd.type = NEBTYPE_SERVICESTATUS_UPDATE;
+    for(x = 0; x < UPDATES; x++) {
+        svc[x % NUM_SERVICES].current_attempt = x;
+        nssd.object_ptr = &svc[x % NUM_SERVICES];
+        export_coalesce_add(NEBCALLBACK_SERVICE_STATUS_DATA, &nssd);
+    }
+    cmp_ok(jobs_sent, "==", 0, "status updates are held back");
+    ok(export_coalesce_add(NEBCALLBACK_LOG_DATA, &nld) == FALSE, "other callbacks are not coalesced");
+
+    export_coalesce_tick(time(NULL) + 5);
+    cmp_ok(jobs_sent, "==", NUM_SERVICES, "%d updates sent as %d jobs", UPDATES, jobs_sent);
+    snprintf(arg, sizeof(arg), "\"service_description\":\"service %d\",\"current_state\":0,\"last_state\":0,\"state_type\":0,\"current_attempt\":%d,", NUM_SERVICES-1, UPDATES-1);
+    ok(!strcmp(last_queue, "status") && strstr(last_data, arg) != NULL, "latest status has been sent");
+
+    export_coalesce_free();
+    gm_buffer_free(&buf);
+    mod_gm_free_opt(mod_gm_opt);
+    return exit_status();
+}
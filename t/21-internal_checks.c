@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <t/tap.h>
+#include <t/test_naemon_stubs.h>
+#include <common.h>
+#include <utils.h>
+#include <internal_checks.h>
+
+#include <worker_dummy_functions.c>
+
+#include <libgearman/gearman.h>
+
+mod_gm_opt_t *mod_gm_opt;
+char hostname[GM_SMALLBUFSIZE];
+gearman_client_st *current_client;
+gearman_client_st *current_client_dup;
+
+#define NUM_HOSTS           2
+#define SERVICES_PER_HOST   2
+#define NUM_SERVICES        (NUM_HOSTS * SERVICES_PER_HOST)
+
+/* lookups by name like the core does */
+host * find_host(const char * name) {
+    int x;
+    for(x = 0; x < NUM_HOSTS; x++) {
+        if(!strcmp(host_ary[x]->name, name))
+            return(host_ary[x]);
+    }
+    return(NULL);
+}
+service * find_service(const char * host_name, const char * description) {
+    int x;
+    for(x = 0; x < NUM_SERVICES; x++) {
+        if(!strcmp(service_ary[x]->host_name, host_name) && !strcmp(service_ary[x]->description, description))
+            return(service_ary[x]);
+    }
+    return(NULL);
+}
+
+/* run a check on the first service and return its output */
+static int run_check(const char * command_line, int * rc, char * output, size_t size) {
+    char * out = NULL;
+    int ret = internal_check_execute(command_line, host_ary[0], service_ary[0], rc, &out);
+    snprintf(output, size, "%s", out == NULL ? "" : out);
+    free(out);
+    return(ret);
+}
+
+/* main tests */
+int main(void) {
+    char option[GM_SMALLBUFSIZE];
+    char output[GM_BUFFERSIZE];
+    int rc;
+
+    plan(14);
+
+    mod_gm_opt = gm_malloc(sizeof(mod_gm_opt_t));
+    set_default_options(mod_gm_opt);
+    strcpy(option, "internal_checks=all");
+    parse_args_line(mod_gm_opt, option, 0);
+    test_create_objects(NUM_HOSTS, SERVICES_PER_HOST, "host%d", "service %d");
+    internal_checks_init();
+
+    /* check_dummy behaves like before */
+    cmp_ok(run_check("/usr/lib/monitoring-plugins/check_dummy 1 \"some warning\"", &rc, output, sizeof(output)), "==", GM_OK, "check_dummy answered internally");
+    ok(rc == 1 && !strcmp(output, "WARNING: some warning\n"), "check_dummy state and output");
+    cmp_ok(run_check("/usr/lib/monitoring-plugins/check_dummy 0 \"$(reboot)\"", &rc, output, sizeof(output)), "==", GM_ERROR, "check_dummy with shell characters is executed by a worker");
+    cmp_ok(run_check("/usr/lib/monitoring-plugins/check_dummy 7", &rc, output, sizeof(output)), "==", GM_OK, "check_dummy with unsupported state");
+    ok(rc == 3 && !strcmp(output, "UNKNOWN: Status 7 is not a supported error state"), "unsupported state is unknown");
+
+    /* constant checks */
+    run_check("/bin/false", &rc, output, sizeof(output));
+    cmp_ok(rc, "==", 1, "false is answered internally");
+    cmp_ok(run_check("/bin/true --help", &rc, output, sizeof(output)), "==", GM_ERROR, "true with arguments is executed by a worker");
+
+    /* copy state from another object */
+    service_ary[3]->has_been_checked = TRUE;
+    service_ary[3]->current_state    = STATE_CRITICAL;
+    service_ary[3]->plugin_output    = "disk full";
+    service_ary[3]->perf_data        = "used=100%";
+    run_check("check_copy_state host1 'service 1'", &rc, output, sizeof(output));
+    ok(rc == 2 && !strcmp(output, "disk full|used=100%\n"), "service state copied");
+    service_ary[3]->current_state    = STATE_OK;
+    service_ary[3]->plugin_output    = "disk ok";
+    service_ary[3]->perf_data        = NULL;
+    run_check("check_copy_state host1 'service 1'", &rc, output, sizeof(output));
+    ok(rc == 0 && !strcmp(output, "disk ok\n"), "cached check follows the source object");
+    host_ary[1]->has_been_checked = TRUE;
+    host_ary[1]->current_state    = STATE_DOWN;
+    host_ary[1]->plugin_output    = "PING CRITICAL";
+    run_check("check_copy_state host1", &rc, output, sizeof(output));
+    ok(rc == 2 && !strcmp(output, "PING CRITICAL\n"), "host down copied as critical");
+    run_check("check_copy_state host9", &rc, output, sizeof(output));
+    ok(rc == 3 && !strcmp(output, "UNKNOWN: host host9 does not exist\n"), "missing source object is unknown");
+
+    /* disabled handlers and other commands */
+    cmp_ok(run_check("/usr/lib/monitoring-plugins/check_ping -H localhost", &rc, output, sizeof(output)), "==", GM_ERROR, "other commands are executed by a worker");
+    strcpy(option, "internal_checks=check_dummy");
+    parse_args_line(mod_gm_opt, option, 0);
+    cmp_ok(run_check("/bin/true", &rc, output, sizeof(output)), "==", GM_ERROR, "disabled handler is executed by a worker");
+
+    ok(internal_checks_served(GM_INTERNAL_CHECK_DUMMY) == 2
+       && internal_checks_served(GM_INTERNAL_CHECK_CONSTANT) == 1
+       && internal_checks_served(GM_INTERNAL_CHECK_COPY_STATE) == 4, "checks served per handler");
+
+    internal_checks_free();
+    test_free_objects();
+    mod_gm_free_opt(mod_gm_opt);
+    return exit_status();
+}
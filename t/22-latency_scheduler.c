@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <t/tap.h>
+#include <t/test_naemon_stubs.h>
+#include <common.h>
+#include <utils.h>
+#include <latency_scheduler.h>
+
+#include <worker_dummy_functions.c>
+
+#include <libgearman/gearman.h>
+
+mod_gm_opt_t *mod_gm_opt;
+char hostname[GM_SMALLBUFSIZE];
+gearman_client_st *current_client;
+gearman_client_st *current_client_dup;
+
+#define NUM_CHECKS      10000
+#define WINDOW          30
+#define CAPACITY        500     /* checks per second the workers can handle */
+#define START           1000000
+
+/* background load, every 3rd second is busy */
+static unsigned int background(int second) {
+    return(second % 3 == 0 ? 300 : 50);
+}
+
+/* highest submissions per second */
+static unsigned int max_load(unsigned int * load, int num) {
+    unsigned int max = 0;
+    int x;
+    for(x = 0; x < num; x++)
+        if(load[x] > max)
+            max = load[x];
+    return(max);
+}
+
+/* 99th percentile queue wait in milliseconds if workers handle CAPACITY checks per second */
+static int p99_wait(unsigned int * load, int num) {
+    unsigned long waits[WINDOW * 40];
+    unsigned long backlog = 0, total = 0, sum = 0;
+    int x;
+    memset(waits, 0, sizeof(waits));
+    for(x = 0; x < num; x++) {
+        /* checks submitted in this second wait for the backlog in front of them */
+        waits[backlog * 10 / CAPACITY] += load[x];
+        total   += load[x];
+        backlog += load[x];
+        backlog  = backlog > CAPACITY ? backlog - CAPACITY : 0;
+    }
+    for(x = 0; x < num * 10; x++) {
+        sum += waits[x];
+        if(sum >= total * 99 / 100)
+            return(x * 100);
+    }
+    return(num * 1000);
+}
+
+/* main tests */
+int main(void) {
+    unsigned int random_load[WINDOW * 4];
+    unsigned int wheel_load[WINDOW * 4];
+    unsigned int random_max, wheel_max;
+    time_t when;
+    unsigned int y;
+    int x, errors;
+
+    plan(8);
+
+    mod_gm_opt = gm_malloc(sizeof(mod_gm_opt_t));
+    set_default_options(mod_gm_opt);
+
+    latency_scheduler_init(START);
+    latency_scheduler_add("service", START + 5);
+    latency_scheduler_add("service", START + 5);
+    cmp_ok(latency_scheduler_load("service", START + 5), "==", 2, "submissions counted per second");
+    cmp_ok(latency_scheduler_load("host", START + 5), "==", 0, "queues are counted separately");
+    cmp_ok(latency_scheduler_place("service", START + 4, 3), "==", START + 6, "postponed into the first free second");
+    latency_scheduler_advance(START + 6);
+    cmp_ok(latency_scheduler_load("service", START + 5), "==", 0, "elapsed seconds are forgotten");
+    latency_scheduler_add("service", START + LATENCY_WHEEL_SIZE + 5);
+    cmp_ok(latency_scheduler_load("service", START + LATENCY_WHEEL_SIZE + 5), "==", 1, "slots are reused after the wheel wrapped");
+
+    /* outage: all checks are overdue and postponed at once on top of some background load */
+    memset(random_load, 0, sizeof(random_load));
+    memset(wheel_load, 0, sizeof(wheel_load));
+    latency_scheduler_init(START);
+    for(x = 0; x < WINDOW * 4; x++) {
+        random_load[x] = background(x);
+        wheel_load[x]  = background(x);
+        for(y = 0; y < background(x); y++)
+            latency_scheduler_add("service", START + x);
+    }
+    srand(1);
+    errors = 0;
+    for(x = 0; x < NUM_CHECKS; x++) {
+        random_load[1 + rand() % WINDOW]++;
+        when = latency_scheduler_place("service", START, WINDOW);
+        if(when <= START || when > START + WINDOW)
+            errors++;
+        else
+            wheel_load[when - START]++;
+    }
+    cmp_ok(errors, "==", 0, "postponed checks stay within the window");
+
+    random_max = max_load(random_load, WINDOW * 4);
+    wheel_max  = max_load(wheel_load, WINDOW * 4);
+    diag("max submissions/s: random %u, wheel %u", random_max, wheel_max);
+    ok(wheel_max < random_max, "load aware placement is flatter than random postponement");
+    diag("p99 wait at %d checks/s: random %dms, wheel %dms", CAPACITY, p99_wait(random_load, WINDOW * 4), p99_wait(wheel_load, WINDOW * 4));
+    ok(p99_wait(wheel_load, WINDOW * 4) < p99_wait(random_load, WINDOW * 4), "p99 wait lower than with random postponement");
+
+    latency_scheduler_free();
+    mod_gm_free_opt(mod_gm_opt);
+    return exit_status();
+}
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <t/tap.h>
+#include <t/test_naemon_stubs.h>
+#include <common.h>
+#include <utils.h>
+#include <inflight.h>
+
+#include <worker_dummy_functions.c>
+
+#include <libgearman/gearman.h>
+
+mod_gm_opt_t *mod_gm_opt;
+char hostname[GM_SMALLBUFSIZE];
+gearman_client_st *current_client;
+gearman_client_st *current_client_dup;
+
+#define NUM_HOSTS           10
+#define SERVICES_PER_HOST   10
+#define NUM_SERVICES        (NUM_HOSTS * SERVICES_PER_HOST)
+#define START               1000000
+
+/* orphans reported by the table */
+static int orphans = 0;
+static char last_orphan[GM_BUFFERSIZE];
+
+static void orphan(host * hst, service * svc, const char * queue) {
+    orphans++;
+    snprintf(last_orphan, sizeof(last_orphan), "%s;%s;%s", hst->name, svc == NULL ? "" : svc->description, queue);
+}
+
+/* main tests */
+int main(void) {
+    int x;
+
+    plan(11);
+
+    mod_gm_opt = gm_malloc(sizeof(mod_gm_opt_t));
+    set_default_options(mod_gm_opt);
+
+    test_create_objects(NUM_HOSTS, SERVICES_PER_HOST, "host%d", "service%d");
+
+    inflight_init(START);
+    for(x = 0; x < NUM_SERVICES; x++)
+        inflight_add(service_ary[x]->host_ptr, service_ary[x], x < 60 ? "service" : "hostgroup_a", START + 60);
+    inflight_add(host_ary[1], NULL, "host", START + 30);
+    cmp_ok(inflight_count(NULL), "==", NUM_SERVICES + 1, "all jobs in flight");
+    cmp_ok(inflight_count("service"), "==", 60, "jobs in flight per queue");
+    cmp_ok(inflight_count("hostgroup_a"), "==", 40, "jobs in flight for another queue");
+
+    /* results remove jobs */
+    ok(inflight_remove("host1", "service1") == TRUE, "result removes service job");
+    ok(inflight_remove("host1", "service1") == FALSE, "duplicate result is ignored");
+    ok(inflight_remove("host1", NULL) == TRUE, "result removes host job");
+
+    /* resubmitting replaces the job */
+    inflight_add(service_ary[2]->host_ptr, service_ary[2], "hostgroup_a", START + 10);
+    cmp_ok(inflight_count("service"), "==", 58, "resubmitted job moved to the new queue");
+
+    /* deadlines */
+    cmp_ok(inflight_expire(START + 9, orphan), "==", 0, "nothing overdue before the deadline");
+    cmp_ok(inflight_expire(START + 10, orphan), "==", 1, "job orphaned at its deadline");
+    is(last_orphan, "host0;service2;hostgroup_a", "orphan callback gets object and queue");
+
+    /* deadlines after one round of the wheel */
+    inflight_add(service_ary[2]->host_ptr, service_ary[2], "service", START + 10 + INFLIGHT_WHEEL_SIZE + 5);
+    inflight_expire(START + 70, orphan);
+    cmp_ok(orphans, "==", 1 + NUM_SERVICES - 2, "far deadlines survive a round of the wheel");
+
+    inflight_free();
+    test_free_objects();
+    mod_gm_free_opt(mod_gm_opt);
+    return exit_status();
+}
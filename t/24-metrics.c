@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <t/tap.h>
+#include <t/test_naemon_stubs.h>
+#include <common.h>
+#include <utils.h>
+#include <gm_buffer.h>
+#include <metrics.h>
+
+#include <worker_dummy_functions.c>
+
+#include <libgearman/gearman.h>
+
+mod_gm_opt_t *mod_gm_opt;
+char hostname[GM_SMALLBUFSIZE];
+gearman_client_st *current_client;
+gearman_client_st *current_client_dup;
+
+/* statistics of the submit threads and the spool */
+int submit_queue_length   = 3;
+int spool_jobs            = 7;
+unsigned long spool_bytes = 2048;
+
+/* read everything the metrics socket returns */
+static void scrape(const char * path, const char * request, char * response, size_t size) {
+    struct sockaddr_un addr;
+    size_t len = 0;
+    ssize_t ret;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    response[0] = '\0';
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return;
+    }
+    if(request != NULL && write(fd, request, strlen(request)) < 0) {
+        close(fd);
+        return;
+    }
+    while(len < size - 1 && (ret = read(fd, response + len, size - 1 - len)) > 0)
+        len += ret;
+    response[len] = '\0';
+    close(fd);
+}
+
+/* main tests */
+int main(void) {
+    char option[GM_BUFFERSIZE];
+    char path[GM_SMALLBUFSIZE];
+    char * response;
+    gm_buffer_t * buf;
+    struct stat st;
+    int x;
+
+    plan(13);
+
+    mod_gm_opt = gm_malloc(sizeof(mod_gm_opt_t));
+    set_default_options(mod_gm_opt);
+
+    for(x = 0; x < 10; x++)
+        metrics_submit("service", TRUE, 200);
+    metrics_submit("service", FALSE, 2000000);
+    metrics_submit("host", TRUE, 50);
+    for(x = 0; x < 5; x++) {
+        metrics_result_received();
+        metrics_result_added();
+    }
+    metrics_results_injected(3, 1500);
+
+    buf = gm_buffer_new();
+    metrics_render(buf);
+    ok(strstr(buf->data, "mod_gearman_submit_jobs_total{queue=\"service\"} 10\n") != NULL, "submitted jobs per queue");
+    ok(strstr(buf->data, "mod_gearman_submit_errors_total{queue=\"service\"} 1\n") != NULL, "submit errors per queue");
+    ok(strstr(buf->data, "mod_gearman_submit_jobs_total{queue=\"host\"} 1\n") != NULL, "queues are counted separately");
+    ok(strstr(buf->data, "mod_gearman_submit_duration_seconds_bucket{queue=\"service\",le=\"0.0005\"} 10\n") != NULL, "histogram buckets are cumulative");
+    ok(strstr(buf->data, "mod_gearman_submit_duration_seconds_count{queue=\"service\"} 11\n") != NULL, "histogram count");
+    ok(strstr(buf->data, "mod_gearman_result_backlog 2\n") != NULL, "result backlog");
+    ok(strstr(buf->data, "mod_gearman_result_injection_seconds_sum 0.001500\n") != NULL, "injection time");
+    ok(strstr(buf->data, "mod_gearman_spool_jobs 7\n") != NULL, "spool depth");
+    gm_buffer_free(&buf);
+
+    /* serve them on a socket */
+    snprintf(path, sizeof(path), "/tmp/mod_gearman_metrics_test.%d.sock", (int)getpid());
+    snprintf(option, sizeof(option), "metrics_socket=%s", path);
+    parse_args_line(mod_gm_opt, option, 0);
+    cmp_ok(start_metrics(), "==", GM_OK, "metrics socket started");
+    ok(stat(path, &st) == 0 && (st.st_mode & 0777) == 0660, "socket mode does not depend on the umask");
+
+    response = gm_malloc(GM_BUFFERSIZE * 4);
+    scrape(path, NULL, response, GM_BUFFERSIZE * 4);
+    ok(strncmp(response, "# HELP mod_gearman_submit_jobs_total", 36) == 0, "plain clients get the metrics");
+    scrape(path, "GET /metrics HTTP/1.0\r\n\r\n", response, GM_BUFFERSIZE * 4);
+    ok(strncmp(response, "HTTP/1.0 200 OK\r\n", 17) == 0 && strstr(response, "mod_gearman_results_received_total 5\n") != NULL, "http clients get a http response");
+    gm_free(response);
+
+    stop_metrics();
+
+    /* queue names are freed and created again on next use */
+    metrics_free();
+    metrics_submit("host", TRUE, 50);
+    buf = gm_buffer_new();
+    metrics_render(buf);
+    ok(strstr(buf->data, "mod_gearman_submit_jobs_total{queue=\"host\"} 1\n") != NULL && strstr(buf->data, "queue=\"service\"") == NULL, "statistics freed");
+    gm_buffer_free(&buf);
+    metrics_free();
+
+    mod_gm_free_opt(mod_gm_opt);
+    return exit_status();
+}
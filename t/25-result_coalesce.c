@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <t/tap.h>
+#include <t/test_naemon_stubs.h>
+#include <common.h>
+#include <utils.h>
+#include <result_coalesce.h>
+
+#include <worker_dummy_functions.c>
+
+#include <libgearman/gearman.h>
+
+mod_gm_opt_t *mod_gm_opt;
+char hostname[GM_SMALLBUFSIZE];
+gearman_client_st *current_client;
+gearman_client_st *current_client_dup;
+
+/* fake core objects */
+host fake_host = { .name = "host1" };
+service fake_service = { .host_name = "host1", .description = "disk" };
+
+host * find_host(const char * name) {
+    if(!strcmp(name, fake_host.name))
+        return(&fake_host);
+    return(NULL);
+}
+service * find_service(const char * host_name, const char * description) {
+    if(!strcmp(host_name, fake_service.host_name) && !strcmp(description, fake_service.description))
+        return(&fake_service);
+    return(NULL);
+}
+
+#define NUM_RESULTS 6
+
+static check_result results[NUM_RESULTS];
+
+static void set_result(int x, int type, const char * host_name, const char * description, int finish, int rc) {
+    memset(&results[x], 0, sizeof(check_result));
+    results[x].object_check_type   = type;
+    results[x].host_name           = (char *)host_name;
+    results[x].service_description = (char *)description;
+    results[x].finish_time.tv_sec  = finish;
+    results[x].return_code         = rc;
+}
+
+/* create a batch: three disk results out of order, two host results and one other service */
+static void create_batch(check_result ** list, int disk_rc_old) {
+    int x;
+    set_result(0, SERVICE_CHECK, "host1", "disk", 20, 0);
+    set_result(1, HOST_CHECK,    "host1", NULL,   10, 0);
+    set_result(2, SERVICE_CHECK, "host1", "disk", 10, disk_rc_old);
+    set_result(3, SERVICE_CHECK, "host1", "load", 10, 0);
+    set_result(4, HOST_CHECK,    "host1", NULL,   11, 0);
+    set_result(5, SERVICE_CHECK, "host1", "disk", 15, 0);
+    for(x = 0; x < NUM_RESULTS; x++)
+        list[x] = &results[x];
+}
+
+/* main tests */
+int main(void) {
+    check_result * list[NUM_RESULTS];
+    check_result * single;
+
+    plan(13);
+
+    mod_gm_opt = gm_malloc(sizeof(mod_gm_opt_t));
+    set_default_options(mod_gm_opt);
+
+    /* nothing to do for a single result */
+    single = &results[0];
+    cmp_ok(result_coalesce(&single, 1, TRUE), "==", 1, "single result is kept");
+
+    /* newest result per object wins */
+    create_batch(list, 0);
+    cmp_ok(result_coalesce(list, NUM_RESULTS, FALSE), "==", 3, "three objects remain");
+    ok(list[0] == &results[0] && list[1] == &results[3] && list[2] == &results[4], "newest results kept in arrival order");
+    ok(list[3] == &results[1] && list[4] == &results[2] && list[5] == &results[5], "dropped results behind the kept ones");
+
+    /* identical finish times keep the last received result */
+    set_result(0, SERVICE_CHECK, "host1", "disk", 10, 2);
+    set_result(1, SERVICE_CHECK, "host1", "disk", 10, 1);
+    list[0] = &results[0];
+    list[1] = &results[1];
+    cmp_ok(result_coalesce(list, 2, FALSE), "==", 1, "duplicate result dropped");
+    ok(list[0] == &results[1], "last received result wins on identical finish time");
+
+    /* state changes are kept on request */
+    fake_service.current_state = STATE_OK;
+    create_batch(list, 2);
+    cmp_ok(result_coalesce(list, NUM_RESULTS, TRUE), "==", 5, "critical and recovery kept");
+    ok(list[0] == &results[2] && list[1] == &results[5] && list[2] == &results[3] && list[3] == &results[4] && list[4] == &results[0],
+       "state changes ordered by finish time in the arrival positions of the object");
+    create_batch(list, 2);
+    cmp_ok(result_coalesce(list, NUM_RESULTS, FALSE), "==", 3, "state changes dropped if disabled");
+
+    /* unchanged state is still coalesced */
+    fake_service.current_state = STATE_CRITICAL;
+    set_result(0, SERVICE_CHECK, "host1", "disk", 10, 2);
+    set_result(1, SERVICE_CHECK, "host1", "disk", 11, 2);
+    set_result(2, SERVICE_CHECK, "host1", "disk", 12, 2);
+    list[0] = &results[0];
+    list[1] = &results[1];
+    list[2] = &results[2];
+    cmp_ok(result_coalesce(list, 3, TRUE), "==", 1, "repeated critical results coalesced");
+
+    /* results arriving in reverse order, the newest result has to be injected last */
+    fake_service.current_state = STATE_OK;
+    set_result(0, SERVICE_CHECK, "host1", "disk", 30, 0);
+    set_result(1, SERVICE_CHECK, "host1", "disk", 20, 2);
+    set_result(2, SERVICE_CHECK, "host1", "disk", 10, 1);
+    list[0] = &results[0];
+    list[1] = &results[1];
+    list[2] = &results[2];
+    cmp_ok(result_coalesce(list, 3, TRUE), "==", 3, "all state changes kept");
+    ok(list[0] == &results[2] && list[1] == &results[1] && list[2] == &results[0], "reverse arrival is injected oldest first");
+    list[0] = &results[0];
+    list[1] = &results[1];
+    list[2] = &results[2];
+    ok(result_coalesce(list, 3, FALSE) == 1 && list[0] == &results[0], "newest result kept from reverse arrival");
+
+    mod_gm_free_opt(mod_gm_opt);
+    return exit_status();
+}
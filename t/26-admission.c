@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <t/tap.h>
+#include <t/test_naemon_stubs.h>
+#include <common.h>
+#include <utils.h>
+#include <gm_buffer.h>
+#include <metrics.h>
+#include <admission.h>
+
+#include <worker_dummy_functions.c>
+
+#include <libgearman/gearman.h>
+
+mod_gm_opt_t *mod_gm_opt;
+char hostname[GM_SMALLBUFSIZE];
+gearman_client_st *current_client;
+gearman_client_st *current_client_dup;
+
+/* statistics of the submit threads and the spool */
+int submit_queue_length   = 0;
+int spool_jobs            = 0;
+unsigned long spool_bytes = 0;
+
+/* main tests */
+int main(void) {
+    char option[GM_SMALLBUFSIZE];
+    gm_buffer_t * buf;
+    int x;
+
+    plan(16);
+
+    mod_gm_opt = gm_malloc(sizeof(mod_gm_opt_t));
+    set_default_options(mod_gm_opt);
+
+    /* wait time estimation */
+    cmp_ok(admission_estimate_wait(0, 100, 10, 50, 2), "==", 0, "empty queue has no wait");
+    cmp_ok(admission_estimate_wait(100, 100, 50, 0, 2), "==", 4, "100 waiting, 25 drained per second");
+    cmp_ok(admission_estimate_wait(120, 100, 20, 6, 2), "==", 8, "stuck queue ages with every poll");
+
+    /* overload decision */
+    ok(admission_overloaded(FALSE, 5000, 0, 0, 0, 0) == FALSE, "no limits configured");
+    ok(admission_overloaded(FALSE, 1, 0, 0, 1000, 0) == TRUE, "jobs without workers");
+    ok(admission_overloaded(FALSE, 1001, 5, 0, 1000, 0) == TRUE, "depth exceeded");
+    ok(admission_overloaded(FALSE, 10, 5, 61, 0, 60) == TRUE, "age exceeded");
+    ok(admission_overloaded(TRUE, 600, 5, 0, 1000, 0) == TRUE, "stays overloaded above half of the limit");
+    ok(admission_overloaded(TRUE, 400, 5, 0, 1000, 0) == FALSE, "recovers below half of the limit");
+
+    /* disabled admission control always enqueues */
+    cmp_ok(admission_check("service"), "==", GM_ADMISSION_ENQUEUE, "disabled admission control enqueues");
+
+    strcpy(option, "admission_max_queue_depth=1000");
+    parse_args_line(mod_gm_opt, option, 0);
+    strcpy(option, "admission_policy=postpone");
+    parse_args_line(mod_gm_opt, option, 0);
+    cmp_ok(mod_gm_opt->admission_policy, "==", GM_ADMISSION_POSTPONE, "admission_policy parsed");
+
+    /* unknown queues are admitted and tracked from now on */
+    for(x = 0; x < 500; x++)
+        admission_check("service");
+    admission_update("service", 2000, 5, 2);
+    cmp_ok(admission_check("service"), "==", GM_ADMISSION_POSTPONE, "overloaded queue is postponed");
+    cmp_ok(admission_check("hostgroup_dmz"), "==", GM_ADMISSION_ENQUEUE, "other queues are not affected");
+
+    /* queue drains */
+    admission_update("service", 300, 5, 2);
+    cmp_ok(admission_check("service"), "==", GM_ADMISSION_ENQUEUE, "drained queue is admitted again");
+
+    /* decisions are counted */
+    strcpy(option, "admission_policy=local");
+    parse_args_line(mod_gm_opt, option, 0);
+    admission_update("service", 2000, 5, 2);
+    admission_check("service");
+    admission_check("service");
+    buf = gm_buffer_new();
+    metrics_render(buf);
+    like(buf->data, "mod_gearman_admission_total\\{queue=\"service\",decision=\"postpone\"\\} 1", "postponed check counted");
+    like(buf->data, "mod_gearman_admission_total\\{queue=\"service\",decision=\"local\"\\} 2", "local checks counted");
+    gm_buffer_free(&buf);
+
+    stop_admission();
+    mod_gm_free_opt(mod_gm_opt);
+    return exit_status();
+}
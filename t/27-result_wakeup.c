@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <t/tap.h>
+#include <t/test_naemon_stubs.h>
+#include <common.h>
+#include <utils.h>
+
+#include <worker_dummy_functions.c>
+
+#include <libgearman/gearman.h>
+
+mod_gm_opt_t *mod_gm_opt;
+char hostname[GM_SMALLBUFSIZE];
+gearman_client_st *current_client;
+gearman_client_st *current_client_dup;
+
+/*
+ * Performance comparison only, the result worker waits for gearmand on the
+ * server connection. A pipe stands in for that connection here, so both the
+ * old sleep based loop and the poll() based loop can be measured without a
+ * running gearmand. Timings are reported, not tested.
+ */
+#define NUM_JOBS        25
+#define JOB_INTERVAL    13000   /* us between two submitted results */
+#define POLL_SLEEP      100000  /* us, the old result worker sleep */
+
+static int job_pipe[2];
+static double submitted[NUM_JOBS];
+static double latency[NUM_JOBS];
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return((double)tv.tv_sec + (double)tv.tv_usec / 1000000);
+}
+
+/* submit results at a steady rate */
+static void *producer(void * data) {
+    int x;
+    char c = 'j';
+    (void)data;
+    for(x = 0; x < NUM_JOBS; x++) {
+        usleep(JOB_INTERVAL);
+        submitted[x] = now();
+        if(write(job_pipe[1], &c, 1) != 1)
+            break;
+    }
+    return(NULL);
+}
+
+/* old loop: try to fetch a job, sleep 100ms if there is none */
+static int consume_sleeping(void) {
+    int received = 0;
+    char c;
+    while(received < NUM_JOBS) {
+        if(read(job_pipe[0], &c, 1) == 1) {
+            latency[received] = now() - submitted[received];
+            received++;
+            continue;
+        }
+        if(errno != EAGAIN)
+            break;
+        usleep(POLL_SLEEP);
+    }
+    return(received);
+}
+
+/* new loop: try to fetch a job, sleep in poll() until the server wakes us up */
+static int consume_polling(void) {
+    int received = 0;
+    char c;
+    struct pollfd pfd;
+    pfd.fd     = job_pipe[0];
+    pfd.events = POLLIN;
+    while(received < NUM_JOBS) {
+        if(read(job_pipe[0], &c, 1) == 1) {
+            latency[received] = now() - submitted[received];
+            received++;
+            continue;
+        }
+        if(errno != EAGAIN)
+            break;
+        if(poll(&pfd, 1, 30000) < 0)
+            break;
+    }
+    return(received);
+}
+
+/* run one consumer against the producer and return the average latency in ms */
+static double measure(int (*consume)(void), int * received, double * max) {
+    pthread_t thr;
+    double sum = 0;
+    int x;
+
+    if(pipe(job_pipe) != 0)
+        return(-1);
+    fcntl(job_pipe[0], F_SETFL, fcntl(job_pipe[0], F_GETFL) | O_NONBLOCK);
+
+    pthread_create(&thr, NULL, producer, NULL);
+    *received = consume();
+    pthread_join(thr, NULL);
+    close(job_pipe[0]);
+    close(job_pipe[1]);
+
+    *max = 0;
+    for(x = 0; x < *received; x++) {
+        sum += latency[x];
+        if(latency[x] > *max)
+            *max = latency[x];
+    }
+    *max *= 1000;
+    return(*received > 0 ? sum / *received * 1000 : -1);
+}
+
+/* main tests */
+int main(void) {
+    int received_sleeping, received_polling;
+    double avg_sleeping, avg_polling, max_sleeping, max_polling;
+
+    plan(2);
+
+    avg_sleeping = measure(consume_sleeping, &received_sleeping, &max_sleeping);
+    avg_polling  = measure(consume_polling,  &received_polling,  &max_polling);
+
+    cmp_ok(received_sleeping, "==", NUM_JOBS, "sleeping loop received all results");
+    cmp_ok(received_polling,  "==", NUM_JOBS, "polling loop received all results");
+    diag("%d results every %dms: usleep loop avg %.3fms max %.3fms, poll loop avg %.3fms max %.3fms",
+         NUM_JOBS, JOB_INTERVAL/1000, avg_sleeping, max_sleeping, avg_polling, max_polling);
+
+    return exit_status();
+}
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <t/tap.h>
+#include <t/test_naemon_stubs.h>
+#include <common.h>
+#include <utils.h>
+#include <result_pool.h>
+
+#include <worker_dummy_functions.c>
+
+#include <libgearman/gearman.h>
+
+mod_gm_opt_t *mod_gm_opt;
+char hostname[GM_SMALLBUFSIZE];
+gearman_client_st *current_client;
+gearman_client_st *current_client_dup;
+
+#define NUM_RESULTS     100000
+#define BATCH_SIZE      200
+
+/* same as the core */
+int init_check_result(check_result *info) {
+    memset(info, 0, sizeof(*info));
+    return(OK);
+}
+int free_check_result(check_result *info) {
+    gm_free(info->host_name);
+    gm_free(info->service_description);
+    gm_free(info->output);
+    return(OK);
+}
+
+static const char * host_name = "host0815.example.com";
+static const char * service_description = "Disk /var/lib/mysql";
+static const char * output = "DISK OK - free space: /var/lib/mysql 31201 MB (73% inode=99%);| /var/lib/mysql=11417MB;34272;38556;0;42840";
+
+static double elapsed(struct timeval start) {
+    struct timeval end;
+    gettimeofday(&end, NULL);
+    return((end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0);
+}
+
+/* the result thread as before: malloc the result and strdup all strings */
+static void fill_malloc(check_result * cr) {
+    cr->host_name           = gm_strdup(host_name);
+    cr->service_description = gm_strdup(service_description);
+    cr->output              = gm_strdup(output);
+}
+
+/* the result thread now: strings go into the storage of the pooled result */
+static mod_gm_result_t * get_pooled(result_pool_t * pool) {
+    mod_gm_result_t * res = result_pool_get(pool);
+    size_t host_len = strlen(host_name), service_len = strlen(service_description), output_len = strlen(output);
+    result_pool_reserve(res, host_len + service_len + output_len + 3);
+    res->result.host_name           = result_pool_strdup(res, host_name, host_len);
+    res->result.service_description = result_pool_strdup(res, service_description, service_len);
+    res->result.output              = result_pool_strdup(res, output, output_len);
+    return(res);
+}
+
+/* core thread, gives back all results passed by the result thread */
+static mpsc_queue_t processed = MPSC_QUEUE_INITIALIZER;
+static int core_done = FALSE;
+static void *core_thread(void * data) {
+    mpsc_queue_node_t * node;
+    mpsc_queue_node_t * next;
+    int * received = (int *)data;
+    while(__atomic_load_n(received, __ATOMIC_RELAXED) < NUM_RESULTS) {
+        for(node = mpsc_queue_take_all(&processed); node != NULL; node = next) {
+            next = node->next;
+            result_pool_put(mpsc_queue_entry(node, mod_gm_result_t, node));
+            __atomic_add_fetch(received, 1, __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_store_n(&core_done, TRUE, __ATOMIC_RELEASE);
+    return(NULL);
+}
+
+/* main tests */
+int main(void) {
+    result_pool_t * pool;
+    mod_gm_result_t * batch[BATCH_SIZE];
+    mod_gm_result_t * res;
+    struct timeval start;
+    double malloc_time;
+    unsigned long allocs;
+    pthread_t thr;
+    char * big;
+    int x, y, received = 0;
+
+    plan(9);
+
+    mod_gm_opt = gm_malloc(sizeof(mod_gm_opt_t));
+    set_default_options(mod_gm_opt);
+
+    /* results are reused after the core gave them back */
+    pool = result_pool_new();
+    for(x = 0; x < BATCH_SIZE; x++)
+        batch[x] = get_pooled(pool);
+    cmp_ok(pool->allocs, "==", 2 * BATCH_SIZE, "first batch allocates result and string storage");
+    ok(!strcmp(batch[0]->result.host_name, host_name) && !strcmp(batch[0]->result.output, output)
+       && batch[0]->result.output >= batch[0]->strings && batch[0]->result.output < batch[0]->strings + batch[0]->strings_size, "strings are stored in the result");
+    for(x = 0; x < BATCH_SIZE; x++)
+        result_pool_put(batch[x]);
+    for(x = 0; x < BATCH_SIZE; x++)
+        batch[x] = get_pooled(pool);
+    ok(pool->allocs == 2 * BATCH_SIZE && pool->reused == BATCH_SIZE, "second batch reuses all results");
+
+    /* strings which do not fit are allocated and freed separately */
+    big = gm_malloc(GM_RESULT_POOL_STRINGS_MIN * 2);
+    memset(big, 'x', GM_RESULT_POOL_STRINGS_MIN * 2 - 1);
+    big[GM_RESULT_POOL_STRINGS_MIN * 2 - 1] = '\x0';
+    res = batch[0];
+    res->result.output = result_pool_strdup(res, big, strlen(big));
+    ok(strlen(res->result.output) == strlen(big) && (res->result.output < res->strings || res->result.output >= res->strings + res->strings_size), "too long output is allocated");
+
+    /* results with too much string storage are not kept */
+    res = batch[1];
+    res->strings_len = 0;
+    res->result.host_name = res->result.service_description = res->result.output = NULL;
+    result_pool_reserve(res, GM_RESULT_POOL_STRINGS_MAX + 1);
+    allocs = pool->reused;
+    for(x = 0; x < BATCH_SIZE; x++)
+        result_pool_put(batch[x]);
+    for(x = 0; x < BATCH_SIZE; x++)
+        batch[x] = get_pooled(pool);
+    cmp_ok(pool->reused - allocs, "==", BATCH_SIZE - 1, "large results are freed");
+    free(big);
+
+    /* the pool stays alive until the last result is back */
+    result_pool_close(pool);
+    cmp_ok(pool->refs, "==", BATCH_SIZE, "closed pool is kept for results in use");
+    for(x = 0; x < BATCH_SIZE; x++)
+        result_pool_put(batch[x]);
+
+    /* unpooled results */
+    res = result_pool_get(NULL);
+    res->result.output = gm_strdup(output);
+    result_pool_put(res);
+    ok(TRUE, "results without pool are freed");
+
+    /* result thread and core thread in parallel */
+    pool = result_pool_new();
+    pthread_create(&thr, NULL, core_thread, &received);
+    for(x = 0; x < NUM_RESULTS; x++) {
+        mpsc_queue_push(&processed, &get_pooled(pool)->node);
+        /* do not run away from the core */
+        while(x - __atomic_load_n(&received, __ATOMIC_RELAXED) > BATCH_SIZE * 5 && __atomic_load_n(&core_done, __ATOMIC_ACQUIRE) == FALSE)
+            ;
+    }
+    pthread_join(thr, NULL);
+    allocs = pool->allocs;
+    cmp_ok(received, "==", NUM_RESULTS, "all results returned by the core thread");
+    ok(allocs < NUM_RESULTS / 10, "results are recycled across threads");
+    result_pool_close(pool);
+
+    /* throughput of the old way for comparison, same thread */
+    gettimeofday(&start, NULL);
+    for(x = 0; x < NUM_RESULTS; x += BATCH_SIZE) {
+        for(y = 0; y < BATCH_SIZE; y++) {
+            batch[y] = gm_malloc(sizeof(mod_gm_result_t));
+            init_check_result(&batch[y]->result);
+            fill_malloc(&batch[y]->result);
+        }
+        for(y = 0; y < BATCH_SIZE; y++) {
+            free_check_result(&batch[y]->result);
+            free(batch[y]);
+        }
+    }
+    malloc_time = elapsed(start);
+    pool = result_pool_new();
+    gettimeofday(&start, NULL);
+    for(x = 0; x < NUM_RESULTS; x += BATCH_SIZE) {
+        for(y = 0; y < BATCH_SIZE; y++)
+            batch[y] = get_pooled(pool);
+        for(y = 0; y < BATCH_SIZE; y++)
+            result_pool_put(batch[y]);
+    }
+    diag("%d results: malloc %d allocations %.3fus/result, pooled %lu allocations %.3fus/result",
+         NUM_RESULTS, NUM_RESULTS * 4, malloc_time * 1000000 / NUM_RESULTS,
+         pool->allocs, elapsed(start) * 1000000 / NUM_RESULTS);
+    result_pool_close(pool);
+
+    mod_gm_free_opt(mod_gm_opt);
+    return exit_status();
+}
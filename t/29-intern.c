@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <t/tap.h>
+#include <t/test_naemon_stubs.h>
+#include <common.h>
+#include <utils.h>
+#include <intern.h>
+#include <result_pool.h>
+
+#include <worker_dummy_functions.c>
+
+#include <libgearman/gearman.h>
+
+mod_gm_opt_t *mod_gm_opt;
+char hostname[GM_SMALLBUFSIZE];
+gearman_client_st *current_client;
+gearman_client_st *current_client_dup;
+
+#define NUM_HOSTS           1000
+#define SERVICES_PER_HOST   10
+#define NUM_SERVICES        (NUM_HOSTS * SERVICES_PER_HOST)
+#define NUM_LOOKUPS         1000000
+
+/* same as the core */
+int init_check_result(check_result *info) {
+    memset(info, 0, sizeof(*info));
+    return(OK);
+}
+int free_check_result(check_result *info) {
+    gm_free(info->host_name);
+    gm_free(info->service_description);
+    gm_free(info->output);
+    return(OK);
+}
+
+static double elapsed(struct timeval start) {
+    struct timeval end;
+    gettimeofday(&end, NULL);
+    return((end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0);
+}
+
+/* main tests */
+int main(void) {
+    host * hst;
+    service * svc;
+    mod_gm_result_t * res;
+    struct timeval start;
+    double lookup_time, copy_time;
+    char * copy;
+    int x, found;
+
+    plan(8);
+
+    mod_gm_opt = gm_malloc(sizeof(mod_gm_opt_t));
+    set_default_options(mod_gm_opt);
+    test_create_objects(NUM_HOSTS, SERVICES_PER_HOST, "host%d", "service %d");
+
+    /* results are accepted until the table has been built */
+    ok(intern_lookup("host1", "service 2", &hst, &svc) == GM_OK && hst == NULL && svc == NULL, "all results accepted before init");
+
+    intern_init();
+    ok(intern_lookup("host17", NULL, &hst, &svc) == GM_OK && hst == host_ary[17] && svc == NULL, "host found");
+    ok(intern_lookup("host17", "service 3", &hst, &svc) == GM_OK && svc == service_ary[17 * SERVICES_PER_HOST + 3] && hst == host_ary[17], "service found");
+    ok(intern_lookup("host17", "service 3", &hst, &svc) == GM_OK && svc->description == service_ary[17 * SERVICES_PER_HOST + 3]->description, "service description is the one of the object");
+    ok(intern_lookup("host1000", NULL, &hst, &svc) == GM_ERROR && hst == NULL, "unknown host");
+    ok(intern_lookup("host17", "service 10", &hst, &svc) == GM_ERROR && intern_lookup("host17", "", &hst, &svc) == GM_ERROR, "unknown service");
+
+    found = 0;
+    for(x = 0; x < NUM_SERVICES; x++) {
+        if(intern_lookup(service_ary[x]->host_name, service_ary[x]->description, &hst, &svc) == GM_OK && svc == service_ary[x])
+            found++;
+    }
+    cmp_ok(found, "==", NUM_SERVICES, "all services found");
+
+    /* interned names are not freed with the result */
+    res = result_pool_get(NULL);
+    intern_lookup("host17", "service 3", &hst, &svc);
+    res->result.host_name           = hst->name;
+    res->result.service_description = svc->description;
+    res->result.output              = gm_strdup("OK");
+    res->interned                   = TRUE;
+    result_pool_put(res);
+    ok(!strcmp(host_ary[17]->name, "host17"), "interned names survive the result");
+
+    /* compare with copying the names, the core has to look them up again in that case */
+    gettimeofday(&start, NULL);
+    for(x = 0; x < NUM_LOOKUPS; x++) {
+        intern_lookup(service_ary[x % NUM_SERVICES]->host_name, service_ary[x % NUM_SERVICES]->description, &hst, &svc);
+    }
+    lookup_time = elapsed(start);
+    gettimeofday(&start, NULL);
+    for(x = 0; x < NUM_LOOKUPS; x++) {
+        copy = gm_strdup(service_ary[x % NUM_SERVICES]->host_name);
+        free(copy);
+        copy = gm_strdup(service_ary[x % NUM_SERVICES]->description);
+        free(copy);
+    }
+    copy_time = elapsed(start);
+    diag("%d services: lookup %.3fus/result, strdup of both names %.3fus/result", NUM_SERVICES, lookup_time * 1000000 / NUM_LOOKUPS, copy_time * 1000000 / NUM_LOOKUPS);
+
+    intern_free();
+    test_free_objects();
+    mod_gm_free_opt(mod_gm_opt);
+    return exit_status();
+}
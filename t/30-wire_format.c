@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <t/tap.h>
+#include <t/test_naemon_stubs.h>
+#include <common.h>
+#include <utils.h>
+#include <gm_crypt.h>
+#include <gm_payload.h>
+
+#include <worker_dummy_functions.c>
+
+#include <libgearman/gearman.h>
+
+mod_gm_opt_t *mod_gm_opt;
+char hostname[GM_SMALLBUFSIZE];
+gearman_client_st *current_client;
+gearman_client_st *current_client_dup;
+
+#define NUM_MESSAGES    100000
+
+static const char * host_name = "host0815.example.com";
+static const char * service_description = "Disk /var/lib/mysql";
+static const char * output = "DISK OK - free space: /var/lib/mysql 31201 MB (73% inode=99%);\\n/var/lib/mysql 31201 MB|/var/lib/mysql=11417MB;34272;38556;0;42840";
+static const long long start_time = 1760781234123456LL;
+
+static double elapsed(struct timeval start) {
+    struct timeval end;
+    gettimeofday(&end, NULL);
+    return((end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0);
+}
+
+/* same fields as send_result_back */
+static void build_result(gm_buffer_t * buf, int format) {
+    size_t offset;
+    gm_payload_begin(buf, format);
+    gm_payload_append(buf, GM_PAYLOAD_HOST_NAME, host_name);
+    gm_payload_append_time(buf, GM_PAYLOAD_CORE_START_TIME, start_time - 2000);
+    gm_payload_append_time(buf, GM_PAYLOAD_START_TIME, start_time);
+    gm_payload_append_time(buf, GM_PAYLOAD_FINISH_TIME, start_time + 21337);
+    gm_payload_append_int(buf, GM_PAYLOAD_RETURN_CODE, 0);
+    gm_payload_append_int(buf, GM_PAYLOAD_EXITED_OK, 1);
+    gm_payload_append(buf, GM_PAYLOAD_SOURCE, "Mod-Gearman Worker @ worker01.example.com");
+    gm_payload_append(buf, GM_PAYLOAD_SERVICE_DESCRIPTION, service_description);
+    offset = gm_payload_open(buf, GM_PAYLOAD_OUTPUT);
+    gm_buffer_append_str(buf, output);
+    gm_payload_close(buf, offset);
+    gm_payload_end(buf);
+}
+
+/* same as the result thread, returns the return code */
+static int decode_result(char * data, size_t size, struct timeval * finish) {
+    gm_payload_t payload;
+    long long rc = -1;
+    gm_payload_decode(&payload, data, size);
+    if(payload.value[GM_PAYLOAD_OUTPUT] != NULL && payload.format == GM_PAYLOAD_FORMAT_TEXT)
+        payload.len[GM_PAYLOAD_OUTPUT] = gm_payload_unescape(payload.value[GM_PAYLOAD_OUTPUT], payload.len[GM_PAYLOAD_OUTPUT]);
+    gm_payload_time(&payload, GM_PAYLOAD_FINISH_TIME, finish);
+    gm_payload_int(&payload, GM_PAYLOAD_RETURN_CODE, &rc);
+    return(rc);
+}
+
+/* encode and decode in one format, returns the bytes on the wire */
+static int benchmark(int format, EVP_CIPHER_CTX * ctx, int mode, double * encode_us, double * decode_us) {
+    gm_buffer_t * buf = gm_buffer_new();
+    struct timeval start, finish;
+    char * crypted;
+    char * data;
+    int x, size, wire = 0;
+
+    gettimeofday(&start, NULL);
+    for(x = 0; x < NUM_MESSAGES; x++) {
+        build_result(buf, format);
+        wire = mod_gm_encrypt(ctx, &crypted, buf->data, mode);
+        free(crypted);
+    }
+    *encode_us = elapsed(start) * 1000000 / NUM_MESSAGES;
+
+    mod_gm_encrypt(ctx, &crypted, buf->data, mode);
+    gettimeofday(&start, NULL);
+    for(x = 0; x < NUM_MESSAGES; x++) {
+        size = mod_gm_decrypt(ctx, &data, crypted, wire, mode);
+        decode_result(data, size, &finish);
+        free(data);
+    }
+    *decode_us = elapsed(start) * 1000000 / NUM_MESSAGES;
+
+    free(crypted);
+    gm_buffer_free(&buf);
+    return(wire);
+}
+
+/* main tests */
+int main(void) {
+    gm_buffer_t * text;
+    gm_buffer_t * binary;
+    gm_payload_t payload;
+    EVP_CIPHER_CTX * ctx;
+    struct timeval tv;
+    long long num;
+    char * crypted;
+    char * data;
+    char * copy;
+    int size, text_wire, binary_wire;
+    double text_encode, text_decode, binary_encode, binary_decode;
+
+    plan(17);
+
+    mod_gm_opt = gm_malloc(sizeof(mod_gm_opt_t));
+    set_default_options(mod_gm_opt);
+    ctx = mod_gm_crypt_init("test1234");
+
+    text   = gm_buffer_new();
+    binary = gm_buffer_new();
+    build_result(text, GM_PAYLOAD_FORMAT_TEXT);
+    build_result(binary, GM_PAYLOAD_FORMAT_BINARY);
+
+    /* format detection */
+    ok(!gm_payload_is_binary(text->data, text->len) && gm_payload_is_binary(binary->data, binary->len), "binary payloads are detected");
+    cmp_ok(gm_payload_size(binary->data), "==", binary->len, "size of binary payload with zero bytes");
+    cmp_ok(gm_payload_size(text->data), "==", text->len, "size of text payload");
+
+    /* both formats decode to the same values */
+    copy = gm_malloc(binary->len + 1);
+    memcpy(copy, binary->data, binary->len + 1);
+    gm_payload_decode(&payload, copy, binary->len);
+    cmp_ok(payload.found, "==", 9, "all binary values found");
+    ok(payload.format == GM_PAYLOAD_FORMAT_BINARY
+       && !strcmp(gm_payload_value(&payload, GM_PAYLOAD_HOST_NAME), host_name)
+       && !strcmp(gm_payload_value(&payload, GM_PAYLOAD_SERVICE_DESCRIPTION), service_description), "binary strings");
+    ok(gm_payload_time(&payload, GM_PAYLOAD_START_TIME, &tv) && tv.tv_sec == start_time / 1000000 && tv.tv_usec == start_time % 1000000, "binary timestamp keeps microseconds");
+    ok(gm_payload_int(&payload, GM_PAYLOAD_EXITED_OK, &num) && num == 1 && !gm_payload_int(&payload, GM_PAYLOAD_TIMEOUT, &num), "binary integers");
+    ok(strchr(gm_payload_value(&payload, GM_PAYLOAD_OUTPUT), '\n') != NULL && strstr(gm_payload_value(&payload, GM_PAYLOAD_OUTPUT), "\\n") == NULL, "binary output is sent raw");
+    free(copy);
+
+    gm_payload_decode(&payload, text->data, text->len);
+    ok(payload.format == GM_PAYLOAD_FORMAT_TEXT && gm_payload_time(&payload, GM_PAYLOAD_START_TIME, &tv) && tv.tv_sec == start_time / 1000000, "text payloads still work");
+    build_result(text, GM_PAYLOAD_FORMAT_TEXT);
+
+    /* transport with zero bytes in the payload */
+    size = mod_gm_encrypt(ctx, &crypted, binary->data, GM_ENCODE_AND_ENCRYPT);
+    size = mod_gm_decrypt(ctx, &data, crypted, size, GM_ENCODE_AND_ENCRYPT);
+    ok(size >= (int)binary->len && memcmp(data, binary->data, binary->len) == 0 && decode_result(data, size, &tv) == 0, "encrypted binary payload");
+    free(crypted);
+    free(data);
+    size = mod_gm_encrypt(NULL, &crypted, binary->data, GM_ENCODE_ONLY);
+    size = mod_gm_decrypt(ctx, &data, crypted, size, GM_ENCODE_ACCEPT_ALL);
+    ok(size >= (int)binary->len && memcmp(data, binary->data, binary->len) == 0 && decode_result(data, size, &tv) == 0, "clear binary payload is accepted");
+    free(crypted);
+    free(data);
+
+    /* broken payloads */
+    copy = gm_malloc(binary->len + 1);
+    memcpy(copy, binary->data, binary->len + 1);
+    ok(!gm_payload_is_binary(copy, binary->len - 1), "truncated payload is no binary payload");
+    copy[GM_PAYLOAD_MAGIC_SIZE] = GM_PAYLOAD_VERSION + 1;
+    cmp_ok(gm_payload_decode(&payload, copy, binary->len), "==", 0, "unknown version is rejected");
+    memcpy(copy, binary->data, binary->len + 1);
+    copy[GM_PAYLOAD_HEADER_SIZE + 1] = 0x7f;
+    cmp_ok(gm_payload_decode(&payload, copy, binary->len), "==", 0, "broken record is rejected");
+    memcpy(copy, binary->data, binary->len + 1);
+    copy[GM_PAYLOAD_HEADER_SIZE] = 0x7e;
+    cmp_ok(gm_payload_decode(&payload, copy, binary->len), "==", 8, "unknown keys are skipped");
+    free(copy);
+
+    /* cost and size compared to the text format */
+    text_wire   = benchmark(GM_PAYLOAD_FORMAT_TEXT, ctx, GM_ENCODE_AND_ENCRYPT, &text_encode, &text_decode);
+    binary_wire = benchmark(GM_PAYLOAD_FORMAT_BINARY, ctx, GM_ENCODE_AND_ENCRYPT, &binary_encode, &binary_decode);
+    diag("aes: text %zu bytes, %d on the wire, encode %.3fus decode %.3fus; binary %zu bytes, %d on the wire, encode %.3fus decode %.3fus",
+         text->len, text_wire, text_encode, text_decode, binary->len, binary_wire, binary_encode, binary_decode);
+    ok(binary_wire < text_wire, "binary results are smaller");
+    text_wire   = benchmark(GM_PAYLOAD_FORMAT_TEXT, NULL, GM_ENCODE_ONLY, &text_encode, &text_decode);
+    binary_wire = benchmark(GM_PAYLOAD_FORMAT_BINARY, NULL, GM_ENCODE_ONLY, &binary_encode, &binary_decode);
+    diag("base64: text %d on the wire, encode %.3fus decode %.3fus; binary %d on the wire, encode %.3fus decode %.3fus",
+         text_wire, text_encode, text_decode, binary_wire, binary_encode, binary_decode);
+    ok(binary_decode < text_decode, "binary results decode faster");
+
+    gm_buffer_free(&text);
+    gm_buffer_free(&binary);
+    mod_gm_crypt_deinit(ctx);
+    mod_gm_free_opt(mod_gm_opt);
+    return exit_status();
+}
@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <t/tap.h>
+#include <t/test_naemon_stubs.h>
+#include <common.h>
+#include <utils.h>
+#include <result_scale.h>
+
+#include <worker_dummy_functions.c>
+
+#include <libgearman/gearman.h>
+
+mod_gm_opt_t *mod_gm_opt;
+char hostname[GM_SMALLBUFSIZE];
+gearman_client_st *current_client;
+gearman_client_st *current_client_dup;
+
+int main(void) {
+    plan(16);
+
+    /* growing */
+    cmp_ok(result_threads_target(4, 2, 16, 401, 0.5), "==", 6, "backlog grows by half of the pool");
+    cmp_ok(result_threads_target(4, 2, 16, 0, 0.9), "==", 6, "busy threads grow the pool");
+    cmp_ok(result_threads_target(1, 1, 16, 101, 0), "==", 2, "small pools grow by at least one thread");
+    cmp_ok(result_threads_target(14, 2, 16, 5000, 1), "==", 16, "growth is clamped to the maximum");
+    cmp_ok(result_threads_target(16, 2, 16, 5000, 1), "==", 16, "no growth beyond the maximum");
+
+    /* shrinking */
+    cmp_ok(result_threads_target(6, 2, 16, 0, 0.1), "==", 5, "idle pool shrinks by one thread");
+    cmp_ok(result_threads_target(2, 2, 16, 0, 0), "==", 2, "no shrinking below the minimum");
+    cmp_ok(result_threads_target(1, 2, 16, 0, 0.5), "==", 2, "pool below the minimum is raised to it");
+
+    /* hysteresis between the low and the high busy mark */
+    cmp_ok(result_threads_target(6, 2, 16, 0, 0.5), "==", 6, "no change between the busy marks");
+    cmp_ok(result_threads_target(6, 2, 16, 0, GM_RESULT_SCALE_BUSY_HIGH), "==", 6, "no growth at the high mark");
+    cmp_ok(result_threads_target(6, 2, 16, 0, GM_RESULT_SCALE_BUSY_LOW), "==", 6, "no shrinking at the low mark");
+    cmp_ok(result_threads_target(6, 2, 16, 6 * GM_RESULT_SCALE_BACKLOG, 0.5), "==", 6, "no growth at the backlog limit");
+    cmp_ok(result_threads_target(6, 2, 16, 1, 0.1), "==", 6, "no shrinking while results are waiting");
+
+    /* busy ratio */
+    ok(result_threads_busy_ratio(2500000, 1, 5) == 0.5, "busy ratio of one thread");
+    ok(result_threads_busy_ratio(2500000, 0, 5) == 0, "busy ratio without running threads");
+    ok(result_threads_busy_ratio(50000000, 2, 5) == 1, "busy ratio is capped at 1");
+
+    return exit_status();
+}
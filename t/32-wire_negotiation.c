@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <t/tap.h>
+#include <t/test_naemon_stubs.h>
+#include <common.h>
+#include <utils.h>
+#include <gm_payload.h>
+#include <wire_negotiation.h>
+
+#include <worker_dummy_functions.c>
+
+#include <libgearman/gearman.h>
+
+mod_gm_opt_t *mod_gm_opt;
+char hostname[GM_SMALLBUFSIZE];
+gearman_client_st *current_client;
+gearman_client_st *current_client_dup;
+
+/* main tests */
+int main(void) {
+    char option[GM_SMALLBUFSIZE];
+
+    plan(10);
+
+    mod_gm_opt = gm_malloc(sizeof(mod_gm_opt_t));
+    set_default_options(mod_gm_opt);
+
+    /* capability decision */
+    ok(wire_format_capable(0, 0) == FALSE, "no workers");
+    ok(wire_format_capable(5, 3) == FALSE, "some workers are too old");
+    ok(wire_format_capable(5, 5) == TRUE, "all workers accept binary jobs");
+
+    /* text is always sent unless binary is enabled */
+    wire_format_update("service", 5, 5);
+    cmp_ok(wire_format_for_queue("service"), "==", GM_PAYLOAD_FORMAT_TEXT, "text unless enabled");
+
+    strcpy(option, "wire_format=binary");
+    parse_args_line(mod_gm_opt, option, 0);
+    cmp_ok(mod_gm_opt->wire_format, "==", GM_PAYLOAD_FORMAT_BINARY, "wire_format parsed");
+
+    /* unknown queues get text and are tracked from now on */
+    cmp_ok(wire_format_for_queue("service"), "==", GM_PAYLOAD_FORMAT_TEXT, "unknown queue gets text");
+    wire_format_update("service", 5, 5);
+    cmp_ok(wire_format_for_queue("service"), "==", GM_PAYLOAD_FORMAT_BINARY, "upgraded queue gets binary");
+    cmp_ok(wire_format_for_queue("hostgroup_dmz"), "==", GM_PAYLOAD_FORMAT_TEXT, "other queues are not affected");
+
+    /* an old worker joins */
+    wire_format_update("service", 6, 5);
+    cmp_ok(wire_format_for_queue("service"), "==", GM_PAYLOAD_FORMAT_TEXT, "back to text with an old worker");
+
+    /* all workers left */
+    wire_format_update("service", 0, 0);
+    cmp_ok(wire_format_for_queue("service"), "==", GM_PAYLOAD_FORMAT_TEXT, "text without workers");
+
+    stop_wire_negotiation();
+    mod_gm_free_opt(mod_gm_opt);
+    return exit_status();
+}
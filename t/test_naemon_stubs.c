@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <t/test_naemon_stubs.h>
+
+struct object_count num_objects;
+host **host_ary;
+service **service_ary;
+
+/* core log wrapper */
+void write_core_log(char *data) {
+    printf("core logger is not available for tests: %s", data);
+    return;
+}
+
+/* create hosts and services like the core does */
+void test_create_objects(int num_hosts, int services_per_host, const char * host_format, const char * service_format) {
+    char name[GM_SMALLBUFSIZE];
+    service * svc;
+    int x, y;
+
+    num_objects.hosts    = num_hosts;
+    num_objects.services = num_hosts * services_per_host;
+    host_ary    = gm_malloc((num_hosts > 0 ? num_hosts : 1) * sizeof(host *));
+    service_ary = gm_malloc((num_objects.services > 0 ? num_objects.services : 1) * sizeof(service *));
+    for(x = 0; x < num_hosts; x++) {
+        host_ary[x] = gm_malloc(sizeof(host));
+        memset(host_ary[x], 0, sizeof(host));
+        host_ary[x]->id = x;
+        snprintf(name, sizeof(name), host_format, x);
+        host_ary[x]->name = gm_strdup(name);
+        for(y = 0; y < services_per_host; y++) {
+            svc = gm_malloc(sizeof(service));
+            memset(svc, 0, sizeof(service));
+            svc->id        = x * services_per_host + y;
+            svc->host_ptr  = host_ary[x];
+            svc->host_name = host_ary[x]->name;
+            snprintf(name, sizeof(name), service_format, y);
+            svc->description = gm_strdup(name);
+            service_ary[svc->id] = svc;
+        }
+    }
+}
+
+/* free the fake objects */
+void test_free_objects(void) {
+    unsigned int x;
+    for(x = 0; x < num_objects.services; x++) {
+        gm_free(service_ary[x]->description);
+        gm_free(service_ary[x]);
+    }
+    for(x = 0; x < num_objects.hosts; x++) {
+        gm_free(host_ary[x]->name);
+        gm_free(host_ary[x]);
+    }
+    gm_free(host_ary);
+    gm_free(service_ary);
+    num_objects.hosts    = 0;
+    num_objects.services = 0;
+}
@@ -0,0 +1,41 @@
+/** @file
+ *  @brief core stubs and fake core objects shared by the NEB module tests
+ *
+ *  @{
+ */
+
+#include "mod_gearman.h"
+
+/** fake core objects, filled by test_create_objects() */
+extern struct object_count num_objects;
+extern host **host_ary;
+extern service **service_ary;
+
+/**
+ * test_create_objects
+ *
+ * create fake hosts and services like the core does. Host x is named by
+ * host_format and x, its services get the ids x * services_per_host + y and
+ * are named by service_format and y.
+ *
+ * @param[in] num_hosts         - number of hosts
+ * @param[in] services_per_host - number of services of each host
+ * @param[in] host_format       - printf format of the host names
+ * @param[in] service_format    - printf format of the service descriptions
+ *
+ * @return nothing
+ */
+void test_create_objects(int num_hosts, int services_per_host, const char * host_format, const char * service_format);
+
+/**
+ * test_free_objects
+ *
+ * free the fake hosts and services
+ *
+ * @return nothing
+ */
+void test_free_objects(void);
+
+/**
+ * @}
+ */
@@ -24,7 +24,6 @@
 /* include header */
 #include "send_gearman.h"
 #include "utils.h"
-#include "gearman_utils.h"
 #include "openssl/evp.h"
 
 #include <worker_dummy_functions.c>
@@ -185,6 +184,7 @@ void print_usage(void) {
     printf("\n");
     printf("             [ --timeout|-t=<timeout>       ]\n");
     printf("             [ --delimiter|-d=<delimiter>   ]\n");
+    printf("             [ --submit_batch_size=<num>    ]\n");
     printf("\n");
     printf("             [ --encryption=<yes|no>        ]\n");
     printf("             [ --key=<string>               ]\n");
@@ -225,6 +225,8 @@ void print_usage(void) {
 int send_result(EVP_CIPHER_CTX * ctx) {
     char *ptr1, *ptr2, *ptr3, *ptr4;
     char buffer[GM_BUFFERSIZE];
+    gm_submit_job_t ** jobs;
+    int num = 0;
 
     gm_log( GM_LOG_TRACE, "send_result()\n" );
 
@@ -235,6 +237,7 @@ int send_result(EVP_CIPHER_CTX * ctx) {
 
     /* multiple results */
     if(mod_gm_opt->host == NULL) {
+        jobs = gm_malloc(mod_gm_opt->submit_batch_size * sizeof *jobs);
         while(fgets(buffer,sizeof(buffer)-1,stdin)) {
             if(feof(stdin))
                 break;
@@ -279,13 +282,30 @@ int send_result(EVP_CIPHER_CTX * ctx) {
                 mod_gm_opt->return_code = atoi(ptr3);
                 mod_gm_opt->message     = gm_strdup(ptr4);
             }
-            if(submit_result(ctx) == STATE_OK) {
-                results_sent++;
-            } else {
-                printf("failed to send result!\n");
-                return(STATE_UNKNOWN);
+
+            /* collect results and send them in batches */
+            jobs[num]           = gm_malloc(sizeof(gm_submit_job_t));
+            jobs[num]->queue    = mod_gm_opt->result_queue;
+            jobs[num]->uniq     = NULL;
+            jobs[num]->data     = create_result();
+            jobs[num]->priority = GM_JOB_PRIO_NORMAL;
+            jobs[num]->retries  = GM_DEFAULT_JOB_RETRIES;
+            num++;
+            if(num == mod_gm_opt->submit_batch_size) {
+                if(submit_results(ctx, jobs, num) != STATE_OK) {
+                    printf("failed to send result!\n");
+                    gm_free(jobs);
+                    return(STATE_UNKNOWN);
+                }
+                num = 0;
             }
         }
+        if(num > 0 && submit_results(ctx, jobs, num) != STATE_OK) {
+            printf("failed to send result!\n");
+            gm_free(jobs);
+            return(STATE_UNKNOWN);
+        }
+        gm_free(jobs);
         printf("%d data packet(s) sent to host successfully.\n",results_sent);
         return(STATE_OK);
     }
@@ -301,8 +321,8 @@ int send_result(EVP_CIPHER_CTX * ctx) {
     return(submit_result(ctx));
 }
 
-/* submit result */
-int submit_result(EVP_CIPHER_CTX * ctx) {
+/* create result data from the current options */
+char * create_result(void) {
     char * buf;
     char * temp_buffer;
     char * result;
@@ -364,8 +384,58 @@ int submit_result(EVP_CIPHER_CTX * ctx) {
         strcat(result, temp_buffer);
     }
     strcat(result, "\n");
+    free(temp_buffer);
 
     gm_log( GM_LOG_TRACE, "data:\n%s\n", result);
+    return(result);
+}
+
+/* submit a batch of results, takes care of freeing the jobs */
+int submit_results(EVP_CIPHER_CTX * ctx, gm_submit_job_t ** jobs, int num) {
+    int x;
+    int sent = 0;
+    int rc;
+
+    rc = add_jobs_to_queue(&client, mod_gm_opt->server_list, jobs, num, mod_gm_opt->transportmode, ctx, 0, 1);
+
+    /* only successfully sent results go to the duplicate server */
+    for(x = 0; x < num; x++) {
+        if(jobs[x]->status == GM_OK)
+            jobs[sent++] = jobs[x];
+        else {
+            free(jobs[x]->data);
+            free(jobs[x]);
+        }
+    }
+    results_sent += sent;
+
+    if( sent > 0 && mod_gm_opt->dupserver_num ) {
+        for(x = 0; x < sent; x++)
+            jobs[x]->retries = GM_DEFAULT_JOB_RETRIES;
+        if(add_jobs_to_queue(&client_dup, mod_gm_opt->dupserver_list, jobs, sent, mod_gm_opt->transportmode, ctx, 0, 1) == GM_OK) {
+            gm_log( GM_LOG_TRACE, "submit_results() finished successfully for duplicate server.\n" );
+        }
+        else {
+            gm_log( GM_LOG_TRACE, "submit_results() finished unsuccessfully for duplicate server\n" );
+        }
+    }
+
+    for(x = 0; x < sent; x++) {
+        free(jobs[x]->data);
+        free(jobs[x]);
+    }
+
+    if(rc != GM_OK) {
+        gm_log( GM_LOG_TRACE, "submit_results() finished unsuccessfully\n" );
+        return( STATE_UNKNOWN );
+    }
+    gm_log( GM_LOG_TRACE, "submit_results() finished successfully\n" );
+    return( STATE_OK );
+}
+
+/* submit result */
+int submit_result(EVP_CIPHER_CTX * ctx) {
+    char * result = create_result();
 
     if(add_job_to_queue( &client,
                          mod_gm_opt->server_list,
@@ -404,11 +474,9 @@ int submit_result(EVP_CIPHER_CTX * ctx) {
     else {
         gm_log( GM_LOG_TRACE, "send_result_back() finished unsuccessfully\n" );
         free(result);
-        free(temp_buffer);
         return( STATE_UNKNOWN );
     }
     free(result);
-    free(temp_buffer);
     return( STATE_OK );
 }
 
@@ -28,6 +28,7 @@
 #include "utils.h"
 #include "check_utils.h"
 #include "gearman_utils.h"
+#include "gm_payload.h"
 #ifdef EMBEDDEDPERL
 #include "epn_utils.h"
 #endif
@@ -170,7 +171,11 @@ void *get_job( gearman_job_st *job, __attribute__((__unused__)) void *context, s
     const char * workload;
     char * decrypted_data = NULL;
     char * decrypted_data_c;
-    char *ptr;
+    gm_payload_t payload;
+    char *value;
+    long long num;
+    struct timeval tv;
+    int plain_size;
     int is_notification_job = FALSE;
     int is_eventhandler_job = FALSE;
     int is_service_notification = FALSE;
@@ -210,14 +215,14 @@ void *get_job( gearman_job_st *job, __attribute__((__unused__)) void *context, s
     gm_log( GM_LOG_TRACE, "%zu +++>\n%.*s\n<+++\n", wsize, (int)wsize, workload);
 
     /* decrypt data */
-    mod_gm_decrypt(worker_ctx, &decrypted_data, workload, wsize, mod_gm_opt->transportmode);
+    plain_size = mod_gm_decrypt(worker_ctx, &decrypted_data, workload, wsize, mod_gm_opt->transportmode);
     decrypted_data_c = decrypted_data;
 
     if(decrypted_data == NULL) {
         *ret_ptr = GEARMAN_WORK_FAIL;
         return NULL;
     }
-    gm_log( GM_LOG_TRACE, "%zu --->\n%s\n<---\n", strlen(decrypted_data), decrypted_data );
+    gm_log( GM_LOG_TRACE, "%zu --->\n%s\n<---\n", gm_payload_size(decrypted_data), decrypted_data );
 
     /* set result pointer to success */
     *ret_ptr= GEARMAN_SUCCESS;
@@ -225,63 +230,38 @@ void *get_job( gearman_job_st *job, __attribute__((__unused__)) void *context, s
     exec_job = ( gm_job_t * )gm_malloc( sizeof *exec_job );
     set_default_job(exec_job, mod_gm_opt);
 
-    valid_lines = 0;
-    while ( (ptr = strsep(&decrypted_data, "\n" )) != NULL ) {
-        char *key   = strsep( &ptr, "=" );
-        char *value = strsep( &ptr, "\x0" );
-
-        if ( key == NULL )
-            continue;
-
-        if ( value == NULL || !strcmp( value, "") )
-            break;
-
-        if ( !strcmp( key, "host_name" ) ) {
-            exec_job->host_name = gm_strdup(value);
-            valid_lines++;
-        } else if ( !strcmp( key, "service_description" ) ) {
-            exec_job->service_description = gm_strdup(value);
-            valid_lines++;
-        } else if ( !strcmp( key, "type" ) ) {
-            exec_job->type = gm_strdup(value);
-            valid_lines++;
-        } else if ( !strcmp( key, "result_queue" ) ) {
-            exec_job->result_queue = gm_strdup(value);
-            valid_lines++;
-        } else if ( !strcmp( key, "check_options" ) ) {
-            exec_job->check_options = atoi(value);
-            valid_lines++;
-        } else if ( !strcmp( key, "scheduled_check" ) ) {
-            exec_job->scheduled_check = atoi(value);
-            valid_lines++;
-        } else if ( !strcmp( key, "latency" ) ) {
-            exec_job->latency = atof(value);
-            valid_lines++;
-        } else if ( !strcmp( key, "next_check" ) ) {
-            string2timeval(value, &exec_job->next_check);
-            valid_lines++;
-        } else if ( !strcmp( key, "start_time" ) ) {
-            /* for compatibility reasons... (used by older mod-gearman neb modules) */
-            string2timeval(value, &exec_job->next_check);
-            string2timeval(value, &exec_job->core_time);
-            valid_lines++;
-        } else if ( !strcmp( key, "core_time" ) ) {
-            string2timeval(value, &exec_job->core_time);
-            valid_lines++;
-        } else if ( !strcmp( key, "timeout" ) ) {
-            exec_job->timeout = atoi(value);
-            valid_lines++;
-        } else if ( !strcmp( key, "command_line" ) ) {
-            exec_job->command_line = gm_strdup(value);
-            valid_lines++;
-        } else if ( !strcmp( key, "plugin_output" ) ) {
-            exec_job->output = gm_strdup(value);
-            valid_lines++;
-        } else if ( !strcmp( key, "long_plugin_output" ) ) {
-            exec_job->long_output = gm_strdup(value);
-            valid_lines++;
-        }
-    }
+    valid_lines = gm_payload_decode(&payload, decrypted_data, plain_size > 0 ? plain_size : 0);
+    exec_job->wire_format = payload.format;
+
+    if ( (value = gm_payload_value(&payload, GM_PAYLOAD_HOST_NAME)) != NULL )
+        exec_job->host_name = gm_strdup(value);
+    if ( (value = gm_payload_value(&payload, GM_PAYLOAD_SERVICE_DESCRIPTION)) != NULL )
+        exec_job->service_description = gm_strdup(value);
+    if ( (value = gm_payload_value(&payload, GM_PAYLOAD_TYPE)) != NULL )
+        exec_job->type = gm_strdup(value);
+    if ( (value = gm_payload_value(&payload, GM_PAYLOAD_RESULT_QUEUE)) != NULL )
+        exec_job->result_queue = gm_strdup(value);
+    if ( gm_payload_int(&payload, GM_PAYLOAD_CHECK_OPTIONS, &num) )
+        exec_job->check_options = num;
+    if ( gm_payload_int(&payload, GM_PAYLOAD_SCHEDULED_CHECK, &num) )
+        exec_job->scheduled_check = num;
+    if ( gm_payload_time(&payload, GM_PAYLOAD_LATENCY, &tv) )
+        exec_job->latency = timeval2double(&tv);
+    if ( gm_payload_time(&payload, GM_PAYLOAD_START_TIME, &tv) ) {
+        /* for compatibility reasons... (used by older mod-gearman neb modules) */
+        exec_job->next_check = tv;
+        exec_job->core_time  = tv;
+    }
+    gm_payload_time(&payload, GM_PAYLOAD_NEXT_CHECK, &exec_job->next_check);
+    gm_payload_time(&payload, GM_PAYLOAD_CORE_TIME, &exec_job->core_time);
+    if ( gm_payload_int(&payload, GM_PAYLOAD_TIMEOUT, &num) )
+        exec_job->timeout = num;
+    if ( (value = gm_payload_value(&payload, GM_PAYLOAD_COMMAND_LINE)) != NULL )
+        exec_job->command_line = gm_strdup(value);
+    if ( (value = gm_payload_value(&payload, GM_PAYLOAD_PLUGIN_OUTPUT)) != NULL )
+        exec_job->output = gm_strdup(value);
+    if ( (value = gm_payload_value(&payload, GM_PAYLOAD_LONG_PLUGIN_OUTPUT)) != NULL )
+        exec_job->long_output = gm_strdup(value);
 
     if(exec_job->type != NULL && !strcmp( exec_job->type, "notification")) {
         is_notification_job = TRUE;
@@ -457,21 +437,21 @@ int set_worker(gearman_worker_st **w) {
     else {
         /* normal worker */
         if(mod_gm_opt->hosts == GM_ENABLED)
-            worker_add_function(*w, "host", get_job);
+            add_job_function(*w, "host");
 
         if(mod_gm_opt->services == GM_ENABLED)
-            worker_add_function(*w, "service", get_job);
+            add_job_function(*w, "service");
 
         if(mod_gm_opt->events == GM_ENABLED)
-            worker_add_function(*w, "eventhandler", get_job);
+            add_job_function(*w, "eventhandler");
 
         if(mod_gm_opt->notifications == GM_ENABLED)
-            worker_add_function(*w, "notification", get_job);
+            add_job_function(*w, "notification");
 
         while ( mod_gm_opt->hostgroups_list[x] != NULL ) {
             char buffer[GM_BUFFERSIZE];
             snprintf( buffer, (sizeof(buffer)-1), "hostgroup_%s", mod_gm_opt->hostgroups_list[x] );
-            worker_add_function(*w, buffer, get_job);
+            add_job_function(*w, buffer);
             x++;
         }
 
@@ -479,7 +459,7 @@ int set_worker(gearman_worker_st **w) {
         while ( mod_gm_opt->servicegroups_list[x] != NULL ) {
             char buffer[GM_BUFFERSIZE];
             snprintf( buffer, (sizeof(buffer)-1), "servicegroup_%s", mod_gm_opt->servicegroups_list[x] );
-            worker_add_function(*w, buffer, get_job);
+            add_job_function(*w, buffer);
             x++;
         }
     }
@@ -487,6 +467,17 @@ int set_worker(gearman_worker_st **w) {
     return GM_OK;
 }
 
+/* register a job queue and advertise that binary jobs are accepted there */
+void add_job_function(gearman_worker_st *w, char * queue) {
+    char binary_queue[GM_BUFFERSIZE];
+
+    worker_add_function(w, queue, get_job);
+
+    /* the neb module only sends binary jobs to a queue if all its workers registered this */
+    snprintf( binary_queue, sizeof(binary_queue), "%s%s", queue, GM_PAYLOAD_BINARY_SUFFIX );
+    worker_add_function(w, binary_queue, accept_binary);
+}
+
 /* called when worker runs into exit timeout */
 void exit_sighandler(int sig) {
     gm_log( GM_LOG_TRACE, "exit_sighandler(%i)\n", sig );
@@ -665,6 +656,15 @@ void *return_status( gearman_job_st *job, __attribute__((__unused__)) void *cont
 }
 
 
+/* jobs for the binary marker functions carry no work */
+void *accept_binary( __attribute__((__unused__)) gearman_job_st *job, __attribute__((__unused__)) void *context, size_t *result_size, gearman_return_t *ret_ptr ) {
+    gm_log( GM_LOG_TRACE, "accept_binary()\n" );
+    *result_size = 0;
+    *ret_ptr     = GEARMAN_SUCCESS;
+    return NULL;
+}
+
+
 #ifdef GM_DEBUG
 /* write text to a debug file */
 void write_debug_file(char ** text) {